@@ -0,0 +1,386 @@
+#include "crawler_core.h"
+#include "archive.h"
+#include "memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define ARCHIVE_MIN_COMPRESS 512    // Smaller identity bodies are stored as-is
+
+// One archive segment file. A retired segment is closed when its last writer finishes.
+typedef struct {
+    int fd;
+    int number;
+    off_t size;
+    int writers;
+    bool retired;
+} ArchiveSegment;
+
+// Sidecar index entry pointing from a URL hash to a record.
+typedef struct {
+    uint64_t url_hash;
+    uint64_t offset;
+    uint32_t segment;
+    uint32_t length;
+} ArchiveIndexEntry;
+
+// Optional sink that stores every fetched response in rotating segment files.
+struct Archive {
+    char dir[512];
+    off_t segment_limit;
+    ArchiveSegment *current;
+    FILE *index_file;
+    pthread_mutex_t lock;
+    IoBackend *io;
+};
+
+// A record in flight: owns its header bytes and the body blocks until the write completes.
+typedef struct {
+    IoRequest req;
+    Archive *archive;
+    ArchiveSegment *segment;
+    char *header;
+    char *blocks[BODY_MAX_BLOCKS];
+    int block_count;
+    struct iovec iov[BODY_MAX_BLOCKS + 3];
+} ArchiveRecord;
+
+// Sink wrapper that archives every page.
+typedef struct {
+    Sink base;
+    Archive *archive;
+} ArchiveSink;
+
+// Move the filled blocks out of a chain into `blocks`; the chain keeps its spare blocks.
+static int body_detach(BodyChain *chain, char **blocks) {
+    int count = chain->count;
+    memcpy(blocks, chain->blocks, count * sizeof(char *));
+    memmove(chain->blocks, chain->blocks + count, (chain->allocated - count) * sizeof(char *));
+    chain->allocated -= count;
+    body_reset(chain);
+    // The blocks now wait on the write rather than on the next fetch.
+    mem_account(MEM_BUFFERS, -(long)count * BODY_BLOCK_SIZE);
+    mem_account(MEM_OUTPUT, (long)count * BODY_BLOCK_SIZE);
+    return count;
+}
+
+// Gzip an uncompressed body into another chain. Returns false if it doesn't fit.
+static bool body_compress(const BodyChain *in, BodyChain *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 16 selects a gzip wrapper so each record body is a standalone gzip member.
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    body_reset(out);
+    char buffer[DECODE_CHUNK];
+    int ret = Z_OK;
+    for (int i = 0; i <= in->count && ret != Z_STREAM_END; i++) {
+        int flush = i == in->count ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = i < in->count ? (Bytef *)in->blocks[i] : NULL;
+        zs.avail_in = i < in->count ? in->used[i] : 0;
+        do {
+            zs.next_out = (Bytef *)buffer;
+            zs.avail_out = sizeof(buffer);
+            ret = deflate(&zs, flush);
+            body_append(out, buffer, sizeof(buffer) - zs.avail_out);
+        } while (zs.avail_out == 0);
+    }
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END && !out->truncated;
+}
+
+// Open segment number `number` in the archive directory.
+static ArchiveSegment *segment_open(Archive *archive, int number) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/segment-%05d.warc", archive->dir, number);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error: Unable to open archive segment");
+        return NULL;
+    }
+    ArchiveSegment *segment = (ArchiveSegment *)calloc(1, sizeof(ArchiveSegment));
+    if (!segment) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    segment->fd = fd;
+    segment->number = number;
+    return segment;
+}
+
+// Create the archive directory and its first segment.
+Archive *archive_open(const char *dir, long segment_mb, IoBackend *io) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("Error: Unable to create archive directory");
+        return NULL;
+    }
+    Archive *archive = (Archive *)calloc(1, sizeof(Archive));
+    if (!archive) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(archive->dir, sizeof(archive->dir), "%s", dir);
+    archive->segment_limit = (off_t)segment_mb << 20;
+    archive->io = io;
+    pthread_mutex_init(&archive->lock, NULL);
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/archive.idx.tmp", dir);
+    archive->index_file = fopen(path, "wb");
+    archive->current = archive->index_file ? segment_open(archive, 0) : NULL;
+    if (!archive->current) {
+        fprintf(stderr, "Error: Unable to open archive in %s\n", dir);
+        if (archive->index_file) {
+            fclose(archive->index_file);
+        }
+        free(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+// Called once a record is on disk: frees its buffers and releases the segment.
+static void archive_record_done(IoRequest *req, bool ok) {
+    (void)ok;
+    ArchiveRecord *record = (ArchiveRecord *)req;
+    Archive *archive = record->archive;
+    ArchiveSegment *segment = record->segment;
+
+    for (int i = 0; i < record->block_count; i++) {
+        free(record->blocks[i]);
+    }
+    mem_account(MEM_OUTPUT, -(long)record->block_count * BODY_BLOCK_SIZE);
+    free(record->header);
+    free(record);
+
+    pthread_mutex_lock(&archive->lock);
+    segment->writers--;
+    if (segment->retired && segment->writers == 0) {
+        close(segment->fd);
+        free(segment);
+    }
+    pthread_mutex_unlock(&archive->lock);
+}
+
+// Append one response record. The body blocks are handed to the I/O backend as they are, without
+// being copied into a record buffer. Bodies that arrived uncompressed are gzipped first.
+static void archive_write(Archive *archive, const char *url, long status, const char *headers, size_t headers_len,
+                   BodyChain *body, ContentEncoding wire_encoding, BodyChain *scratch) {
+    BodyChain *payload = body;
+    const char *body_encoding = "";
+    if (wire_encoding == ENCODING_IDENTITY && body->total >= ARCHIVE_MIN_COMPRESS &&
+        body_compress(body, scratch) && scratch->total < body->total) {
+        payload = scratch;
+        body_encoding = "WARC-Body-Encoding: gzip\r\n";
+    }
+
+    char date[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+
+    ArchiveRecord *record = (ArchiveRecord *)calloc(1, sizeof(ArchiveRecord));
+    char *header = (char *)malloc(MAX_URL_LENGTH + 512 + headers_len);
+    if (!record || !header) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    // The record header and the response headers share one small buffer; the worker reuses its own.
+    int header_len = snprintf(header, MAX_URL_LENGTH + 512,
+                              "WARC/1.1\r\n"
+                              "WARC-Type: response\r\n"
+                              "WARC-Target-URI: %s\r\n"
+                              "WARC-Date: %s\r\n"
+                              "WARC-Crawl-Status: %ld\r\n"
+                              "%s%s"
+                              "Content-Length: %zu\r\n"
+                              "\r\n",
+                              url, date, status, body_encoding,
+                              body->truncated ? "WARC-Truncated: length\r\n" : "",
+                              headers_len + payload->total);
+    if (header_len >= MAX_URL_LENGTH + 512) {
+        header_len = MAX_URL_LENGTH + 511;
+    }
+    memcpy(header + header_len, headers, headers_len);
+    record->header = header;
+
+    int iovcnt = 0;
+    record->iov[iovcnt++] = (struct iovec){header, header_len + headers_len};
+    for (int i = 0; i < payload->count; i++) {
+        record->iov[iovcnt++] = (struct iovec){payload->blocks[i], payload->used[i]};
+    }
+    record->iov[iovcnt++] = (struct iovec){(void *)"\r\n\r\n", 4};
+    size_t record_len = header_len + headers_len + payload->total + 4;
+    record->block_count = body_detach(payload, record->blocks);
+    body_reset(body);
+
+    // Reserve space under the lock; the write itself is left to the I/O backend.
+    pthread_mutex_lock(&archive->lock);
+    ArchiveSegment *segment = archive->current;
+    if (segment->size > 0 && segment->size + (off_t)record_len > archive->segment_limit) {
+        ArchiveSegment *next = segment_open(archive, segment->number + 1);
+        if (next) {
+            segment->retired = true;
+            if (segment->writers == 0) {
+                close(segment->fd);
+                free(segment);
+            }
+            archive->current = segment = next;
+        }
+    }
+    off_t offset = segment->size;
+    segment->size += record_len;
+    segment->writers++;
+    ArchiveIndexEntry entry = {url_hash(url), (uint64_t)offset, (uint32_t)segment->number, (uint32_t)record_len};
+    fwrite(&entry, sizeof(entry), 1, archive->index_file);
+    pthread_mutex_unlock(&archive->lock);
+
+    record->archive = archive;
+    record->segment = segment;
+    record->req.fd = segment->fd;
+    record->req.offset = offset;
+    record->req.iov = record->iov;
+    record->req.iovcnt = iovcnt;
+    record->req.done = archive_record_done;
+    archive->io->submit(archive->io, &record->req);
+}
+
+// Order index entries by hash, then by position so the newest record for a URL comes last.
+static int compare_index_entries(const void *a, const void *b) {
+    const ArchiveIndexEntry *x = (const ArchiveIndexEntry *)a;
+    const ArchiveIndexEntry *y = (const ArchiveIndexEntry *)b;
+    if (x->url_hash != y->url_hash) {
+        return x->url_hash < y->url_hash ? -1 : 1;
+    }
+    if (x->segment != y->segment) {
+        return x->segment < y->segment ? -1 : 1;
+    }
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+// Close the archive and write the sorted index next to the segments.
+void archive_close(Archive *archive) {
+    close(archive->current->fd);
+    free(archive->current);
+    fclose(archive->index_file);
+
+    char tmp_path[600], path[600];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/archive.idx.tmp", archive->dir);
+    snprintf(path, sizeof(path), "%s/archive.idx", archive->dir);
+
+    FILE *in = fopen(tmp_path, "rb");
+    if (in) {
+        fseek(in, 0, SEEK_END);
+        size_t count = ftell(in) / sizeof(ArchiveIndexEntry);
+        rewind(in);
+        ArchiveIndexEntry *entries = (ArchiveIndexEntry *)malloc((count ? count : 1) * sizeof(ArchiveIndexEntry));
+        if (entries && fread(entries, sizeof(ArchiveIndexEntry), count, in) == count) {
+            qsort(entries, count, sizeof(ArchiveIndexEntry), compare_index_entries);
+            FILE *out = fopen(path, "wb");
+            if (out) {
+                fwrite(entries, sizeof(ArchiveIndexEntry), count, out);
+                fclose(out);
+                unlink(tmp_path);
+            }
+        }
+        free(entries);
+        fclose(in);
+    }
+    pthread_mutex_destroy(&archive->lock);
+    free(archive);
+}
+
+// Print the newest archived record for a URL to stdout. Returns false if it isn't archived.
+bool archive_get(const char *dir, const char *url) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/archive.idx", dir);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error: Unable to open archive index");
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t count = st.st_size / sizeof(ArchiveIndexEntry);
+    if (count == 0) {
+        close(fd);
+        return false;
+    }
+    ArchiveIndexEntry *entries = (ArchiveIndexEntry *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (entries == MAP_FAILED) {
+        perror("Error: Unable to map archive index");
+        return false;
+    }
+
+    // Binary search for the first entry with this hash.
+    uint64_t hash = url_hash(url);
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].url_hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Walk the equal-hash run backwards so the newest record wins; the URI line guards against collisions.
+    char expected[MAX_URL_LENGTH + 32];
+    int expected_len = snprintf(expected, sizeof(expected), "WARC-Target-URI: %s\r\n", url);
+    bool found = false;
+    size_t end = lo;
+    while (end < count && entries[end].url_hash == hash) {
+        end++;
+    }
+    for (size_t i = end; i > lo && !found; i--) {
+        ArchiveIndexEntry *entry = &entries[i - 1];
+        snprintf(path, sizeof(path), "%s/segment-%05u.warc", dir, entry->segment);
+        int segment_fd = open(path, O_RDONLY);
+        if (segment_fd < 0) {
+            continue;
+        }
+        char *record = (char *)malloc(entry->length);
+        if (record && pread(segment_fd, record, entry->length, entry->offset) == (ssize_t)entry->length &&
+            memmem(record, entry->length < 2048 + MAX_URL_LENGTH ? entry->length : 2048 + MAX_URL_LENGTH,
+                   expected, expected_len) != NULL) {
+            fwrite(record, 1, entry->length, stdout);
+            found = true;
+        }
+        free(record);
+        close(segment_fd);
+    }
+    munmap(entries, st.st_size);
+    return found;
+}
+
+// Archive one fetched page.
+static void archive_sink_page(Sink *sink, const FetchResult *result) {
+    Archive *archive = ((ArchiveSink *)sink)->archive;
+    archive_write(archive, result->url, result->status, result->headers, result->headers_len, result->body,
+                  result->encoding, result->scratch);
+}
+
+// The archive outlives its sink: archive_close() runs once the I/O backend has drained.
+static void archive_sink_close(Sink *sink) {
+    free(sink);
+}
+
+// Wrap an open archive as a crawl sink.
+Sink *archive_sink_create(Archive *archive) {
+    ArchiveSink *sink = (ArchiveSink *)calloc(1, sizeof(ArchiveSink));
+    if (!sink) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    sink->base.name = "archive";
+    sink->base.capture = true;
+    sink->base.page = archive_sink_page;
+    sink->base.close = archive_sink_close;
+    sink->archive = archive;
+    return &sink->base;
+}
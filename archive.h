@@ -0,0 +1,17 @@
+// Optional sink that stores every fetched response in rotating, indexed segment files.
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "crawler_core.h"
+#include "io_backend.h"
+
+#define ARCHIVE_SEGMENT_MB 1024     // Default segment size before rotating
+
+typedef struct Archive Archive;
+
+Archive *archive_open(const char *dir, long segment_mb, IoBackend *io);
+void archive_close(Archive *archive);
+bool archive_get(const char *dir, const char *url);
+Sink *archive_sink_create(Archive *archive);
+
+#endif
@@ -0,0 +1,401 @@
+#include "crawler_core.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "control.h"
+#include "host_control.h"
+#include "index.h"
+#include "url_table.h"
+#include "memory.h"
+
+// Reply text being built for one command.
+typedef struct {
+    char *text;
+    size_t len, cap;
+} ControlReply;
+
+// Append formatted text to a reply.
+static void reply_printf(ControlReply *reply, const char *format, ...) {
+    while (true) {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(reply->text + reply->len, reply->cap - reply->len, format, args);
+        va_end(args);
+        if (n < 0) {
+            return;
+        }
+        if (reply->len + (size_t)n < reply->cap) {
+            reply->len += n;
+            return;
+        }
+        size_t cap = reply->cap ? reply->cap * 2 : 4096;
+        while (cap <= reply->len + (size_t)n) {
+            cap *= 2;
+        }
+        reply->text = (char *)realloc(reply->text, cap);
+        if (!reply->text) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        reply->cap = cap;
+    }
+}
+
+// Append a histogram as "label <limit:count ..." with empty buckets left out.
+static void reply_histogram(ControlReply *reply, const char *label, atomic_ulong *buckets) {
+    reply_printf(reply, "%s", label);
+    for (int b = 0; b < STATS_BUCKETS; b++) {
+        unsigned long count = atomic_load(&buckets[b]);
+        if (!count) {
+            continue;
+        }
+        if (b == STATS_BUCKETS - 1) {
+            reply_printf(reply, " >=%lu:%lu", 1UL << (b - 1), count);
+        } else {
+            reply_printf(reply, " <%lu:%lu", 1UL << b, count);
+        }
+    }
+    reply_printf(reply, "\n");
+}
+
+// "stats": crawl-wide counters. Pages per second is given since the previous "stats" and since
+// the server started.
+static void control_stats(ControlServer *server, ControlReply *reply) {
+    Crawler *crawler = server->crawler;
+    URLQueue *queue = &crawler->queue;
+    uint64_t now = now_ms();
+    unsigned long pages = atomic_load(&crawler->stats.pages);
+    double since_last = (now - server->last_ms) / 1000.0;
+    double since_start = (now - server->started_ms) / 1000.0;
+    reply_printf(reply, "pages %lu\n", pages);
+    reply_printf(reply, "pages_per_sec %.1f\n", since_last > 0 ? (pages - server->last_pages) / since_last : 0.0);
+    reply_printf(reply, "pages_per_sec_avg %.1f\n", since_start > 0 ? pages / since_start : 0.0);
+    reply_printf(reply, "links %lu\n", atomic_load(&crawler->stats.links));
+    reply_printf(reply, "frontier %zu\n", atomic_load(&queue->size));
+    reply_printf(reply, "active %d\n", atomic_load(&queue->active));
+    reply_printf(reply, "in_flight %d\n", atomic_load(&crawler->stats.in_flight));
+    reply_printf(reply, "urls %lu\n", atomic_load(&queue->urls->urls));
+    reply_printf(reply, "wire_bytes %lu\n", atomic_load(&crawler->stats.wire_bytes));
+    reply_printf(reply, "workers %d of %d\n", atomic_load(&crawler->worker_limit), server->max_workers);
+    reply_printf(reply, "paused %d\n", atomic_load(&crawler->paused) ? 1 : 0);
+    reply_printf(reply, "checkpoints %u\n", atomic_load(&crawler->checkpoint));
+    if (crawler->hosts) {
+        reply_printf(reply, "hosts %lu\n", atomic_load(&crawler->hosts->hosts));
+    }
+    MemStats mem;
+    mem_stats(&mem);
+    if (mem.limit) {
+        long total = 0;
+        for (int kind = 0; kind < MEM_KINDS; kind++) {
+            total += mem.current[kind];
+        }
+        reply_printf(reply, "memory %ld of %zu, pressure %d\n", total, mem.limit, (int)mem_pressure());
+    }
+    reply_histogram(reply, "fetch_ms", crawler->stats.fetch_ms);
+    reply_histogram(reply, "body_kb", crawler->stats.body_kb);
+    server->last_ms = now;
+    server->last_pages = pages;
+}
+
+// "hosts [n]": the busiest hosts with their limits.
+static void control_hosts(ControlServer *server, ControlReply *reply, const char *arg) {
+    HostControl *hosts = server->crawler->hosts;
+    if (!hosts) {
+        reply_printf(reply, "error host control is off\n");
+        return;
+    }
+    long max = *arg ? atol(arg) : CONTROL_HOSTS;
+    if (max <= 0 || max > CONTROL_MAX_HOSTS) {
+        max = CONTROL_HOSTS;
+    }
+    HostReport *reports = (HostReport *)malloc(max * sizeof(HostReport));
+    if (!reports) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = host_report(hosts, reports, (size_t)max);
+    reply_printf(reply, "origin in_flight limit cap interval_ms latency_ms error_rate fetched deferred\n");
+    for (size_t i = 0; i < count; i++) {
+        HostReport *r = &reports[i];
+        reply_printf(reply, "%s %d %d %d %d %.1f %.2f %lu %lu\n", r->origin[0] ? r->origin : "-", r->inflight,
+                     r->allowed, r->cap, r->interval_ms, r->latency_ms, r->error_rate, r->fetched, r->deferred);
+    }
+    free(reports);
+}
+
+// "workers <n>": let only the first n workers take URLs. Threads are started once, so the limit
+// can go back up only as far as the number started.
+static void control_workers(ControlServer *server, ControlReply *reply, const char *arg) {
+    long n = atol(arg);
+    if (n < 1 || n > server->max_workers) {
+        reply_printf(reply, "error workers must be 1 to %d\n", server->max_workers);
+        return;
+    }
+    atomic_store(&server->crawler->worker_limit, (int)n);
+    reply_printf(reply, "ok workers %ld of %d\n", n, server->max_workers);
+}
+
+// "rate <url> <parallel> [interval-ms]": pin a host's limits; 0 hands them back to the adaptive control.
+static void control_rate(ControlServer *server, ControlReply *reply, char *arg) {
+    if (!server->crawler->hosts) {
+        reply_printf(reply, "error host control is off\n");
+        return;
+    }
+    char *save;
+    char *url = strtok_r(arg, " ", &save);
+    char *cap = strtok_r(NULL, " ", &save);
+    char *interval = strtok_r(NULL, " ", &save);
+    int max = server->crawler->hosts->max_limit;
+    if (!url || !cap || atol(cap) < 0 || atol(cap) > max || (interval && atol(interval) < 0)) {
+        reply_printf(reply, "error usage: rate <url> <0-%d> [interval-ms]\n", max);
+        return;
+    }
+    host_set_rate(server->crawler->hosts, url, (int)atol(cap), interval ? (int)atol(interval) : 0);
+    reply_printf(reply, "ok\n");
+}
+
+// "checkpoint <file>": write out every thread's buffered index postings, and save the URLs
+// waiting in the frontier to `file`, one per line, so a later crawl can take them as --seeds.
+// The reply comes once both are on disk.
+static void control_checkpoint(ControlServer *server, ControlReply *reply, const char *path) {
+    if (!*path) {
+        reply_printf(reply, "error usage: checkpoint <file>\n");
+        return;
+    }
+    Crawler *crawler = server->crawler;
+    unsigned int generation = atomic_fetch_add(&crawler->checkpoint, 1) + 1;
+    if (crawler->index) {
+        index_checkpoint(crawler->index);
+    }
+
+    char tmp[CONTROL_LINE_LENGTH + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *file = fopen(tmp, "w");
+    if (!file) {
+        reply_printf(reply, "error unable to open %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+    size_t queued, parked = 0;
+    uint32_t *ids = frontier_snapshot(&crawler->queue, &queued);
+    uint32_t *parked_ids = crawler->hosts ? host_parked_snapshot(crawler->hosts, &parked) : NULL;
+    size_t count = queued + parked;
+    fprintf(file, "# Frontier at checkpoint %u, %zu URLs\n", generation, count);
+    char url[MAX_URL_LENGTH];
+    for (size_t i = 0; i < count; i++) {
+        url_table_get(crawler->queue.urls, i < queued ? ids[i] : parked_ids[i - queued], url, sizeof(url));
+        fprintf(file, "%s\n", url);
+    }
+    free(ids);
+    free(parked_ids);
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        reply_printf(reply, "error unable to write %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    reply_printf(reply, "ok checkpoint %u, %zu frontier URLs\n", generation, count);
+}
+
+// Run one command line and build its reply.
+static void control_command(ControlServer *server, char *line, ControlReply *reply) {
+    char *arg = line + strcspn(line, " ");
+    if (*arg) {
+        *arg++ = '\0';
+        arg += strspn(arg, " ");
+    }
+    Crawler *crawler = server->crawler;
+    if (strcmp(line, "stats") == 0) {
+        control_stats(server, reply);
+    } else if (strcmp(line, "hosts") == 0) {
+        control_hosts(server, reply, arg);
+    } else if (strcmp(line, "pause") == 0) {
+        atomic_store(&crawler->paused, true);
+        reply_printf(reply, "ok paused\n");
+    } else if (strcmp(line, "resume") == 0) {
+        atomic_store(&crawler->paused, false);
+        reply_printf(reply, "ok resumed\n");
+    } else if (strcmp(line, "workers") == 0) {
+        control_workers(server, reply, arg);
+    } else if (strcmp(line, "rate") == 0) {
+        control_rate(server, reply, arg);
+    } else if (strcmp(line, "checkpoint") == 0) {
+        control_checkpoint(server, reply, arg);
+    } else {
+        reply_printf(reply, "error commands: stats, hosts [n], pause, resume, workers <n>, "
+                            "rate <url> <parallel> [interval-ms], checkpoint <file>\n");
+    }
+}
+
+// Read one command from a client, answer it and hang up.
+static void control_serve(ControlServer *server, int client) {
+    char line[CONTROL_LINE_LENGTH];
+    size_t len = 0;
+    while (len < sizeof(line) - 1 && !memchr(line, '\n', len)) {
+        struct pollfd pfd = {client, POLLIN, 0};
+        if (poll(&pfd, 1, CONTROL_READ_TIMEOUT_MS) <= 0) {
+            break;
+        }
+        ssize_t n = read(client, line + len, sizeof(line) - 1 - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    line[len] = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+
+    ControlReply reply = {NULL, 0, 0};
+    control_command(server, line, &reply);
+    atomic_fetch_add(&server->commands, 1);
+    // A client that hung up without reading must not take the crawl down with SIGPIPE.
+    for (size_t sent = 0; sent < reply.len;) {
+        ssize_t n = send(client, reply.text + sent, reply.len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        sent += n;
+    }
+    free(reply.text);
+}
+
+// Server thread: accept clients one at a time until the crawl is over.
+static void *control_main(void *arg) {
+    ControlServer *server = (ControlServer *)arg;
+    while (!atomic_load(&server->stopping)) {
+        struct pollfd pfd = {server->fd, POLLIN, 0};
+        if (poll(&pfd, 1, CONTROL_POLL_MS) <= 0) {
+            continue;
+        }
+        int client = accept(server->fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        control_serve(server, client);
+        close(client);
+    }
+    return NULL;
+}
+
+// Fill in a socket address. Returns false if the path is too long for one.
+static bool control_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: Control socket path %s is too long\n", path);
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+// Clear the way for a new socket at `path`. Only a socket nobody listens on any more, left by an
+// earlier crawl, is removed; anything else there is an error.
+static bool control_clear(const char *path, const struct sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(path, &st) != 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        fprintf(stderr, "Error: Unable to check %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Error: %s exists and is not a socket\n", path);
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Unable to check %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool live = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0 || errno != ECONNREFUSED;
+    close(fd);
+    if (live) {
+        fprintf(stderr, "Error: %s is in use by a running crawl\n", path);
+        return false;
+    }
+    unlink(path);
+    return true;
+}
+
+// Listen on `path`, replacing a socket left by an earlier crawl, and start the server thread.
+ControlServer *control_start(Crawler *crawler, const char *path, int max_workers) {
+    struct sockaddr_un addr;
+    if (!control_address(path, &addr) || !control_clear(path, &addr)) {
+        return NULL;
+    }
+    ControlServer *server = (ControlServer *)calloc(1, sizeof(ControlServer));
+    if (!server) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    server->crawler = crawler;
+    server->max_workers = max_workers;
+    snprintf(server->path, sizeof(server->path), "%s", path);
+    server->started_ms = server->last_ms = now_ms();
+    server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server->fd < 0 || bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->fd, 16) != 0) {
+        fprintf(stderr, "Error: Unable to listen on %s: %s\n", path, strerror(errno));
+        if (server->fd >= 0) {
+            close(server->fd);
+        }
+        free(server);
+        return NULL;
+    }
+    if (pthread_create(&server->thread, NULL, control_main, server) != 0) {
+        fprintf(stderr, "Error: Unable to start the control thread\n");
+        close(server->fd);
+        unlink(path);
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+// Stop the server thread and remove the socket.
+void control_stop(ControlServer *server) {
+    atomic_store(&server->stopping, true);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    unlink(server->path);
+    free(server);
+}
+
+// Client side: send one command to a running crawl and print the reply.
+bool control_send(const char *path, const char *command) {
+    struct sockaddr_un addr;
+    if (!control_address(path, &addr)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: Unable to connect to %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    char line[CONTROL_LINE_LENGTH];
+    int len = snprintf(line, sizeof(line), "%s\n", command);
+    bool ok = len < (int)sizeof(line) && write(fd, line, len) == len;
+    shutdown(fd, SHUT_WR);
+    char buffer[4096];
+    ssize_t n;
+    bool error = false;
+    bool first = true;
+    while (ok && (n = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (first && n >= 6 && memcmp(buffer, "error ", 6) == 0) {
+            error = true;
+        }
+        first = false;
+        fwrite(buffer, 1, n, stdout);
+    }
+    close(fd);
+    return ok && !error;
+}
@@ -0,0 +1,32 @@
+// Live control of a running crawl: a Unix-domain socket, served by its own thread, that reports
+// the crawl's counters and takes commands. One text command per connection, answered in text.
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "crawler_core.h"
+
+#define CONTROL_LINE_LENGTH 1024
+#define CONTROL_POLL_MS 200             // How often the thread looks for the end of the crawl
+#define CONTROL_HOSTS 20                // Hosts listed by "hosts" without a count
+#define CONTROL_MAX_HOSTS 1000
+#define CONTROL_READ_TIMEOUT_MS 1000    // A client that sends no command in time is dropped
+
+// The server. Everything it reports is read from atomics, never under the frontier lock.
+typedef struct ControlServer {
+    Crawler *crawler;
+    int max_workers;                    // Workers started; "workers" can lower the limit up to this
+    int fd;
+    char path[108];
+    pthread_t thread;
+    atomic_bool stopping;
+    uint64_t started_ms;
+    uint64_t last_ms;                   // When "stats" last ran, and the page count then
+    unsigned long last_pages;
+    atomic_ulong commands;
+} ControlServer;
+
+ControlServer *control_start(Crawler *crawler, const char *path, int max_workers);
+void control_stop(ControlServer *server);
+bool control_send(const char *path, const char *command);
+
+#endif
@@ -0,0 +1,2089 @@
+#include "crawler_core.h"
+#include <limits.h>
+#include "io_backend.h"
+#include "error_log.h"
+#include "archive.h"
+#include "robots.h"
+#include "dns_cache.h"
+#include "url_table.h"
+#include "link_graph.h"
+#include "pagerank.h"
+#include "host_control.h"
+#include "shard.h"
+#include "topology.h"
+#include "fiber.h"
+#include "seeds.h"
+#include "index.h"
+#include "topic.h"
+#include "url_filter.h"
+#include "memory.h"
+#include "control.h"
+#include "replay.h"
+#include "recrawl.h"
+
+// First-in first-out frontier: breadth-first crawl order.
+typedef struct {
+    URLQueueNode *head, *tail;
+} FifoFrontier;
+
+// Last-in first-out frontier: depth-first crawl order.
+typedef struct {
+    URLQueueNode *head;
+} LifoFrontier;
+
+// Priority frontier: highest score first, discovery order among equals.
+typedef struct {
+    struct PriorityEntry {
+        float key;
+        uint64_t seq;
+        URLQueueNode *node;
+    } *heap;
+    size_t len, cap;
+    uint64_t seq;
+    const float *scores;         // Owned by the ranker; replaced under the queue lock
+    uint32_t count;
+} PriorityFrontier;
+
+// Where a link found on the current page goes.
+typedef enum {
+    LINK_EDGE_ONLY,              // Not followed; only recorded in the link graph
+    LINK_FOLLOW,                 // Goes to this crawl's frontier
+    LINK_FORWARDED,              // Goes to the shard that owns it
+    LINK_FILTERED                // Out of the --filter scope
+} LinkState;
+
+// Links of the page being fetched, canonicalized and deduplicated as they are found, then
+// interned and spliced into the frontier in one go when the page is done.
+typedef struct LinkBatch {
+    char *text;                  // The links' URLs back to back
+    size_t text_len, text_cap;
+    struct PageLink {
+        uint64_t hash;
+        uint32_t offset, len;
+        LinkState state;
+    } *links;
+    size_t count, cap;
+    uint32_t *slots;             // Open-addressed set of link index + 1, 0 when empty
+    size_t slot_cap;             // Power of two, at least twice count
+} LinkBatch;
+
+// Output sink: one crawled URL per line in the output file.
+typedef struct {
+    Sink base;
+    IoBackend *io;
+} OutputSink;
+
+// Allocate the state of a frontier, exiting if memory is exhausted.
+static void *frontier_alloc(size_t size) {
+    void *state = calloc(1, size);
+    if (!state) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return state;
+}
+
+// Create an empty breadth-first frontier.
+static void *fifo_create(void) {
+    return frontier_alloc(sizeof(FifoFrontier));
+}
+
+// Append a node at the tail.
+static void fifo_push(void *state, URLQueueNode *node) {
+    FifoFrontier *fifo = (FifoFrontier *)state;
+    node->next = NULL;
+    if (fifo->tail) {
+        fifo->tail->next = node;
+    } else {
+        fifo->head = node;
+    }
+    fifo->tail = node;
+}
+
+// Take the oldest node.
+static URLQueueNode *fifo_pop(void *state) {
+    FifoFrontier *fifo = (FifoFrontier *)state;
+    URLQueueNode *node = fifo->head;
+    if (node) {
+        fifo->head = node->next;
+        if (fifo->head == NULL) {
+            fifo->tail = NULL;
+        }
+    }
+    return node;
+}
+
+// Copy out the queued IDs, oldest first.
+static size_t fifo_list(void *state, uint32_t *ids, size_t max) {
+    size_t count = 0;
+    for (URLQueueNode *node = ((FifoFrontier *)state)->head; node && count < max; node = node->next) {
+        ids[count++] = node->id;
+    }
+    return count;
+}
+
+// Create an empty depth-first frontier.
+static void *lifo_create(void) {
+    return frontier_alloc(sizeof(LifoFrontier));
+}
+
+// Push a node on top of the stack.
+static void lifo_push(void *state, URLQueueNode *node) {
+    LifoFrontier *lifo = (LifoFrontier *)state;
+    node->next = lifo->head;
+    lifo->head = node;
+}
+
+// Take the newest node.
+static URLQueueNode *lifo_pop(void *state) {
+    LifoFrontier *lifo = (LifoFrontier *)state;
+    URLQueueNode *node = lifo->head;
+    if (node) {
+        lifo->head = node->next;
+    }
+    return node;
+}
+
+// Copy out the queued IDs, newest first.
+static size_t lifo_list(void *state, uint32_t *ids, size_t max) {
+    size_t count = 0;
+    for (URLQueueNode *node = ((LifoFrontier *)state)->head; node && count < max; node = node->next) {
+        ids[count++] = node->id;
+    }
+    return count;
+}
+
+// Create an empty priority frontier. Until the first scores arrive it behaves like a FIFO.
+static void *priority_create(void) {
+    return frontier_alloc(sizeof(PriorityFrontier));
+}
+
+// Score of a URL; URLs found after the last ranking round get the average.
+static float priority_key(PriorityFrontier *pq, uint32_t id) {
+    if (id < pq->count) {
+        return pq->scores[id];
+    }
+    return pq->count ? 1.0f / pq->count : 0.0f;
+}
+
+// True if entry a should be crawled before entry b.
+static bool priority_before(const struct PriorityEntry *a, const struct PriorityEntry *b) {
+    return a->key > b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+// Move an entry down until the heap property holds below it.
+static void priority_sift_down(PriorityFrontier *pq, size_t i) {
+    while (true) {
+        size_t best = i, left = 2 * i + 1, right = left + 1;
+        if (left < pq->len && priority_before(&pq->heap[left], &pq->heap[best])) {
+            best = left;
+        }
+        if (right < pq->len && priority_before(&pq->heap[right], &pq->heap[best])) {
+            best = right;
+        }
+        if (best == i) {
+            return;
+        }
+        struct PriorityEntry tmp = pq->heap[i];
+        pq->heap[i] = pq->heap[best];
+        pq->heap[best] = tmp;
+        i = best;
+    }
+}
+
+// Insert a node with its current score.
+static void priority_push(void *state, URLQueueNode *node) {
+    PriorityFrontier *pq = (PriorityFrontier *)state;
+    if (pq->len == pq->cap) {
+        size_t cap = pq->cap ? pq->cap * 2 : 1024;
+        struct PriorityEntry *grown = (struct PriorityEntry *)realloc(pq->heap, cap * sizeof(*grown));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        pq->heap = grown;
+        pq->cap = cap;
+    }
+    size_t i = pq->len++;
+    struct PriorityEntry entry = {priority_key(pq, node->id), pq->seq++, node};
+    while (i > 0 && priority_before(&entry, &pq->heap[(i - 1) / 2])) {
+        pq->heap[i] = pq->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    pq->heap[i] = entry;
+}
+
+// Take the best node.
+static URLQueueNode *priority_pop(void *state) {
+    PriorityFrontier *pq = (PriorityFrontier *)state;
+    if (pq->len == 0) {
+        return NULL;
+    }
+    URLQueueNode *node = pq->heap[0].node;
+    pq->heap[0] = pq->heap[--pq->len];
+    priority_sift_down(pq, 0);
+    return node;
+}
+
+// Re-key every queued node with new scores and rebuild the heap in linear time.
+static void priority_rescore(void *state, const float *scores, uint32_t count) {
+    PriorityFrontier *pq = (PriorityFrontier *)state;
+    pq->scores = scores;
+    pq->count = count;
+    for (size_t i = 0; i < pq->len; i++) {
+        pq->heap[i].key = priority_key(pq, pq->heap[i].node->id);
+    }
+    for (size_t i = pq->len / 2; i-- > 0;) {
+        priority_sift_down(pq, i);
+    }
+}
+
+// Copy out the queued IDs in heap order.
+static size_t priority_list(void *state, uint32_t *ids, size_t max) {
+    PriorityFrontier *pq = (PriorityFrontier *)state;
+    size_t count = pq->len < max ? pq->len : max;
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = pq->heap[i].node->id;
+    }
+    return count;
+}
+
+// Free the heap; the nodes have been popped by then.
+static void priority_destroy(void *state) {
+    PriorityFrontier *pq = (PriorityFrontier *)state;
+    free(pq->heap);
+    free(pq);
+}
+
+static const FrontierOps fifo_frontier = {"fifo", fifo_create, fifo_push, fifo_pop, free, NULL, fifo_list};
+static const FrontierOps lifo_frontier = {"lifo", lifo_create, lifo_push, lifo_pop, free, NULL, lifo_list};
+static const FrontierOps pagerank_frontier = {"pagerank", priority_create, priority_push, priority_pop,
+                                              priority_destroy, priority_rescore, priority_list};
+
+// Look up a frontier ordering by name.
+const FrontierOps *frontier_find(const char *name) {
+    const FrontierOps *all[] = {&fifo_frontier, &lifo_frontier, &pagerank_frontier};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(all[i]->name, name) == 0) {
+            return all[i];
+        }
+    }
+    return NULL;
+}
+
+// Initialize a URL queue.
+void initQueue(URLQueue *queue, const FrontierOps *ops) {
+    queue->ops = ops;
+    queue->state = ops->create();
+    queue->size = 0;
+    queue->active = 0;
+    queue->urls = url_table_create();
+    queue->robots = NULL;
+    queue->dns = NULL;
+    queue->spill = NULL;
+    queue->held = NULL;
+    queue->held_count = queue->held_cap = 0;
+    queue->held_due_ms = UINT64_MAX;
+    queue->parked = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+}
+
+// Append an already admitted node to the queue.
+void frontier_push(URLQueue *queue, URLQueueNode *newNode) {
+    bool spill = queue->spill && mem_pressure() != MEM_OK;
+    pthread_mutex_lock(&queue->lock);
+    if (spill) {
+        spill_push(queue->spill, newNode);
+    } else {
+        queue->ops->push(queue->state, newNode);
+    }
+    queue->size++;
+    pthread_mutex_unlock(&queue->lock);
+    if (!spill) {
+        mem_account(MEM_FRONTIER, sizeof(URLQueueNode));
+    }
+}
+
+// Check a new URL's node against robots.txt and start resolving its host. Returns false if the
+// node was parked until its origin's rules arrive, or dropped as disallowed.
+static bool frontier_admit(URLQueue *queue, URLQueueNode *node) {
+    if (!queue->robots && !queue->dns) {
+        return true;
+    }
+    char full[MAX_URL_LENGTH];
+    url_table_get(queue->urls, node->id, full, sizeof(full));
+    // Disallowed URLs never reach the queue; URLs of origins without rules yet are parked.
+    if (queue->robots && !robots_admit(queue->robots, node, full)) {
+        return false;
+    }
+    // Resolve the host while the URL waits in the queue.
+    if (queue->dns) {
+        dns_prefetch(queue->dns, full);
+    }
+    return true;
+}
+
+// Add `len` bytes of URL to a batch unless it was seen before. Returns true if it was new; new
+// URLs that robots.txt parks or disallows are not added. The URL's ID is stored in *id if that
+// is not NULL.
+bool frontier_batch_add(URLQueue *queue, FrontierBatch *batch, const char *url, size_t len, int depth,
+                        uint32_t *id_out) {
+    if (id_out) {
+        *id_out = URL_ID_NONE;
+    }
+    if (len >= MAX_URL_LENGTH) {
+        return false;
+    }
+    uint32_t id = url_intern(queue->urls, url, len, NULL);
+    if (id_out) {
+        *id_out = id;
+    }
+    if (!url_claim(queue->urls, id)) {
+        return false;
+    }
+    URLQueueNode *newNode = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+    if (!newNode) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    newNode->id = id;
+    newNode->depth = depth;
+    newNode->next = NULL;
+    if (frontier_admit(queue, newNode)) {
+        if (batch->tail) {
+            batch->tail->next = newNode;
+        } else {
+            batch->head = newNode;
+        }
+        batch->tail = newNode;
+        batch->count++;
+    }
+    return true;
+}
+
+// Splice a batch into the frontier under one lock acquisition and empty it. While memory is
+// short the batch goes to the spill file instead.
+void frontier_batch_push(URLQueue *queue, FrontierBatch *batch) {
+    if (batch->count == 0) {
+        return;
+    }
+    bool spill = queue->spill && mem_pressure() != MEM_OK;
+    URLQueueNode *node = batch->head;
+    pthread_mutex_lock(&queue->lock);
+    while (node) {
+        URLQueueNode *next = node->next;
+        if (spill) {
+            spill_push(queue->spill, node);
+        } else {
+            queue->ops->push(queue->state, node);
+        }
+        node = next;
+    }
+    queue->size += batch->count;
+    pthread_mutex_unlock(&queue->lock);
+    if (!spill) {
+        mem_account(MEM_FRONTIER, (long)(batch->count * sizeof(URLQueueNode)));
+    }
+    batch->head = batch->tail = NULL;
+    batch->count = 0;
+}
+
+// Add `len` bytes of URL to the queue unless it was seen before. Returns true if it was new.
+// The URL's ID is stored in *id if that is not NULL.
+bool enqueue_link(URLQueue *queue, const char *url, size_t len, int depth, uint32_t *id_out) {
+    FrontierBatch batch = {NULL, NULL, 0};
+    bool fresh = frontier_batch_add(queue, &batch, url, len, depth, id_out);
+    frontier_batch_push(queue, &batch);
+    return fresh;
+}
+
+// Add a URL to the queue.
+void enqueue(URLQueue *queue, const char *url, int depth) {
+    enqueue_link(queue, url, strlen(url), depth, NULL);
+}
+
+// Hold a dequeued URL out of the frontier until `due_ms`, for when it cannot be fetched yet. It
+// stays in flight, so the crawl doesn't end meanwhile, and goes back in once a dequeue finds it due.
+void frontier_hold(URLQueue *queue, uint32_t id, int depth, uint64_t due_ms) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->held_count == queue->held_cap) {
+        size_t cap = queue->held_cap ? queue->held_cap * 2 : 64;
+        FrontierHeld *held = (FrontierHeld *)realloc(queue->held, cap * sizeof(FrontierHeld));
+        if (!held) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        mem_account(MEM_FRONTIER, (long)((cap - queue->held_cap) * sizeof(FrontierHeld)));
+        queue->held = held;
+        queue->held_cap = cap;
+    }
+    size_t i = queue->held_count++;
+    while (i > 0 && queue->held[(i - 1) / 2].due_ms > due_ms) {
+        queue->held[i] = queue->held[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    queue->held[i] = (FrontierHeld){due_ms, id, depth};
+    atomic_store(&queue->held_due_ms, queue->held[0].due_ms);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Move the held URLs that are due into the frontier. Returns how many. Called with the lock held.
+static size_t frontier_release_held(URLQueue *queue, uint64_t now) {
+    size_t released = 0;
+    while (queue->held_count && queue->held[0].due_ms <= now) {
+        URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+        if (!node) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        node->id = queue->held[0].id;
+        node->depth = queue->held[0].depth;
+        node->next = NULL;
+        queue->ops->push(queue->state, node);
+        queue->size++;
+        queue->active--;
+        released++;
+
+        // Sift the last entry down from the root
+        FrontierHeld last = queue->held[--queue->held_count];
+        size_t i = 0;
+        while (true) {
+            size_t child = 2 * i + 1;
+            if (child >= queue->held_count) {
+                break;
+            }
+            if (child + 1 < queue->held_count && queue->held[child + 1].due_ms < queue->held[child].due_ms) {
+                child++;
+            }
+            if (queue->held[child].due_ms >= last.due_ms) {
+                break;
+            }
+            queue->held[i] = queue->held[child];
+            i = child;
+        }
+        if (queue->held_count) {
+            queue->held[i] = last;
+        }
+    }
+    atomic_store(&queue->held_due_ms, queue->held_count ? queue->held[0].due_ms : UINT64_MAX);
+    return released;
+}
+
+// Remove a URL from the queue and return its ID, or URL_ID_NONE if the queue is empty.
+// The caller must call frontier_done() once it is processed.
+uint32_t dequeue(URLQueue *queue, int *depth) {
+    uint64_t now = atomic_load(&queue->held_due_ms) != UINT64_MAX ? now_ms() : 0;
+    size_t released = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (now && now >= queue->held_due_ms) {
+        released = frontier_release_held(queue, now);
+    }
+    URLQueueNode *temp = queue->ops->pop(queue->state);
+    if (temp == NULL && queue->spill && queue->spill->count && spill_refill(queue->spill, queue)) {
+        temp = queue->ops->pop(queue->state);
+    }
+    if (temp == NULL) {
+        pthread_mutex_unlock(&queue->lock);
+        return URL_ID_NONE;
+    }
+    queue->size--;
+    queue->active++;
+    pthread_mutex_unlock(&queue->lock);
+    if (released) {
+        mem_account(MEM_FRONTIER, (long)(released * sizeof(URLQueueNode)));
+    }
+
+    uint32_t id = temp->id;
+    *depth = temp->depth;
+    free(temp);
+    mem_account(MEM_FRONTIER, -(long)sizeof(URLQueueNode));
+    return id;
+}
+
+// Count a dequeued URL as parked outside the queue until something other than time frees it.
+// It stays in flight meanwhile.
+void frontier_park(URLQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->parked++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Put a parked URL back in the queue and finish its dequeue.
+void frontier_unpark(URLQueue *queue, URLQueueNode *node) {
+    frontier_push(queue, node);
+    pthread_mutex_lock(&queue->lock);
+    queue->parked--;
+    queue->active--;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Mark work that may still add URLs as in flight.
+void frontier_begin(URLQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->active++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Finish a dequeued URL or other in-flight work.
+void frontier_done(URLQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->active--;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// The crawl is over when the queue is empty and nothing in flight can refill it.
+bool frontier_idle(URLQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    bool idle = queue->size == 0 && queue->active == 0;
+    pthread_mutex_unlock(&queue->lock);
+    return idle;
+}
+
+// Hand new URL scores to the frontier. The previous array may be freed once this returns.
+void frontier_rescore(URLQueue *queue, const float *scores, uint32_t count) {
+    if (!queue->ops->rescore) {
+        return;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->ops->rescore(queue->state, scores, count);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Copy the IDs of every URL waiting in the frontier, spilled and held ones included, into a new
+// array. The lock is held only for the copy. Returns NULL if the frontier is empty.
+uint32_t *frontier_snapshot(URLQueue *queue, size_t *count) {
+    *count = 0;
+    pthread_mutex_lock(&queue->lock);
+    size_t size = atomic_load(&queue->size) + queue->held_count;
+    uint32_t *ids = size ? (uint32_t *)malloc(size * sizeof(uint32_t)) : NULL;
+    if (size && !ids) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (ids) {
+        *count = queue->ops->list(queue->state, ids, size);
+        if (queue->spill) {
+            *count += spill_list(queue->spill, ids + *count, size - *count);
+        }
+        for (size_t i = 0; i < queue->held_count && *count < size; i++) {
+            ids[(*count)++] = queue->held[i].id;
+        }
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ids;
+}
+
+// Free the nodes still in the queue and the frontier itself.
+void freeQueue(URLQueue *queue) {
+    URLQueueNode *node;
+    while ((node = queue->ops->pop(queue->state)) != NULL) {
+        free(node);
+    }
+    queue->ops->destroy(queue->state);
+    if (queue->held_cap) {
+        mem_account(MEM_FRONTIER, -(long)(queue->held_cap * sizeof(FrontierHeld)));
+    }
+    free(queue->held);
+    spill_free(queue->spill);
+    url_table_free(queue->urls);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+// 64-bit FNV-1a hash of a URL, used as the archive index key.
+uint64_t url_hash(const char *url) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)url; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Copy the host part of a URL into `host`.
+void url_host(const char *url, char *host, size_t size) {
+    const char *start = strstr(url, "://");
+    start = start ? start + 3 : url;
+    size_t len = strcspn(start, "/:?#");
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(host, start, len);
+    host[len] = '\0';
+}
+
+// Split an absolute URL into its lower-cased origin and its path. Returns false for relative URLs.
+bool url_origin(const char *url, char *origin, size_t size, const char **path) {
+    const char *sep = strstr(url, "://");
+    if (!sep || sep == url) {
+        return false;
+    }
+    const char *end = sep + 3 + strcspn(sep + 3, "/?#");
+    size_t len = end - url;
+    if (len >= size) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        origin[i] = (url[i] >= 'A' && url[i] <= 'Z') ? url[i] + 32 : url[i];
+    }
+    origin[len] = '\0';
+    *path = *end == '/' ? end : "/";
+    return true;
+}
+
+// Canonical form of an http(s) URL: lowercase scheme and host, no default port, no fragment,
+// "/" for an empty path. Returns its length, or 0 if the URL is not http(s) or doesn't fit.
+size_t url_normalize(const char *url, size_t len, char *out, size_t size) {
+    size_t scheme_len;
+    if (len >= 7 && strncasecmp(url, "http://", 7) == 0) {
+        scheme_len = 7;
+    } else if (len >= 8 && strncasecmp(url, "https://", 8) == 0) {
+        scheme_len = 8;
+    } else {
+        return 0;
+    }
+    const char *fragment = memchr(url, '#', len);
+    if (fragment) {
+        len = fragment - url;
+    }
+    const char *authority = url + scheme_len;
+    const char *end = url + len;
+    const char *rest = authority;
+    while (rest < end && *rest != '/' && *rest != '?') {
+        rest++;
+    }
+    if (rest == authority || len + 1 >= size) {
+        return 0;
+    }
+
+    // User info keeps its case; the scheme and host don't.
+    const char *host = authority;
+    for (const char *p = authority; p < rest; p++) {
+        if (*p == '@') {
+            host = p + 1;
+        }
+    }
+    size_t n = 0;
+    for (const char *p = url; p < rest; p++) {
+        out[n++] = (p < authority || p >= host) && *p >= 'A' && *p <= 'Z' ? *p + 32 : *p;
+    }
+    const char *default_port = scheme_len == 7 ? ":80" : ":443";
+    size_t port_len = strlen(default_port);
+    if (n - scheme_len > port_len && memcmp(out + n - port_len, default_port, port_len) == 0) {
+        n -= port_len;
+    }
+    if (rest == end || *rest == '?') {
+        out[n++] = '/';
+    }
+    if (n + (end - rest) >= size) {
+        return 0;
+    }
+    memcpy(out + n, rest, end - rest);
+    n += end - rest;
+    out[n] = '\0';
+    return n;
+}
+
+// Copy the host of a URL and work out its port from the authority or the scheme.
+bool url_host_port(const char *url, char *host, size_t size, int *port) {
+    const char *sep = strstr(url, "://");
+    if (!sep) {
+        return false;
+    }
+    const char *start = sep + 3;
+    const char *end = start + strcspn(start, "/?#");
+    const char *at = memchr(start, '@', end - start);
+    if (at) {
+        start = at + 1;
+    }
+    const char *colon = NULL;
+    if (*start == '[') {
+        const char *close = memchr(start, ']', end - start);
+        if (!close) {
+            return false;
+        }
+        colon = close + 1 < end && close[1] == ':' ? close + 1 : NULL;
+    } else {
+        colon = memchr(start, ':', end - start);
+    }
+    const char *host_end = colon ? colon : end;
+    if (host_end == start || (size_t)(host_end - start) >= size) {
+        return false;
+    }
+    memcpy(host, start, host_end - start);
+    host[host_end - start] = '\0';
+    for (char *p = host; *p; p++) {
+        if (*p >= 'A' && *p <= 'Z') {
+            *p += 32;
+        }
+    }
+    *port = colon ? atoi(colon + 1) : (strncasecmp(url, "https", sep - url > 5 ? 5 : sep - url) == 0 ? 443 : 80);
+    return true;
+}
+
+// Wall-clock time in milliseconds.
+uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Return the calling thread's CPU time in nanoseconds.
+unsigned long thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+// Forget the previous body but keep its blocks for reuse.
+void body_reset(BodyChain *chain) {
+    chain->count = 0;
+    chain->total = 0;
+    chain->truncated = false;
+}
+
+// Append bytes to a body chain; bodies beyond BODY_MAX_BLOCKS blocks are truncated.
+void body_append(BodyChain *chain, const char *data, size_t len) {
+    while (len > 0) {
+        if (chain->count == 0 || chain->used[chain->count - 1] == BODY_BLOCK_SIZE) {
+            if (chain->count == BODY_MAX_BLOCKS) {
+                chain->truncated = true;
+                return;
+            }
+            if (chain->count == chain->allocated) {
+                chain->blocks[chain->allocated] = (char *)malloc(BODY_BLOCK_SIZE);
+                if (!chain->blocks[chain->allocated]) {
+                    fprintf(stderr, "Error: Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+                chain->allocated++;
+                mem_account(MEM_BUFFERS, BODY_BLOCK_SIZE);
+            }
+            chain->used[chain->count++] = 0;
+        }
+        size_t *used = &chain->used[chain->count - 1];
+        size_t n = BODY_BLOCK_SIZE - *used;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(chain->blocks[chain->count - 1] + *used, data, n);
+        *used += n;
+        chain->total += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Release all blocks of a body chain.
+void body_free(BodyChain *chain) {
+    for (int i = 0; i < chain->allocated; i++) {
+        free(chain->blocks[i]);
+    }
+    mem_account(MEM_BUFFERS, -(long)chain->allocated * BODY_BLOCK_SIZE);
+    chain->allocated = chain->count = 0;
+}
+
+
+// Grow a buffer to hold at least `need` elements, exiting if memory is exhausted.
+static void *link_batch_grow(void *buf, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) {
+        return buf;
+    }
+    size_t grown = *cap ? *cap : 64;
+    while (grown < need) {
+        grown *= 2;
+    }
+    buf = realloc(buf, grown * size);
+    if (!buf) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *cap = grown;
+    return buf;
+}
+
+// Find a URL among the page's links, adding it as LINK_EDGE_ONLY if it is new. Sets *added.
+static struct PageLink *link_batch_find(LinkBatch *batch, const char *url, size_t len, bool *added) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)url[i]) * 1099511628211ULL;
+    }
+    size_t mask = batch->slot_cap - 1;
+    size_t slot = hash & mask;
+    for (; batch->slots[slot] != 0; slot = (slot + 1) & mask) {
+        struct PageLink *link = &batch->links[batch->slots[slot] - 1];
+        if (link->hash == hash && link->len == len && memcmp(batch->text + link->offset, url, len) == 0) {
+            *added = false;
+            return link;
+        }
+    }
+
+    batch->text = (char *)link_batch_grow(batch->text, &batch->text_cap, batch->text_len + len, 1);
+    batch->links = (struct PageLink *)link_batch_grow(batch->links, &batch->cap, batch->count + 1,
+                                                      sizeof(struct PageLink));
+    struct PageLink *link = &batch->links[batch->count++];
+    link->hash = hash;
+    link->offset = (uint32_t)batch->text_len;
+    link->len = (uint32_t)len;
+    link->state = LINK_EDGE_ONLY;
+    memcpy(batch->text + batch->text_len, url, len);
+    batch->text_len += len;
+    batch->slots[slot] = (uint32_t)batch->count;
+
+    // Keep the set at most half full.
+    if (batch->count * 2 > batch->slot_cap) {
+        free(batch->slots);
+        batch->slot_cap *= 2;
+        batch->slots = (uint32_t *)calloc(batch->slot_cap, sizeof(uint32_t));
+        if (!batch->slots) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        mask = batch->slot_cap - 1;
+        for (size_t i = 0; i < batch->count; i++) {
+            size_t j = batch->links[i].hash & mask;
+            while (batch->slots[j] != 0) {
+                j = (j + 1) & mask;
+            }
+            batch->slots[j] = (uint32_t)(i + 1);
+        }
+    }
+    *added = true;
+    return link;
+}
+
+// Create an empty link batch.
+static LinkBatch *link_batch_create(void) {
+    LinkBatch *batch = (LinkBatch *)calloc(1, sizeof(LinkBatch));
+    if (!batch) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    batch->slot_cap = 256;
+    batch->slots = (uint32_t *)calloc(batch->slot_cap, sizeof(uint32_t));
+    if (!batch->slots) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return batch;
+}
+
+// Free a link batch.
+static void link_batch_free(LinkBatch *batch) {
+    free(batch->text);
+    free(batch->links);
+    free(batch->slots);
+    free(batch);
+}
+
+// Function to collect a link found on the current page; worker_flush_links() hands them on.
+static void worker_emit(void *arg, const char *url, size_t len) {
+    Worker *worker = (Worker *)arg;
+    Crawler *crawler = worker->crawler;
+    // Links are followed up to the maximum depth, if they contain the search query
+    bool follow = worker->depth + 1 < crawler->max_depth &&
+                  (!crawler->search || memmem(url, len, crawler->search, strlen(crawler->search)) != NULL);
+    if (!follow && !worker->edges) {
+        return;
+    }
+
+    // Spellings of one URL collapse to one link; anything but http(s) is kept as found.
+    char canonical[MAX_URL_LENGTH];
+    size_t canonical_len = url_normalize(url, len, canonical, sizeof(canonical));
+    if (canonical_len) {
+        url = canonical;
+        len = canonical_len;
+    } else if (len >= MAX_URL_LENGTH) {
+        return;
+    }
+    bool added;
+    struct PageLink *link = link_batch_find(worker->links, url, len, &added);
+    if (!follow || link->state != LINK_EDGE_ONLY) {
+        return;
+    }
+    if (crawler->filter && !url_filter_allows(crawler->filter, url, len)) {
+        link->state = LINK_FILTERED;
+        return;
+    }
+
+    // Links to origins another shard owns are forwarded; it dedupes them against its own set.
+    if (crawler->shards && shard_of(crawler->shards, url, len) != crawler->shards->self) {
+        link->state = LINK_FORWARDED;
+        return;
+    }
+    link->state = LINK_FOLLOW;
+}
+
+// Intern the page's links, record its edges and splice the new URLs into the frontier under
+// one queue lock. Called once the page is fetched, before it is marked done.
+static void worker_flush_links(Worker *worker) {
+    Crawler *crawler = worker->crawler;
+    LinkBatch *batch = worker->links;
+    URLQueue *queue = &crawler->queue;
+    FrontierBatch fresh = {NULL, NULL, 0};
+    unsigned long followed = 0;
+    // In a focused crawl only pages with enough keyword hits are expanded; seeds always are.
+    bool expand = !worker->topics || worker->depth == 0 || worker->topics->hits >= crawler->topics->min_hits;
+    bool dropped = false;
+    for (size_t i = 0; i < batch->count; i++) {
+        struct PageLink *link = &batch->links[i];
+        const char *url = batch->text + link->offset;
+        uint32_t id = URL_ID_NONE;
+        dropped |= !expand && (link->state == LINK_FOLLOW || link->state == LINK_FORWARDED);
+        if (expand && link->state == LINK_FORWARDED) {
+            shard_send(crawler->shards, worker->slot, shard_of(crawler->shards, url, link->len), url, link->len,
+                       worker->depth + 1, crawler);
+        }
+        if (expand && link->state == LINK_FOLLOW) {
+            followed += frontier_batch_add(queue, &fresh, url, link->len, worker->depth + 1, &id);
+        } else if (worker->edges) {
+            id = url_intern(queue->urls, url, link->len, NULL);
+        } else {
+            continue;
+        }
+        if (worker->edges && id != URL_ID_NONE) {
+            graph_add_edge(worker->edges, worker->page_id, id);
+        }
+    }
+    frontier_batch_push(queue, &fresh);
+    if (followed) {
+        atomic_fetch_add(&crawler->stats.links, followed);
+    }
+    if (dropped) {
+        atomic_fetch_add(&crawler->topics->unexpanded, 1);
+    }
+
+    batch->text_len = 0;
+    batch->count = 0;
+    memset(batch->slots, 0, batch->slot_cap * sizeof(uint32_t));
+}
+
+// Function to write a crawled URL to the output file.
+static void output_sink_page(Sink *sink, const FetchResult *result) {
+    OutputSink *output = (OutputSink *)sink;
+    char line[MAX_URL_LENGTH + 32];
+    int line_len = result->topic_scanned
+                       ? snprintf(line, sizeof(line), "%s\t%lu\t%u\n", result->url, result->topic_hits, result->topic_terms)
+                       : snprintf(line, sizeof(line), "%s\n", result->url);
+    output->io->write_line(output->io, IO_STREAM_OUTPUT, line,
+                           line_len < (int)sizeof(line) ? line_len : (int)sizeof(line) - 1);
+}
+
+// The I/O backend owns the output file, so closing the sink only frees it.
+static void output_sink_close(Sink *sink) {
+    free(sink);
+}
+
+// Create the sink that lists crawled URLs.
+static Sink *output_sink_create(IoBackend *io) {
+    OutputSink *output = (OutputSink *)calloc(1, sizeof(OutputSink));
+    if (!output) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    output->base.name = "output";
+    output->base.page = output_sink_page;
+    output->base.close = output_sink_close;
+    output->io = io;
+    return &output->base;
+}
+
+// Set up a worker's extractor, fetcher and link graph buffer. Returns false if it can't run.
+static bool worker_init(Worker *worker, Crawler *crawler, int slot) {
+    memset(worker, 0, sizeof(*worker));
+    worker->crawler = crawler;
+    worker->extractor = crawler->extractor;
+    worker->page_id = URL_ID_NONE;
+    worker->slot = slot;
+    if (crawler->graph) {
+        worker->edges = (GraphWriter *)malloc(sizeof(GraphWriter));
+        if (!worker->edges) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        graph_writer_init(worker->edges, crawler->graph);
+    }
+    worker->links = link_batch_create();
+    worker->topics = crawler->topics ? topic_scan_create(crawler->topics) : NULL;
+    worker->index_page = crawler->index ? index_page_create() : NULL;
+    worker->extractor_state = crawler->extractor->create(worker_emit, worker);
+    worker->fetcher = worker->extractor_state ? crawler->fetcher->create(worker) : NULL;
+    if (!worker->fetcher) {
+        fprintf(stderr, "Error: Unable to initialize worker\n");
+        if (worker->extractor_state) {
+            crawler->extractor->destroy(worker->extractor_state);
+        }
+        free(worker->edges);
+        link_batch_free(worker->links);
+        topic_scan_free(worker->topics);
+        index_page_free(worker->index_page);
+        return false;
+    }
+    return true;
+}
+
+// The worker's handle for robots.txt fetches, created on first use.
+static CURL *worker_robots_curl(Worker *worker) {
+    if (!worker->robots_curl) {
+        worker->robots_curl = curl_easy_init();
+        if (!worker->robots_curl) {
+            return NULL;
+        }
+        curl_easy_setopt(worker->robots_curl, CURLOPT_USERAGENT, CRAWLER_USER_AGENT);
+        curl_easy_setopt(worker->robots_curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(worker->robots_curl, CURLOPT_MAXREDIRS, 5L);
+        curl_easy_setopt(worker->robots_curl, CURLOPT_TIMEOUT, 30L);
+        curl_easy_setopt(worker->robots_curl, CURLOPT_CONNECTTIMEOUT_MS, (long)FETCH_CONNECT_TIMEOUT_MS);
+        if (worker->crawler->http_version) {
+            curl_easy_setopt(worker->robots_curl, CURLOPT_HTTP_VERSION, worker->crawler->http_version);
+            curl_easy_setopt(worker->robots_curl, CURLOPT_FORBID_REUSE, (long)worker->crawler->fresh_connections);
+        }
+    }
+    return worker->robots_curl;
+}
+
+// Histogram bucket of a value: 0 for 0, b for [2^(b-1), 2^b), the last bucket for the rest.
+static int stats_bucket(uint64_t value) {
+    int bucket = value ? 64 - __builtin_clzll(value) : 0;
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+// Whether this worker waits: the control socket paused the crawl or limits the workers below its
+// slot, or memory is at its hard limit. Under hard pressure the first slot keeps fetching alone,
+// with new links spilled to disk, so the crawl slows down instead of losing links.
+static bool worker_parked(Crawler *crawler, int slot) {
+    if (slot > 0 && mem_pressure() == MEM_HARD) {
+        mem_trim();
+        return true;
+    }
+    return atomic_load_explicit(&crawler->paused, memory_order_relaxed) ||
+           slot >= atomic_load_explicit(&crawler->worker_limit, memory_order_relaxed);
+}
+
+// Fetch one dequeued URL and hand the page to the sinks, or put it back if it has to wait.
+static void worker_process(Worker *worker, uint32_t url_id, int depth) {
+    Crawler *crawler = worker->crawler;
+    URLQueue *queue = &crawler->queue;
+    char url[MAX_URL_LENGTH];
+    url_table_get(queue->urls, url_id, url, sizeof(url));
+
+    // Honour Crawl-delay: hold the URL back until its origin's next slot.
+    uint64_t wait = queue->robots ? robots_delay(queue->robots, url) : 0;
+    if (wait > 0) {
+        frontier_hold(queue, url_id, depth, now_ms() + wait);
+        return;
+    }
+
+    // Take a slot on the host. A backed-off host holds the URL until its pause ends; a busy one
+    // parks it until one of its fetches ends.
+    FetchResult result;
+    memset(&result, 0, sizeof(result));
+    struct HostState *host = NULL;
+    uint64_t retry_ms;
+    while (crawler->hosts && !(host = host_acquire(crawler->hosts, url, &result, &retry_ms))) {
+        if (retry_ms) {
+            frontier_hold(queue, url_id, depth, retry_ms);
+            return;
+        }
+        if (host_park(crawler->hosts, url, url_id, depth)) {
+            return;
+        }
+    }
+
+    // Print fetched URL
+    printf("Fetched URL: %s\n", url);
+
+    result.url = url;
+    result.url_id = url_id;
+    worker->depth = depth;
+    worker->page_id = url_id;
+    atomic_fetch_add(&crawler->stats.in_flight, 1);
+    uint64_t fetch_started = now_ms();
+    if (worker->topics) {
+        topic_begin(worker->topics);
+    }
+    if (worker->index_page) {
+        index_page_begin(worker->index_page);
+        result.index_page = worker->index_page;
+    }
+    worker->digest = RECRAWL_DIGEST_SEED;
+    crawler->fetcher->fetch(worker->fetcher, url, &result);
+    if (worker->topics) {
+        topic_end(worker->topics);
+        result.topic_scanned = true;
+        result.topic_hits = worker->topics->hits;
+        result.topic_terms = worker->topics->terms;
+    }
+    worker_flush_links(worker);
+    uint64_t fetch_ms = now_ms() - fetch_started;
+    atomic_fetch_sub(&crawler->stats.in_flight, 1);
+    if (host) {
+        host_release(crawler->hosts, host, &result, fetch_ms);
+    }
+    if (result.error != CURLE_OK) {
+        char host[ERROR_HOST_LENGTH];
+        url_host(url, host, sizeof(host));
+        log_error(ERROR_KIND_CURL, result.error, host, curl_easy_strerror(result.error));
+        if (crawler->recrawl) {
+            recrawl_visit(crawler->recrawl, url_id, depth, 0, false);
+        }
+        frontier_done(queue);
+        return;
+    }
+    atomic_fetch_add(&crawler->stats.pages, 1);
+    if (crawler->shards) {
+        shard_count_page(crawler->shards);
+    }
+    atomic_fetch_add(&crawler->stats.fetch_ms[stats_bucket(fetch_ms)], 1);
+    atomic_fetch_add(&crawler->stats.body_kb[stats_bucket(result.wire_len >> 10)], 1);
+
+    if (result.status >= 400) {
+        char host[ERROR_HOST_LENGTH];
+        url_host(url, host, sizeof(host));
+        log_error(ERROR_KIND_HTTP, (int)result.status, host, url);
+    }
+
+    for (Sink *sink = crawler->sinks; sink; sink = sink->next) {
+        sink->page(sink, &result);
+    }
+
+    // While memory is short, give up the blocks kept for the next page instead of reusing them.
+    if (mem_pressure() != MEM_OK) {
+        if (result.body) {
+            body_free(result.body);
+        }
+        if (result.scratch) {
+            body_free(result.scratch);
+        }
+        mem_trim();
+    }
+
+    // In a continuous crawl the page comes round again; error pages count as fetched.
+    if (crawler->recrawl) {
+        recrawl_visit(crawler->recrawl, url_id, depth, worker->digest, true);
+    }
+    frontier_done(queue);
+}
+
+// Release what worker_init() and worker_robots_curl() set up.
+static void worker_destroy(Worker *worker) {
+    Crawler *crawler = worker->crawler;
+    if (worker->edges) {
+        graph_writer_flush(worker->edges);
+        free(worker->edges);
+    }
+    crawler->fetcher->destroy(worker->fetcher);
+    crawler->extractor->destroy(worker->extractor_state);
+    curl_easy_cleanup(worker->robots_curl);
+    link_batch_free(worker->links);
+    topic_scan_free(worker->topics);
+    index_page_free(worker->index_page);
+}
+
+// Whether the fetch budget is spent. Shards share one budget.
+static bool budget_spent(Crawler *crawler) {
+    if (!crawler->max_pages) {
+        return false;
+    }
+    unsigned long pages = crawler->shards ? shard_pages(crawler->shards) : atomic_load(&crawler->stats.pages);
+    return pages >= crawler->max_pages;
+}
+
+// Function to fetch and process URLs until the crawl is over.
+static void *crawl_worker(void *arg) {
+    Crawler *crawler = (Crawler *)arg;
+    URLQueue *queue = &crawler->queue;
+
+    int slot = atomic_fetch_add(&crawler->next_worker, 1);
+    if (crawler->topology) {
+        topology_place_worker(crawler->topology, slot);
+    }
+    Worker worker;
+    if (!worker_init(&worker, crawler, slot)) {
+        return NULL;
+    }
+    CURL *robots_curl = queue->robots ? worker_robots_curl(&worker) : NULL;
+    if (queue->robots && !robots_curl) {
+        fprintf(stderr, "Error: Unable to initialize worker\n");
+        worker_destroy(&worker);
+        return NULL;
+    }
+
+    while (true) {
+        // A parked worker takes nothing but still notices the end of the crawl.
+        bool parked = worker_parked(crawler, slot);
+
+        // robots.txt fetches come first: they release the URLs parked behind them.
+        if (!parked && robots_curl && robots_fetch_next(queue->robots, robots_curl, queue)) {
+            continue;
+        }
+
+        // Stop once the fetch budget is spent. A shard stays until all shards are done, dropping
+        // the links it is still sent.
+        if (budget_spent(crawler)) {
+            if (crawler->shards && !shard_idle(crawler->shards, crawler, true)) {
+                fiber_sleep_ms(1);
+                continue;
+            }
+            break;
+        }
+
+        if (crawler->shards) {
+            shard_drain(crawler->shards, crawler);
+        }
+        int depth;
+        uint32_t url_id = parked ? URL_ID_NONE : dequeue(queue, &depth);
+        if (url_id == URL_ID_NONE) {
+            if ((crawler->recrawl && recrawl_pending(crawler->recrawl)) ||
+                (queue->robots && robots_pending(queue->robots)) || !frontier_idle(queue) ||
+                (crawler->shards && !shard_idle(crawler->shards, crawler, false))) {
+                // Other workers or revisits coming due may still add URLs.
+                fiber_sleep_ms(1);
+                continue;
+            }
+            // Queue is empty, exit thread
+            break;
+        }
+        worker_process(&worker, url_id, depth);
+    }
+
+    // Clean up resources
+    worker_destroy(&worker);
+    error_log_thread_done();
+
+    return NULL;
+}
+
+// Fiber task standing for "fetch the next robots.txt"; URL tasks are queue nodes.
+static URLQueueNode robots_task;
+
+// Fiber scheduler thread start: place it like the worker thread it replaces.
+static void fiber_thread_start(void *arg, int index) {
+    Crawler *crawler = (Crawler *)arg;
+    if (crawler->topology) {
+        topology_place_worker(crawler->topology, index);
+    }
+}
+
+// Fiber scheduler thread exit.
+static void fiber_thread_stop(void *arg, int index) {
+    (void)arg;
+    (void)index;
+    error_log_thread_done();
+}
+
+// Claim the next fiber task: a pending robots.txt fetch first, then a URL from the frontier.
+static bool fiber_next(void *arg, void **task) {
+    Crawler *crawler = (Crawler *)arg;
+    URLQueue *queue = &crawler->queue;
+    // The worker limit counts tasks in progress, since fibers have no fixed slots.
+    if (worker_parked(crawler, atomic_load(&crawler->tasks))) {
+        return false;
+    }
+    // One unstarted robots task at a time; it takes its origin off the list when it starts.
+    if (queue->robots && atomic_load(&crawler->robots_tasks) == 0 && robots_pending(queue->robots)) {
+        atomic_fetch_add(&crawler->robots_tasks, 1);
+        atomic_fetch_add(&crawler->tasks, 1);
+        *task = &robots_task;
+        return true;
+    }
+    if (budget_spent(crawler)) {
+        return false;
+    }
+    int depth;
+    uint32_t url_id = dequeue(queue, &depth);
+    if (url_id == URL_ID_NONE) {
+        return false;
+    }
+    URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+    if (!node) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    node->id = url_id;
+    node->depth = depth;
+    atomic_fetch_add(&crawler->tasks, 1);
+    *task = node;
+    return true;
+}
+
+// Run one fiber task with the fiber's own worker, set up on its first task.
+static void fiber_run(void *arg, void *task, void **local) {
+    Crawler *crawler = (Crawler *)arg;
+    Worker *worker = (Worker *)*local;
+    if (!worker) {
+        worker = (Worker *)malloc(sizeof(Worker));
+        if (!worker) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        // Fibers have no outbound shard rings, so the slot only numbers them.
+        if (!worker_init(worker, crawler, atomic_fetch_add(&crawler->next_worker, 1))) {
+            exit(EXIT_FAILURE);
+        }
+        *local = worker;
+    }
+    if (task == &robots_task) {
+        atomic_fetch_sub(&crawler->robots_tasks, 1);
+        CURL *curl = worker_robots_curl(worker);
+        if (!curl) {
+            fprintf(stderr, "Error: Unable to initialize worker\n");
+            exit(EXIT_FAILURE);
+        }
+        robots_fetch_next(crawler->queue.robots, curl, &crawler->queue);
+        atomic_fetch_sub(&crawler->tasks, 1);
+        return;
+    }
+    URLQueueNode *node = (URLQueueNode *)task;
+    uint32_t url_id = node->id;
+    int depth = node->depth;
+    free(node);
+    worker_process(worker, url_id, depth);
+    atomic_fetch_sub(&crawler->tasks, 1);
+}
+
+// With no fiber busy and no task to claim, the crawl is over unless robots.txt fetches,
+// in-flight URLs or revisits coming due may still feed the frontier.
+static bool fiber_finished(void *arg) {
+    Crawler *crawler = (Crawler *)arg;
+    URLQueue *queue = &crawler->queue;
+    if (budget_spent(crawler)) {
+        return true;
+    }
+    if (crawler->recrawl && recrawl_pending(crawler->recrawl)) {
+        return false;
+    }
+    return frontier_idle(queue) && !(queue->robots && robots_pending(queue->robots));
+}
+
+// Free a fiber's worker at the end of the crawl.
+static void fiber_release(void *arg, void *local) {
+    (void)arg;
+    Worker *worker = (Worker *)local;
+    worker_destroy(worker);
+    free(worker);
+}
+
+static const FiberHooks crawl_fiber_hooks = {fiber_thread_start, fiber_thread_stop, fiber_next,
+                                             fiber_run, fiber_finished, fiber_release};
+
+// Function to print the crawl counters once all workers are done.
+static void print_stats(CrawlStats *stats, UrlTable *urls, double elapsed) {
+    unsigned long pages = atomic_load(&stats->pages);
+    unsigned long wire = atomic_load(&stats->wire_bytes);
+    unsigned long body = atomic_load(&stats->body_bytes);
+    unsigned long logged, suppressed, dropped;
+    error_log_counts(&logged, &suppressed, &dropped);
+    fprintf(stderr, "Pages fetched: %lu in %.3f s (%.1f pages/s), links followed: %lu\n", pages, elapsed,
+            elapsed > 0 ? pages / elapsed : 0.0, atomic_load(&stats->links));
+    fprintf(stderr, "Bytes on the wire: %lu, after decoding: %lu (ratio %.2f)\n",
+            wire, body, wire ? (double)body / wire : 0.0);
+    fprintf(stderr, "Decompression CPU time: %.3f ms, extraction CPU time: %.3f ms\n",
+            atomic_load(&stats->decode_ns) / 1e6, atomic_load(&stats->extract_ns) / 1e6);
+    fprintf(stderr, "Errors logged: %lu, suppressed: %lu, dropped: %lu\n", logged, suppressed, dropped);
+    fprintf(stderr, "Distinct URLs: %lu, URL table: %lu KiB\n", atomic_load(&urls->urls),
+            atomic_load(&urls->bytes) / 1024);
+}
+
+// Function to print the command line of a crawler program.
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s <starting-url|max-depth> | <starting-url> [max-depth] | --seeds <file> [max-depth]\n"
+                    "       [--extractor regex|strstr|libxml2|libxml2-sax] [--fetcher curl|static] [--frontier fifo|lifo|pagerank]\n"
+                    "       [--threads <n>] [--fibers <n>] [--shards <n>] [--pin none|compact|spread|remote] [--numa-bench]\n"
+                    "       [--http2 tls|h2c] [--h2-streams <n>]\n"
+                    "       [--max-pages <n>] [--search <text>] [--filter <file>] [--topics <file>] [--topic-min <n>]\n"
+                    "       [--index <dir>] [--mem-limit <size>] [--control <socket>] [--output <file>]\n"
+                    "       [--archive <dir>] [--segment-mb <n>] [--io uring|stdio] [--no-robots]\n"
+                    "       [--record <file>] [--replay <file> [--replay-latency]]\n"
+                    "       [--recrawl <seconds>] [--revisit-min <seconds>] [--revisit-max <seconds>]\n"
+                    "       [--no-dns-cache] [--dns-server <host:port,...>] [--no-host-control] [--graph <file>]\n", program);
+    fprintf(stderr, "       %s --archive <dir> --archive-get <url>\n", program);
+    fprintf(stderr, "       %s --graph <file> --graph-get <url>\n", program);
+    fprintf(stderr, "       %s --index <dir> --index-query <words>\n", program);
+    fprintf(stderr, "       %s --control <socket> --control-send <command>\n", program);
+    fprintf(stderr, "       %s --filter-bench\n", program);
+}
+
+// Fetch a single page with the cURL fetcher and pass its links to `emit`, without a crawl around it.
+// With `record_path` the response is also recorded there; with `replay_path` it is served from that
+// recording instead of the network.
+bool crawler_fetch_page(const char *url, const char *extractor_name, const char *record_path, const char *replay_path,
+                        LinkEmitter emit, void *arg) {
+    const ExtractorOps *extractor = extractor_find(extractor_name);
+    if (!extractor) {
+        fprintf(stderr, "Error: Unknown extractor %s\n", extractor_name);
+        return false;
+    }
+    Crawler crawler;
+    memset(&crawler, 0, sizeof(crawler));
+    Worker worker;
+    memset(&worker, 0, sizeof(worker));
+    worker.crawler = &crawler;
+    worker.extractor = extractor;
+    worker.page_id = URL_ID_NONE;
+    worker.extractor_state = extractor->create(emit, arg);
+    if (!worker.extractor_state) {
+        return false;
+    }
+    if (replay_path || record_path) {
+        crawler.replay = replay_path ? replay_open(replay_path, false) : replay_create(record_path);
+        if (!crawler.replay) {
+            extractor->destroy(worker.extractor_state);
+            return false;
+        }
+    }
+    const FetcherOps *ops = replay_path ? &replay_fetcher : &curl_fetcher;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    FetchResult result;
+    memset(&result, 0, sizeof(result));
+    result.url = url;
+    void *fetcher = ops->create(&worker);
+    if (fetcher) {
+        ops->fetch(fetcher, url, &result);
+        ops->destroy(fetcher);
+    }
+    extractor->destroy(worker.extractor_state);
+    curl_global_cleanup();
+    if (crawler.replay) {
+        replay_close(crawler.replay);
+    }
+
+    if (!fetcher) {
+        return false;
+    }
+    if (result.error != CURLE_OK) {
+        if (replay_path && result.error == CURLE_REMOTE_FILE_NOT_FOUND) {
+            fprintf(stderr, "Error: %s is not recorded in %s\n", url, replay_path);
+        } else {
+            fprintf(stderr, "Error: cURL request failed: %s\n", curl_easy_strerror(result.error));
+        }
+        return false;
+    }
+    return true;
+}
+
+// Main function to drive the web crawler with a program's default strategies.
+int crawler_main(int argc, char *argv[], const CrawlerDefaults *defaults) {
+    char *spec = NULL;
+    const char *depth_arg = NULL;
+    const char *archive_dir = NULL;
+    const char *archive_lookup = NULL;
+    const char *graph_path = NULL;
+    const char *graph_lookup = NULL;
+    const char *index_dir = NULL;
+    const char *index_lookup = NULL;
+    const char *seeds_path = NULL;
+    const char *filter_path = NULL;
+    const char *topics_path = NULL;
+    long topic_min = 0;
+    bool filter_bench = false;
+    const char *extractor_name = defaults->extractor;
+    const char *fetcher_name = defaults->fetcher;
+    const char *frontier_name = defaults->frontier;
+    const char *output_path = defaults->output_path;
+    const char *search = NULL;
+    long segment_mb = ARCHIVE_SEGMENT_MB;
+    int num_threads = NUM_THREADS;
+    int num_fibers = 0;
+    const char *http2 = NULL;
+    int h2_streams = HTTP2_STREAMS;
+    long max_pages = 0;
+    int num_shards = 1;
+    PlacementPolicy placement = PLACEMENT_NONE;
+    bool numa_bench = false;
+    bool use_uring = true;
+    bool use_robots = true;
+    bool use_dns_cache = true;
+    bool use_host_control = true;
+    const char *dns_servers = NULL;
+    const char *mem_limit = NULL;
+    const char *control_path = NULL;
+    const char *control_command = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    bool replay_latency = false;
+    long recrawl_s = 0;
+    long revisit_min = RECRAWL_MIN_S;
+    long revisit_max = RECRAWL_MAX_S;
+    bool usage_error = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--archive") == 0 && i + 1 < argc) {
+            archive_dir = argv[++i];
+        } else if (strcmp(argv[i], "--segment-mb") == 0 && i + 1 < argc) {
+            segment_mb = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            const char *io_name = argv[++i];
+            use_uring = strcmp(io_name, "uring") == 0;
+            usage_error |= !use_uring && strcmp(io_name, "stdio") != 0;
+        } else if (strcmp(argv[i], "--no-robots") == 0) {
+            use_robots = false;
+        } else if (strcmp(argv[i], "--no-dns-cache") == 0) {
+            use_dns_cache = false;
+        } else if (strcmp(argv[i], "--no-host-control") == 0) {
+            use_host_control = false;
+        } else if (strcmp(argv[i], "--dns-server") == 0 && i + 1 < argc) {
+            dns_servers = argv[++i];
+        } else if (strcmp(argv[i], "--archive-get") == 0 && i + 1 < argc) {
+            archive_lookup = argv[++i];
+        } else if (strcmp(argv[i], "--graph") == 0 && i + 1 < argc) {
+            graph_path = argv[++i];
+        } else if (strcmp(argv[i], "--graph-get") == 0 && i + 1 < argc) {
+            graph_lookup = argv[++i];
+        } else if (strcmp(argv[i], "--extractor") == 0 && i + 1 < argc) {
+            extractor_name = argv[++i];
+        } else if (strcmp(argv[i], "--fetcher") == 0 && i + 1 < argc) {
+            fetcher_name = argv[++i];
+        } else if (strcmp(argv[i], "--frontier") == 0 && i + 1 < argc) {
+            frontier_name = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fibers") == 0 && i + 1 < argc) {
+            num_fibers = atoi(argv[++i]);
+            usage_error |= num_fibers <= 0;
+        } else if (strcmp(argv[i], "--http2") == 0 && i + 1 < argc) {
+            http2 = argv[++i];
+            usage_error |= strcmp(http2, "tls") != 0 && strcmp(http2, "h2c") != 0;
+        } else if (strcmp(argv[i], "--h2-streams") == 0 && i + 1 < argc) {
+            h2_streams = atoi(argv[++i]);
+            usage_error |= h2_streams <= 0;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            num_shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pin") == 0 && i + 1 < argc) {
+            usage_error |= !placement_parse(argv[++i], &placement);
+        } else if (strcmp(argv[i], "--numa-bench") == 0) {
+            numa_bench = true;
+        } else if (strcmp(argv[i], "--max-pages") == 0 && i + 1 < argc) {
+            max_pages = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+            seeds_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter_path = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            index_dir = argv[++i];
+        } else if (strcmp(argv[i], "--index-query") == 0 && i + 1 < argc) {
+            index_lookup = argv[++i];
+        } else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) {
+            control_path = argv[++i];
+        } else if (strcmp(argv[i], "--control-send") == 0 && i + 1 < argc) {
+            control_command = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay-latency") == 0) {
+            replay_latency = true;
+        } else if (strcmp(argv[i], "--recrawl") == 0 && i + 1 < argc) {
+            recrawl_s = atol(argv[++i]);
+            usage_error |= recrawl_s <= 0;
+        } else if (strcmp(argv[i], "--revisit-min") == 0 && i + 1 < argc) {
+            revisit_min = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--revisit-max") == 0 && i + 1 < argc) {
+            revisit_max = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            mem_limit = argv[++i];
+        } else if (strcmp(argv[i], "--topics") == 0 && i + 1 < argc) {
+            topics_path = argv[++i];
+        } else if (strcmp(argv[i], "--topic-min") == 0 && i + 1 < argc) {
+            topic_min = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--filter-bench") == 0) {
+            filter_bench = true;
+        } else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc) {
+            search = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (argv[i][0] != '-' && spec == NULL) {
+            spec = argv[i];
+        } else if (argv[i][0] != '-' && depth_arg == NULL) {
+            depth_arg = argv[i];
+        } else {
+            usage_error = true;
+            break;
+        }
+    }
+
+    if (filter_bench) {
+        return url_filter_bench();
+    }
+
+    if (archive_lookup) {
+        if (!archive_dir) {
+            fprintf(stderr, "Error: --archive-get needs --archive <dir>\n");
+            return EXIT_FAILURE;
+        }
+        if (!archive_get(archive_dir, archive_lookup)) {
+            fprintf(stderr, "Error: %s is not in the archive\n", archive_lookup);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (graph_lookup) {
+        if (!graph_path) {
+            fprintf(stderr, "Error: --graph-get needs --graph <file>\n");
+            return EXIT_FAILURE;
+        }
+        if (!graph_get(graph_path, graph_lookup)) {
+            fprintf(stderr, "Error: %s is not in the link graph\n", graph_lookup);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (index_lookup) {
+        if (!index_dir) {
+            fprintf(stderr, "Error: --index-query needs --index <dir>\n");
+            return EXIT_FAILURE;
+        }
+        return index_query(index_dir, index_lookup) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (control_command) {
+        if (!control_path) {
+            fprintf(stderr, "Error: --control-send needs --control <socket>\n");
+            return EXIT_FAILURE;
+        }
+        return control_send(control_path, control_command) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // With a seed file the start URL is optional, so a lone number is the maximum depth
+    if (seeds_path && spec && !depth_arg && spec[strspn(spec, "0123456789")] == '\0') {
+        depth_arg = spec;
+        spec = NULL;
+    }
+    if (usage_error || (spec == NULL && !seeds_path) || segment_mb <= 0 || num_threads <= 0 || max_pages < 0 ||
+        topic_min < 0 || num_shards <= 0 || num_shards > SHARD_MAX || (mem_limit && !mem_parse_size(mem_limit)) ||
+        revisit_min <= 0 || revisit_max < revisit_min || revisit_max > INT_MAX / 1000) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (num_fibers && num_shards > 1) {
+        fprintf(stderr, "Error: --fibers cannot be combined with --shards\n");
+        return EXIT_FAILURE;
+    }
+    if ((record_path && replay_path) || (replay_latency && !replay_path)) {
+        fprintf(stderr, "Error: %s\n", replay_latency && !replay_path ? "--replay-latency needs --replay <file>"
+                                                                      : "--record and --replay cannot be combined");
+        return EXIT_FAILURE;
+    }
+    // A replayed crawl fetches from the recording whatever fetcher the program defaults to
+    if (replay_path) {
+        fetcher_name = replay_fetcher.name;
+    }
+
+    // Benchmark mode reruns this crawl under each placement policy, each in its own process
+    if (numa_bench) {
+        return topology_bench(argc, argv, defaults);
+    }
+
+    Crawler crawler;
+    memset(&crawler, 0, sizeof(crawler));
+    const FrontierOps *frontier = frontier_find(frontier_name);
+    crawler.fetcher = fetcher_find(fetcher_name);
+    crawler.extractor = extractor_find(extractor_name);
+    if (!frontier || !crawler.fetcher || !crawler.extractor) {
+        fprintf(stderr, "Error: Unknown %s %s\n", !frontier ? "frontier" : !crawler.fetcher ? "fetcher" : "extractor",
+                !frontier ? frontier_name : !crawler.fetcher ? fetcher_name : extractor_name);
+        return EXIT_FAILURE;
+    }
+    if ((crawler.fetcher == &replay_fetcher && !replay_path) || (record_path && crawler.fetcher != &curl_fetcher)) {
+        fprintf(stderr, "Error: %s\n", record_path ? "--record needs the curl fetcher"
+                                                   : "The replay fetcher needs --replay <file>");
+        return EXIT_FAILURE;
+    }
+
+    // Splitting the input argument into URL and maximum depth
+    char *start_url = spec ? strtok(spec, "|") : NULL;
+    char *depth_str = spec ? strtok(NULL, "|") : NULL;
+    if ((start_url == NULL && !seeds_path) || (depth_str != NULL && depth_arg != NULL)) {
+        fprintf(stderr, "Error: Invalid input format\n");
+        return EXIT_FAILURE;
+    }
+    if (depth_str == NULL) {
+        depth_str = (char *)depth_arg;
+    }
+    crawler.max_depth = depth_str ? atoi(depth_str) : MAX_DEPTH;
+    if (crawler.max_depth <= 0) {
+        fprintf(stderr, "Error: Maximum depth must be a positive integer\n");
+        return EXIT_FAILURE;
+    }
+    crawler.num_threads = num_threads;
+    crawler.fibers = num_fibers;
+    // HTTP/2 over TLS is negotiated per host; h2c assumes every host speaks it in cleartext
+    if (http2) {
+        crawler.http_version = strcmp(http2, "h2c") == 0 ? CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : CURL_HTTP_VERSION_2TLS;
+        // libcurl before 8.0 breaks the second request on a prior-knowledge connection.
+        curl_version_info_data *curl_info = curl_version_info(CURLVERSION_NOW);
+        if (crawler.http_version == CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE && curl_info->version_num < 0x080000) {
+            fprintf(stderr, "Warning: libcurl %s cannot reuse h2c connections; each fetch opens its own\n",
+                    curl_info->version);
+            crawler.fresh_connections = true;
+        }
+    }
+    crawler.max_pages = (unsigned long)max_pages;
+
+    // Ask once for a link filter, instead of once per page as crawler.c used to.
+    char query[100];
+    if (!search && defaults->prompt_search) {
+        printf("Search what you want: ");
+        fflush(stdout);
+        if (fgets(query, sizeof(query), stdin)) {
+            query[strcspn(query, "\r\n")] = '\0';
+            if (query[0] != '\0') {
+                search = query;
+            }
+        }
+    }
+    crawler.search = search;
+    if (filter_path && !(crawler.filter = url_filter_load(filter_path))) {
+        return EXIT_FAILURE;
+    }
+    if (topic_min && !topics_path) {
+        fprintf(stderr, "Error: --topic-min needs --topics <file>\n");
+        return EXIT_FAILURE;
+    }
+    if (topics_path) {
+        if (!(crawler.topics = topics_load(topics_path))) {
+            return EXIT_FAILURE;
+        }
+        crawler.topics->min_hits = (unsigned long)topic_min;
+    }
+
+    // Sharded: fork one process per shard. Each runs the rest of this function on its own queue,
+    // visited set and files, named with a ".<shard>" suffix; the parent only waits.
+    char shard_output[PATH_MAX], shard_errors[PATH_MAX], shard_archive[PATH_MAX], shard_graph[PATH_MAX];
+    char shard_index[PATH_MAX], shard_control[PATH_MAX], shard_replay[PATH_MAX];
+    const char *error_path = "error_log.txt";
+    static Topology topology;
+    if (placement != PLACEMENT_NONE) {
+        if (topology_discover(&topology, placement)) {
+            crawler.topology = &topology;
+        } else {
+            fprintf(stderr, "Warning: Unable to read the CPU topology, workers will not be pinned\n");
+        }
+    }
+    if (num_shards > 1) {
+        crawler.shards = shard_set_create(num_shards, num_threads);
+        if (!crawler.shards) {
+            return EXIT_FAILURE;
+        }
+        int shard = shard_fork(crawler.shards);
+        if (shard == -2) {
+            return EXIT_FAILURE;
+        }
+        if (shard < 0) {
+            return shard_wait(crawler.shards);
+        }
+        if (crawler.topology) {
+            topology_home(crawler.topology, shard);
+        }
+        snprintf(shard_output, sizeof(shard_output), "%s.%d", output_path, shard);
+        snprintf(shard_errors, sizeof(shard_errors), "%s.%d", error_path, shard);
+        output_path = shard_output;
+        error_path = shard_errors;
+        if (archive_dir) {
+            snprintf(shard_archive, sizeof(shard_archive), "%s.%d", archive_dir, shard);
+            archive_dir = shard_archive;
+        }
+        if (graph_path) {
+            snprintf(shard_graph, sizeof(shard_graph), "%s.%d", graph_path, shard);
+            graph_path = shard_graph;
+        }
+        if (index_dir) {
+            snprintf(shard_index, sizeof(shard_index), "%s.%d", index_dir, shard);
+            index_dir = shard_index;
+        }
+        if (control_path) {
+            snprintf(shard_control, sizeof(shard_control), "%s.%d", control_path, shard);
+            control_path = shard_control;
+        }
+        // Each shard records its own share, and replays it with the same shard count
+        if (record_path) {
+            snprintf(shard_replay, sizeof(shard_replay), "%s.%d", record_path, shard);
+            record_path = shard_replay;
+        } else if (replay_path) {
+            snprintf(shard_replay, sizeof(shard_replay), "%s.%d", replay_path, shard);
+            replay_path = shard_replay;
+        }
+    }
+
+    // Offline fetchers never touch the network, so they need neither robots.txt, DNS nor host control.
+    if (!crawler.fetcher->network) {
+        use_robots = false;
+        use_dns_cache = false;
+        use_host_control = false;
+    }
+
+    URLQueue *queue = &crawler.queue;
+    if (crawler.topology) {
+        topology_place_shared(crawler.topology);
+    }
+    // Counting starts before the URL table is created so the frontier's share includes it
+    if (mem_limit) {
+        mem_init(mem_parse_size(mem_limit));
+    }
+    initQueue(queue, frontier);
+    if (mem_limit && !(queue->spill = spill_create())) {
+        return EXIT_FAILURE;
+    }
+    static DnsCache dns;
+    if (use_dns_cache) {
+        ares_library_init(ARES_LIB_INIT_ALL);
+        if (!dns_init(&dns, dns_servers)) {
+            return EXIT_FAILURE;
+        }
+        queue->dns = &dns;
+    }
+    RobotsCache robots;
+    if (use_robots) {
+        robots_init(&robots);
+        robots.dns = queue->dns;
+        queue->robots = &robots;
+    }
+    static HostControl hosts;
+    if (use_host_control) {
+        host_control_init(&hosts, http2 && !crawler.fresh_connections ? h2_streams : HOST_MAX_LIMIT, queue);
+        crawler.hosts = &hosts;
+    }
+
+    // Open the output and error files through the I/O backend, falling back to stdio
+    IoBackend *io = use_uring ? uring_backend_create(output_path, error_path) : NULL;
+    if (use_uring && !io) {
+        fprintf(stderr, "Warning: io_uring unavailable, using stdio\n");
+    }
+    if (!io) {
+        io = stdio_backend_create(output_path, error_path);
+    }
+    if (!io) {
+        record_error("Unable to open output file");
+        return EXIT_FAILURE;
+    }
+    if (!error_log_start(io)) {
+        fprintf(stderr, "Error: Failed to start the error log\n");
+        return EXIT_FAILURE;
+    }
+    crawler.io = io;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    if (record_path || replay_path) {
+        crawler.replay = record_path ? replay_create(record_path) : replay_open(replay_path, replay_latency);
+        if (!crawler.replay) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Set up the sinks: the URL list always, the archive on request
+    crawler.sinks = output_sink_create(io);
+    Archive *archive = NULL;
+    if (archive_dir) {
+        archive = archive_open(archive_dir, segment_mb, io);
+        if (!archive) {
+            return EXIT_FAILURE;
+        }
+        crawler.sinks->next = archive_sink_create(archive);
+    }
+    // The priority frontier ranks the link graph, so capture it even if it isn't saved
+    if (graph_path || frontier->rescore) {
+        crawler.graph = graph_create(queue->urls);
+    }
+    if (graph_path) {
+        Sink *sink = graph_sink_create(crawler.graph, graph_path);
+        sink->next = crawler.sinks;
+        crawler.sinks = sink;
+    }
+    if (index_dir) {
+        if (!(crawler.index = index_open(index_dir))) {
+            return EXIT_FAILURE;
+        }
+        Sink *sink = index_sink_create(crawler.index);
+        sink->next = crawler.sinks;
+        crawler.sinks = sink;
+    }
+    PageRank ranker;
+    if (frontier->rescore && !pagerank_start(&ranker, crawler.graph, queue, PAGERANK_THREADS)) {
+        return EXIT_FAILURE;
+    }
+    for (Sink *sink = crawler.sinks; sink; sink = sink->next) {
+        crawler.capture |= sink->capture;
+    }
+
+    // Add starting URL to the queue of the shard that owns it
+    if (start_url &&
+        (!crawler.shards || shard_of(crawler.shards, start_url, strlen(start_url)) == crawler.shards->self)) {
+        enqueue(queue, start_url, 0);
+    }
+    // Bulk-load the seed list; each shard keeps the seeds it owns
+    if (seeds_path) {
+        SeedStats seeds;
+        if (!seeds_load(&crawler, seeds_path, num_threads, &seeds)) {
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Seeds: %lu loaded from %lu lines (%lu duplicate, %lu invalid, %lu filtered%s) in %.3f s, %.1f MiB\n",
+                seeds.loaded, seeds.lines, seeds.duplicates, seeds.invalid, seeds.filtered,
+                crawler.shards ? ", others sharded" : "", seeds.seconds, seeds.bytes / 1048576.0);
+    }
+
+    // Live stats and commands over a local socket while the crawl runs
+    atomic_store(&crawler.worker_limit, num_fibers ? num_fibers : num_threads);
+    ControlServer *control = NULL;
+    if (control_path && !(control = control_start(&crawler, control_path, num_fibers ? num_fibers : num_threads))) {
+        return EXIT_FAILURE;
+    }
+
+    // Continuous crawl: fetched pages come round again until the time is up
+    if (recrawl_s && !(crawler.recrawl = recrawl_start(queue, recrawl_s, revisit_min, revisit_max))) {
+        return EXIT_FAILURE;
+    }
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    FiberScheduler *scheduler = NULL;
+    if (num_fibers) {
+        // Fiber mode: the threads run every fetch as a fiber on their own event loops
+        scheduler = fiber_scheduler_create(num_threads, num_fibers, &crawl_fiber_hooks, &crawler);
+        if (scheduler && http2) {
+            fiber_scheduler_multiplex(scheduler, crawler.fresh_connections ? 0 : h2_streams);
+        }
+        if (!scheduler || !fiber_scheduler_run(scheduler)) {
+            record_error("Failed to start the fiber scheduler");
+            return EXIT_FAILURE;
+        }
+    }
+    pthread_t *threads = num_fibers ? NULL : (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    if (!num_fibers && !threads) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Create worker threads
+    for (int i = 0; !num_fibers && i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, crawl_worker, (void *)&crawler) != 0) {
+            record_error("Failed to create thread");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Join threads after completion
+    for (int i = 0; !num_fibers && i < num_threads; i++) {
+        if (pthread_join(threads[i], NULL) != 0) {
+            record_error("Failed to join thread");
+            return EXIT_FAILURE;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    free(threads);
+    if (control) {
+        fprintf(stderr, "Control: %lu commands served on %s\n", atomic_load(&control->commands), control->path);
+        control_stop(control);
+    }
+    if (crawler.recrawl) {
+        fprintf(stderr, "Recrawl: %lu revisits, %lu found changed, %lu still scheduled\n",
+                atomic_load(&crawler.recrawl->revisits), atomic_load(&crawler.recrawl->changed),
+                atomic_load(&crawler.recrawl->pending));
+        recrawl_stop(crawler.recrawl);
+    }
+    if (frontier->rescore) {
+        pagerank_stop(&ranker);
+        fprintf(stderr, "PageRank rounds: %lu, last round: %.3f ms\n", atomic_load(&ranker.rounds),
+                atomic_load(&ranker.round_ns) / 1e6);
+    }
+
+    // Close the sinks, drain pending writes and close the output file
+    while (crawler.sinks) {
+        Sink *sink = crawler.sinks;
+        crawler.sinks = sink->next;
+        sink->close(sink);
+    }
+    error_log_stop();
+    io->shutdown(io);
+    if (archive) {
+        archive_close(archive);
+    }
+
+    if (crawler.shards) {
+        fprintf(stderr, "Shard %d of %d: links forwarded: %lu, received: %lu\n", crawler.shards->self,
+                crawler.shards->shards, atomic_load(&crawler.shards->sent), atomic_load(&crawler.shards->received));
+    }
+    print_stats(&crawler.stats, queue->urls, (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9);
+    fprintf(stderr, "Strategies: extractor %s, fetcher %s, frontier %s\n", crawler.extractor->name,
+            crawler.fetcher->name, frontier->name);
+    if (crawler.replay) {
+        if (record_path) {
+            fprintf(stderr, "Recorded: %zu responses, %.1f MiB in %s\n", crawler.replay->count,
+                    crawler.replay->size / 1048576.0, record_path);
+        } else {
+            fprintf(stderr, "Replayed: %lu responses from %s, not recorded: %lu\n", atomic_load(&crawler.replay->served),
+                    replay_path, atomic_load(&crawler.replay->missing));
+        }
+        replay_close(crawler.replay);
+    }
+    if (crawler.fetcher->network) {
+        fprintf(stderr, "Connections opened by page fetches: %lu, HTTP/2 responses: %lu\n", atomic_load(&crawler.stats.connects),
+                atomic_load(&crawler.stats.http2));
+    }
+    if (crawler.topology) {
+        fprintf(stderr, "Placement: %s, %d CPUs on %d NUMA nodes\n", placement_name(placement), topology.cpus,
+                topology.nodes);
+    }
+    if (scheduler) {
+        fprintf(stderr, "Fibers: %lu on %d threads, peak transfers in flight: %d, steals: %lu\n",
+                atomic_load(&scheduler->created), num_threads, atomic_load(&scheduler->peak_in_flight),
+                atomic_load(&scheduler->steals));
+        fiber_scheduler_free(scheduler);
+    }
+    if (use_robots) {
+        fprintf(stderr, "robots.txt fetched: %lu, URLs disallowed: %lu\n", atomic_load(&robots.fetched),
+                atomic_load(&robots.denied));
+        robots_free(&robots);
+    }
+    if (use_dns_cache) {
+        fprintf(stderr, "DNS lookups: %lu, cache hits: %lu, negative hits: %lu, waits: %lu\n",
+                atomic_load(&dns.lookups), atomic_load(&dns.hits), atomic_load(&dns.negative_hits),
+                atomic_load(&dns.waits));
+        dns_free(&dns);
+        ares_library_cleanup();
+    }
+    if (use_host_control) {
+        fprintf(stderr, "Hosts: %lu, fetches deferred: %lu, limit raised: %lu, cut: %lu\n",
+                atomic_load(&hosts.hosts), atomic_load(&hosts.deferred), atomic_load(&hosts.increases),
+                atomic_load(&hosts.decreases));
+        host_control_free(&hosts);
+    }
+    if (mem_limit) {
+        MemStats mem;
+        mem_stats(&mem);
+        fprintf(stderr, "Memory: limit %.1f MiB, peak %.1f MiB (frontier %.1f, buffers %.1f, parser %.1f, caches %.1f, "
+                        "output %.1f at exit), soft: %lu, hard: %lu, frontier spilled: %lu\n",
+                mem.limit / 1048576.0, mem.peak / 1048576.0, mem.current[MEM_FRONTIER] / 1048576.0,
+                mem.current[MEM_BUFFERS] / 1048576.0, mem.current[MEM_PARSER] / 1048576.0,
+                mem.current[MEM_CACHES] / 1048576.0, mem.current[MEM_OUTPUT] / 1048576.0, mem.soft, mem.hard,
+                queue->spill->total);
+    }
+    if (crawler.index) {
+        index_close(crawler.index);
+        fprintf(stderr, "Index: %lu pages, %lu postings, segments written: %lu, merged: %lu, %.1f MiB\n",
+                atomic_load(&crawler.index->pages), atomic_load(&crawler.index->postings),
+                atomic_load(&crawler.index->written), atomic_load(&crawler.index->merged),
+                atomic_load(&crawler.index->bytes) / 1048576.0);
+        index_free(crawler.index);
+    }
+    if (crawler.topics) {
+        fprintf(stderr, "Topics: %zu keywords, pages matched: %lu of %lu, hits: %lu, pages not expanded: %lu\n",
+                crawler.topics->count, atomic_load(&crawler.topics->matched), atomic_load(&crawler.topics->pages),
+                atomic_load(&crawler.topics->hits), atomic_load(&crawler.topics->unexpanded));
+        topics_free(crawler.topics);
+    }
+    if (crawler.filter) {
+        fprintf(stderr, "Filter: %zu rules, %u states, URLs rejected: %lu\n", crawler.filter->rule_count,
+                crawler.filter->states, atomic_load(&crawler.filter->rejected));
+        url_filter_free(crawler.filter);
+    }
+    if (crawler.graph) {
+        graph_free(crawler.graph);
+    }
+    freeQueue(queue);
+    curl_global_cleanup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+// Shared crawler core: queue, engine and the pluggable frontier, fetcher, extractor and sink interfaces.
+//
+// Every crawler program is a thin main() around crawler_main() and links the same modules:
+//   gcc -o WC WC.c crawler_core.c fetcher.c extractors.c archive.c io_backend.c error_log.c robots.c
+//       dns_cache.c url_table.c link_graph.c pagerank.c host_control.c shard.c
+//       topology.c fiber.c seeds.c url_filter.c topic.c index.c memory.c control.c replay.c
+//       recrawl.c
+//       -I/usr/include/libxml2
+//       -lcurl -lxml2 -lz -lbrotlidec -lcares -lpthread -lm
+#ifndef CRAWLER_CORE_H
+#define CRAWLER_CORE_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <curl/curl.h>
+
+#define MAX_URL_LENGTH 1024
+#define MAX_DEPTH 10                // Used when a program is started with a bare URL
+#define NUM_THREADS 4
+#define DECODE_CHUNK 16384
+
+#define BODY_BLOCK_SIZE 65536
+#define BODY_MAX_BLOCKS 512         // Captured bodies are capped at 32 MiB
+
+#define CRAWLER_USER_AGENT "WC-crawler/1.0"
+
+#define FETCH_CONNECT_TIMEOUT_MS 10000  // Defaults for every transfer; per-host control only tightens them
+#define FETCH_TIMEOUT_MS 120000
+#define FETCH_LOW_SPEED_LIMIT 1024      // Bytes/s below which a transfer counts as stalled
+#define FETCH_LOW_SPEED_TIME 30         // Seconds a transfer may stall
+#define HTTP2_STREAMS 64                // Default streams per host over HTTP/2
+
+#define STATS_BUCKETS 16                // Power-of-two histogram buckets; the last one is open-ended
+
+struct IoBackend;
+struct Archive;
+struct RobotsCache;
+struct DnsCache;
+struct UrlTable;
+struct LinkGraph;
+struct GraphWriter;
+struct HostControl;
+struct ShardSet;
+struct UrlFilter;
+struct Topics;
+struct TopicScan;
+struct Index;
+struct IndexPage;
+struct Topology;
+struct ReplayStore;
+struct Recrawl;
+struct Worker;
+struct LinkBatch;
+
+// Structure for queue elements.
+typedef struct URLQueueNode {
+    uint32_t id;                 // Interned URL
+    int depth;                   // Links away from the seed
+    struct URLQueueNode *next;
+} URLQueueNode;
+
+// Ordering policy of the frontier. push, pop and rescore run with the queue lock held.
+typedef struct {
+    const char *name;
+    void *(*create)(void);
+    void (*push)(void *state, URLQueueNode *node);
+    URLQueueNode *(*pop)(void *state);
+    void (*destroy)(void *state);
+    void (*rescore)(void *state, const float *scores, uint32_t count); // NULL if scores don't matter
+    size_t (*list)(void *state, uint32_t *ids, size_t max); // Copy out up to max queued IDs
+} FrontierOps;
+
+// A URL held out of the frontier until it is due.
+typedef struct {
+    uint64_t due_ms;
+    uint32_t id;
+    int depth;
+} FrontierHeld;
+
+// Structure for a thread-safe queue.
+typedef struct {
+    const FrontierOps *ops;
+    void *state;
+    pthread_mutex_t lock;
+    atomic_size_t size;          // URLs waiting in the frontier; changed under the lock, read without
+    atomic_int active;           // URLs dequeued but not finished yet
+    struct UrlTable *urls;       // Every URL ever queued, also the visited set
+    struct RobotsCache *robots;  // NULL when robots.txt is ignored
+    struct DnsCache *dns;        // NULL when cURL resolves names itself
+    struct FrontierSpill *spill; // NULL unless a memory limit is set
+    FrontierHeld *held;          // Min-heap on due time; held URLs count as active
+    size_t held_count, held_cap;
+    int parked;                  // Active URLs parked outside the queue, such as on a busy host
+    atomic_ullong held_due_ms;   // Earliest due time, UINT64_MAX when nothing is held
+} URLQueue;
+
+// New URLs gathered to be spliced into the frontier together.
+typedef struct {
+    URLQueueNode *head, *tail;
+    size_t count;
+} FrontierBatch;
+
+// Crawl-wide counters, updated lock-free by the workers.
+typedef struct {
+    atomic_ulong pages;
+    atomic_ulong links;        // Links handed to the frontier
+    atomic_ulong wire_bytes;   // Body bytes as received, possibly compressed
+    atomic_ulong body_bytes;   // Body bytes after decompression
+    atomic_ulong decode_ns;    // Thread CPU time spent decompressing
+    atomic_ulong extract_ns;   // Thread CPU time spent in the extractor
+    atomic_int in_flight;      // Fetches in progress
+    atomic_ulong connects;     // Connections the fetches opened
+    atomic_ulong http2;        // Responses that came over HTTP/2
+    atomic_ulong fetch_ms[STATS_BUCKETS];  // Fetch times: bucket b counts [2^(b-1), 2^b) ms, 0 in bucket 0
+    atomic_ulong body_kb[STATS_BUCKETS];   // Bodies as received, bucketed the same way in KiB
+} CrawlStats;
+
+// A response body kept as it arrived, in fixed-size blocks, so it can be archived with one pwritev.
+typedef struct {
+    char *blocks[BODY_MAX_BLOCKS];
+    size_t used[BODY_MAX_BLOCKS];
+    int count;      // Blocks holding data for the current body
+    int allocated;  // Blocks allocated so far; reused across fetches
+    size_t total;
+    bool truncated;
+} BodyChain;
+
+// Content codings we can decode ourselves.
+typedef enum {
+    ENCODING_IDENTITY,
+    ENCODING_ZLIB,   // gzip and deflate, told apart by inflate's header detection
+    ENCODING_BROTLI,
+    ENCODING_ZSTD
+} ContentEncoding;
+
+// Receives each link an extractor finds; `url` is not NUL-terminated.
+typedef void (*LinkEmitter)(void *arg, const char *url, size_t len);
+
+// Link extraction strategy, fed the decoded body one chunk at a time.
+typedef struct {
+    const char *name;
+    void *(*create)(LinkEmitter emit, void *arg);
+    void (*begin)(void *state, const char *page_url);
+    void (*feed)(void *state, const char *data, size_t len);
+    void (*end)(void *state);
+    void (*destroy)(void *state);
+} ExtractorOps;
+
+// What a fetcher reports about one page.
+typedef struct {
+    const char *url;
+    uint32_t url_id;
+    long status;
+    CURLcode error;              // CURLE_OK unless the transfer failed
+    ContentEncoding encoding;
+    const char *headers;         // Raw response headers, only when the crawl captures responses
+    size_t headers_len;
+    BodyChain *body;             // Raw body as received, only when the crawl captures responses
+    BodyChain *scratch;          // Spare chain a sink may use while handling this page
+    long connect_timeout_ms;     // Per-host limits set before the fetch, 0 for the defaults
+    long timeout_ms;
+    long low_speed_time;
+    size_t wire_len;             // Body bytes as received
+    bool topic_scanned;          // Keyword hits below were counted
+    unsigned long topic_hits;
+    unsigned int topic_terms;    // Distinct keywords among the hits
+    struct IndexPage *index_page; // Words of the page, only when the crawl is indexed
+} FetchResult;
+
+// Page fetching strategy. fetch() streams the decoded body into the worker's extractor.
+typedef struct {
+    const char *name;
+    bool network;                // Needs robots.txt and DNS
+    void *(*create)(struct Worker *worker);
+    void (*fetch)(void *state, const char *url, FetchResult *result);
+    void (*destroy)(void *state);
+} FetcherOps;
+
+// Consumer of fetched pages, called concurrently from the workers.
+typedef struct Sink {
+    const char *name;
+    bool capture;                // Needs the raw headers and body
+    void (*page)(struct Sink *sink, const FetchResult *result);
+    void (*close)(struct Sink *sink);
+    struct Sink *next;
+} Sink;
+
+// One crawl: the queue, the selected strategies and everything the workers share.
+typedef struct Crawler {
+    URLQueue queue;
+    const FetcherOps *fetcher;
+    const ExtractorOps *extractor;
+    Sink *sinks;
+    bool capture;                // Some sink needs raw responses
+    struct IoBackend *io;
+    CrawlStats stats;
+    int max_depth;
+    int num_threads;
+    const char *search;          // Only follow links containing this, if set
+    struct UrlFilter *filter;    // Scope rules links must pass to be followed, NULL if none
+    struct Topics *topics;       // Keywords counted in page text, NULL if none
+    struct Index *index;         // Inverted index of page text, NULL if not built
+    struct LinkGraph *graph;     // NULL unless the link graph is captured
+    unsigned long max_pages;     // Fetch budget, 0 for none
+    struct HostControl *hosts;   // Per-host concurrency and timeouts, NULL if off
+    struct ShardSet *shards;     // Set in a shard process of a sharded crawl
+    struct Topology *topology;   // CPU and memory placement of the workers, NULL if they float
+    atomic_int next_worker;
+    int fibers;                  // Fetches in progress at once in fiber mode, 0 for one per thread
+    long http_version;           // CURL_HTTP_VERSION_* for page fetches, 0 for cURL's default
+    bool fresh_connections;      // Open a connection per fetch, for h2c on a libcurl that can't reuse one
+    struct ReplayStore *replay;  // Responses recorded by the cURL fetcher or served by the replay fetcher, if set
+    struct Recrawl *recrawl;     // Schedules revisits of fetched pages in a continuous crawl, NULL if off
+    atomic_int robots_tasks;     // Fiber tasks claimed for robots.txt fetches but not started yet
+    atomic_bool paused;          // Workers take no new URLs while set
+    atomic_int worker_limit;     // Workers, or fibers in fiber mode, allowed to take URLs
+    atomic_int tasks;            // Fiber tasks claimed and not finished
+    atomic_uint checkpoint;      // Checkpoints taken over the control socket
+} Crawler;
+
+// State of a crawl worker: a thread, or a fiber in fiber mode.
+typedef struct Worker {
+    Crawler *crawler;
+    const ExtractorOps *extractor;
+    void *extractor_state;
+    int depth;                   // Depth of the page being fetched
+    uint32_t page_id;            // URL ID of the page being fetched
+    struct GraphWriter *edges;   // This worker's link graph buffer, if captured
+    int slot;                    // Index among the crawl's workers: its CPU and outbound shard rings
+    void *fetcher;               // The fetcher's per-worker state
+    CURL *robots_curl;           // For robots.txt fetches, created on first use
+    struct LinkBatch *links;     // Links found on the page being fetched
+    struct TopicScan *topics;    // Keyword scan of the page being fetched, if keywords are set
+    struct IndexPage *index_page; // Words of the page being fetched, if the crawl is indexed
+    uint64_t digest;             // Of the decoded body of the page being fetched, in a continuous crawl
+} Worker;
+
+// Strategy choices of a crawler program; all can be overridden on the command line.
+typedef struct {
+    const char *extractor;
+    const char *fetcher;
+    const char *frontier;
+    const char *output_path;
+    bool prompt_search;          // Ask for a link filter on stdin when none is given
+} CrawlerDefaults;
+
+// Queue and frontier.
+void initQueue(URLQueue *queue, const FrontierOps *ops);
+void frontier_push(URLQueue *queue, URLQueueNode *newNode);
+bool frontier_batch_add(URLQueue *queue, FrontierBatch *batch, const char *url, size_t len, int depth, uint32_t *id);
+void frontier_batch_push(URLQueue *queue, FrontierBatch *batch);
+bool enqueue_link(URLQueue *queue, const char *url, size_t len, int depth, uint32_t *id);
+void enqueue(URLQueue *queue, const char *url, int depth);
+uint32_t dequeue(URLQueue *queue, int *depth);
+void frontier_hold(URLQueue *queue, uint32_t id, int depth, uint64_t due_ms);
+void frontier_park(URLQueue *queue);
+void frontier_unpark(URLQueue *queue, URLQueueNode *node);
+void frontier_begin(URLQueue *queue);
+void frontier_done(URLQueue *queue);
+bool frontier_idle(URLQueue *queue);
+void frontier_rescore(URLQueue *queue, const float *scores, uint32_t count);
+uint32_t *frontier_snapshot(URLQueue *queue, size_t *count);
+void freeQueue(URLQueue *queue);
+
+// Strategy registries.
+const FrontierOps *frontier_find(const char *name);
+const FetcherOps *fetcher_find(const char *name);
+const ExtractorOps *extractor_find(const char *name);
+extern const FetcherOps curl_fetcher, static_fetcher, replay_fetcher;
+extern const ExtractorOps regex_extractor, strstr_extractor, libxml2_extractor, libxml2_sax_extractor;
+
+// Helpers shared by the modules.
+uint64_t url_hash(const char *url);
+void url_host(const char *url, char *host, size_t size);
+bool url_origin(const char *url, char *origin, size_t size, const char **path);
+bool url_host_port(const char *url, char *host, size_t size, int *port);
+size_t url_normalize(const char *url, size_t len, char *out, size_t size);
+uint64_t now_ms(void);
+unsigned long thread_cpu_ns(void);
+void body_reset(BodyChain *chain);
+void body_append(BodyChain *chain, const char *data, size_t len);
+void body_free(BodyChain *chain);
+
+// Engine.
+int crawler_main(int argc, char *argv[], const CrawlerDefaults *defaults);
+bool crawler_fetch_page(const char *url, const char *extractor, const char *record_path, const char *replay_path,
+                        LinkEmitter emit, void *arg);
+
+#endif
@@ -0,0 +1,321 @@
+#include "crawler_core.h"
+#include "dns_cache.h"
+#include "fiber.h"
+#include "memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define DNS_HOST_LENGTH 256
+#define DNS_ADDRESS_LENGTH 512
+#define DNS_MIN_TTL 5               // Seconds; very short TTLs would defeat the cache
+#define DNS_MAX_TTL 3600
+#define DNS_NEGATIVE_TTL 60
+#define DNS_WAIT_SECONDS 10         // After this a worker lets cURL resolve the name itself
+
+// Resolution state of a cached host name.
+typedef enum {
+    DNS_PENDING,   // Lookup queued or running
+    DNS_READY,     // `addresses` holds the answer
+    DNS_FAILED     // Negative entry: the name didn't resolve
+} DnsState;
+
+// Cached answer for one host name.
+typedef struct DnsEntry {
+    struct DnsEntry *next;           // Bucket chain
+    struct DnsEntry *next_request;   // Resolver work list
+    struct DnsCache *cache;
+    DnsState state;
+    bool refreshing;                 // A lookup is queued for a stale entry
+    uint64_t expires_ms;
+    char host[DNS_HOST_LENGTH];
+    char addresses[DNS_ADDRESS_LENGTH]; // "addr,addr,[v6addr]" as CURLOPT_RESOLVE expects
+} DnsEntry;
+
+// c-ares completion: store the answer (or a negative entry) and wake any waiting worker.
+static void dns_callback(void *arg, int status, int timeouts, struct ares_addrinfo *result) {
+    (void)timeouts;
+    DnsEntry *entry = (DnsEntry *)arg;
+    DnsCache *cache = entry->cache;
+
+    char addresses[DNS_ADDRESS_LENGTH];
+    size_t len = 0;
+    int ttl = DNS_MAX_TTL;
+    if (status == ARES_SUCCESS && result) {
+        for (struct ares_addrinfo_node *node = result->nodes; node; node = node->ai_next) {
+            char text[INET6_ADDRSTRLEN];
+            const void *addr = node->ai_family == AF_INET6
+                                   ? (const void *)&((struct sockaddr_in6 *)node->ai_addr)->sin6_addr
+                                   : (const void *)&((struct sockaddr_in *)node->ai_addr)->sin_addr;
+            if (!inet_ntop(node->ai_family, addr, text, sizeof(text))) {
+                continue;
+            }
+            int n = snprintf(addresses + len, sizeof(addresses) - len, node->ai_family == AF_INET6 ? "%s[%s]" : "%s%s",
+                             len ? "," : "", text);
+            if (n < 0 || (size_t)n >= sizeof(addresses) - len) {
+                break;
+            }
+            len += n;
+            if (node->ai_ttl < ttl) {
+                ttl = node->ai_ttl;
+            }
+        }
+    }
+    if (result) {
+        ares_freeaddrinfo(result);
+    }
+    if (ttl < DNS_MIN_TTL) {
+        ttl = DNS_MIN_TTL;
+    }
+
+    uint64_t hash = url_hash(entry->host);
+    pthread_mutex_t *lock = &cache->locks[hash % DNS_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    if (len > 0) {
+        memcpy(entry->addresses, addresses, len + 1);
+        entry->state = DNS_READY;
+        entry->expires_ms = now_ms() + (uint64_t)ttl * 1000;
+    } else {
+        // Also on a failed refresh: callers stop using the stale answer.
+        entry->addresses[0] = '\0';
+        entry->state = DNS_FAILED;
+        entry->expires_ms = now_ms() + DNS_NEGATIVE_TTL * 1000;
+    }
+    entry->refreshing = false;
+    pthread_cond_broadcast(&cache->resolved[hash % DNS_LOCK_STRIPES]);
+    pthread_mutex_unlock(lock);
+}
+
+// Resolver thread: hands queued names to c-ares and drives its sockets.
+static void *dns_thread(void *arg) {
+    DnsCache *cache = (DnsCache *)arg;
+    struct ares_addrinfo_hints hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = ARES_AI_NOSORT;
+
+    while (!atomic_load(&cache->stopping)) {
+        pthread_mutex_lock(&cache->request_lock);
+        DnsEntry *requests = cache->request_head;
+        cache->request_head = NULL;
+        pthread_mutex_unlock(&cache->request_lock);
+        while (requests) {
+            DnsEntry *entry = requests;
+            requests = requests->next_request;
+            ares_getaddrinfo(cache->channel, entry->host, NULL, &hints, dns_callback, entry);
+        }
+
+        // poll() rather than select(): with thousands of transfers open, c-ares sockets can
+        // land above FD_SETSIZE.
+        ares_socket_t sockets[ARES_GETSOCK_MAXNUM];
+        int bits = ares_getsock(cache->channel, sockets, ARES_GETSOCK_MAXNUM);
+        struct pollfd fds[ARES_GETSOCK_MAXNUM + 1];
+        nfds_t nfds = 0;
+        for (int i = 0; i < ARES_GETSOCK_MAXNUM; i++) {
+            if (ARES_GETSOCK_READABLE(bits, i) || ARES_GETSOCK_WRITABLE(bits, i)) {
+                fds[nfds].fd = sockets[i];
+                fds[nfds].events = (ARES_GETSOCK_READABLE(bits, i) ? POLLIN : 0) |
+                                   (ARES_GETSOCK_WRITABLE(bits, i) ? POLLOUT : 0);
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+        }
+        fds[nfds].fd = cache->wake_pipe[0];
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        struct timeval max_wait = {0, 100000};
+        struct timeval tv;
+        struct timeval *timeout = ares_timeout(cache->channel, &max_wait, &tv);
+        int wait_ms = (int)(timeout->tv_sec * 1000 + timeout->tv_usec / 1000);
+        if (poll(fds, nfds + 1, wait_ms) < 0 && errno != EINTR) {
+            perror("Error: poll failed in DNS resolver");
+            break;
+        }
+        if (fds[nfds].revents & POLLIN) {
+            char drain[64];
+            while (read(cache->wake_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        bool ready = false;
+        for (nfds_t i = 0; i < nfds; i++) {
+            ares_socket_t readable = fds[i].revents & (POLLIN | POLLERR | POLLHUP) ? fds[i].fd : ARES_SOCKET_BAD;
+            ares_socket_t writable = fds[i].revents & POLLOUT ? fds[i].fd : ARES_SOCKET_BAD;
+            if (readable != ARES_SOCKET_BAD || writable != ARES_SOCKET_BAD) {
+                ares_process_fd(cache->channel, readable, writable);
+                ready = true;
+            }
+        }
+        if (!ready) {
+            ares_process_fd(cache->channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD); // Timeouts
+        }
+    }
+    return NULL;
+}
+
+// Queue a name for the resolver thread. Call with the entry's stripe lock held.
+static void dns_request(DnsCache *cache, DnsEntry *entry) {
+    pthread_mutex_lock(&cache->request_lock);
+    entry->next_request = cache->request_head;
+    cache->request_head = entry;
+    pthread_mutex_unlock(&cache->request_lock);
+    if (write(cache->wake_pipe[1], "x", 1) < 0 && errno != EAGAIN) {
+        perror("Error: Unable to wake DNS resolver");
+    }
+}
+
+// Find the entry for a host, creating and queueing it if needed. Call with the stripe lock held.
+static DnsEntry *dns_entry(DnsCache *cache, const char *host, uint64_t hash) {
+    DnsEntry **bucket = &cache->buckets[hash % DNS_BUCKETS];
+    for (DnsEntry *entry = *bucket; entry; entry = entry->next) {
+        if (strcmp(entry->host, host) == 0) {
+            return entry;
+        }
+    }
+    DnsEntry *entry = (DnsEntry *)calloc(1, sizeof(DnsEntry));
+    if (!entry) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    mem_account(MEM_CACHES, sizeof(DnsEntry));
+    snprintf(entry->host, sizeof(entry->host), "%s", host);
+    entry->cache = cache;
+    entry->state = DNS_PENDING;
+    entry->next = *bucket;
+    *bucket = entry;
+    atomic_fetch_add(&cache->lookups, 1);
+    dns_request(cache, entry);
+    return entry;
+}
+
+// Start resolving a URL's host in the background. Called as URLs enter the frontier.
+void dns_prefetch(DnsCache *cache, const char *url) {
+    char host[DNS_HOST_LENGTH];
+    int port;
+    if (!url_host_port(url, host, sizeof(host), &port)) {
+        return;
+    }
+    uint64_t hash = url_hash(host);
+    pthread_mutex_t *lock = &cache->locks[hash % DNS_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    DnsEntry *entry = dns_entry(cache, host, hash);
+    if (entry->state != DNS_PENDING && !entry->refreshing && now_ms() >= entry->expires_ms) {
+        entry->refreshing = true;
+        atomic_fetch_add(&cache->lookups, 1);
+        dns_request(cache, entry);
+    }
+    pthread_mutex_unlock(lock);
+}
+
+// Point a cURL handle at the cached addresses for a URL's host. Returns the list to free after
+// the transfer (NULL if cURL should resolve the name itself). Sets *failed for negative entries.
+struct curl_slist *dns_apply(DnsCache *cache, CURL *curl, const char *url, bool *failed) {
+    *failed = false;
+    char host[DNS_HOST_LENGTH];
+    int port;
+    if (!url_host_port(url, host, sizeof(host), &port) || host[0] == '[') {
+        return NULL;
+    }
+    uint64_t hash = url_hash(host);
+    pthread_mutex_t *lock = &cache->locks[hash % DNS_LOCK_STRIPES];
+    pthread_mutex_lock(lock);
+    DnsEntry *entry = dns_entry(cache, host, hash);
+    if (entry->state == DNS_PENDING) {
+        atomic_fetch_add(&cache->waits, 1);
+        if (fiber_active()) {
+            // A fiber polls instead, so the other fibers on its thread keep running.
+            uint64_t give_up = now_ms() + DNS_WAIT_SECONDS * 1000;
+            while (entry->state == DNS_PENDING && now_ms() < give_up) {
+                pthread_mutex_unlock(lock);
+                fiber_sleep_ms(1);
+                pthread_mutex_lock(lock);
+            }
+        } else {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += DNS_WAIT_SECONDS;
+            while (entry->state == DNS_PENDING &&
+                   pthread_cond_timedwait(&cache->resolved[hash % DNS_LOCK_STRIPES], lock, &deadline) == 0) {
+            }
+        }
+    } else {
+        atomic_fetch_add(entry->state == DNS_READY ? &cache->hits : &cache->negative_hits, 1);
+    }
+
+    // Stale answers are still used while a refresh runs in the background.
+    if (entry->state != DNS_PENDING && !entry->refreshing && now_ms() >= entry->expires_ms) {
+        entry->refreshing = true;
+        atomic_fetch_add(&cache->lookups, 1);
+        dns_request(cache, entry);
+    }
+
+    struct curl_slist *resolve = NULL;
+    if (entry->state == DNS_READY) {
+        char line[DNS_HOST_LENGTH + DNS_ADDRESS_LENGTH + 16];
+        snprintf(line, sizeof(line), "%s:%d:%s", host, port, entry->addresses);
+        resolve = curl_slist_append(NULL, line);
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+    } else if (entry->state == DNS_FAILED) {
+        *failed = true;
+    }
+    pthread_mutex_unlock(lock);
+    return resolve;
+}
+
+// Set up the cache and its resolver thread. `servers` is an optional "host:port,..." list.
+bool dns_init(DnsCache *cache, const char *servers) {
+    memset(cache, 0, sizeof(*cache));
+    if (ares_init(&cache->channel) != ARES_SUCCESS) {
+        fprintf(stderr, "Error: Unable to initialize c-ares\n");
+        return false;
+    }
+    if (servers && ares_set_servers_ports_csv(cache->channel, servers) != ARES_SUCCESS) {
+        fprintf(stderr, "Error: Invalid DNS server list: %s\n", servers);
+        ares_destroy(cache->channel);
+        return false;
+    }
+    if (pipe(cache->wake_pipe) != 0) {
+        perror("Error: Unable to create DNS wake pipe");
+        ares_destroy(cache->channel);
+        return false;
+    }
+    fcntl(cache->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(cache->wake_pipe[1], F_SETFL, O_NONBLOCK);
+    for (int i = 0; i < DNS_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&cache->locks[i], NULL);
+        pthread_cond_init(&cache->resolved[i], NULL);
+    }
+    pthread_mutex_init(&cache->request_lock, NULL);
+    if (pthread_create(&cache->thread, NULL, dns_thread, cache) != 0) {
+        fprintf(stderr, "Error: Failed to create DNS resolver thread\n");
+        return false;
+    }
+    return true;
+}
+
+// Stop the resolver thread and free the cache.
+void dns_free(DnsCache *cache) {
+    atomic_store(&cache->stopping, true);
+    if (write(cache->wake_pipe[1], "x", 1) < 0) {
+        perror("Error: Unable to wake DNS resolver");
+    }
+    pthread_join(cache->thread, NULL);
+    ares_destroy(cache->channel); // Runs outstanding callbacks with ARES_EDESTRUCTION
+    close(cache->wake_pipe[0]);
+    close(cache->wake_pipe[1]);
+    for (int i = 0; i < DNS_BUCKETS; i++) {
+        DnsEntry *entry = cache->buckets[i];
+        while (entry) {
+            DnsEntry *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    for (int i = 0; i < DNS_LOCK_STRIPES; i++) {
+        pthread_mutex_destroy(&cache->locks[i]);
+        pthread_cond_destroy(&cache->resolved[i]);
+    }
+    pthread_mutex_destroy(&cache->request_lock);
+}
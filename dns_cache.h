@@ -0,0 +1,32 @@
+// Process-wide DNS cache fed by one c-ares resolver thread.
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#include <ares.h>
+#include "crawler_core.h"
+
+#define DNS_BUCKETS 4096
+#define DNS_LOCK_STRIPES 64
+
+struct DnsEntry;
+
+// Process-wide DNS cache fed by one c-ares resolver thread.
+typedef struct DnsCache {
+    struct DnsEntry *buckets[DNS_BUCKETS];
+    pthread_mutex_t locks[DNS_LOCK_STRIPES];
+    pthread_cond_t resolved[DNS_LOCK_STRIPES];
+    pthread_mutex_t request_lock;
+    struct DnsEntry *request_head;          // Names waiting to be sent to c-ares
+    int wake_pipe[2];                // Wakes the resolver thread out of poll()
+    ares_channel channel;
+    pthread_t thread;
+    atomic_bool stopping;
+    atomic_ulong lookups, hits, negative_hits, waits;
+} DnsCache;
+
+bool dns_init(DnsCache *cache, const char *servers);
+void dns_free(DnsCache *cache);
+void dns_prefetch(DnsCache *cache, const char *url);
+struct curl_slist *dns_apply(DnsCache *cache, CURL *curl, const char *url, bool *failed);
+
+#endif
@@ -0,0 +1,249 @@
+#include "crawler_core.h"
+#include "error_log.h"
+#include <time.h>
+
+#define ERROR_RING_SIZE 1024        // Per-thread error records awaiting the flusher (power of two)
+#define ERROR_LIMIT_SLOTS 256       // Per-thread (host, code) rate limiter slots
+#define ERROR_BURST 5               // Records per (host, code) and window before suppressing
+#define ERROR_WINDOW_MS 10000
+#define ERROR_FLUSH_MS 200
+#define ERROR_MESSAGE_LENGTH 96
+
+// Compact error record. `repeats` > 1 marks a summary of suppressed duplicates.
+typedef struct {
+    uint64_t time_ms;
+    int32_t code;
+    uint16_t kind;
+    uint32_t repeats;
+    char host[ERROR_HOST_LENGTH];
+    char message[ERROR_MESSAGE_LENGTH];
+} ErrorRecord;
+
+// Per-thread rate limiter slot for one (host, kind, code) combination.
+typedef struct {
+    uint64_t key;
+    uint64_t window_start_ms;
+    uint32_t count;
+    uint32_t suppressed;
+    ErrorRecord last; // Template for the suppression summary
+} ErrorLimit;
+
+// Single-producer, single-consumer ring owned by one thread and drained by the flusher.
+typedef struct ErrorRing {
+    ErrorRecord records[ERROR_RING_SIZE];
+    atomic_uint head;  // Next record the flusher reads
+    atomic_uint tail;  // Next slot the owning thread writes
+    struct ErrorRing *next;
+    ErrorLimit limits[ERROR_LIMIT_SLOTS]; // Only touched by the owning thread
+} ErrorRing;
+
+// Process-wide asynchronous error log.
+typedef struct {
+    _Atomic(ErrorRing *) rings;
+    IoBackend *io;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_bool stopping;
+    atomic_ulong logged;
+    atomic_ulong suppressed;
+    atomic_ulong dropped;
+} ErrorLog;
+
+static ErrorLog error_log;
+
+static _Thread_local ErrorRing *thread_error_ring = NULL;
+
+// Return the calling thread's ring, registering it on first use.
+static ErrorRing *error_ring_get(void) {
+    if (!thread_error_ring) {
+        ErrorRing *ring = (ErrorRing *)calloc(1, sizeof(ErrorRing));
+        if (!ring) {
+            return NULL;
+        }
+        ring->next = atomic_load(&error_log.rings);
+        while (!atomic_compare_exchange_weak(&error_log.rings, &ring->next, ring)) {
+        }
+        thread_error_ring = ring;
+    }
+    return thread_error_ring;
+}
+
+// Append a record to the calling thread's ring. Never blocks: a full ring drops the record.
+static void error_ring_push(ErrorRing *ring, const ErrorRecord *record) {
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - head == ERROR_RING_SIZE) {
+        atomic_fetch_add(&error_log.dropped, record->repeats);
+        return;
+    }
+    ring->records[tail & (ERROR_RING_SIZE - 1)] = *record;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    atomic_fetch_add(&error_log.logged, 1);
+}
+
+// Log an error. Repeats of the same (host, kind, code) beyond ERROR_BURST per window are
+// only counted, and summarised in one record when the window closes.
+void log_error(ErrorKind kind, int code, const char *host, const char *message) {
+    ErrorRing *ring = error_ring_get();
+    if (!ring) {
+        return;
+    }
+
+    ErrorRecord record;
+    record.time_ms = now_ms();
+    record.code = code;
+    record.kind = kind;
+    record.repeats = 1;
+    snprintf(record.host, sizeof(record.host), "%s", host);
+    snprintf(record.message, sizeof(record.message), "%s", message);
+
+    uint64_t key = url_hash(host) ^ ((uint64_t)kind << 56) ^ (uint64_t)(uint32_t)code;
+    ErrorLimit *limit = &ring->limits[key % ERROR_LIMIT_SLOTS];
+    if (limit->key != key || record.time_ms - limit->window_start_ms >= ERROR_WINDOW_MS) {
+        // Window over, or the slot is taken over by another host: report what was held back.
+        if (limit->suppressed > 0) {
+            limit->last.repeats = limit->suppressed;
+            error_ring_push(ring, &limit->last);
+        }
+        limit->key = key;
+        limit->window_start_ms = record.time_ms;
+        limit->count = 0;
+        limit->suppressed = 0;
+    }
+    if (++limit->count <= ERROR_BURST) {
+        error_ring_push(ring, &record);
+    } else {
+        limit->suppressed++;
+        limit->last = record;
+        atomic_fetch_add(&error_log.suppressed, 1);
+    }
+}
+
+// Emit the pending suppression summaries of the calling thread; workers call this on exit.
+void error_log_thread_done(void) {
+    ErrorRing *ring = thread_error_ring;
+    if (!ring) {
+        return;
+    }
+    for (int i = 0; i < ERROR_LIMIT_SLOTS; i++) {
+        ErrorLimit *limit = &ring->limits[i];
+        if (limit->suppressed > 0) {
+            limit->last.repeats = limit->suppressed;
+            error_ring_push(ring, &limit->last);
+            limit->suppressed = 0;
+        }
+    }
+}
+
+// Drain every ring into one batch of tab-separated lines:
+// time, kind, code, host, repeats, message.
+static void error_log_flush(void) {
+    static const char *kind_names[] = {"general", "curl", "http"};
+    char batch[IO_BUFFER_SIZE];
+    size_t len = 0;
+
+    for (ErrorRing *ring = atomic_load(&error_log.rings); ring; ring = ring->next) {
+        unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            ErrorRecord *record = &ring->records[head & (ERROR_RING_SIZE - 1)];
+            char timestamp[24];
+            time_t seconds = record->time_ms / 1000;
+            struct tm local_time;
+            strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &local_time));
+
+            char line[ERROR_HOST_LENGTH + ERROR_MESSAGE_LENGTH + 96];
+            int line_len = snprintf(line, sizeof(line), "%s.%03u\t%s\t%d\t%s\t%u\t%s\n", timestamp,
+                                    (unsigned)(record->time_ms % 1000), kind_names[record->kind], record->code,
+                                    record->host, record->repeats, record->message);
+            if (line_len >= (int)sizeof(line)) {
+                line_len = sizeof(line) - 1;
+            }
+            if (len + line_len > sizeof(batch)) {
+                error_log.io->write_line(error_log.io, IO_STREAM_ERRORS, batch, len);
+                len = 0;
+            }
+            memcpy(batch + len, line, line_len);
+            len += line_len;
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+    if (len > 0) {
+        error_log.io->write_line(error_log.io, IO_STREAM_ERRORS, batch, len);
+    }
+}
+
+// Background flusher: wakes every ERROR_FLUSH_MS and hands the batch to the I/O backend.
+static void *error_log_thread(void *arg) {
+    (void)arg;
+    struct timespec interval = {0, ERROR_FLUSH_MS * 1000000L};
+    while (!atomic_load(&error_log.stopping)) {
+        nanosleep(&interval, NULL);
+        error_log_flush();
+    }
+    return NULL;
+}
+
+// Start the asynchronous error log on top of an I/O backend.
+bool error_log_start(IoBackend *io) {
+    error_log.io = io;
+    atomic_store(&error_log.stopping, false);
+    if (pthread_create(&error_log.thread, NULL, error_log_thread, NULL) != 0) {
+        return false;
+    }
+    atomic_store(&error_log.running, true);
+    return true;
+}
+
+// Stop the flusher after a final drain and free the rings. Call once the workers are joined.
+void error_log_stop(void) {
+    if (!atomic_load(&error_log.running)) {
+        return;
+    }
+    error_log_thread_done();
+    atomic_store(&error_log.stopping, true);
+    pthread_join(error_log.thread, NULL);
+    error_log_flush();
+    atomic_store(&error_log.running, false);
+
+    ErrorRing *ring = atomic_exchange(&error_log.rings, NULL);
+    while (ring) {
+        ErrorRing *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    thread_error_ring = NULL;
+}
+
+// Function to record errors into a text file.
+void record_error(const char *error_message) {
+    if (atomic_load(&error_log.running)) {
+        log_error(ERROR_KIND_GENERAL, 0, "-", error_message);
+        return;
+    }
+
+    FILE *error_file = fopen("error_log.txt", "a"); // Open the error log file in append mode
+    if (error_file == NULL) {
+        fprintf(stderr, "Error: Unable to open error log file\n");
+        return;
+    }
+
+    // Get current time
+    time_t current_time;
+    struct tm local_time;
+    char timestamp[20];
+    time(&current_time);
+    localtime_r(&current_time, &local_time);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local_time);
+
+    // Write error message and timestamp to the error log file
+    fprintf(error_file, "[%s] %s\n", timestamp, error_message);
+    fclose(error_file);
+}
+
+// Report how many records were written, suppressed by the rate limiter and dropped on full rings.
+void error_log_counts(unsigned long *logged, unsigned long *suppressed, unsigned long *dropped) {
+    *logged = atomic_load(&error_log.logged);
+    *suppressed = atomic_load(&error_log.suppressed);
+    *dropped = atomic_load(&error_log.dropped);
+}
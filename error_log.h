@@ -0,0 +1,24 @@
+// Asynchronous, rate-limited error log written through the I/O backend.
+#ifndef ERROR_LOG_H
+#define ERROR_LOG_H
+
+#include "crawler_core.h"
+#include "io_backend.h"
+
+#define ERROR_HOST_LENGTH 64
+
+// What kind of failure an error record describes.
+typedef enum {
+    ERROR_KIND_GENERAL,  // record_error() messages
+    ERROR_KIND_CURL,     // code is a CURLcode
+    ERROR_KIND_HTTP      // code is the HTTP status
+} ErrorKind;
+
+void log_error(ErrorKind kind, int code, const char *host, const char *message);
+void error_log_thread_done(void);
+bool error_log_start(IoBackend *io);
+void error_log_stop(void);
+void error_log_counts(unsigned long *logged, unsigned long *suppressed, unsigned long *dropped);
+void record_error(const char *error_message);
+
+#endif
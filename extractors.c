@@ -0,0 +1,481 @@
+#include "crawler_core.h"
+#include <regex.h>
+#include <sys/mman.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/tree.h>
+#include <libxml/xmlmemory.h>
+#include "memory.h"
+
+// Unmatched tail kept between chunks so a link split across two chunks is still found.
+#define EXTRACT_CARRY (MAX_URL_LENGTH + 32)
+#define EXTRACT_WINDOW (DECODE_CHUNK + EXTRACT_CARRY + 1)
+
+#define XML_ARENA_RESERVE (256L << 20)  // Address space reserved per libxml2 extractor; pages beyond it use the heap
+#define XML_ARENA_KEEP (4L << 20)       // Touched arena memory kept for the next page; the rest is given back
+#define XML_ARENA_ALIGN 16
+
+// Regex extractor: the pattern from WC.c, CrawlerA.c and fetch_url.c, run over a sliding window.
+typedef struct {
+    regex_t regex;
+    LinkEmitter emit;
+    void *arg;
+    char window[EXTRACT_WINDOW];
+    size_t len;
+} RegexExtractor;
+
+// strstr extractor: the literal `<a href="` scan from CrawlerB.c, over the same kind of window.
+typedef struct {
+    LinkEmitter emit;
+    void *arg;
+    char window[EXTRACT_WINDOW];
+    size_t len;
+} StrstrExtractor;
+
+// Bump allocator that libxml2 allocates from while one of our parsers runs. Everything a page's parse
+// allocates, nodes and attribute strings included, is dropped at once when the page ends.
+typedef struct {
+    char *base;
+    size_t used;
+    size_t touched;             // High-water mark since memory was last given back, its share of MEM_PARSER
+    char *last;                 // Latest allocation, which can grow or be taken back in place
+    bool overflowed;            // Some of this page's allocations fell back to the heap
+} XmlArena;
+
+// libxml2 extractors: a push parser fed chunk by chunk, either building a DOM or reporting SAX events.
+typedef struct {
+    LinkEmitter emit;
+    void *arg;
+    bool sax;
+    htmlSAXHandler handler;
+    htmlParserCtxtPtr ctxt;
+    XmlArena *arena;            // NULL if the address space couldn't be reserved; libxml2 then uses the heap
+} XmlExtractor;
+
+// Arena of the libxml2 parser running on this thread, if any. Set around each call into the parser
+// rather than per thread, since fibers sharing a thread parse their pages interleaved.
+static _Thread_local XmlArena *xml_arena;
+static pthread_once_t xml_hooks_once = PTHREAD_ONCE_INIT;
+
+// Copy as much of `data` as fits into an extractor window. Returns the number of bytes taken.
+static size_t window_fill(char *window, size_t *len, const char *data, size_t size) {
+    size_t room = EXTRACT_WINDOW - 1 - *len;
+    size_t n = size < room ? size : room;
+    memcpy(window + *len, data, n);
+    *len += n;
+    window[*len] = '\0';
+    return n;
+}
+
+// Drop everything before `consumed`, but never keep more than EXTRACT_CARRY bytes.
+static void window_shift(char *window, size_t *len, size_t consumed) {
+    if (*len - consumed > EXTRACT_CARRY) {
+        consumed = *len - EXTRACT_CARRY;
+    }
+    memmove(window, window + consumed, *len - consumed);
+    *len -= consumed;
+}
+
+// Compile the link pattern for one worker.
+static void *regex_create(LinkEmitter emit, void *arg) {
+    RegexExtractor *ex = (RegexExtractor *)calloc(1, sizeof(RegexExtractor));
+    if (!ex) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    const char *pattern = "<a\\s+href=\"([^\"]+)\"";
+    if (regcomp(&ex->regex, pattern, REG_EXTENDED) != 0) {
+        fprintf(stderr, "Error: Unable to compile regular expression\n");
+        free(ex);
+        return NULL;
+    }
+    ex->emit = emit;
+    ex->arg = arg;
+    return ex;
+}
+
+// Start a new page.
+static void regex_begin(void *state, const char *page_url) {
+    (void)page_url;
+    ((RegexExtractor *)state)->len = 0;
+}
+
+// Feed a chunk of decoded HTML and emit every complete link in it.
+static void regex_feed(void *state, const char *data, size_t len) {
+    RegexExtractor *ex = (RegexExtractor *)state;
+    while (len > 0) {
+        size_t n = window_fill(ex->window, &ex->len, data, len);
+        data += n;
+        len -= n;
+
+        regmatch_t matches[2]; // We're interested in the captured group
+        const char *ptr = ex->window;
+        while (regexec(&ex->regex, ptr, 2, matches, 0) == 0) {
+            int url_len = matches[1].rm_eo - matches[1].rm_so;
+            if (url_len < MAX_URL_LENGTH) {
+                ex->emit(ex->arg, ptr + matches[1].rm_so, url_len);
+            }
+            ptr += matches[0].rm_eo;
+        }
+
+        // Keep only the tail that might hold the start of a link.
+        window_shift(ex->window, &ex->len, ptr - ex->window);
+    }
+}
+
+// Nothing is pending at the end of a page: window extractors emit links as soon as they are complete.
+static void window_end(void *state) {
+    (void)state;
+}
+
+// Release the compiled pattern.
+static void regex_destroy(void *state) {
+    RegexExtractor *ex = (RegexExtractor *)state;
+    regfree(&ex->regex);
+    free(ex);
+}
+
+// Set up the strstr extractor.
+static void *strstr_create(LinkEmitter emit, void *arg) {
+    StrstrExtractor *ex = (StrstrExtractor *)calloc(1, sizeof(StrstrExtractor));
+    if (!ex) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ex->emit = emit;
+    ex->arg = arg;
+    return ex;
+}
+
+// Start a new page.
+static void strstr_begin(void *state, const char *page_url) {
+    (void)page_url;
+    ((StrstrExtractor *)state)->len = 0;
+}
+
+// Find `<a href="` literals and emit the quoted value after each one.
+static void strstr_feed(void *state, const char *data, size_t len) {
+    StrstrExtractor *ex = (StrstrExtractor *)state;
+    const char *needle = "<a href=\"";
+    size_t needle_len = strlen(needle);
+    while (len > 0) {
+        size_t n = window_fill(ex->window, &ex->len, data, len);
+        data += n;
+        len -= n;
+
+        const char *ptr = ex->window;
+        const char *start;
+        while ((start = strstr(ptr, needle)) != NULL) {
+            start += needle_len;
+            const char *end = strchr(start, '"');
+            if (!end) {
+                ptr = start - needle_len; // The closing quote is in the next chunk
+                break;
+            }
+            if (end - start < MAX_URL_LENGTH) {
+                ex->emit(ex->arg, start, end - start);
+            }
+            ptr = end + 1;
+        }
+        if (!start) {
+            // Keep a partial needle at the end of the window.
+            size_t tail = ex->window + ex->len - ptr;
+            if (tail > needle_len - 1) {
+                ptr = ex->window + ex->len - (needle_len - 1);
+            }
+        }
+        window_shift(ex->window, &ex->len, ptr - ex->window);
+    }
+}
+
+// Release the strstr extractor.
+static void strstr_destroy(void *state) {
+    free(state);
+}
+
+// Whether `ptr` was handed out by `arena`.
+static bool arena_owns(const XmlArena *arena, const void *ptr) {
+    return arena && (const char *)ptr >= arena->base && (const char *)ptr < arena->base + XML_ARENA_RESERVE;
+}
+
+// Bump-allocate from an arena. Returns NULL once the reservation is used up.
+static void *arena_alloc(XmlArena *arena, size_t size) {
+    size_t start = (arena->used + XML_ARENA_ALIGN - 1) & ~(size_t)(XML_ARENA_ALIGN - 1);
+    if (size > XML_ARENA_RESERVE - start) {
+        arena->overflowed = true;
+        return NULL;
+    }
+    arena->used = start + size;
+    if (arena->used > arena->touched) {
+        mem_account(MEM_PARSER, (long)(arena->used - arena->touched));
+        arena->touched = arena->used;
+    }
+    arena->last = arena->base + start;
+    return arena->last;
+}
+
+// Drop everything allocated for the last page, giving back what the page touched beyond XML_ARENA_KEEP.
+static void arena_reset(XmlArena *arena) {
+    arena->used = 0;
+    arena->last = NULL;
+    arena->overflowed = false;
+    if (arena->touched > XML_ARENA_KEEP) {
+        madvise(arena->base + XML_ARENA_KEEP, arena->touched - XML_ARENA_KEEP, MADV_DONTNEED);
+        mem_account(MEM_PARSER, -(long)(arena->touched - XML_ARENA_KEEP));
+        arena->touched = XML_ARENA_KEEP;
+    }
+}
+
+// Reserve an arena's address space; pages are only backed once touched.
+static XmlArena *arena_create(void) {
+    void *base = mmap(NULL, XML_ARENA_RESERVE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    XmlArena *arena = (XmlArena *)calloc(1, sizeof(XmlArena));
+    if (!arena) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    arena->base = (char *)base;
+    return arena;
+}
+
+// Release an arena and its address space.
+static void arena_free(XmlArena *arena) {
+    mem_account(MEM_PARSER, -(long)arena->touched);
+    munmap(arena->base, XML_ARENA_RESERVE);
+    free(arena);
+}
+
+// libxml2 allocator hooks: the running parser's arena if there is one, the heap otherwise.
+static void *xml_hook_malloc(size_t size) {
+    void *ptr = xml_arena ? arena_alloc(xml_arena, size) : NULL;
+    return ptr ? ptr : malloc(size);
+}
+
+// Grow in place if `ptr` is the arena's latest allocation, else move it. The old size isn't kept,
+// so the copy takes whatever lies between `ptr` and the arena's top, up to the new size.
+static void *xml_hook_realloc(void *ptr, size_t size) {
+    XmlArena *arena = xml_arena;
+    if (!ptr) {
+        return xml_hook_malloc(size);
+    }
+    if (!arena_owns(arena, ptr)) {
+        return realloc(ptr, size);
+    }
+    size_t start = (size_t)((char *)ptr - arena->base);
+    if ((char *)ptr == arena->last && size <= XML_ARENA_RESERVE - start) {
+        arena->used = start + size;
+        if (arena->used > arena->touched) {
+            mem_account(MEM_PARSER, (long)(arena->used - arena->touched));
+            arena->touched = arena->used;
+        }
+        return ptr;
+    }
+    // Measure before allocating: the new block moves the top past `ptr`'s old extent.
+    size_t old = arena->used - start;
+    void *moved = xml_hook_malloc(size);
+    if (moved) {
+        memmove(moved, ptr, old < size ? old : size);
+    }
+    return moved;
+}
+
+// Freeing arena memory does nothing, except that the latest allocation is taken back.
+static void xml_hook_free(void *ptr) {
+    XmlArena *arena = xml_arena;
+    if (!arena_owns(arena, ptr)) {
+        free(ptr);
+    } else if ((char *)ptr == arena->last) {
+        arena->used = (size_t)((char *)ptr - arena->base);
+        arena->last = NULL;
+    }
+}
+
+// String copies go through the same arena.
+static char *xml_hook_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)xml_hook_malloc(len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+// Install the hooks, before libxml2 allocates anything.
+static void xml_hooks_install(void) {
+    xmlMemSetup(xml_hook_free, xml_hook_malloc, xml_hook_realloc, xml_hook_strdup);
+}
+
+// Route libxml2's allocations on this thread to the extractor's arena until xml_leave().
+static void xml_enter(XmlExtractor *ex) {
+    xml_arena = ex->arena;
+}
+
+// Stop routing. The thread's copy of the last parse error is dropped too, so nothing outside the
+// parser is left pointing into the arena when another parser takes the thread.
+static void xml_leave(void) {
+    xmlResetLastError();
+    xml_arena = NULL;
+}
+
+// Emit the href attribute of an element if it is an anchor.
+static void xml_emit_href(XmlExtractor *ex, const xmlChar *name, const xmlChar *href) {
+    if (name && href && xmlStrcasecmp(name, (const xmlChar *)"a") == 0) {
+        size_t len = strlen((const char *)href);
+        if (len < MAX_URL_LENGTH) {
+            ex->emit(ex->arg, (const char *)href, len);
+        }
+    }
+}
+
+// SAX callback: anchors are reported as soon as their start tag is parsed.
+static void xml_start_element(void *ctx, const xmlChar *name, const xmlChar **attrs) {
+    XmlExtractor *ex = (XmlExtractor *)ctx;
+    if (!attrs || xmlStrcasecmp(name, (const xmlChar *)"a") != 0) {
+        return;
+    }
+    for (int i = 0; attrs[i]; i += 2) {
+        if (xmlStrcasecmp(attrs[i], (const xmlChar *)"href") == 0) {
+            xml_emit_href(ex, name, attrs[i + 1]);
+        }
+    }
+}
+
+// Walk the whole document tree and emit every anchor's href.
+static void xml_walk(XmlExtractor *ex, xmlNodePtr node) {
+    for (; node != NULL; node = node->next) {
+        if (node->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        if (xmlStrcasecmp(node->name, (const xmlChar *)"a") == 0) {
+            for (xmlAttrPtr attr = node->properties; attr; attr = attr->next) {
+                if (!xmlStrEqual(attr->name, (const xmlChar *)"href")) {
+                    continue;
+                }
+                // A plain value is one text node, read in place; anything else is copied out.
+                xmlNodePtr text = attr->children;
+                if (text && text->type == XML_TEXT_NODE && !text->next) {
+                    xml_emit_href(ex, node->name, text->content);
+                } else {
+                    xmlChar *href = xmlGetProp(node, (const xmlChar *)"href");
+                    if (href != NULL) {
+                        xml_emit_href(ex, node->name, href);
+                        xmlFree(href);
+                    }
+                }
+                break;
+            }
+        }
+        xml_walk(ex, node->children);
+    }
+}
+
+// Set up a libxml2 extractor; `sax` selects event-driven parsing instead of a DOM walk.
+static XmlExtractor *xml_create(LinkEmitter emit, void *arg, bool sax) {
+    XmlExtractor *ex = (XmlExtractor *)calloc(1, sizeof(XmlExtractor));
+    if (!ex) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_once(&xml_hooks_once, xml_hooks_install);
+    xmlInitParser();
+    ex->arena = arena_create();
+    ex->emit = emit;
+    ex->arg = arg;
+    ex->sax = sax;
+    ex->handler.startElement = xml_start_element;
+    return ex;
+}
+
+// Create the DOM-walking extractor used by CurlCrawler.c, crawler.c and TestCrawler1.c.
+static void *libxml2_create(LinkEmitter emit, void *arg) {
+    return xml_create(emit, arg, false);
+}
+
+// Create the SAX extractor, which never builds a tree.
+static void *libxml2_sax_create(LinkEmitter emit, void *arg) {
+    return xml_create(emit, arg, true);
+}
+
+// Start a push parser for a new page.
+static void xml_begin(void *state, const char *page_url) {
+    XmlExtractor *ex = (XmlExtractor *)state;
+    xml_enter(ex);
+    ex->ctxt = htmlCreatePushParserCtxt(ex->sax ? &ex->handler : NULL, ex->sax ? ex : NULL, NULL, 0, page_url,
+                                        XML_CHAR_ENCODING_NONE);
+    if (ex->ctxt) {
+        htmlCtxtUseOptions(ex->ctxt, HTML_PARSE_RECOVER | HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
+    }
+    xml_leave();
+}
+
+// Feed a chunk of decoded HTML to the parser.
+static void xml_feed(void *state, const char *data, size_t len) {
+    XmlExtractor *ex = (XmlExtractor *)state;
+    if (ex->ctxt) {
+        xml_enter(ex);
+        htmlParseChunk(ex->ctxt, data, (int)len, 0);
+        xml_leave();
+    }
+}
+
+// Finish the page: walk the tree in DOM mode, then free the parser and document.
+static void xml_end(void *state) {
+    XmlExtractor *ex = (XmlExtractor *)state;
+    if (!ex->ctxt) {
+        return;
+    }
+    xml_enter(ex);
+    htmlParseChunk(ex->ctxt, NULL, 0, 1);
+    xmlDocPtr doc = ex->ctxt->myDoc;
+    ex->ctxt->myDoc = NULL;
+    if (doc) {
+        if (!ex->sax) {
+            xml_walk(ex, xmlDocGetRootElement(doc));
+        }
+        // A tree wholly in the arena goes with it; only the dictionary, whose lock is on the heap,
+        // has to be released.
+        if (ex->arena && !ex->arena->overflowed) {
+            xmlDictFree(doc->dict);
+        } else {
+            xmlFreeDoc(doc);
+        }
+    }
+    htmlFreeParserCtxt(ex->ctxt);
+    ex->ctxt = NULL;
+    xml_leave();
+    if (ex->arena) {
+        arena_reset(ex->arena);
+    }
+}
+
+// Release a libxml2 extractor.
+static void xml_destroy(void *state) {
+    XmlExtractor *ex = (XmlExtractor *)state;
+    if (ex->ctxt) {
+        xml_end(ex);
+    }
+    if (ex->arena) {
+        arena_free(ex->arena);
+    }
+    free(ex);
+}
+
+const ExtractorOps regex_extractor = {"regex", regex_create, regex_begin, regex_feed, window_end, regex_destroy};
+const ExtractorOps strstr_extractor = {"strstr", strstr_create, strstr_begin, strstr_feed, window_end, strstr_destroy};
+const ExtractorOps libxml2_extractor = {"libxml2", libxml2_create, xml_begin, xml_feed, xml_end, xml_destroy};
+const ExtractorOps libxml2_sax_extractor = {"libxml2-sax", libxml2_sax_create, xml_begin, xml_feed, xml_end,
+                                            xml_destroy};
+
+// Look up an extractor by name.
+const ExtractorOps *extractor_find(const char *name) {
+    const ExtractorOps *all[] = {&regex_extractor, &strstr_extractor, &libxml2_extractor, &libxml2_sax_extractor};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(all[i]->name, name) == 0) {
+            return all[i];
+        }
+    }
+    return NULL;
+}
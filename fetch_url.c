@@ -1,83 +1,36 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <pthread.h>
-#include <string.h>
-#include <stdbool.h>
-#include <curl/curl.h>
-#include <regex.h>
+#include "crawler_core.h"
 
-#define MAX_URL_LENGTH 1024
-
-// Structure to hold crawler parameters
-typedef struct {
-    int max_depth;
-} CrawlerParams;
-
-// Function to handle received data from cURL.
-size_t write_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    // Here you can process the received data if needed.
-    return size * nmemb;
+// Function to print each link of the fetched page.
+static void print_link(void *arg, const char *url, size_t len) {
+    (void)arg;
+    printf("Extracted URL: %.*s\n", (int)len, url);
 }
 
-void *fetch_url(void *arg) {
-    CrawlerParams *params = (CrawlerParams *)arg;
-    int max_depth = params->max_depth;
-
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        fprintf(stderr, "Error: Unable to initialize cURL\n");
-        return NULL;
-    }
-
-    // Regular expression for extracting links from HTML content
-    regex_t regex;
-    const char *pattern = "<a\\s+href=\"([^\"]+)\"";
-    if (regcomp(&regex, pattern, REG_EXTENDED) != 0) {
-        fprintf(stderr, "Error: Unable to compile regular expression\n");
-        curl_easy_cleanup(curl);
-        return NULL;
+// Fetch one page (google.com unless a URL is given) and print the links on it. --record <file>
+// keeps the response for later runs; --replay <file> serves it from there instead of the network.
+int main(int argc, char *argv[]) {
+    const char *url = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (argv[i][0] != '-' && !url) {
+            url = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [url] [--record <file> | --replay <file>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
     }
-
-    // Set the write callback function
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-
-    // URL to fetch (replace google.com with the desired URL)
-    const char *url = "http://google.com";
-    fprintf("Using Google.com\n");
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-
-    char response_buffer[4096];
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, response_buffer);
-
-    CURLcode res = curl_easy_perform(curl);
-    if (res != CURLE_OK) {
-        fprintf(stderr, "Error: cURL request failed: %s\n", curl_easy_strerror(res));
-        curl_easy_cleanup(curl);
-        return NULL;
+    if (record_path && replay_path) {
+        fprintf(stderr, "Error: --record and --replay cannot be combined\n");
+        return EXIT_FAILURE;
     }
-
-    regmatch_t matches[2];
-    const char *ptr = response_buffer;
-    while (regexec(&regex, ptr, 2, matches, 0) == 0) {
-        char extracted_url[MAX_URL_LENGTH];
-        int len = matches[1].rm_eo - matches[1].rm_so;
-        if (len < MAX_URL_LENGTH) {
-            strncpy(extracted_url, ptr + matches[1].rm_so, len);
-            extracted_url[len] = '\0';
-            printf("Extracted URL: %s\n", extracted_url);
-        }
-        ptr += matches[0].rm_eo;
+    if (!url) {
+        url = "http://google.com";
+        printf("Using Google.com\n");
     }
-
-    regfree(&regex);
-    curl_easy_cleanup(curl);
-
-    return NULL;
-}
-
-int main() {
-    // Set up crawler parameters
-    CrawlerParams params = { .max_depth = 3 }; // Example max_depth
-    fetch_url(&params);
-    return 0;
+    return crawler_fetch_page(url, "regex", record_path, replay_path, print_link, NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,547 @@
+#include "crawler_core.h"
+#include "dns_cache.h"
+#include "fiber.h"
+#include "index.h"
+#include "recrawl.h"
+#include "replay.h"
+#include "topic.h"
+#include <zlib.h>
+#include <brotli/decode.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#define ACCEPTED_ENCODINGS "gzip, deflate, br, zstd"
+#else
+#define ACCEPTED_ENCODINGS "gzip, deflate, br"
+#endif
+
+#define STATIC_LINKS 8                // Links on every synthetic page
+#define STATIC_SITE "https://example.com"
+
+// Per-transfer state handed to the cURL callbacks.
+typedef struct {
+    CURL *curl;
+    Worker *worker;
+    ContentEncoding encoding;
+    bool decoder_ready;
+    z_stream zs;
+    bool raw_deflate;             // zs was restarted for raw deflate; a second failure is final
+    BrotliDecoderState *br;
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+    CrawlStats *stats;
+    // Raw response kept for the sinks; only filled in when the crawl captures responses.
+    bool capture;
+    char *headers;
+    size_t headers_len, headers_cap;
+    BodyChain body;
+    BodyChain scratch;
+} FetchContext;
+
+// Offline fetcher state: the page being generated.
+typedef struct {
+    Worker *worker;
+    char page[STATIC_LINKS * (MAX_URL_LENGTH + 64) + 128];
+    // The page as a response body for the sinks; only filled in when the crawl captures responses.
+    BodyChain body;
+    BodyChain scratch;
+} StaticFetcher;
+
+// Hand decoded bytes to the worker's extractor, keyword scan, indexer and change digest, counting
+// the CPU time.
+static void extract_chunk(FetchContext *ctx, const char *data, size_t len) {
+    unsigned long start = thread_cpu_ns();
+    ctx->worker->extractor->feed(ctx->worker->extractor_state, data, len);
+    if (ctx->worker->topics) {
+        topic_feed(ctx->worker->topics, data, len);
+    }
+    if (ctx->worker->index_page) {
+        index_page_feed(ctx->worker->index_page, data, len);
+    }
+    if (ctx->worker->crawler->recrawl) {
+        ctx->worker->digest = recrawl_digest(ctx->worker->digest, data, len);
+    }
+    atomic_fetch_add(&ctx->stats->extract_ns, thread_cpu_ns() - start);
+}
+
+// Set up the decoder for the negotiated content coding.
+static bool decoder_init(FetchContext *ctx) {
+    switch (ctx->encoding) {
+    case ENCODING_ZLIB:
+        memset(&ctx->zs, 0, sizeof(ctx->zs));
+        ctx->raw_deflate = false;
+        // 32 enables automatic gzip/zlib header detection.
+        if (inflateInit2(&ctx->zs, 15 + 32) != Z_OK) {
+            return false;
+        }
+        break;
+    case ENCODING_BROTLI:
+        ctx->br = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+        if (!ctx->br) {
+            return false;
+        }
+        break;
+#ifdef HAVE_ZSTD
+    case ENCODING_ZSTD:
+        ctx->zstd = ZSTD_createDStream();
+        if (!ctx->zstd) {
+            return false;
+        }
+        ZSTD_initDStream(ctx->zstd);
+        break;
+#endif
+    default:
+        break;
+    }
+    ctx->decoder_ready = true;
+    return true;
+}
+
+// Release the decoder of a finished transfer.
+static void decoder_free(FetchContext *ctx) {
+    if (!ctx->decoder_ready) {
+        return;
+    }
+    switch (ctx->encoding) {
+    case ENCODING_ZLIB:
+        inflateEnd(&ctx->zs);
+        break;
+    case ENCODING_BROTLI:
+        BrotliDecoderDestroyInstance(ctx->br);
+        ctx->br = NULL;
+        break;
+#ifdef HAVE_ZSTD
+    case ENCODING_ZSTD:
+        ZSTD_freeDStream(ctx->zstd);
+        ctx->zstd = NULL;
+        break;
+#endif
+    default:
+        break;
+    }
+    ctx->decoder_ready = false;
+}
+
+// Decompress one received chunk and stream the output into the extractor.
+// Returns false if the body is corrupt.
+static bool decode_chunk(FetchContext *ctx, const char *in, size_t in_len) {
+    char out[DECODE_CHUNK];
+
+    if (ctx->encoding == ENCODING_IDENTITY) {
+        atomic_fetch_add(&ctx->stats->body_bytes, in_len);
+        extract_chunk(ctx, in, in_len);
+        return true;
+    }
+    if (!ctx->decoder_ready && !decoder_init(ctx)) {
+        return false;
+    }
+
+    unsigned long start = thread_cpu_ns();
+    unsigned long spent = 0;
+    bool ok = true;
+
+    if (ctx->encoding == ENCODING_ZLIB) {
+        ctx->zs.next_in = (Bytef *)in;
+        ctx->zs.avail_in = in_len;
+        while (ctx->zs.avail_in > 0) {
+            ctx->zs.next_out = (Bytef *)out;
+            ctx->zs.avail_out = sizeof(out);
+            int ret = inflate(&ctx->zs, Z_NO_FLUSH);
+            if (ret == Z_DATA_ERROR && ctx->zs.total_out == 0 && !ctx->raw_deflate) {
+                // Some servers send raw deflate without the zlib wrapper. Try that once; a body that
+                // isn't raw deflate either is corrupt.
+                inflateEnd(&ctx->zs);
+                memset(&ctx->zs, 0, sizeof(ctx->zs));
+                ctx->raw_deflate = true;
+                if (inflateInit2(&ctx->zs, -15) != Z_OK) {
+                    ctx->decoder_ready = false;
+                    ok = false;
+                    break;
+                }
+                ctx->zs.next_in = (Bytef *)in;
+                ctx->zs.avail_in = in_len;
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+            size_t produced = sizeof(out) - ctx->zs.avail_out;
+            spent += thread_cpu_ns() - start;
+            atomic_fetch_add(&ctx->stats->body_bytes, produced);
+            extract_chunk(ctx, out, produced);
+            start = thread_cpu_ns();
+            if (ret == Z_STREAM_END || (ret == Z_BUF_ERROR && produced == 0)) {
+                break;
+            }
+        }
+    } else if (ctx->encoding == ENCODING_BROTLI) {
+        const uint8_t *next_in = (const uint8_t *)in;
+        size_t avail_in = in_len;
+        BrotliDecoderResult ret;
+        do {
+            uint8_t *next_out = (uint8_t *)out;
+            size_t avail_out = sizeof(out);
+            ret = BrotliDecoderDecompressStream(ctx->br, &avail_in, &next_in, &avail_out, &next_out, NULL);
+            if (ret == BROTLI_DECODER_RESULT_ERROR) {
+                ok = false;
+                break;
+            }
+            size_t produced = sizeof(out) - avail_out;
+            spent += thread_cpu_ns() - start;
+            atomic_fetch_add(&ctx->stats->body_bytes, produced);
+            extract_chunk(ctx, out, produced);
+            start = thread_cpu_ns();
+        } while (ret == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT);
+    }
+#ifdef HAVE_ZSTD
+    else if (ctx->encoding == ENCODING_ZSTD) {
+        ZSTD_inBuffer input = {in, in_len, 0};
+        while (input.pos < input.size) {
+            ZSTD_outBuffer output = {out, sizeof(out), 0};
+            size_t ret = ZSTD_decompressStream(ctx->zstd, &output, &input);
+            if (ZSTD_isError(ret)) {
+                ok = false;
+                break;
+            }
+            spent += thread_cpu_ns() - start;
+            atomic_fetch_add(&ctx->stats->body_bytes, output.pos);
+            extract_chunk(ctx, out, output.pos);
+            start = thread_cpu_ns();
+        }
+    }
+#endif
+
+    spent += thread_cpu_ns() - start;
+    atomic_fetch_add(&ctx->stats->decode_ns, spent);
+    return ok;
+}
+
+// Keep raw response header bytes for the sinks. Returns false if out of memory.
+static bool headers_append(FetchContext *ctx, const char *data, size_t len) {
+    if (ctx->headers_len + len > ctx->headers_cap) {
+        size_t cap = ctx->headers_cap ? ctx->headers_cap * 2 : 4096;
+        while (cap < ctx->headers_len + len) {
+            cap *= 2;
+        }
+        char *grown = (char *)realloc(ctx->headers, cap);
+        if (!grown) {
+            return false;
+        }
+        ctx->headers = grown;
+        ctx->headers_cap = cap;
+    }
+    memcpy(ctx->headers + ctx->headers_len, data, len);
+    ctx->headers_len += len;
+    return true;
+}
+
+// Function to inspect response headers and pick the body decoder.
+static size_t header_data(char *buffer, size_t size, size_t nitems, void *userdata) {
+    FetchContext *ctx = (FetchContext *)userdata;
+    size_t len = size * nitems;
+    const char *name = "Content-Encoding:";
+    size_t name_len = strlen(name);
+
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        // New response (e.g. after a 100 Continue): forget earlier headers.
+        decoder_free(ctx);
+        ctx->encoding = ENCODING_IDENTITY;
+        ctx->headers_len = 0;
+    } else if (len > name_len && strncasecmp(buffer, name, name_len) == 0) {
+        const char *value = buffer + name_len;
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
+        if (strncasecmp(value, "gzip", 4) == 0 || strncasecmp(value, "x-gzip", 6) == 0 ||
+            strncasecmp(value, "deflate", 7) == 0) {
+            ctx->encoding = ENCODING_ZLIB;
+        } else if (strncasecmp(value, "br", 2) == 0) {
+            ctx->encoding = ENCODING_BROTLI;
+        }
+#ifdef HAVE_ZSTD
+        else if (strncasecmp(value, "zstd", 4) == 0) {
+            ctx->encoding = ENCODING_ZSTD;
+        }
+#endif
+    }
+
+    if (ctx->capture && !headers_append(ctx, buffer, len)) {
+        return 0;
+    }
+    return len;
+}
+
+// Function to handle received data from cURL.
+static size_t write_data(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    FetchContext *ctx = (FetchContext *)userdata;
+    size_t len = size * nmemb;
+
+    atomic_fetch_add(&ctx->stats->wire_bytes, len);
+    if (ctx->capture) {
+        body_append(&ctx->body, (const char *)ptr, len);
+    }
+    if (!decode_chunk(ctx, (const char *)ptr, len)) {
+        return 0; // Makes cURL abort the transfer with CURLE_WRITE_ERROR
+    }
+    return len;
+}
+
+// Set up a cURL handle for one worker.
+static void *curl_fetcher_create(Worker *worker) {
+    FetchContext *ctx = (FetchContext *)calloc(1, sizeof(FetchContext));
+    if (!ctx) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->curl = curl_easy_init();
+    if (!ctx->curl) {
+        fprintf(stderr, "Error: Unable to initialize cURL\n");
+        free(ctx);
+        return NULL;
+    }
+    ctx->worker = worker;
+    ctx->stats = &worker->crawler->stats;
+    // A recording needs the raw response even if no sink does.
+    ctx->capture = worker->crawler->capture || worker->crawler->replay;
+
+    // Ask for compressed bodies but decode them ourselves, chunk by chunk.
+    curl_easy_setopt(ctx->curl, CURLOPT_ACCEPT_ENCODING, ACCEPTED_ENCODINGS);
+    curl_easy_setopt(ctx->curl, CURLOPT_HTTP_CONTENT_DECODING, 0L);
+    curl_easy_setopt(ctx->curl, CURLOPT_HEADERFUNCTION, header_data);
+    curl_easy_setopt(ctx->curl, CURLOPT_HEADERDATA, ctx);
+    curl_easy_setopt(ctx->curl, CURLOPT_WRITEFUNCTION, write_data);
+    curl_easy_setopt(ctx->curl, CURLOPT_WRITEDATA, ctx);
+    curl_easy_setopt(ctx->curl, CURLOPT_USERAGENT, CRAWLER_USER_AGENT);
+    curl_easy_setopt(ctx->curl, CURLOPT_LOW_SPEED_LIMIT, (long)FETCH_LOW_SPEED_LIMIT);
+    // Over HTTP/2 a new fetch waits for a host's pending connection and becomes a stream on it,
+    // rather than racing to open one of its own.
+    if (worker->crawler->http_version) {
+        curl_easy_setopt(ctx->curl, CURLOPT_HTTP_VERSION, worker->crawler->http_version);
+        curl_easy_setopt(ctx->curl, CURLOPT_PIPEWAIT, (long)!worker->crawler->fresh_connections);
+        curl_easy_setopt(ctx->curl, CURLOPT_FORBID_REUSE, (long)worker->crawler->fresh_connections);
+    }
+    return ctx;
+}
+
+// Fetch one URL; links are extracted while the body streams in.
+static void curl_fetcher_fetch(void *state, const char *url, FetchResult *result) {
+    FetchContext *ctx = (FetchContext *)state;
+    DnsCache *dns = ctx->worker->crawler->queue.dns;
+    curl_easy_setopt(ctx->curl, CURLOPT_URL, url);
+    curl_easy_setopt(ctx->curl, CURLOPT_CONNECTTIMEOUT_MS,
+                     result->connect_timeout_ms ? result->connect_timeout_ms : (long)FETCH_CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(ctx->curl, CURLOPT_TIMEOUT_MS, result->timeout_ms ? result->timeout_ms : (long)FETCH_TIMEOUT_MS);
+    curl_easy_setopt(ctx->curl, CURLOPT_LOW_SPEED_TIME,
+                     result->low_speed_time ? result->low_speed_time : (long)FETCH_LOW_SPEED_TIME);
+
+    // Reset the per-transfer state.
+    ctx->encoding = ENCODING_IDENTITY;
+    ctx->headers_len = 0;
+    body_reset(&ctx->body);
+
+    // Use the shared DNS cache; names known not to resolve cost no request at all.
+    bool unresolvable = false;
+    struct curl_slist *resolve = dns ? dns_apply(dns, ctx->curl, url, &unresolvable) : NULL;
+
+    const ExtractorOps *extractor = ctx->worker->extractor;
+    extractor->begin(ctx->worker->extractor_state, url);
+    result->error = unresolvable ? CURLE_COULDNT_RESOLVE_HOST : fiber_perform(ctx->curl);
+    extractor->end(ctx->worker->extractor_state);
+    decoder_free(ctx);
+    if (resolve) {
+        curl_easy_setopt(ctx->curl, CURLOPT_RESOLVE, NULL);
+        curl_slist_free_all(resolve);
+    }
+
+    result->status = 0;
+    curl_easy_getinfo(ctx->curl, CURLINFO_RESPONSE_CODE, &result->status);
+    curl_off_t wire_len = 0;
+    curl_easy_getinfo(ctx->curl, CURLINFO_SIZE_DOWNLOAD_T, &wire_len);
+    result->wire_len = (size_t)wire_len;
+    long connects = 0, version = 0;
+    curl_easy_getinfo(ctx->curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(ctx->curl, CURLINFO_HTTP_VERSION, &version);
+    if (connects) {
+        atomic_fetch_add(&ctx->stats->connects, connects);
+    }
+    if (version == CURL_HTTP_VERSION_2_0) {
+        atomic_fetch_add(&ctx->stats->http2, 1);
+    }
+    result->encoding = ctx->encoding;
+    result->headers = ctx->headers;
+    result->headers_len = ctx->headers_len;
+    result->body = &ctx->body;
+    result->scratch = &ctx->scratch;
+    if (ctx->worker->crawler->replay) {
+        curl_off_t latency_us = 0;
+        curl_easy_getinfo(ctx->curl, CURLINFO_TOTAL_TIME_T, &latency_us);
+        replay_record(ctx->worker->crawler->replay, url, result,
+                      latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us);
+    }
+}
+
+// Release a worker's cURL handle and buffers.
+static void curl_fetcher_destroy(void *state) {
+    FetchContext *ctx = (FetchContext *)state;
+    body_free(&ctx->body);
+    body_free(&ctx->scratch);
+    free(ctx->headers);
+    curl_easy_cleanup(ctx->curl);
+    free(ctx);
+}
+
+// Set up the offline fetcher.
+static void *static_fetcher_create(Worker *worker) {
+    StaticFetcher *fetcher = (StaticFetcher *)calloc(1, sizeof(StaticFetcher));
+    if (!fetcher) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    fetcher->worker = worker;
+    return fetcher;
+}
+
+// Serve a synthetic page instead of going to the network, like the simulated content in crawler.c
+// and TestCrawler1.c. The links are derived from the URL, so every run sees the same site.
+static void static_fetcher_fetch(void *state, const char *url, FetchResult *result) {
+    StaticFetcher *fetcher = (StaticFetcher *)state;
+    uint64_t hash = url_hash(url);
+    size_t len = snprintf(fetcher->page, sizeof(fetcher->page), "<html><body>\n");
+    for (int i = 0; i < STATIC_LINKS; i++) {
+        uint64_t target = (hash >> (i * 7)) % 1000003;
+        len += snprintf(fetcher->page + len, sizeof(fetcher->page) - len,
+                        "<a href=\"%s/page%lu\">Page %lu</a>\n", STATIC_SITE, (unsigned long)target,
+                        (unsigned long)target);
+    }
+    len += snprintf(fetcher->page + len, sizeof(fetcher->page) - len, "</body></html>\n");
+
+    CrawlStats *stats = &fetcher->worker->crawler->stats;
+    atomic_fetch_add(&stats->wire_bytes, len);
+    atomic_fetch_add(&stats->body_bytes, len);
+    result->wire_len = len;
+    const ExtractorOps *extractor = fetcher->worker->extractor;
+    unsigned long start = thread_cpu_ns();
+    extractor->begin(fetcher->worker->extractor_state, url);
+    extractor->feed(fetcher->worker->extractor_state, fetcher->page, len);
+    extractor->end(fetcher->worker->extractor_state);
+    if (fetcher->worker->topics) {
+        topic_feed(fetcher->worker->topics, fetcher->page, len);
+    }
+    if (fetcher->worker->index_page) {
+        index_page_feed(fetcher->worker->index_page, fetcher->page, len);
+    }
+    if (fetcher->worker->crawler->recrawl) {
+        fetcher->worker->digest = recrawl_digest(fetcher->worker->digest, fetcher->page, len);
+    }
+    atomic_fetch_add(&stats->extract_ns, thread_cpu_ns() - start);
+
+    if (fetcher->worker->crawler->capture) {
+        body_reset(&fetcher->body);
+        body_append(&fetcher->body, fetcher->page, len);
+        result->body = &fetcher->body;
+        result->scratch = &fetcher->scratch;
+    }
+    result->error = CURLE_OK;
+    result->status = 200;
+}
+
+// Release the offline fetcher.
+static void static_fetcher_destroy(void *state) {
+    StaticFetcher *fetcher = (StaticFetcher *)state;
+    body_free(&fetcher->body);
+    body_free(&fetcher->scratch);
+    free(fetcher);
+}
+
+// Set up the replay fetcher: the cURL fetcher's decoding state, without a handle.
+static void *replay_fetcher_create(Worker *worker) {
+    FetchContext *ctx = (FetchContext *)calloc(1, sizeof(FetchContext));
+    if (!ctx) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ctx->worker = worker;
+    ctx->stats = &worker->crawler->stats;
+    ctx->capture = worker->crawler->capture;
+    return ctx;
+}
+
+// Serve a recorded response from the mapped store. The body goes through the same decoding and
+// extraction as a live one, in chunks the size cURL hands over, so only the network is left out.
+static void replay_fetcher_fetch(void *state, const char *url, FetchResult *result) {
+    FetchContext *ctx = (FetchContext *)state;
+    ReplayStore *store = ctx->worker->crawler->replay;
+    ctx->encoding = ENCODING_IDENTITY;
+    ctx->headers_len = 0;
+    body_reset(&ctx->body);
+
+    ReplayResponse response;
+    const ExtractorOps *extractor = ctx->worker->extractor;
+    extractor->begin(ctx->worker->extractor_state, url);
+    if (!replay_find(store, url, &response)) {
+        extractor->end(ctx->worker->extractor_state);
+        result->error = CURLE_REMOTE_FILE_NOT_FOUND;
+        return;
+    }
+    if (store->latency && response.latency_us >= 1000) {
+        fiber_sleep_ms(response.latency_us / 1000);
+    }
+    ctx->encoding = response.encoding;
+    if (ctx->capture && !headers_append(ctx, response.headers, response.headers_len)) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    result->error = response.error;
+    for (size_t done = 0; done < response.body_len;) {
+        size_t len = response.body_len - done < CURL_MAX_WRITE_SIZE ? response.body_len - done : CURL_MAX_WRITE_SIZE;
+        atomic_fetch_add(&ctx->stats->wire_bytes, len);
+        if (ctx->capture) {
+            body_append(&ctx->body, response.body + done, len);
+        }
+        if (!decode_chunk(ctx, response.body + done, len)) {
+            result->error = CURLE_WRITE_ERROR;
+            break;
+        }
+        done += len;
+    }
+    extractor->end(ctx->worker->extractor_state);
+    decoder_free(ctx);
+
+    result->status = response.status;
+    result->wire_len = response.body_len;
+    result->encoding = ctx->encoding;
+    result->headers = ctx->headers;
+    result->headers_len = ctx->headers_len;
+    result->body = &ctx->body;
+    result->scratch = &ctx->scratch;
+}
+
+// Release the replay fetcher's buffers; the store itself belongs to the crawl.
+static void replay_fetcher_destroy(void *state) {
+    FetchContext *ctx = (FetchContext *)state;
+    body_free(&ctx->body);
+    body_free(&ctx->scratch);
+    free(ctx->headers);
+    free(ctx);
+}
+
+const FetcherOps curl_fetcher = {"curl", true, curl_fetcher_create, curl_fetcher_fetch, curl_fetcher_destroy};
+const FetcherOps static_fetcher = {"static", false, static_fetcher_create, static_fetcher_fetch,
+                                   static_fetcher_destroy};
+const FetcherOps replay_fetcher = {"replay", false, replay_fetcher_create, replay_fetcher_fetch,
+                                   replay_fetcher_destroy};
+
+// Look up a fetcher by name.
+const FetcherOps *fetcher_find(const char *name) {
+    const FetcherOps *all[] = {&curl_fetcher, &static_fetcher, &replay_fetcher};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(all[i]->name, name) == 0) {
+            return all[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,486 @@
+#include "crawler_core.h"
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "fiber.h"
+
+// Why a fiber is not running.
+typedef enum {
+    FIBER_READY,
+    FIBER_WAITING,                   // On a transfer in its thread's multi handle
+    FIBER_SLEEPING,
+    FIBER_DONE                       // Task finished; the fiber can take another
+} FiberStatus;
+
+// A task's execution context. Its stack and local state are reused from task to task.
+typedef struct Fiber {
+    ucontext_t context;
+    void *stack;
+    void *task;
+    void *local;
+    struct FiberThread *thread;      // Thread that last ran it
+    FiberStatus status;
+    CURLcode result;                 // Of the transfer it waited on
+    uint64_t wake_ms;
+    struct Fiber *next;              // Sleep or free list
+    struct Fiber *all_next;
+} Fiber;
+
+// One scheduler thread: its network loop, its ready fibers and the fibers it sleeps or keeps.
+typedef struct FiberThread {
+    FiberScheduler *scheduler;
+    int index;
+    pthread_t thread;
+    ucontext_t loop;                 // The scheduler loop, resumed when a fiber suspends
+    Fiber *current;
+    CURLM *multi;
+    int epoll_fd;
+    uint64_t timer_ms;               // When curl wants its timeout action, 0 for never
+    pthread_mutex_t lock;            // Guards the ready ring, which other threads steal from
+    Fiber **ready;
+    size_t head, count, capacity;
+    Fiber *sleepers;
+} FiberThread;
+
+static _Thread_local FiberThread *fiber_self = NULL;
+
+// The running fiber, or NULL on a scheduler loop or outside the fiber model. Not inlined, so
+// code that resumes on another thread never reuses the previous thread's TLS address.
+__attribute__((noinline)) static Fiber *fiber_running(void) {
+    return fiber_self ? fiber_self->current : NULL;
+}
+
+// Append a fiber to a thread's ready ring.
+static void fiber_push(FiberThread *thread, Fiber *fiber) {
+    pthread_mutex_lock(&thread->lock);
+    if (thread->count == thread->capacity) {
+        size_t capacity = thread->capacity ? thread->capacity * 2 : 256;
+        Fiber **ready = (Fiber **)malloc(capacity * sizeof(Fiber *));
+        if (!ready) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < thread->count; i++) {
+            ready[i] = thread->ready[(thread->head + i) % thread->capacity];
+        }
+        free(thread->ready);
+        thread->ready = ready;
+        thread->head = 0;
+        thread->capacity = capacity;
+    }
+    thread->ready[(thread->head + thread->count++) % thread->capacity] = fiber;
+    pthread_mutex_unlock(&thread->lock);
+}
+
+// Take the oldest ready fiber of a thread (the owner) or the newest one (a thief).
+static Fiber *fiber_take(FiberThread *thread, bool oldest) {
+    pthread_mutex_lock(&thread->lock);
+    Fiber *fiber = NULL;
+    if (thread->count > 0) {
+        if (oldest) {
+            fiber = thread->ready[thread->head];
+            thread->head = (thread->head + 1) % thread->capacity;
+        } else {
+            fiber = thread->ready[(thread->head + thread->count - 1) % thread->capacity];
+        }
+        thread->count--;
+    }
+    pthread_mutex_unlock(&thread->lock);
+    return fiber;
+}
+
+// Steal a ready fiber from another thread, trying each once starting after our own.
+static Fiber *fiber_steal(FiberThread *self) {
+    FiberScheduler *scheduler = self->scheduler;
+    for (int i = 1; i < scheduler->threads; i++) {
+        FiberThread *victim = &scheduler->pool[(self->index + i) % scheduler->threads];
+        if (victim->count == 0) {
+            continue; // Racy peek; a miss only costs a turn
+        }
+        Fiber *fiber = fiber_take(victim, false);
+        if (fiber) {
+            atomic_fetch_add(&scheduler->steals, 1);
+            return fiber;
+        }
+    }
+    return NULL;
+}
+
+// First code a fiber runs for each task.
+static void fiber_entry(void) {
+    Fiber *fiber = fiber_running();
+    FiberScheduler *scheduler = fiber->thread->scheduler;
+    scheduler->hooks.run(scheduler->arg, fiber->task, &fiber->local);
+    fiber->status = FIBER_DONE;
+    swapcontext(&fiber->context, &fiber->thread->loop);
+}
+
+// Give a fiber a fresh context for its next task.
+static void fiber_prepare(Fiber *fiber) {
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = (char *)fiber->stack + getpagesize();
+    fiber->context.uc_stack.ss_size = FIBER_STACK_SIZE;
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, fiber_entry, 0);
+}
+
+// Take a spare fiber or create one: a guard page under a lazily backed stack. Spares are shared,
+// since fibers that were stolen finish on the thief, so no more fibers exist than max_fibers.
+static Fiber *fiber_get(FiberThread *self) {
+    FiberScheduler *scheduler = self->scheduler;
+    pthread_mutex_lock(&scheduler->all_lock);
+    Fiber *fiber = scheduler->spare;
+    if (fiber) {
+        scheduler->spare = fiber->next;
+    }
+    pthread_mutex_unlock(&scheduler->all_lock);
+    if (fiber) {
+        return fiber;
+    }
+    fiber = (Fiber *)calloc(1, sizeof(Fiber));
+    if (!fiber) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t guard = getpagesize();
+    fiber->stack = mmap(NULL, guard + FIBER_STACK_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (fiber->stack == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map a fiber stack\n");
+        exit(EXIT_FAILURE);
+    }
+    mprotect(fiber->stack, guard, PROT_NONE);
+    pthread_mutex_lock(&scheduler->all_lock);
+    fiber->all_next = scheduler->all;
+    scheduler->all = fiber;
+    pthread_mutex_unlock(&scheduler->all_lock);
+    atomic_fetch_add(&scheduler->created, 1);
+    return fiber;
+}
+
+// Run a fiber until it suspends or finishes, then file it according to why it stopped.
+static void fiber_resume(FiberThread *self, Fiber *fiber) {
+    fiber->thread = self;
+    self->current = fiber;
+    swapcontext(&self->loop, &fiber->context);
+    self->current = NULL;
+
+    switch (fiber->status) {
+    case FIBER_DONE: {
+        FiberScheduler *scheduler = self->scheduler;
+        pthread_mutex_lock(&scheduler->all_lock);
+        fiber->next = scheduler->spare;
+        scheduler->spare = fiber;
+        pthread_mutex_unlock(&scheduler->all_lock);
+        atomic_fetch_sub(&scheduler->live, 1);
+        break;
+    }
+    case FIBER_SLEEPING: {
+        Fiber **link = &self->sleepers;
+        while (*link && (*link)->wake_ms <= fiber->wake_ms) {
+            link = &(*link)->next;
+        }
+        fiber->next = *link;
+        *link = fiber;
+        break;
+    }
+    case FIBER_READY:
+        fiber_push(self, fiber);
+        break;
+    case FIBER_WAITING:
+        break; // The multi handle holds it until the transfer completes
+    }
+}
+
+// Start fibers for new tasks while there is room. Returns how many were started.
+static int fiber_spawn(FiberThread *self) {
+    FiberScheduler *scheduler = self->scheduler;
+    int started = 0;
+    while (started < FIBER_SPAWN_BATCH) {
+        // Counting the claim as live first means an empty-looking scheduler is really idle.
+        if (atomic_fetch_add(&scheduler->live, 1) >= scheduler->max_fibers) {
+            atomic_fetch_sub(&scheduler->live, 1);
+            break;
+        }
+        void *task;
+        if (!scheduler->hooks.next(scheduler->arg, &task)) {
+            atomic_fetch_sub(&scheduler->live, 1);
+            break;
+        }
+        Fiber *fiber = fiber_get(self);
+        fiber->task = task;
+        fiber->status = FIBER_READY;
+        fiber_prepare(fiber);
+        fiber_push(self, fiber);
+        started++;
+    }
+    return started;
+}
+
+// CURLMOPT_SOCKETFUNCTION: keep the thread's epoll set in step with curl's sockets.
+static int fiber_socket(CURL *easy, curl_socket_t socket, int what, void *userp, void *socketp) {
+    (void)easy;
+    FiberThread *self = (FiberThread *)userp;
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, socket, NULL);
+        curl_multi_assign(self->multi, socket, NULL);
+        return 0;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = (what & CURL_POLL_IN ? EPOLLIN : 0) | (what & CURL_POLL_OUT ? EPOLLOUT : 0);
+    event.data.fd = socket;
+    if (socketp) {
+        epoll_ctl(self->epoll_fd, EPOLL_CTL_MOD, socket, &event);
+    } else {
+        epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, socket, &event);
+        curl_multi_assign(self->multi, socket, self);
+    }
+    return 0;
+}
+
+// CURLMOPT_TIMERFUNCTION: remember when curl wants to be called for timeouts.
+static int fiber_timer(CURLM *multi, long timeout_ms, void *userp) {
+    (void)multi;
+    FiberThread *self = (FiberThread *)userp;
+    self->timer_ms = timeout_ms < 0 ? 0 : now_ms() + (uint64_t)timeout_ms;
+    return 0;
+}
+
+// Let curl act on ready sockets and due timeouts, waiting up to wait_ms for something to happen,
+// then make the fibers whose transfers completed ready. Response bodies stream through the
+// fetchers' callbacks here, on the scheduler loop's stack.
+static void fiber_drive(FiberThread *self, int wait_ms) {
+    uint64_t now = now_ms();
+    if (self->timer_ms && wait_ms > 0) {
+        uint64_t until = self->timer_ms > now ? self->timer_ms - now : 0;
+        wait_ms = until < (uint64_t)wait_ms ? (int)until : wait_ms;
+    }
+    if (self->sleepers && wait_ms > 0) {
+        uint64_t until = self->sleepers->wake_ms > now ? self->sleepers->wake_ms - now : 0;
+        wait_ms = until < (uint64_t)wait_ms ? (int)until : wait_ms;
+    }
+    struct epoll_event events[FIBER_EPOLL_EVENTS];
+    int count = epoll_wait(self->epoll_fd, events, FIBER_EPOLL_EVENTS, wait_ms);
+    int running;
+    for (int i = 0; i < count; i++) {
+        int mask = (events[i].events & EPOLLIN ? CURL_CSELECT_IN : 0) |
+                   (events[i].events & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                   (events[i].events & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+        curl_multi_socket_action(self->multi, events[i].data.fd, mask, &running);
+    }
+    if (self->timer_ms && now_ms() >= self->timer_ms) {
+        self->timer_ms = 0;
+        curl_multi_socket_action(self->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+
+    CURLMsg *message;
+    int left;
+    while ((message = curl_multi_info_read(self->multi, &left))) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+        CURL *easy = message->easy_handle;
+        Fiber *fiber;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&fiber);
+        fiber->result = message->data.result;
+        curl_multi_remove_handle(self->multi, easy);
+        atomic_fetch_sub(&self->scheduler->in_flight, 1);
+        fiber->status = FIBER_READY;
+        fiber_push(self, fiber);
+    }
+
+    // Sleepers whose time has come.
+    now = now_ms();
+    while (self->sleepers && self->sleepers->wake_ms <= now) {
+        Fiber *fiber = self->sleepers;
+        self->sleepers = fiber->next;
+        fiber->status = FIBER_READY;
+        fiber_push(self, fiber);
+    }
+}
+
+// Scheduler thread: network, new tasks, ready fibers (ours, then stolen), until the job is over.
+static void *fiber_thread_main(void *arg) {
+    FiberThread *self = (FiberThread *)arg;
+    FiberScheduler *scheduler = self->scheduler;
+    fiber_self = self;
+    if (scheduler->hooks.thread_start) {
+        scheduler->hooks.thread_start(scheduler->arg, self->index);
+    }
+
+    while (!atomic_load(&scheduler->over)) {
+        fiber_drive(self, 0);
+        int worked = fiber_spawn(self);
+        Fiber *fiber;
+        while (worked < FIBER_RUN_BATCH && (fiber = fiber_take(self, true))) {
+            fiber_resume(self, fiber);
+            worked++;
+        }
+        if (worked == 0 && (fiber = fiber_steal(self))) {
+            fiber_resume(self, fiber);
+            worked++;
+        }
+        if (worked) {
+            continue;
+        }
+        if (atomic_load(&scheduler->live) == 0 && scheduler->hooks.finished(scheduler->arg)) {
+            atomic_store(&scheduler->over, true);
+            break;
+        }
+        // Idle: wait briefly for the network, a sleeper or work from another thread.
+        fiber_drive(self, 1);
+    }
+
+    if (scheduler->hooks.thread_stop) {
+        scheduler->hooks.thread_stop(scheduler->arg, self->index);
+    }
+    fiber_self = NULL;
+    return NULL;
+}
+
+// Set up the scheduler threads' multi handles and epoll sets. Raises the open file limit as far
+// as allowed, since every transfer in flight holds a socket.
+FiberScheduler *fiber_scheduler_create(int threads, int max_fibers, const FiberHooks *hooks, void *arg) {
+    FiberScheduler *scheduler = (FiberScheduler *)calloc(1, sizeof(FiberScheduler));
+    FiberThread *pool = (FiberThread *)calloc(threads, sizeof(FiberThread));
+    if (!scheduler || !pool) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    scheduler->hooks = *hooks;
+    scheduler->arg = arg;
+    scheduler->threads = threads;
+    scheduler->max_fibers = max_fibers;
+    scheduler->pool = pool;
+    pthread_mutex_init(&scheduler->all_lock, NULL);
+
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        FiberThread *thread = &pool[i];
+        thread->scheduler = scheduler;
+        thread->index = i;
+        pthread_mutex_init(&thread->lock, NULL);
+        thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        thread->multi = curl_multi_init();
+        if (thread->epoll_fd < 0 || !thread->multi) {
+            fprintf(stderr, "Error: Unable to set up fiber scheduler thread %d\n", i);
+            scheduler->threads = i + 1;
+            fiber_scheduler_free(scheduler);
+            return NULL;
+        }
+        curl_multi_setopt(thread->multi, CURLMOPT_SOCKETFUNCTION, fiber_socket);
+        curl_multi_setopt(thread->multi, CURLMOPT_SOCKETDATA, thread);
+        curl_multi_setopt(thread->multi, CURLMOPT_TIMERFUNCTION, fiber_timer);
+        curl_multi_setopt(thread->multi, CURLMOPT_TIMERDATA, thread);
+    }
+    return scheduler;
+}
+
+// Let transfers to one host share an HTTP/2 connection per scheduler thread, `streams` at a time.
+// With 0 streams, every transfer gets a connection to itself.
+void fiber_scheduler_multiplex(FiberScheduler *scheduler, long streams) {
+    for (int i = 0; i < scheduler->threads; i++) {
+        curl_multi_setopt(scheduler->pool[i].multi, CURLMOPT_PIPELINING, streams ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        if (streams) {
+            curl_multi_setopt(scheduler->pool[i].multi, CURLMOPT_MAX_CONCURRENT_STREAMS, streams);
+        }
+    }
+}
+
+// Run the scheduler threads until the job is over, then hand every fiber's local state to
+// release(). Returns false if the threads could not be started.
+bool fiber_scheduler_run(FiberScheduler *scheduler) {
+    int started = 0;
+    for (; started < scheduler->threads; started++) {
+        FiberThread *thread = &scheduler->pool[started];
+        if (pthread_create(&thread->thread, NULL, fiber_thread_main, thread) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        return false;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(scheduler->pool[i].thread, NULL);
+    }
+    for (Fiber *fiber = scheduler->all; fiber; fiber = fiber->all_next) {
+        if (fiber->local && scheduler->hooks.release) {
+            scheduler->hooks.release(scheduler->arg, fiber->local);
+            fiber->local = NULL;
+        }
+    }
+    return true;
+}
+
+// Free the fibers, their stacks and the threads' network state.
+void fiber_scheduler_free(FiberScheduler *scheduler) {
+    Fiber *fiber = scheduler->all;
+    while (fiber) {
+        Fiber *next = fiber->all_next;
+        munmap(fiber->stack, getpagesize() + FIBER_STACK_SIZE);
+        free(fiber);
+        fiber = next;
+    }
+    for (int i = 0; i < scheduler->threads; i++) {
+        FiberThread *thread = &scheduler->pool[i];
+        if (thread->multi) {
+            curl_multi_cleanup(thread->multi);
+        }
+        if (thread->epoll_fd > 0) {
+            close(thread->epoll_fd);
+        }
+        free(thread->ready);
+        pthread_mutex_destroy(&thread->lock);
+    }
+    pthread_mutex_destroy(&scheduler->all_lock);
+    free(scheduler->pool);
+    free(scheduler);
+}
+
+// Whether the caller runs in a fiber, and so must not block its thread.
+bool fiber_active(void) {
+    return fiber_running() != NULL;
+}
+
+// Perform a transfer. In a fiber, the handle joins the thread's multi handle and the fiber
+// suspends until it completes; anywhere else this is curl_easy_perform().
+CURLcode fiber_perform(CURL *curl) {
+    Fiber *fiber = fiber_running();
+    if (!fiber) {
+        return curl_easy_perform(curl);
+    }
+    FiberThread *thread = fiber->thread;
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (char *)fiber);
+    if (curl_multi_add_handle(thread->multi, curl) != CURLM_OK) {
+        return CURLE_FAILED_INIT;
+    }
+    FiberScheduler *scheduler = thread->scheduler;
+    int in_flight = atomic_fetch_add(&scheduler->in_flight, 1) + 1;
+    int peak = atomic_load(&scheduler->peak_in_flight);
+    while (in_flight > peak && !atomic_compare_exchange_weak(&scheduler->peak_in_flight, &peak, in_flight)) {
+    }
+    fiber->status = FIBER_WAITING;
+    swapcontext(&fiber->context, &thread->loop);
+    return fiber->result;
+}
+
+// Pause. A fiber gives its thread to others meanwhile; anywhere else this is nanosleep().
+void fiber_sleep_ms(uint64_t ms) {
+    Fiber *fiber = fiber_running();
+    if (!fiber) {
+        struct timespec pause = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+        nanosleep(&pause, NULL);
+        return;
+    }
+    fiber->wake_ms = now_ms() + ms;
+    fiber->status = FIBER_SLEEPING;
+    swapcontext(&fiber->context, &fiber->thread->loop);
+}
@@ -0,0 +1,52 @@
+// Fiber execution model: crawl tasks run as sequential code on small stacks and suspend on
+// network I/O, driven by a few scheduler threads that steal ready fibers from each other.
+#ifndef FIBER_H
+#define FIBER_H
+
+#include "crawler_core.h"
+
+#define FIBER_STACK_SIZE (256 * 1024)  // Reserved per fiber; only touched pages are backed
+#define FIBER_SPAWN_BATCH 64           // New fibers a scheduler thread starts per turn
+#define FIBER_RUN_BATCH 64             // Fibers it resumes before looking at the network again
+#define FIBER_EPOLL_EVENTS 256
+
+struct FiberThread;
+
+// What the scheduler runs. next() claims a task, run() does it inside a fiber, and finished()
+// decides, when no fiber is left and next() found nothing, whether the whole job is done.
+// Each fiber keeps its `local` state between tasks; release() frees it at the end.
+typedef struct {
+    void (*thread_start)(void *arg, int index);
+    void (*thread_stop)(void *arg, int index);
+    bool (*next)(void *arg, void **task);
+    void (*run)(void *arg, void *task, void **local);
+    bool (*finished)(void *arg);
+    void (*release)(void *arg, void *local);
+} FiberHooks;
+
+// The scheduler threads and the fibers they share.
+typedef struct FiberScheduler {
+    FiberHooks hooks;
+    void *arg;
+    int threads;
+    int max_fibers;                  // Tasks in progress at once
+    struct FiberThread *pool;
+    struct Fiber *all;               // Every fiber created, for the final release
+    struct Fiber *spare;             // Fibers between tasks
+    pthread_mutex_t all_lock;        // Guards all and spare
+    atomic_int live;                 // Fibers with a task, plus next() calls in progress
+    atomic_bool over;
+    atomic_int in_flight;            // Transfers waiting in the multi handles
+    atomic_int peak_in_flight;
+    atomic_ulong created, steals;
+} FiberScheduler;
+
+FiberScheduler *fiber_scheduler_create(int threads, int max_fibers, const FiberHooks *hooks, void *arg);
+void fiber_scheduler_multiplex(FiberScheduler *scheduler, long streams);
+bool fiber_scheduler_run(FiberScheduler *scheduler);
+void fiber_scheduler_free(FiberScheduler *scheduler);
+bool fiber_active(void);
+CURLcode fiber_perform(CURL *curl);
+void fiber_sleep_ms(uint64_t ms);
+
+#endif
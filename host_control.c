@@ -0,0 +1,331 @@
+#include "crawler_core.h"
+#include "host_control.h"
+#include "memory.h"
+
+// Estimates and admission state of one origin.
+typedef struct HostState {
+    struct HostState *next;         // Bucket chain
+    uint64_t hash;
+    pthread_mutex_t lock;           // Guards the estimates
+    double latency_ms;              // Average fetch time, 0 before the first sample
+    double error_rate;              // Average of failures, 0 to 1
+    double limit;                   // Congestion window in fetches, grows by fractions
+    uint64_t decreased_ms;          // Time of the last cut
+    atomic_int inflight;
+    atomic_int allowed;             // Whole part of limit, read without the lock
+    atomic_ullong not_before_ms;    // Pause after repeated failures
+    atomic_int cap;                 // Most parallel fetches, set by hand; 0 leaves the limit free
+    atomic_int interval_ms;         // Least time between fetch starts, set by hand; 0 for none
+    atomic_ulong fetched;
+    atomic_ulong deferred;          // Fetches put back because the host was busy or paused
+    URLQueueNode *parked;           // URLs waiting for a slot, oldest first; under the lock
+    URLQueueNode *parked_tail;
+    char origin[HOST_ORIGIN_LENGTH];
+} HostState;
+
+// Find the entry for an origin, adding it if it is new.
+static HostState *host_find(HostControl *control, const char *origin) {
+    uint64_t hash = url_hash(origin);
+    _Atomic(HostState *) *bucket = &control->buckets[hash % HOST_BUCKETS];
+    HostState *fresh = NULL;
+    HostState *head = atomic_load_explicit(bucket, memory_order_acquire);
+    while (true) {
+        for (HostState *host = head; host; host = host->next) {
+            if (host->hash == hash && strcmp(host->origin, origin) == 0) {
+                if (fresh) {
+                    pthread_mutex_destroy(&fresh->lock);
+                    free(fresh);
+                }
+                return host;
+            }
+        }
+        if (!fresh) {
+            fresh = (HostState *)calloc(1, sizeof(HostState));
+            if (!fresh) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            fresh->hash = hash;
+            fresh->limit = HOST_START_LIMIT;
+            atomic_init(&fresh->allowed, HOST_START_LIMIT);
+            snprintf(fresh->origin, sizeof(fresh->origin), "%s", origin);
+            pthread_mutex_init(&fresh->lock, NULL);
+        }
+        fresh->next = head;
+        if (atomic_compare_exchange_weak_explicit(bucket, &head, fresh, memory_order_release, memory_order_acquire)) {
+            atomic_fetch_add(&control->hosts, 1);
+            mem_account(MEM_CACHES, sizeof(HostState));
+            return fresh;
+        }
+    }
+}
+
+// Clamp a value to [low, high].
+static long host_clamp(double value, long low, long high) {
+    return value < low ? low : value > high ? high : (long)value;
+}
+
+// Take a fetch slot on the URL's host and fill in the timeouts for it. Returns NULL if the host
+// is paused, with the end of the pause in *retry_ms, or at its limit, with *retry_ms 0; the
+// caller should hold the URL until then or park it with host_park().
+HostState *host_acquire(HostControl *control, const char *url, FetchResult *result, uint64_t *retry_ms) {
+    char origin[HOST_ORIGIN_LENGTH];
+    const char *path;
+    if (!url_origin(url, origin, sizeof(origin), &path)) {
+        origin[0] = '\0';
+    }
+    HostState *host = host_find(control, origin);
+
+    uint64_t now = now_ms();
+    unsigned long long not_before = atomic_load(&host->not_before_ms);
+    if (not_before > now) {
+        atomic_fetch_add(&control->deferred, 1);
+        atomic_fetch_add(&host->deferred, 1);
+        *retry_ms = not_before;
+        return NULL;
+    }
+    int inflight = atomic_load(&host->inflight);
+    do {
+        if (inflight >= atomic_load(&host->allowed)) {
+            atomic_fetch_add(&control->deferred, 1);
+            atomic_fetch_add(&host->deferred, 1);
+            *retry_ms = 0;
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak(&host->inflight, &inflight, inflight + 1));
+    // A fixed interval claims the next start time; losing the race means another fetch took it.
+    int interval = atomic_load(&host->interval_ms);
+    if (interval && !atomic_compare_exchange_strong(&host->not_before_ms, &not_before, now + (uint64_t)interval)) {
+        atomic_fetch_sub(&host->inflight, 1);
+        atomic_fetch_add(&control->deferred, 1);
+        atomic_fetch_add(&host->deferred, 1);
+        *retry_ms = not_before > now ? not_before : now + (uint64_t)interval;
+        return NULL;
+    }
+
+    // Fast hosts get tight timeouts so a stall is noticed early; unknown hosts get the defaults.
+    pthread_mutex_lock(&host->lock);
+    double latency = host->latency_ms;
+    pthread_mutex_unlock(&host->lock);
+    if (latency > 0) {
+        result->connect_timeout_ms = host_clamp(2 * latency + 1000, 2000, FETCH_CONNECT_TIMEOUT_MS);
+        result->timeout_ms = host_clamp(10 * latency + 5000, 5000, FETCH_TIMEOUT_MS);
+        result->low_speed_time = host_clamp(4 * latency / 1000 + 5, 5, FETCH_LOW_SPEED_TIME);
+    }
+    return host;
+}
+
+// Park a URL that found its host at its limit, to go back to the frontier when a fetch there
+// ends. Returns false, parking nothing, if a slot came free in the meantime.
+bool host_park(HostControl *control, const char *url, uint32_t id, int depth) {
+    char origin[HOST_ORIGIN_LENGTH];
+    const char *path;
+    if (!url_origin(url, origin, sizeof(origin), &path)) {
+        origin[0] = '\0';
+    }
+    HostState *host = host_find(control, origin);
+    URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+    if (!node) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    node->id = id;
+    node->depth = depth;
+    node->next = NULL;
+
+    // host_release() frees slots under the lock, so no release can slip in between the check and the parking.
+    pthread_mutex_lock(&host->lock);
+    if (atomic_load(&host->inflight) < atomic_load(&host->allowed)) {
+        pthread_mutex_unlock(&host->lock);
+        free(node);
+        return false;
+    }
+    if (host->parked_tail) {
+        host->parked_tail->next = node;
+    } else {
+        host->parked = node;
+    }
+    host->parked_tail = node;
+    frontier_park(control->queue);
+    pthread_mutex_unlock(&host->lock);
+    atomic_fetch_add(&control->parked, 1);
+    mem_account(MEM_FRONTIER, sizeof(URLQueueNode));
+    return true;
+}
+
+// Give the slot back and fold the fetch into the host's estimates. Failures and fetches much
+// slower than usual halve the limit, at most once per average fetch time; other fetches add
+// 1/limit, so the limit grows by about one per round of parallel fetches. URLs parked on the
+// host go back to the frontier, one for each free slot.
+void host_release(HostControl *control, HostState *host, const FetchResult *result, uint64_t elapsed_ms) {
+    bool failed = result->error != CURLE_OK || result->status == 429 || result->status >= 500;
+    uint64_t now = now_ms();
+
+    pthread_mutex_lock(&host->lock);
+    double previous = host->latency_ms;
+    bool slow = previous > 0 && elapsed_ms > HOST_SLOW_FACTOR * previous && elapsed_ms > previous + HOST_SLOW_MIN_MS;
+    host->latency_ms = previous > 0 ? previous + HOST_EWMA_WEIGHT * ((double)elapsed_ms - previous)
+                                    : (elapsed_ms ? (double)elapsed_ms : 1.0);
+    host->error_rate += HOST_EWMA_WEIGHT * ((failed ? 1.0 : 0.0) - host->error_rate);
+
+    int before = (int)host->limit;
+    int cap = atomic_load(&host->cap);
+    double ceiling = cap ? cap : control->max_limit;
+    if (failed || slow) {
+        if (now - host->decreased_ms >= (uint64_t)host->latency_ms) {
+            host->limit = host->limit / 2 < 1 ? 1 : host->limit / 2;
+            host->decreased_ms = now;
+            atomic_fetch_add(&control->decreases, 1);
+        }
+        if (failed && before <= 1 && host->error_rate > HOST_PACE_ERROR_RATE) {
+            long pause = host_clamp(2 * host->latency_ms * host->error_rate, 10, HOST_MAX_PAUSE_MS);
+            atomic_store(&host->not_before_ms, now + (uint64_t)pause);
+        }
+    } else if (host->limit < ceiling) {
+        host->limit += 1.0 / host->limit;
+        if ((int)host->limit > before) {
+            atomic_fetch_add(&control->increases, 1);
+        }
+    }
+    if (host->limit > ceiling) {
+        host->limit = ceiling;
+    }
+    atomic_store(&host->allowed, (int)host->limit);
+    atomic_fetch_add(&host->fetched, 1);
+    atomic_fetch_sub(&host->inflight, 1);
+    URLQueueNode *ready = NULL;
+    URLQueueNode **ready_tail = &ready;
+    unsigned long released = 0;
+    for (int free_slots = atomic_load(&host->allowed) - atomic_load(&host->inflight);
+         host->parked && free_slots > 0; free_slots--) {
+        URLQueueNode *node = host->parked;
+        host->parked = node->next;
+        node->next = NULL;
+        *ready_tail = node;
+        ready_tail = &node->next;
+        released++;
+    }
+    if (!host->parked) {
+        host->parked_tail = NULL;
+    }
+    pthread_mutex_unlock(&host->lock);
+
+    if (released) {
+        atomic_fetch_sub(&control->parked, released);
+        mem_account(MEM_FRONTIER, -(long)(released * sizeof(URLQueueNode)));
+    }
+    while (ready) {
+        URLQueueNode *next = ready->next;
+        frontier_unpark(control->queue, ready);
+        ready = next;
+    }
+}
+
+// Pin a host's limits by hand: at most `cap` parallel fetches and at least `interval_ms` between
+// fetch starts. Zero gives either back to the adaptive control. The host may not have been seen yet.
+void host_set_rate(HostControl *control, const char *url, int cap, int interval_ms) {
+    char origin[HOST_ORIGIN_LENGTH];
+    const char *path;
+    if (!url_origin(url, origin, sizeof(origin), &path)) {
+        snprintf(origin, sizeof(origin), "%s", url);
+    }
+    HostState *host = host_find(control, origin);
+    pthread_mutex_lock(&host->lock);
+    atomic_store(&host->cap, cap);
+    atomic_store(&host->interval_ms, interval_ms);
+    if (cap) {
+        host->limit = cap;
+    }
+    atomic_store(&host->allowed, (int)host->limit);
+    pthread_mutex_unlock(&host->lock);
+}
+
+// Fill in up to `max` reports for the busiest hosts, by fetches in flight and then by fetches
+// deferred. Walks the lock-free buckets; only each host's own lock is taken. Returns the count.
+size_t host_report(HostControl *control, HostReport *reports, size_t max) {
+    size_t count = 0;
+    for (size_t b = 0; b < HOST_BUCKETS; b++) {
+        for (HostState *host = atomic_load_explicit(&control->buckets[b], memory_order_acquire); host;
+             host = host->next) {
+            HostReport report;
+            snprintf(report.origin, sizeof(report.origin), "%s", host->origin);
+            report.inflight = atomic_load(&host->inflight);
+            report.allowed = atomic_load(&host->allowed);
+            report.cap = atomic_load(&host->cap);
+            report.interval_ms = atomic_load(&host->interval_ms);
+            report.fetched = atomic_load(&host->fetched);
+            report.deferred = atomic_load(&host->deferred);
+            pthread_mutex_lock(&host->lock);
+            report.latency_ms = host->latency_ms;
+            report.error_rate = host->error_rate;
+            pthread_mutex_unlock(&host->lock);
+
+            // Insertion into the sorted prefix; hosts below the last kept one are skipped.
+            size_t i = count < max ? count++ : max;
+            while (i > 0 && (reports[i - 1].inflight < report.inflight ||
+                             (reports[i - 1].inflight == report.inflight && reports[i - 1].deferred < report.deferred))) {
+                if (i < max) {
+                    reports[i] = reports[i - 1];
+                }
+                i--;
+            }
+            if (i < max) {
+                reports[i] = report;
+            }
+        }
+    }
+    return count;
+}
+
+// Copy the IDs of every URL parked on a busy host into a new array. Returns NULL if there are none.
+uint32_t *host_parked_snapshot(HostControl *control, size_t *count) {
+    uint32_t *ids = NULL;
+    size_t cap = 0;
+    *count = 0;
+    for (size_t b = 0; b < HOST_BUCKETS; b++) {
+        for (HostState *host = atomic_load_explicit(&control->buckets[b], memory_order_acquire); host;
+             host = host->next) {
+            pthread_mutex_lock(&host->lock);
+            for (URLQueueNode *node = host->parked; node; node = node->next) {
+                if (*count == cap) {
+                    cap = cap ? cap * 2 : 256;
+                    uint32_t *grown = (uint32_t *)realloc(ids, cap * sizeof(uint32_t));
+                    if (!grown) {
+                        fprintf(stderr, "Error: Memory allocation failed\n");
+                        exit(EXIT_FAILURE);
+                    }
+                    ids = grown;
+                }
+                ids[(*count)++] = node->id;
+            }
+            pthread_mutex_unlock(&host->lock);
+        }
+    }
+    return ids;
+}
+
+// Start with no hosts; none will get more than `max_limit` parallel fetches. URLs parked on a
+// busy host go back to `queue`.
+void host_control_init(HostControl *control, int max_limit, URLQueue *queue) {
+    memset(control, 0, sizeof(*control));
+    control->max_limit = max_limit;
+    control->queue = queue;
+}
+
+// Free every host entry and the URLs still parked on it.
+void host_control_free(HostControl *control) {
+    for (int i = 0; i < HOST_BUCKETS; i++) {
+        HostState *host = atomic_load(&control->buckets[i]);
+        while (host) {
+            HostState *next = host->next;
+            while (host->parked) {
+                URLQueueNode *node = host->parked;
+                host->parked = node->next;
+                free(node);
+            }
+            pthread_mutex_destroy(&host->lock);
+            free(host);
+            host = next;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+// Per-host adaptive concurrency and timeouts, driven by each host's latency and error rate.
+#ifndef HOST_CONTROL_H
+#define HOST_CONTROL_H
+
+#include "crawler_core.h"
+
+#define HOST_BUCKETS 4096
+#define HOST_ORIGIN_LENGTH 256
+#define HOST_START_LIMIT 2          // Parallel fetches a host gets before anything is known about it
+#define HOST_MAX_LIMIT 16           // Over HTTP/1.1, where every parallel fetch is a connection
+#define HOST_EWMA_WEIGHT 0.2        // Weight of the newest sample in the averages
+#define HOST_SLOW_FACTOR 3.0        // A fetch this much slower than the average counts as congestion,
+#define HOST_SLOW_MIN_MS 50         // if it is also at least this much slower
+#define HOST_PACE_ERROR_RATE 0.5    // Above this, a host already down to one fetch is also paced
+#define HOST_MAX_PAUSE_MS 10000     // Longest pause between fetches of a failing host
+
+struct HostState;
+
+// One host as the control socket reports it.
+typedef struct {
+    char origin[HOST_ORIGIN_LENGTH];
+    int inflight;
+    int allowed;                     // Current parallel fetch limit
+    int cap;                         // Limit set by hand, 0 if none
+    int interval_ms;                 // Least time between fetches set by hand, 0 if none
+    double latency_ms;
+    double error_rate;
+    unsigned long fetched;
+    unsigned long deferred;
+} HostReport;
+
+// All hosts seen by the crawl. Lookups are lock-free; entries are never removed.
+typedef struct HostControl {
+    _Atomic(struct HostState *) buckets[HOST_BUCKETS];
+    int max_limit;                   // Highest limit a host can reach: HOST_MAX_LIMIT, or the HTTP/2 stream limit
+    URLQueue *queue;                 // Where parked URLs go back once their host has a slot
+    atomic_ulong hosts;
+    atomic_ulong parked;             // URLs waiting for a slot on a busy host
+    atomic_ulong deferred;           // Fetches put back because their host was busy or paused
+    atomic_ulong increases;          // Additive steps that raised a host's limit
+    atomic_ulong decreases;          // Multiplicative cuts
+} HostControl;
+
+void host_control_init(HostControl *control, int max_limit, URLQueue *queue);
+void host_control_free(HostControl *control);
+struct HostState *host_acquire(HostControl *control, const char *url, FetchResult *result, uint64_t *retry_ms);
+bool host_park(HostControl *control, const char *url, uint32_t id, int depth);
+uint32_t *host_parked_snapshot(HostControl *control, size_t *count);
+void host_release(HostControl *control, struct HostState *host, const FetchResult *result, uint64_t elapsed_ms);
+void host_set_rate(HostControl *control, const char *url, int cap, int interval_ms);
+size_t host_report(HostControl *control, HostReport *reports, size_t max);
+
+#endif
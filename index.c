@@ -0,0 +1,1354 @@
+#include "crawler_core.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "index.h"
+#include "memory.h"
+
+#define INDEX_WRITE_BUFFER (1UL << 20)  // stdio buffer of a segment being written
+
+// A distinct word of the page being tokenized.
+typedef struct IndexWord {
+    uint32_t hash;
+    uint32_t offset;                    // In the page's text, 0 for an empty slot: words start at 1
+    uint32_t len;
+    uint32_t count;
+} IndexWord;
+
+// One document's term frequency in an in-memory posting list.
+typedef struct {
+    uint64_t doc;
+    uint32_t tf;
+    uint32_t version;                   // Of the visit the frequency was counted on
+} IndexPosting;
+
+// A term of a thread buffer and its postings, in the order pages were added.
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;                    // In the buffer's text, 0 for an empty slot
+    uint32_t len;
+    uint32_t count, cap;
+    IndexPosting *postings;
+} IndexTerm;
+
+// A document of a thread buffer.
+typedef struct {
+    uint64_t doc;
+    uint32_t offset;                    // URL in the buffer's text
+    uint32_t len;
+    uint32_t version;
+} IndexDoc;
+
+// One thread's postings, written out as a segment when full or at the end of the crawl.
+typedef struct IndexBuffer {
+    IndexTerm *terms;                   // Open-addressed by term hash
+    size_t term_count, term_cap;
+    char *text;                         // Terms and URLs back to back
+    size_t text_len, text_cap;
+    IndexDoc *docs;
+    size_t doc_count, doc_cap;
+    size_t bytes;                       // Memory held, against INDEX_BUFFER_MB
+    pthread_mutex_t lock;               // Held by the owning thread while it adds a page, and by a checkpoint
+    struct IndexBuffer *next;
+} IndexBuffer;
+
+// A live segment file.
+typedef struct IndexSegment {
+    uint32_t number;
+    uint32_t level;
+    struct IndexSegment *next;
+} IndexSegment;
+
+// A segment mapped for reading.
+typedef struct {
+    char *map;
+    size_t size;
+    const IndexSegmentHeader *header;
+    const IndexTermEntry *terms;
+    const IndexDocEntry *docs;
+} IndexMap;
+
+// A segment being written: postings go straight to the file, the tables at the end.
+typedef struct {
+    FILE *file;
+    char tmp_path[600];
+    uint64_t offset;
+    IndexTermEntry *terms;
+    size_t term_count, term_cap;
+    IndexDocEntry *docs;
+    size_t doc_count, doc_cap;
+    char *strings;                      // Offsets in the tables are into this until finished
+    size_t strings_len, strings_cap;
+    uint64_t doc_limit;
+} SegmentWriter;
+
+// A growable byte buffer for encoding one posting list.
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} ByteBuffer;
+
+// Sink wrapper that indexes every page.
+typedef struct {
+    Sink base;
+    Index *index;
+} IndexSink;
+
+// This thread's buffer, created on the first page it indexes.
+static _Thread_local IndexBuffer *index_local;
+
+// Byte -> folded word byte: ASCII letters lowercased, digits and UTF-8 bytes kept, 0 between words.
+static uint8_t index_fold[256];
+
+// Fill in the folding table.
+static void index_fold_init(void) {
+    for (int c = 0; c < 256; c++) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            index_fold[c] = (uint8_t)c;
+        } else if (c >= 'A' && c <= 'Z') {
+            index_fold[c] = (uint8_t)(c - 'A' + 'a');
+        } else {
+            index_fold[c] = 0;
+        }
+    }
+}
+
+// FNV-1a over a term.
+static uint32_t index_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Grow an array to hold at least `need` elements of `size` bytes.
+static void *index_grow(void *array, size_t *cap, size_t need, size_t size) {
+    if (need <= *cap) {
+        return array;
+    }
+    size_t grown = *cap ? *cap : 4;
+    while (grown < need) {
+        grown *= 2;
+    }
+    array = realloc(array, grown * size);
+    if (!array) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    *cap = grown;
+    return array;
+}
+
+// Append a LEB128 varint.
+static void bytes_varint(ByteBuffer *out, uint64_t value) {
+    out->data = (uint8_t *)index_grow(out->data, &out->cap, out->len + 10, 1);
+    while (value >= 0x80) {
+        out->data[out->len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out->data[out->len++] = (uint8_t)value;
+}
+
+// Read a LEB128 varint, not past `end`.
+static uint64_t read_varint(const uint8_t **p, const uint8_t *end) {
+    uint64_t value = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        uint8_t byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+// Order two terms as bytes, the shorter first on a tie.
+static int term_compare(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    return c ? c : (a_len > b_len) - (a_len < b_len);
+}
+
+// Set up a worker's tokenizer.
+IndexPage *index_page_create(void) {
+    IndexPage *page = (IndexPage *)calloc(1, sizeof(IndexPage));
+    if (!page) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    page->word_cap = 256;
+    page->words = (IndexWord *)calloc(page->word_cap, sizeof(IndexWord));
+    page->text_cap = 4096;
+    page->text = (char *)malloc(page->text_cap);
+    if (!page->words || !page->text) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return page;
+}
+
+// Release a worker's tokenizer.
+void index_page_free(IndexPage *page) {
+    if (page) {
+        free(page->words);
+        free(page->text);
+        free(page);
+    }
+}
+
+// Start a new page.
+void index_page_begin(IndexPage *page) {
+    page->in_tag = page->closing = page->named = page->raw = page->entity = page->lt = false;
+    page->tag_len = 0;
+    page->word_len = 0;
+    page->word_long = false;
+    page->text_len = 1;
+    if (page->word_count) {
+        memset(page->words, 0, page->word_cap * sizeof(IndexWord));
+        page->word_count = 0;
+    }
+}
+
+// Count the word just read, adding it to the page's set if it is new.
+static void index_page_word(IndexPage *page) {
+    size_t len = page->word_len;
+    bool skip = page->word_long || len == 0;
+    page->word_len = 0;
+    page->word_long = false;
+    if (skip) {
+        return;
+    }
+    if ((page->word_count + 1) * 2 > page->word_cap) {
+        size_t cap = page->word_cap * 2;
+        IndexWord *words = (IndexWord *)calloc(cap, sizeof(IndexWord));
+        if (!words) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < page->word_cap; i++) {
+            if (page->words[i].offset) {
+                size_t j = page->words[i].hash & (cap - 1);
+                while (words[j].offset) {
+                    j = (j + 1) & (cap - 1);
+                }
+                words[j] = page->words[i];
+            }
+        }
+        free(page->words);
+        page->words = words;
+        page->word_cap = cap;
+    }
+    uint32_t hash = index_hash(page->word, len);
+    size_t j = hash & (page->word_cap - 1);
+    while (page->words[j].offset) {
+        IndexWord *word = &page->words[j];
+        if (word->hash == hash && word->len == len && memcmp(page->text + word->offset, page->word, len) == 0) {
+            word->count++;
+            return;
+        }
+        j = (j + 1) & (page->word_cap - 1);
+    }
+    page->text = (char *)index_grow(page->text, &page->text_cap, page->text_len + len, 1);
+    memcpy(page->text + page->text_len, page->word, len);
+    page->words[j] = (IndexWord){hash, (uint32_t)page->text_len, (uint32_t)len, 1};
+    page->text_len += len;
+    page->word_count++;
+}
+
+// Tokenize a chunk of decoded HTML. Markup, entities and the contents of <script> and <style>
+// are skipped; words are folded like topic keywords. State carries over between chunks.
+void index_page_feed(IndexPage *page, const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = p[i];
+        if (page->raw) {
+            if (page->lt && c == '/') {
+                page->raw = page->lt = false;
+                page->in_tag = page->closing = true;
+                page->named = false;
+                page->tag_len = 0;
+            } else {
+                page->lt = c == '<';
+            }
+            continue;
+        }
+        if (page->in_tag) {
+            if (c == '>') {
+                page->in_tag = false;
+                page->tag[page->tag_len] = '\0';
+                page->raw = !page->closing && (strcmp(page->tag, "script") == 0 || strcmp(page->tag, "style") == 0);
+            } else if (!page->named && c == '/' && page->tag_len == 0) {
+                page->closing = true;
+            } else if (!page->named && ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') &&
+                       page->tag_len < sizeof(page->tag) - 1) {
+                page->tag[page->tag_len++] = (char)(c | 0x20);
+            } else {
+                page->named = true;
+            }
+            continue;
+        }
+        if (page->entity) {
+            if (index_fold[c] || c == '#') {
+                continue;
+            }
+            page->entity = false;
+            if (c == ';') {
+                continue;
+            }
+        }
+        uint8_t folded = index_fold[c];
+        if (folded) {
+            if (page->word_len < INDEX_TERM_MAX) {
+                page->word[page->word_len++] = (char)folded;
+            } else {
+                page->word_long = true;
+            }
+            continue;
+        }
+        index_page_word(page);
+        if (c == '<') {
+            page->in_tag = true;
+            page->closing = page->named = false;
+            page->tag_len = 0;
+        } else if (c == '&') {
+            page->entity = true;
+        }
+    }
+}
+
+// Create an empty thread buffer.
+static IndexBuffer *index_buffer_create(void) {
+    IndexBuffer *buffer = (IndexBuffer *)calloc(1, sizeof(IndexBuffer));
+    if (buffer) {
+        buffer->term_cap = 1024;
+        buffer->terms = (IndexTerm *)calloc(buffer->term_cap, sizeof(IndexTerm));
+        buffer->text_len = 1;
+    }
+    if (!buffer || !buffer->terms) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&buffer->lock, NULL);
+    return buffer;
+}
+
+// Move a thread buffer's contents into a new buffer, leaving it empty for its thread to go on
+// with. Called with the buffer's lock held.
+static IndexBuffer *index_buffer_take(IndexBuffer *buffer) {
+    IndexBuffer *taken = index_buffer_create();
+    IndexTerm *terms = taken->terms;
+    size_t term_cap = taken->term_cap;
+    taken->terms = buffer->terms;
+    taken->term_count = buffer->term_count;
+    taken->term_cap = buffer->term_cap;
+    taken->text = buffer->text;
+    taken->text_len = buffer->text_len;
+    taken->text_cap = buffer->text_cap;
+    taken->docs = buffer->docs;
+    taken->doc_count = buffer->doc_count;
+    taken->doc_cap = buffer->doc_cap;
+    taken->bytes = buffer->bytes;
+    buffer->terms = terms;
+    buffer->term_count = 0;
+    buffer->term_cap = term_cap;
+    buffer->text = NULL;
+    buffer->text_len = 1;
+    buffer->text_cap = 0;
+    buffer->docs = NULL;
+    buffer->doc_count = buffer->doc_cap = 0;
+    buffer->bytes = 0;
+    return taken;
+}
+
+// Release a thread buffer.
+static void index_buffer_free(IndexBuffer *buffer) {
+    for (size_t i = 0; i < buffer->term_cap; i++) {
+        free(buffer->terms[i].postings);
+    }
+    free(buffer->terms);
+    free(buffer->text);
+    free(buffer->docs);
+    mem_account(MEM_OUTPUT, -(long)buffer->bytes);
+    pthread_mutex_destroy(&buffer->lock);
+    free(buffer);
+}
+
+// Copy bytes into a buffer's text. Returns their offset.
+static uint32_t index_buffer_text(IndexBuffer *buffer, const char *s, size_t len) {
+    size_t cap = buffer->text_cap;
+    buffer->text = (char *)index_grow(buffer->text, &buffer->text_cap, buffer->text_len + len, 1);
+    buffer->bytes += buffer->text_cap - cap;
+    uint32_t offset = (uint32_t)buffer->text_len;
+    memcpy(buffer->text + offset, s, len);
+    buffer->text_len += len;
+    return offset;
+}
+
+// Find a term in a buffer, adding it if it is new.
+static IndexTerm *index_buffer_term(IndexBuffer *buffer, const char *s, size_t len, uint32_t hash) {
+    if ((buffer->term_count + 1) * 2 > buffer->term_cap) {
+        size_t cap = buffer->term_cap * 2;
+        IndexTerm *terms = (IndexTerm *)calloc(cap, sizeof(IndexTerm));
+        if (!terms) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < buffer->term_cap; i++) {
+            if (buffer->terms[i].offset) {
+                size_t j = buffer->terms[i].hash & (cap - 1);
+                while (terms[j].offset) {
+                    j = (j + 1) & (cap - 1);
+                }
+                terms[j] = buffer->terms[i];
+            }
+        }
+        free(buffer->terms);
+        buffer->bytes += (cap - buffer->term_cap) * sizeof(IndexTerm);
+        buffer->terms = terms;
+        buffer->term_cap = cap;
+    }
+    size_t j = hash & (buffer->term_cap - 1);
+    while (buffer->terms[j].offset) {
+        IndexTerm *term = &buffer->terms[j];
+        if (term->hash == hash && term->len == len && memcmp(buffer->text + term->offset, s, len) == 0) {
+            return term;
+        }
+        j = (j + 1) & (buffer->term_cap - 1);
+    }
+    IndexTerm *term = &buffer->terms[j];
+    term->offset = index_buffer_text(buffer, s, len);
+    term->hash = hash;
+    term->len = (uint32_t)len;
+    buffer->term_count++;
+    return term;
+}
+
+// Add a tokenized page to a thread buffer.
+static void index_buffer_add(IndexBuffer *buffer, uint64_t doc, uint32_t version, const char *url,
+                             const IndexPage *page) {
+    buffer->docs = (IndexDoc *)index_grow(buffer->docs, &buffer->doc_cap, buffer->doc_count + 1, sizeof(IndexDoc));
+    size_t url_len = strlen(url);
+    buffer->docs[buffer->doc_count++] =
+        (IndexDoc){doc, index_buffer_text(buffer, url, url_len), (uint32_t)url_len, version};
+    buffer->bytes += sizeof(IndexDoc);
+    for (size_t i = 0; i < page->word_cap; i++) {
+        const IndexWord *word = &page->words[i];
+        if (!word->offset) {
+            continue;
+        }
+        IndexTerm *term = index_buffer_term(buffer, page->text + word->offset, word->len, word->hash);
+        size_t old_cap = term->cap, cap = term->cap;
+        term->postings = (IndexPosting *)index_grow(term->postings, &cap, term->count + 1, sizeof(IndexPosting));
+        term->cap = (uint32_t)cap;
+        buffer->bytes += (cap - old_cap) * sizeof(IndexPosting);
+        term->postings[term->count++] = (IndexPosting){doc, word->count, version};
+    }
+}
+
+// Start writing segment `number`.
+static bool segment_writer_open(SegmentWriter *writer, const char *dir, uint32_t number) {
+    memset(writer, 0, sizeof(*writer));
+    snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s/seg-%06u.tmp", dir, number);
+    writer->file = fopen(writer->tmp_path, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Error: Unable to create index segment %s\n", writer->tmp_path);
+        return false;
+    }
+    setvbuf(writer->file, NULL, _IOFBF, INDEX_WRITE_BUFFER);
+    IndexSegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, writer->file);
+    writer->offset = sizeof(header);
+    return true;
+}
+
+// Copy a string into the writer's string area. Returns its offset there.
+static uint64_t segment_writer_string(SegmentWriter *writer, const char *s, size_t len) {
+    writer->strings = (char *)index_grow(writer->strings, &writer->strings_cap, writer->strings_len + len, 1);
+    memcpy(writer->strings + writer->strings_len, s, len);
+    writer->strings_len += len;
+    return writer->strings_len - len;
+}
+
+// Append a term's encoded posting list. Terms must come in order.
+static void segment_writer_term(SegmentWriter *writer, const char *term, size_t len, const ByteBuffer *postings,
+                                uint32_t docs) {
+    writer->terms = (IndexTermEntry *)index_grow(writer->terms, &writer->term_cap, writer->term_count + 1,
+                                                 sizeof(IndexTermEntry));
+    IndexTermEntry *entry = &writer->terms[writer->term_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->postings = writer->offset;
+    entry->postings_len = (uint32_t)postings->len;
+    entry->docs = docs;
+    entry->text = segment_writer_string(writer, term, len);
+    entry->len = (uint32_t)len;
+    fwrite(postings->data, 1, postings->len, writer->file);
+    writer->offset += postings->len;
+}
+
+// Append a document. Documents must come in order.
+static void segment_writer_doc(SegmentWriter *writer, uint64_t doc, uint32_t version, const char *url, size_t len) {
+    writer->docs = (IndexDocEntry *)index_grow(writer->docs, &writer->doc_cap, writer->doc_count + 1,
+                                               sizeof(IndexDocEntry));
+    IndexDocEntry *entry = &writer->docs[writer->doc_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->doc = doc;
+    entry->text = segment_writer_string(writer, url, len);
+    entry->len = (uint32_t)len;
+    entry->version = version;
+    if (doc + 1 > writer->doc_limit) {
+        writer->doc_limit = doc + 1;
+    }
+}
+
+// Write the tables and header and move the segment into place. Returns its size, 0 on failure.
+static uint64_t segment_writer_finish(SegmentWriter *writer, const char *dir, uint32_t number, uint32_t level) {
+    IndexSegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.level = level;
+    header.terms = (uint32_t)writer->term_count;
+    header.docs = writer->doc_count;
+    header.doc_limit = writer->doc_limit;
+    header.terms_offset = (writer->offset + 7) & ~7ULL;
+    header.docs_offset = header.terms_offset + writer->term_count * sizeof(IndexTermEntry);
+    uint64_t strings = header.docs_offset + writer->doc_count * sizeof(IndexDocEntry);
+    header.size = strings + writer->strings_len;
+    for (size_t i = 0; i < writer->term_count; i++) {
+        writer->terms[i].text += strings;
+    }
+    for (size_t i = 0; i < writer->doc_count; i++) {
+        writer->docs[i].text += strings;
+    }
+
+    static const char pad[8];
+    fwrite(pad, 1, header.terms_offset - writer->offset, writer->file);
+    fwrite(writer->terms, sizeof(IndexTermEntry), writer->term_count, writer->file);
+    fwrite(writer->docs, sizeof(IndexDocEntry), writer->doc_count, writer->file);
+    fwrite(writer->strings, 1, writer->strings_len, writer->file);
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, writer->file);
+    bool ok = !ferror(writer->file);
+    ok &= fclose(writer->file) == 0;
+    free(writer->terms);
+    free(writer->docs);
+    free(writer->strings);
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s/seg-%06u.idx", dir, number);
+    if (!ok || rename(writer->tmp_path, path) != 0) {
+        fprintf(stderr, "Error: Unable to write index segment %s\n", path);
+        unlink(writer->tmp_path);
+        return 0;
+    }
+    return header.size;
+}
+
+// Order a buffer's terms by their bytes.
+static int compare_buffer_terms(const void *a, const void *b, void *arg) {
+    const IndexBuffer *buffer = (const IndexBuffer *)arg;
+    const IndexTerm *x = *(const IndexTerm *const *)a;
+    const IndexTerm *y = *(const IndexTerm *const *)b;
+    return term_compare(buffer->text + x->offset, x->len, buffer->text + y->offset, y->len);
+}
+
+// Order postings by document.
+static int compare_postings(const void *a, const void *b) {
+    uint64_t x = ((const IndexPosting *)a)->doc, y = ((const IndexPosting *)b)->doc;
+    return (x > y) - (x < y);
+}
+
+// Order documents by number, then version.
+static int compare_docs(const void *a, const void *b) {
+    const IndexDoc *x = (const IndexDoc *)a, *y = (const IndexDoc *)b;
+    if (x->doc != y->doc) {
+        return (x->doc > y->doc) - (x->doc < y->doc);
+    }
+    return (x->version > y->version) - (x->version < y->version);
+}
+
+// The newest version of a document in a buffer whose documents are sorted.
+static uint32_t index_buffer_version(const IndexBuffer *buffer, uint64_t doc) {
+    size_t lo = 0, hi = buffer->doc_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (buffer->docs[mid].doc <= doc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 && buffer->docs[lo - 1].doc == doc ? buffer->docs[lo - 1].version : 0;
+}
+
+// Write a full thread buffer as a level-0 segment. A page indexed twice in the buffer keeps
+// only its newest version. Returns its size, 0 on failure.
+static uint64_t index_write_buffer(Index *index, IndexBuffer *buffer, uint32_t number) {
+    SegmentWriter writer;
+    if (!segment_writer_open(&writer, index->dir, number)) {
+        return 0;
+    }
+    qsort(buffer->docs, buffer->doc_count, sizeof(IndexDoc), compare_docs);
+    IndexTerm **order = (IndexTerm **)malloc((buffer->term_count + 1) * sizeof(IndexTerm *));
+    if (!order) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < buffer->term_cap; i++) {
+        if (buffer->terms[i].offset) {
+            order[count++] = &buffer->terms[i];
+        }
+    }
+    qsort_r(order, count, sizeof(IndexTerm *), compare_buffer_terms, buffer);
+
+    ByteBuffer postings = {NULL, 0, 0};
+    for (size_t i = 0; i < count; i++) {
+        IndexTerm *term = order[i];
+        qsort(term->postings, term->count, sizeof(IndexPosting), compare_postings);
+        postings.len = 0;
+        uint64_t last = 0;
+        uint32_t docs = 0;
+        for (uint32_t j = 0; j < term->count; j++) {
+            IndexPosting *posting = &term->postings[j];
+            if (posting->version != index_buffer_version(buffer, posting->doc)) {
+                continue;
+            }
+            bytes_varint(&postings, posting->doc - last);
+            bytes_varint(&postings, posting->tf);
+            last = posting->doc;
+            docs++;
+        }
+        if (docs > 0) {
+            segment_writer_term(&writer, buffer->text + term->offset, term->len, &postings, docs);
+        }
+    }
+    free(postings.data);
+    free(order);
+
+    for (size_t i = 0; i < buffer->doc_count; i++) {
+        IndexDoc *doc = &buffer->docs[i];
+        if (i + 1 < buffer->doc_count && buffer->docs[i + 1].doc == doc->doc) {
+            continue;
+        }
+        segment_writer_doc(&writer, doc->doc, doc->version, buffer->text + doc->offset, doc->len);
+    }
+    return segment_writer_finish(&writer, index->dir, number, 0);
+}
+
+// Map a segment file and check its header. Returns false if it is missing or damaged.
+static bool index_map(IndexMap *map, const char *path) {
+    memset(map, 0, sizeof(*map));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexSegmentHeader)) {
+        close(fd);
+        return false;
+    }
+    map->size = (size_t)st.st_size;
+    map->map = (char *)mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->map == MAP_FAILED) {
+        map->map = NULL;
+        return false;
+    }
+    const IndexSegmentHeader *header = (const IndexSegmentHeader *)map->map;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 || header->size != map->size ||
+        header->terms_offset + (uint64_t)header->terms * sizeof(IndexTermEntry) > header->docs_offset ||
+        header->docs_offset + header->docs * sizeof(IndexDocEntry) > map->size) {
+        fprintf(stderr, "Warning: Skipping damaged index segment %s\n", path);
+        munmap(map->map, map->size);
+        map->map = NULL;
+        return false;
+    }
+    map->header = header;
+    map->terms = (const IndexTermEntry *)(map->map + header->terms_offset);
+    map->docs = (const IndexDocEntry *)(map->map + header->docs_offset);
+    return true;
+}
+
+// Unmap a segment.
+static void index_unmap(IndexMap *map) {
+    if (map->map) {
+        munmap(map->map, map->size);
+    }
+}
+
+// A posting list being decoded.
+typedef struct {
+    const uint8_t *p, *end;
+    uint64_t doc;
+    uint32_t tf;
+    bool valid;
+} PostingCursor;
+
+// Position a cursor on a term's first posting.
+static void posting_open(PostingCursor *cursor, const IndexMap *map, const IndexTermEntry *term) {
+    cursor->p = (const uint8_t *)map->map + term->postings;
+    cursor->end = cursor->p + term->postings_len;
+    cursor->doc = 0;
+    cursor->valid = true;
+}
+
+// Decode the next posting. Returns false at the end of the list.
+static bool posting_next(PostingCursor *cursor) {
+    if (cursor->p >= cursor->end) {
+        cursor->valid = false;
+        return false;
+    }
+    cursor->doc += read_varint(&cursor->p, cursor->end);
+    cursor->tf = (uint32_t)read_varint(&cursor->p, cursor->end);
+    return true;
+}
+
+// The input a document of a merge is taken from.
+typedef struct {
+    uint64_t doc;
+    int input;
+} IndexWinner;
+
+// The input holding a document's newest version, or -1 if no input has it.
+static int index_winner(const IndexWinner *winners, size_t count, uint64_t doc) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (winners[mid].doc < doc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && winners[lo].doc == doc ? winners[lo].input : -1;
+}
+
+// Merge segments into one of the next level. Postings of a term are merged by document. A
+// document found in several inputs, indexed again by a recrawl or left by a merge that was
+// interrupted, is taken whole from the input with its newest version.
+static uint64_t index_merge(Index *index, IndexSegment **inputs, int count, uint32_t number, uint32_t level) {
+    IndexMap maps[INDEX_MERGE_FANIN];
+    int mapped = 0;
+    for (int i = 0; i < count; i++) {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/seg-%06u.idx", index->dir, inputs[i]->number);
+        if (index_map(&maps[mapped], path)) {
+            mapped++;
+        }
+    }
+    SegmentWriter writer;
+    if (!segment_writer_open(&writer, index->dir, number)) {
+        for (int i = 0; i < mapped; i++) {
+            index_unmap(&maps[i]);
+        }
+        return 0;
+    }
+
+    // Each document's newest version, from the first input to have it
+    size_t doc_total = 0;
+    for (int i = 0; i < mapped; i++) {
+        doc_total += maps[i].header->docs;
+    }
+    IndexWinner *winners = (IndexWinner *)malloc((doc_total + 1) * sizeof(IndexWinner));
+    const IndexDocEntry **winner_docs = (const IndexDocEntry **)malloc((doc_total + 1) * sizeof(IndexDocEntry *));
+    if (!winners || !winner_docs) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t winner_count = 0;
+    uint64_t doc_pos[INDEX_MERGE_FANIN] = {0};
+    while (true) {
+        int best = -1;
+        for (int i = 0; i < mapped; i++) {
+            if (doc_pos[i] < maps[i].header->docs &&
+                (best < 0 || maps[i].docs[doc_pos[i]].doc < maps[best].docs[doc_pos[best]].doc)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        const IndexDocEntry *doc = &maps[best].docs[doc_pos[best]++];
+        if (winner_count > 0 && winners[winner_count - 1].doc == doc->doc) {
+            if (doc->version > winner_docs[winner_count - 1]->version) {
+                winners[winner_count - 1].input = best;
+                winner_docs[winner_count - 1] = doc;
+            }
+            continue;
+        }
+        winners[winner_count] = (IndexWinner){doc->doc, best};
+        winner_docs[winner_count++] = doc;
+    }
+
+    uint32_t term_pos[INDEX_MERGE_FANIN] = {0};
+    ByteBuffer postings = {NULL, 0, 0};
+    while (true) {
+        // The smallest term among the inputs' next ones
+        const char *term = NULL;
+        uint32_t term_len = 0;
+        for (int i = 0; i < mapped; i++) {
+            if (term_pos[i] < maps[i].header->terms) {
+                const IndexTermEntry *entry = &maps[i].terms[term_pos[i]];
+                const char *text = maps[i].map + entry->text;
+                if (!term || term_compare(text, entry->len, term, term_len) < 0) {
+                    term = text;
+                    term_len = entry->len;
+                }
+            }
+        }
+        if (!term) {
+            break;
+        }
+        PostingCursor cursors[INDEX_MERGE_FANIN];
+        for (int i = 0; i < mapped; i++) {
+            cursors[i].valid = false;
+            if (term_pos[i] < maps[i].header->terms) {
+                const IndexTermEntry *entry = &maps[i].terms[term_pos[i]];
+                if (term_compare(maps[i].map + entry->text, entry->len, term, term_len) == 0) {
+                    posting_open(&cursors[i], &maps[i], entry);
+                    posting_next(&cursors[i]);
+                    term_pos[i]++;
+                }
+            }
+        }
+        postings.len = 0;
+        uint64_t last = 0;
+        uint32_t docs = 0;
+        while (true) {
+            int best = -1;
+            for (int i = 0; i < mapped; i++) {
+                if (cursors[i].valid && (best < 0 || cursors[i].doc < cursors[best].doc)) {
+                    best = i;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            if (index_winner(winners, winner_count, cursors[best].doc) == best) {
+                bytes_varint(&postings, cursors[best].doc - last);
+                bytes_varint(&postings, cursors[best].tf);
+                last = cursors[best].doc;
+                docs++;
+            }
+            posting_next(&cursors[best]);
+        }
+        if (docs > 0) {
+            segment_writer_term(&writer, term, term_len, &postings, docs);
+        }
+    }
+    free(postings.data);
+
+    for (size_t i = 0; i < winner_count; i++) {
+        const IndexDocEntry *doc = winner_docs[i];
+        segment_writer_doc(&writer, doc->doc, doc->version, maps[winners[i].input].map + doc->text, doc->len);
+    }
+    free(winners);
+    free(winner_docs);
+    for (int i = 0; i < mapped; i++) {
+        index_unmap(&maps[i]);
+    }
+    return segment_writer_finish(&writer, index->dir, number, level);
+}
+
+// Add a segment to the end of the live list. Called with the lock held.
+static void index_add_segment(Index *index, uint32_t number, uint32_t level) {
+    IndexSegment *segment = (IndexSegment *)malloc(sizeof(IndexSegment));
+    if (!segment) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    segment->number = number;
+    segment->level = level;
+    segment->next = NULL;
+    IndexSegment **tail = &index->segments;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    *tail = segment;
+}
+
+// Take the oldest INDEX_MERGE_FANIN segments of the lowest level that has that many off the
+// live list. Returns their level, or -1 if no level is ready. Called with the lock held.
+static int index_take_merge(Index *index, IndexSegment **inputs) {
+    for (uint32_t level = 0; level < 32; level++) {
+        int count = 0;
+        for (IndexSegment *s = index->segments; s && count < INDEX_MERGE_FANIN; s = s->next) {
+            count += s->level == level;
+        }
+        if (count < INDEX_MERGE_FANIN) {
+            continue;
+        }
+        count = 0;
+        for (IndexSegment **link = &index->segments; *link && count < INDEX_MERGE_FANIN;) {
+            if ((*link)->level == level) {
+                inputs[count++] = *link;
+                *link = (*link)->next;
+            } else {
+                link = &(*link)->next;
+            }
+        }
+        return (int)level;
+    }
+    return -1;
+}
+
+// Background thread: write full buffers as segments, and merge segments whenever a level
+// has INDEX_MERGE_FANIN of them, until the index is closed and nothing is left to do.
+static void *index_merger(void *arg) {
+    Index *index = (Index *)arg;
+    pthread_mutex_lock(&index->lock);
+    while (true) {
+        if (index->full) {
+            IndexBuffer *buffer = index->full;
+            index->full = buffer->next;
+            // A checkpoint may have emptied a buffer on its way here.
+            uint32_t number = buffer->doc_count ? index->next_segment++ : 0;
+            pthread_mutex_unlock(&index->lock);
+            uint64_t size = buffer->doc_count ? index_write_buffer(index, buffer, number) : 0;
+            index_buffer_free(buffer);
+            pthread_mutex_lock(&index->lock);
+            if (size) {
+                index_add_segment(index, number, 0);
+                atomic_fetch_add(&index->written, 1);
+                atomic_fetch_add(&index->bytes, size);
+            }
+            index->full_out++;
+            pthread_cond_broadcast(&index->drained);
+            continue;
+        }
+        IndexSegment *inputs[INDEX_MERGE_FANIN];
+        int level = index_take_merge(index, inputs);
+        if (level >= 0) {
+            uint32_t number = index->next_segment++;
+            pthread_mutex_unlock(&index->lock);
+            uint64_t size = index_merge(index, inputs, INDEX_MERGE_FANIN, number, (uint32_t)level + 1);
+            if (size) {
+                // The merged segment is in place; its inputs may go. A reader that still sees
+                // them drops the duplicate documents.
+                for (int i = 0; i < INDEX_MERGE_FANIN; i++) {
+                    char path[600];
+                    snprintf(path, sizeof(path), "%s/seg-%06u.idx", index->dir, inputs[i]->number);
+                    unlink(path);
+                }
+            }
+            pthread_mutex_lock(&index->lock);
+            if (size) {
+                for (int i = 0; i < INDEX_MERGE_FANIN; i++) {
+                    free(inputs[i]);
+                }
+                index_add_segment(index, number, (uint32_t)level + 1);
+                atomic_fetch_add(&index->merged, 1);
+                atomic_fetch_add(&index->bytes, size);
+            } else {
+                // Leave the inputs live but stop merging; the crawl itself goes on.
+                for (int i = 0; i < INDEX_MERGE_FANIN; i++) {
+                    inputs[i]->level = UINT32_MAX;
+                    inputs[i]->next = index->segments;
+                    index->segments = inputs[i];
+                }
+            }
+            continue;
+        }
+        if (index->stopping) {
+            break;
+        }
+        pthread_cond_wait(&index->wake, &index->lock);
+    }
+    pthread_mutex_unlock(&index->lock);
+    return NULL;
+}
+
+// Open or create an index directory. Segments already there are kept, numbered documents
+// continue after theirs, and the background merger starts.
+Index *index_open(const char *dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        perror("Error: Unable to create index directory");
+        return NULL;
+    }
+    DIR *listing = opendir(dir);
+    if (!listing) {
+        perror("Error: Unable to read index directory");
+        return NULL;
+    }
+    index_fold_init();
+    Index *index = (Index *)calloc(1, sizeof(Index));
+    if (!index) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(index->dir, sizeof(index->dir), "%s", dir);
+    pthread_mutex_init(&index->lock, NULL);
+    pthread_cond_init(&index->wake, NULL);
+    pthread_cond_init(&index->drained, NULL);
+
+    // Segments go in oldest first, so merges keep taking the oldest of a level.
+    uint32_t numbers[4096];
+    size_t count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(listing))) {
+        unsigned number;
+        char suffix[8];
+        char path[1100];
+        if (sscanf(entry->d_name, "seg-%u.%7s", &number, suffix) != 2) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (strcmp(suffix, "tmp") == 0) {
+            unlink(path); // Left by a crawl that stopped mid-write
+        } else if (strcmp(suffix, "idx") == 0 && count < sizeof(numbers) / sizeof(numbers[0])) {
+            numbers[count++] = number;
+        }
+    }
+    closedir(listing);
+    for (size_t i = 1; i < count; i++) {
+        for (size_t j = i; j > 0 && numbers[j - 1] > numbers[j]; j--) {
+            uint32_t swap = numbers[j];
+            numbers[j] = numbers[j - 1];
+            numbers[j - 1] = swap;
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        char path[600];
+        snprintf(path, sizeof(path), "%s/seg-%06u.idx", dir, numbers[i]);
+        IndexMap map;
+        if (index_map(&map, path)) {
+            if (map.header->doc_limit > index->doc_base) {
+                index->doc_base = map.header->doc_limit;
+            }
+            index_add_segment(index, numbers[i], map.header->level);
+            index_unmap(&map);
+        }
+        index->next_segment = numbers[i] + 1;
+    }
+
+    if (pthread_create(&index->merger, NULL, index_merger, index) != 0) {
+        fprintf(stderr, "Error: Unable to start the index merger\n");
+        index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+// Write out every thread's remaining postings and wait for the merger to finish.
+void index_close(Index *index) {
+    pthread_mutex_lock(&index->lock);
+    while (index->buffers) {
+        IndexBuffer *buffer = index->buffers;
+        index->buffers = buffer->next;
+        if (buffer->doc_count) {
+            buffer->next = index->full;
+            index->full = buffer;
+            index->full_in++;
+        } else {
+            index_buffer_free(buffer);
+        }
+    }
+    index->stopping = true;
+    pthread_cond_signal(&index->wake);
+    pthread_mutex_unlock(&index->lock);
+    pthread_join(index->merger, NULL);
+}
+
+// Free a closed index.
+void index_free(Index *index) {
+    while (index->segments) {
+        IndexSegment *segment = index->segments;
+        index->segments = segment->next;
+        free(segment);
+    }
+    pthread_cond_destroy(&index->wake);
+    pthread_cond_destroy(&index->drained);
+    pthread_mutex_destroy(&index->lock);
+    free(index);
+}
+
+// Queue a buffer for the merger to write, after those already waiting. Called with the lock held.
+static void index_queue_full(Index *index, IndexBuffer *buffer) {
+    IndexBuffer **tail = &index->full;
+    while (*tail) {
+        tail = &(*tail)->next;
+    }
+    buffer->next = NULL;
+    *tail = buffer;
+    index->full_in++;
+}
+
+// Hand this thread's buffer to the merger to be written as a segment, and start a new one.
+static void index_hand_off(Index *index) {
+    IndexBuffer *full = index_local;
+    index_local = index_buffer_create();
+    pthread_mutex_lock(&index->lock);
+    for (IndexBuffer **link = &index->buffers; *link; link = &(*link)->next) {
+        if (*link == full) {
+            *link = full->next;
+            break;
+        }
+    }
+    index_local->next = index->buffers;
+    index->buffers = index_local;
+    index_queue_full(index, full);
+    pthread_cond_signal(&index->wake);
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Write out the postings every thread has buffered, for a checkpoint, busy threads included:
+// each buffer's contents are taken under its lock. Returns once the merger has written them.
+void index_checkpoint(Index *index) {
+    pthread_mutex_lock(&index->lock);
+    for (IndexBuffer *buffer = index->buffers; buffer; buffer = buffer->next) {
+        pthread_mutex_lock(&buffer->lock);
+        IndexBuffer *taken = buffer->doc_count ? index_buffer_take(buffer) : NULL;
+        pthread_mutex_unlock(&buffer->lock);
+        if (taken) {
+            index_queue_full(index, taken);
+        }
+    }
+    uint64_t target = index->full_in;
+    pthread_cond_signal(&index->wake);
+    while (index->full_out < target) {
+        pthread_cond_wait(&index->drained, &index->lock);
+    }
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Index one fetched page into this thread's buffer, handing the buffer to the merger once full.
+static void index_sink_page(Sink *sink, const FetchResult *result) {
+    Index *index = ((IndexSink *)sink)->index;
+    IndexPage *page = result->index_page;
+    if (!page || result->status >= 400) {
+        return;
+    }
+    index_page_word(page);
+    if (!index_local) {
+        index_local = index_buffer_create();
+        pthread_mutex_lock(&index->lock);
+        index_local->next = index->buffers;
+        index->buffers = index_local;
+        pthread_mutex_unlock(&index->lock);
+    }
+    uint32_t version = atomic_fetch_add(&index->visits, 1) + 1;
+    pthread_mutex_lock(&index_local->lock);
+    size_t before = index_local->bytes;
+    index_buffer_add(index_local, index->doc_base + result->url_id, version, result->url, page);
+    size_t bytes = index_local->bytes;
+    pthread_mutex_unlock(&index_local->lock);
+    mem_account(MEM_OUTPUT, (long)(bytes - before));
+    atomic_fetch_add(&index->pages, 1);
+    atomic_fetch_add(&index->postings, page->word_count);
+    size_t limit = (size_t)(mem_pressure() == MEM_OK ? INDEX_BUFFER_MB : INDEX_BUFFER_SOFT_MB) << 20;
+    if (bytes >= limit) {
+        index_hand_off(index);
+    }
+}
+
+// The index outlives its sink: index_close() runs once the workers are done.
+static void index_sink_close(Sink *sink) {
+    free(sink);
+}
+
+// Wrap an open index as a crawl sink.
+Sink *index_sink_create(Index *index) {
+    IndexSink *sink = (IndexSink *)calloc(1, sizeof(IndexSink));
+    if (!sink) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    sink->base.name = "index";
+    sink->base.page = index_sink_page;
+    sink->base.close = index_sink_close;
+    sink->index = index;
+    return &sink->base;
+}
+
+// A document matching a query.
+typedef struct {
+    uint64_t doc;
+    uint64_t score;                     // Sum of the query terms' frequencies
+    const IndexMap *map;
+    const IndexDocEntry *entry;
+} IndexHit;
+
+// Find a term in a segment's dictionary.
+static const IndexTermEntry *index_find_term(const IndexMap *map, const char *term, size_t len) {
+    size_t lo = 0, hi = map->header->terms;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const IndexTermEntry *entry = &map->terms[mid];
+        int c = term_compare(map->map + entry->text, entry->len, term, len);
+        if (c == 0) {
+            return entry;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// Find a document in a segment's table.
+static const IndexDocEntry *index_find_doc(const IndexMap *map, uint64_t doc) {
+    size_t lo = 0, hi = map->header->docs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->docs[mid].doc < doc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < map->header->docs && map->docs[lo].doc == doc ? &map->docs[lo] : NULL;
+}
+
+// Whether no segment holds a newer version of a document than `entry`.
+static bool index_doc_current(const IndexMap *maps, size_t count, const IndexDocEntry *entry) {
+    for (size_t m = 0; m < count; m++) {
+        const IndexDocEntry *other = index_find_doc(&maps[m], entry->doc);
+        if (other && other->version > entry->version) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Order hits by document, then best score first.
+static int compare_hit_docs(const void *a, const void *b) {
+    const IndexHit *x = (const IndexHit *)a, *y = (const IndexHit *)b;
+    if (x->doc != y->doc) {
+        return (x->doc > y->doc) - (x->doc < y->doc);
+    }
+    return (x->score < y->score) - (x->score > y->score);
+}
+
+// Order hits best score first, then by document.
+static int compare_hit_scores(const void *a, const void *b) {
+    const IndexHit *x = (const IndexHit *)a, *y = (const IndexHit *)b;
+    if (x->score != y->score) {
+        return (x->score < y->score) - (x->score > y->score);
+    }
+    return (x->doc > y->doc) - (x->doc < y->doc);
+}
+
+// Print the URLs of the documents holding every word of `query`, best first, with the sum of
+// the words' frequencies. The segments are mapped, not read.
+bool index_query(const char *dir, const char *query) {
+    index_fold_init();
+    char terms[16][INDEX_TERM_MAX];
+    size_t lens[16];
+    int term_count = 0;
+    for (const unsigned char *p = (const unsigned char *)query; *p;) {
+        while (*p && !index_fold[*p]) {
+            p++;
+        }
+        size_t len = 0;
+        while (index_fold[*p]) {
+            if (len < INDEX_TERM_MAX && term_count < 16) {
+                terms[term_count][len] = (char)index_fold[*p];
+            }
+            len++;
+            p++;
+        }
+        if (len > INDEX_TERM_MAX) {
+            fprintf(stderr, "Error: Words over %d bytes are not indexed\n", INDEX_TERM_MAX);
+            return false;
+        }
+        if (len && term_count < 16) {
+            lens[term_count++] = len;
+        }
+    }
+    if (term_count == 0) {
+        fprintf(stderr, "Error: The query has no words\n");
+        return false;
+    }
+
+    DIR *listing = opendir(dir);
+    if (!listing) {
+        perror("Error: Unable to read index directory");
+        return false;
+    }
+    IndexMap *maps = NULL;
+    size_t map_count = 0, map_cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(listing))) {
+        unsigned number;
+        char suffix[8];
+        char path[1100];
+        if (sscanf(entry->d_name, "seg-%u.%7s", &number, suffix) != 2 || strcmp(suffix, "idx") != 0) {
+            continue;
+        }
+        maps = (IndexMap *)index_grow(maps, &map_cap, map_count + 1, sizeof(IndexMap));
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        map_count += index_map(&maps[map_count], path);
+    }
+    closedir(listing);
+
+    IndexHit *hits = NULL;
+    size_t hit_count = 0, hit_cap = 0;
+    for (size_t m = 0; m < map_count; m++) {
+        const IndexMap *map = &maps[m];
+        const IndexTermEntry *found[16];
+        int shortest = 0;
+        bool all = true;
+        for (int t = 0; t < term_count && all; t++) {
+            found[t] = index_find_term(map, terms[t], lens[t]);
+            all = found[t] != NULL;
+            if (all && found[t]->docs < found[shortest]->docs) {
+                shortest = t;
+            }
+        }
+        if (!all) {
+            continue;
+        }
+        // Walk the rarest term's list and advance the others alongside it.
+        PostingCursor cursors[16];
+        for (int t = 0; t < term_count; t++) {
+            posting_open(&cursors[t], map, found[t]);
+            posting_next(&cursors[t]);
+        }
+        for (; cursors[shortest].valid; posting_next(&cursors[shortest])) {
+            uint64_t doc = cursors[shortest].doc;
+            uint64_t score = 0;
+            bool match = true;
+            for (int t = 0; t < term_count && match; t++) {
+                while (cursors[t].valid && cursors[t].doc < doc) {
+                    posting_next(&cursors[t]);
+                }
+                match = cursors[t].valid && cursors[t].doc == doc;
+                score += match ? cursors[t].tf : 0;
+            }
+            const IndexDocEntry *doc_entry = match ? index_find_doc(map, doc) : NULL;
+            // A page indexed again counts only as its newest version, which may lack the words.
+            if (doc_entry && index_doc_current(maps, map_count, doc_entry)) {
+                hits = (IndexHit *)index_grow(hits, &hit_cap, hit_count + 1, sizeof(IndexHit));
+                hits[hit_count++] = (IndexHit){doc, score, map, doc_entry};
+            }
+        }
+    }
+
+    // A document can be in two segments while a merge is being cleaned up; keep one.
+    qsort(hits, hit_count, sizeof(IndexHit), compare_hit_docs);
+    size_t unique = 0;
+    for (size_t i = 0; i < hit_count; i++) {
+        if (unique == 0 || hits[unique - 1].doc != hits[i].doc) {
+            hits[unique++] = hits[i];
+        }
+    }
+    qsort(hits, unique, sizeof(IndexHit), compare_hit_scores);
+    for (size_t i = 0; i < unique; i++) {
+        printf("%.*s\t%lu\n", (int)hits[i].entry->len, hits[i].map->map + hits[i].entry->text,
+               (unsigned long)hits[i].score);
+    }
+    fprintf(stderr, "%zu documents in %zu segments\n", unique, map_count);
+
+    free(hits);
+    for (size_t m = 0; m < map_count; m++) {
+        index_unmap(&maps[m]);
+    }
+    free(maps);
+    return true;
+}
@@ -0,0 +1,100 @@
+// Optional sink that builds an inverted index of page text: per-thread postings flushed as
+// immutable segment files, merged in the background, queried by mapping the segments.
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "crawler_core.h"
+
+#define INDEX_TERM_MAX 32               // Longer words are not indexed
+#define INDEX_BUFFER_MB 64              // In-memory postings per thread before they become a segment
+#define INDEX_BUFFER_SOFT_MB 4          // The same while memory is short
+#define INDEX_MERGE_FANIN 4             // Segments of one level merged into one of the next
+#define INDEX_MAGIC "WCINDEX1"
+
+struct IndexBuffer;
+struct IndexSegment;
+
+// Header at the start of a segment file. Posting lists follow it; the term and document
+// tables and the strings they point into come after those.
+typedef struct {
+    char magic[8];
+    uint32_t level;                     // Merges that went into the segment
+    uint32_t terms;
+    uint64_t docs;
+    uint64_t doc_limit;                 // One past the highest document number
+    uint64_t terms_offset;              // IndexTermEntry[terms], sorted by term
+    uint64_t docs_offset;               // IndexDocEntry[docs], sorted by document
+    uint64_t size;                      // Whole file, to catch truncation
+} IndexSegmentHeader;
+
+// A term and its posting list: (document delta, term frequency) varint pairs by document.
+typedef struct {
+    uint64_t postings;
+    uint64_t text;                      // Offset of the term's bytes in the file
+    uint32_t postings_len;
+    uint32_t docs;
+    uint32_t len;
+    uint32_t pad;
+} IndexTermEntry;
+
+// A document and its URL.
+typedef struct {
+    uint64_t doc;
+    uint64_t text;
+    uint32_t len;
+    uint32_t version;                   // Visit indexed here; the document's highest version replaces the rest
+} IndexDocEntry;
+
+// The index of one crawl. Documents are numbered doc_base + URL ID, so segments left by an
+// earlier crawl in the same directory keep their own numbers. A page indexed again by a
+// continuous crawl keeps its number under a higher version.
+typedef struct Index {
+    char dir[512];
+    uint64_t doc_base;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t drained;             // Signalled as the merger finishes each full buffer
+    pthread_t merger;
+    struct IndexBuffer *buffers;        // Every thread's buffer, for the final flush
+    struct IndexBuffer *full;           // Buffers waiting to be written by the merger
+    uint64_t full_in, full_out;         // Buffers put on the full list, and written from it
+    struct IndexSegment *segments;      // Live segments, oldest first
+    uint32_t next_segment;
+    bool stopping;
+    atomic_uint visits;                 // Versions handed out
+    atomic_ulong pages;
+    atomic_ulong postings;
+    atomic_ulong written;               // Segments flushed from memory
+    atomic_ulong merged;                // Segments produced by merges
+    atomic_ulong bytes;                 // Bytes of segments written and merged
+} Index;
+
+// Tokenizer state and word counts of the page a worker is fetching.
+typedef struct IndexPage {
+    bool in_tag, closing, named;        // named: the tag name has been read
+    bool raw;                           // Inside <script> or <style>, until the next "</"
+    bool entity;
+    bool lt;                            // Raw text just saw '<'
+    char tag[8];
+    size_t tag_len;
+    char word[INDEX_TERM_MAX];
+    size_t word_len;
+    bool word_long;
+    char *text;                         // Distinct words of the page back to back
+    size_t text_len, text_cap;
+    struct IndexWord *words;            // Open-addressed set of the page's words
+    size_t word_count, word_cap;
+} IndexPage;
+
+Index *index_open(const char *dir);
+Sink *index_sink_create(Index *index);
+void index_close(Index *index);
+void index_free(Index *index);
+void index_checkpoint(Index *index);
+IndexPage *index_page_create(void);
+void index_page_free(IndexPage *page);
+void index_page_begin(IndexPage *page);
+void index_page_feed(IndexPage *page, const char *data, size_t len);
+bool index_query(const char *dir, const char *query);
+
+#endif
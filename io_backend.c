@@ -0,0 +1,513 @@
+#include "crawler_core.h"
+#include "io_backend.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <semaphore.h>
+#include <linux/io_uring.h>
+
+#define IO_RING_ENTRIES 256
+#define IO_FIXED_BUFFERS 64         // Registered buffers that batch result and error lines
+
+// Blocking fallback: the workers write through stdio themselves.
+typedef struct {
+    IoBackend base;
+    FILE *files[IO_STREAM_COUNT];
+    pthread_mutex_t lock;
+} StdioBackend;
+
+// Minimal io_uring instance set up with raw syscalls.
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned sq_entries, cq_entries;
+    unsigned to_submit;
+} Uring;
+
+// Bookkeeping for one registered line buffer.
+typedef struct {
+    int stream;
+    off_t offset;
+    size_t len;
+    int next_free;
+} UringBuffer;
+
+// io_uring backend: workers only push requests; one I/O thread batches and submits them.
+typedef struct {
+    IoBackend base;
+    Uring ring;
+    bool fixed;                  // Line buffers are registered with the kernel
+    int fds[IO_STREAM_COUNT];
+    off_t tails[IO_STREAM_COUNT];
+    int current[IO_STREAM_COUNT]; // Buffer being filled per stream, -1 if none
+    char *buffer_memory;
+    UringBuffer buffers[IO_FIXED_BUFFERS];
+    int free_buffers;
+    unsigned inflight;
+    _Atomic(IoRequest *) pending; // Lock-free stack pushed by the workers
+    sem_t wake;
+    atomic_bool stopping;
+    pthread_t thread;
+} UringBackend;
+
+// pwritev() that retries until every byte of the iovec array is written.
+bool pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t written = pwritev(fd, iov, iovcnt, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        offset += written;
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// Write a line through stdio, as the crawler always did.
+static void stdio_write_line(IoBackend *io, IoStream stream, const char *line, size_t len) {
+    StdioBackend *backend = (StdioBackend *)io;
+    pthread_mutex_lock(&backend->lock);
+    fwrite(line, 1, len, backend->files[stream]);
+    fflush(backend->files[stream]); // Flush the output to ensure it's written immediately
+    pthread_mutex_unlock(&backend->lock);
+}
+
+// Perform a positioned write synchronously in the calling worker.
+static void stdio_submit(IoBackend *io, IoRequest *req) {
+    (void)io;
+    bool ok = pwritev_all(req->fd, req->iov, req->iovcnt, req->offset);
+    if (!ok) {
+        perror("Error: Unable to write archive record");
+    }
+    req->done(req, ok);
+}
+
+// Close the stdio streams.
+static void stdio_shutdown(IoBackend *io) {
+    StdioBackend *backend = (StdioBackend *)io;
+    for (int i = 0; i < IO_STREAM_COUNT; i++) {
+        fclose(backend->files[i]);
+    }
+    pthread_mutex_destroy(&backend->lock);
+    free(backend);
+}
+
+// Open the output file and the error log for the stdio backend.
+IoBackend *stdio_backend_create(const char *output_path, const char *error_path) {
+    StdioBackend *backend = (StdioBackend *)calloc(1, sizeof(StdioBackend));
+    if (!backend) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    backend->files[IO_STREAM_OUTPUT] = fopen(output_path, "w");
+    backend->files[IO_STREAM_ERRORS] = fopen(error_path, "a");
+    if (!backend->files[IO_STREAM_OUTPUT] || !backend->files[IO_STREAM_ERRORS]) {
+        for (int i = 0; i < IO_STREAM_COUNT; i++) {
+            if (backend->files[i]) {
+                fclose(backend->files[i]);
+            }
+        }
+        free(backend);
+        return NULL;
+    }
+    pthread_mutex_init(&backend->lock, NULL);
+    backend->base.name = "stdio";
+    backend->base.write_line = stdio_write_line;
+    backend->base.submit = stdio_submit;
+    backend->base.shutdown = stdio_shutdown;
+    return &backend->base;
+}
+
+// Set up an io_uring instance and map its rings.
+static bool uring_init(Uring *ring, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        return false;
+    }
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return false;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return false;
+    }
+
+    char *sq = (char *)ring->sq_ring;
+    char *cq = (char *)ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    ring->sq_entries = p.sq_entries;
+    ring->cq_entries = p.cq_entries;
+    return true;
+}
+
+// Unmap and close an io_uring instance.
+static void uring_free(Uring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+// Hand queued SQEs to the kernel, optionally waiting for `wait` completions.
+static void uring_enter(Uring *ring, unsigned wait) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    while (ring->to_submit > 0 || wait > 0) {
+        int ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait, flags, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error: io_uring_enter failed");
+            return;
+        }
+        ring->to_submit -= ret < (int)ring->to_submit ? (unsigned)ret : ring->to_submit;
+        if (ring->to_submit == 0) {
+            return;
+        }
+        wait = 0;
+        flags = 0;
+    }
+}
+
+// Completion of one registered line buffer; short writes are finished synchronously.
+static void uring_buffer_done(UringBackend *backend, int index, int res) {
+    UringBuffer *buffer = &backend->buffers[index];
+    char *data = backend->buffer_memory + (size_t)index * IO_BUFFER_SIZE;
+    size_t written = res > 0 ? (size_t)res : 0;
+    if (res < 0) {
+        errno = -res;
+        perror("Error: io_uring write failed");
+    } else if (written < buffer->len) {
+        struct iovec rest = {data + written, buffer->len - written};
+        pwritev_all(backend->fds[buffer->stream], &rest, 1, buffer->offset + written);
+    }
+    buffer->next_free = backend->free_buffers;
+    backend->free_buffers = index;
+}
+
+// Process every available completion.
+static void uring_reap(UringBackend *backend) {
+    Uring *ring = &backend->ring;
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        if (cqe->user_data & 1) {
+            uring_buffer_done(backend, (int)(cqe->user_data >> 1), cqe->res);
+        } else {
+            IoRequest *req = (IoRequest *)(uintptr_t)cqe->user_data;
+            bool ok = cqe->res >= 0;
+            size_t total = 0;
+            for (int i = 0; i < req->iovcnt; i++) {
+                total += req->iov[i].iov_len;
+            }
+            if (ok && (size_t)cqe->res < total) {
+                // Short write: finish the rest here, on the I/O thread.
+                size_t skip = cqe->res;
+                int first = 0;
+                while (skip >= req->iov[first].iov_len) {
+                    skip -= req->iov[first++].iov_len;
+                }
+                req->iov[first].iov_base = (char *)req->iov[first].iov_base + skip;
+                req->iov[first].iov_len -= skip;
+                ok = pwritev_all(req->fd, req->iov + first, req->iovcnt - first, req->offset + cqe->res);
+            }
+            if (!ok) {
+                perror("Error: Unable to write archive record");
+            }
+            req->done(req, ok);
+        }
+        backend->inflight--;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Get a free SQE, submitting or waiting for completions when the rings are full.
+static struct io_uring_sqe *uring_get_sqe(UringBackend *backend) {
+    Uring *ring = &backend->ring;
+    while (backend->inflight + 1 > ring->cq_entries) {
+        uring_enter(ring, 1);
+        uring_reap(backend);
+    }
+    unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        uring_enter(ring, 0);
+    }
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    backend->inflight++;
+    return sqe;
+}
+
+// Queue the write of a filled line buffer at its stream's current tail.
+static void uring_flush_buffer(UringBackend *backend, int stream) {
+    int index = backend->current[stream];
+    if (index < 0) {
+        return;
+    }
+    UringBuffer *buffer = &backend->buffers[index];
+    buffer->offset = backend->tails[stream];
+    backend->tails[stream] += buffer->len;
+    backend->current[stream] = -1;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(backend);
+    sqe->opcode = backend->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = backend->fds[stream];
+    sqe->off = buffer->offset;
+    sqe->addr = (uintptr_t)(backend->buffer_memory + (size_t)index * IO_BUFFER_SIZE);
+    sqe->len = buffer->len;
+    sqe->buf_index = index;
+    sqe->user_data = ((uint64_t)index << 1) | 1;
+}
+
+// Copy a line into its stream's current registered buffer.
+static void uring_append(UringBackend *backend, int stream, const char *data, size_t len) {
+    while (len > 0) {
+        if (backend->current[stream] < 0) {
+            while (backend->free_buffers < 0) {
+                uring_enter(&backend->ring, 1);
+                uring_reap(backend);
+            }
+            int index = backend->free_buffers;
+            backend->free_buffers = backend->buffers[index].next_free;
+            backend->buffers[index].stream = stream;
+            backend->buffers[index].len = 0;
+            backend->current[stream] = index;
+        }
+        UringBuffer *buffer = &backend->buffers[backend->current[stream]];
+        size_t n = IO_BUFFER_SIZE - buffer->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(backend->buffer_memory + (size_t)backend->current[stream] * IO_BUFFER_SIZE + buffer->len, data, n);
+        buffer->len += n;
+        data += n;
+        len -= n;
+        if (buffer->len == IO_BUFFER_SIZE) {
+            uring_flush_buffer(backend, stream);
+        }
+    }
+}
+
+// The I/O thread: drains the request stack, batches lines per stream and submits everything at once.
+static void *uring_thread(void *arg) {
+    UringBackend *backend = (UringBackend *)arg;
+    while (true) {
+        IoRequest *batch = atomic_exchange(&backend->pending, NULL);
+
+        // The stack is newest-first; reverse it to keep lines in submission order.
+        IoRequest *ordered = NULL;
+        while (batch) {
+            IoRequest *next = batch->next;
+            batch->next = ordered;
+            ordered = batch;
+            batch = next;
+        }
+        bool idle = ordered == NULL;
+        while (ordered) {
+            IoRequest *req = ordered;
+            ordered = ordered->next;
+            if (req->stream >= 0) {
+                uring_append(backend, req->stream, req->data, req->len);
+                free(req);
+            } else {
+                struct io_uring_sqe *sqe = uring_get_sqe(backend);
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->fd = req->fd;
+                sqe->off = req->offset;
+                sqe->addr = (uintptr_t)req->iov;
+                sqe->len = req->iovcnt;
+                sqe->user_data = (uintptr_t)req;
+            }
+        }
+        for (int i = 0; i < IO_STREAM_COUNT; i++) {
+            uring_flush_buffer(backend, i);
+        }
+        uring_enter(&backend->ring, 0);
+        uring_reap(backend);
+
+        if (idle) {
+            if (backend->inflight > 0) {
+                uring_enter(&backend->ring, 1);
+                uring_reap(backend);
+            } else if (atomic_load(&backend->stopping)) {
+                break;
+            } else {
+                sem_wait(&backend->wake);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Push a request onto the lock-free stack and wake the I/O thread.
+static void uring_push(UringBackend *backend, IoRequest *req) {
+    req->next = atomic_load(&backend->pending);
+    while (!atomic_compare_exchange_weak(&backend->pending, &req->next, req)) {
+    }
+    sem_post(&backend->wake);
+}
+
+// Queue a line; the worker only pays for a malloc and a copy.
+static void uring_write_line(IoBackend *io, IoStream stream, const char *line, size_t len) {
+    IoRequest *req = (IoRequest *)malloc(sizeof(IoRequest) + len);
+    if (!req) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(req + 1, line, len);
+    req->stream = stream;
+    req->data = (const char *)(req + 1);
+    req->len = len;
+    uring_push((UringBackend *)io, req);
+}
+
+// Queue a positioned write; its buffers are released by req->done on the I/O thread.
+static void uring_submit(IoBackend *io, IoRequest *req) {
+    req->stream = -1;
+    uring_push((UringBackend *)io, req);
+}
+
+// Drain all outstanding writes, then tear the ring down.
+static void uring_shutdown(IoBackend *io) {
+    UringBackend *backend = (UringBackend *)io;
+    atomic_store(&backend->stopping, true);
+    sem_post(&backend->wake);
+    pthread_join(backend->thread, NULL);
+    if (backend->fixed) {
+        syscall(__NR_io_uring_register, backend->ring.fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    uring_free(&backend->ring);
+    for (int i = 0; i < IO_STREAM_COUNT; i++) {
+        close(backend->fds[i]);
+    }
+    sem_destroy(&backend->wake);
+    free(backend->buffer_memory);
+    free(backend);
+}
+
+// Set up the io_uring backend. Returns NULL if the kernel doesn't allow io_uring.
+IoBackend *uring_backend_create(const char *output_path, const char *error_path) {
+    UringBackend *backend = (UringBackend *)calloc(1, sizeof(UringBackend));
+    if (!backend) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!uring_init(&backend->ring, IO_RING_ENTRIES)) {
+        free(backend);
+        return NULL;
+    }
+
+    // The error log is appended to, so its writes start at the current end of file.
+    backend->fds[IO_STREAM_OUTPUT] = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    backend->fds[IO_STREAM_ERRORS] = open(error_path, O_WRONLY | O_CREAT, 0644);
+    if (backend->fds[IO_STREAM_OUTPUT] < 0 || backend->fds[IO_STREAM_ERRORS] < 0) {
+        for (int i = 0; i < IO_STREAM_COUNT; i++) {
+            if (backend->fds[i] >= 0) {
+                close(backend->fds[i]);
+            }
+        }
+        uring_free(&backend->ring);
+        free(backend);
+        return NULL;
+    }
+    for (int i = 0; i < IO_STREAM_COUNT; i++) {
+        backend->tails[i] = lseek(backend->fds[i], 0, SEEK_END);
+        backend->current[i] = -1;
+    }
+
+    backend->buffer_memory = (char *)aligned_alloc(4096, (size_t)IO_FIXED_BUFFERS * IO_BUFFER_SIZE);
+    if (!backend->buffer_memory) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    struct iovec registered[IO_FIXED_BUFFERS];
+    for (int i = 0; i < IO_FIXED_BUFFERS; i++) {
+        registered[i].iov_base = backend->buffer_memory + (size_t)i * IO_BUFFER_SIZE;
+        registered[i].iov_len = IO_BUFFER_SIZE;
+        backend->buffers[i].next_free = i + 1 < IO_FIXED_BUFFERS ? i + 1 : -1;
+    }
+    backend->free_buffers = 0;
+    // Registration can fail under a low RLIMIT_MEMLOCK; plain writes from the same buffers still work.
+    backend->fixed = syscall(__NR_io_uring_register, backend->ring.fd, IORING_REGISTER_BUFFERS,
+                             registered, IO_FIXED_BUFFERS) == 0;
+
+    sem_init(&backend->wake, 0, 0);
+    backend->base.name = "io_uring";
+    backend->base.write_line = uring_write_line;
+    backend->base.submit = uring_submit;
+    backend->base.shutdown = uring_shutdown;
+    if (pthread_create(&backend->thread, NULL, uring_thread, backend) != 0) {
+        uring_free(&backend->ring);
+        free(backend->buffer_memory);
+        free(backend);
+        return NULL;
+    }
+    return &backend->base;
+}
@@ -0,0 +1,43 @@
+// Pluggable output backends: buffered stdio or an io_uring ring fed by one submitter thread.
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "crawler_core.h"
+
+#define IO_BUFFER_SIZE 65536        // Largest batch of lines handed over in one write
+
+// Append-only text streams every backend provides.
+typedef enum {
+    IO_STREAM_OUTPUT,  // output.txt by default, one crawled URL per line
+    IO_STREAM_ERRORS,  // error_log.txt, one per shard process when sharded
+    IO_STREAM_COUNT
+} IoStream;
+
+// A positioned write whose buffers stay owned by the request until `done` runs.
+typedef struct IoRequest {
+    struct IoRequest *next;
+    int stream;          // IoStream for line appends, -1 for positioned writes
+    const char *data;    // Line bytes
+    size_t len;
+    int fd;              // Positioned writes only
+    off_t offset;
+    struct iovec *iov;
+    int iovcnt;
+    void (*done)(struct IoRequest *req, bool ok);
+} IoRequest;
+
+// Where result lines, error records and archive records end up on disk.
+typedef struct IoBackend {
+    const char *name;
+    void (*write_line)(struct IoBackend *io, IoStream stream, const char *line, size_t len);
+    void (*submit)(struct IoBackend *io, IoRequest *req);
+    void (*shutdown)(struct IoBackend *io); // Flushes, closes the streams and frees the backend
+} IoBackend;
+
+IoBackend *stdio_backend_create(const char *output_path, const char *error_path);
+IoBackend *uring_backend_create(const char *output_path, const char *error_path);
+bool pwritev_all(int fd, struct iovec *iov, int iovcnt, off_t offset);
+
+#endif
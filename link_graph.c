@@ -0,0 +1,462 @@
+#include "crawler_core.h"
+#include "link_graph.h"
+#include "url_table.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GRAPH_MAGIC "WCGRAPH1"
+
+// On-disk header, followed by the offsets and the adjacency data of the CSR.
+typedef struct {
+    char magic[8];
+    uint32_t nodes;
+    uint32_t reserved;
+    uint64_t edges;
+    uint64_t data_len;
+} GraphHeader;
+
+// Sink that writes the graph file when the crawl closes.
+typedef struct {
+    Sink base;
+    LinkGraph *graph;
+    const char *path;
+} GraphSink;
+
+// Growable byte buffer for the adjacency data being encoded.
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} GraphBuffer;
+
+// Growable list of targets.
+typedef struct {
+    uint32_t *ids;
+    size_t len, cap;
+} GraphList;
+
+// Append an unsigned LEB128 varint.
+static void graph_put_varint(GraphBuffer *buf, uint64_t value) {
+    if (buf->len + 10 > buf->cap) {
+        size_t cap = buf->cap ? buf->cap * 2 : 1 << 20;
+        uint8_t *grown = (uint8_t *)realloc(buf->data, cap);
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    while (value >= 0x80) {
+        buf->data[buf->len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf->data[buf->len++] = (uint8_t)value;
+}
+
+// Read an unsigned LEB128 varint.
+static uint64_t graph_get_varint(const uint8_t **p) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        value |= (uint64_t)(*(*p)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (uint64_t)(*(*p)++) << shift;
+    return value;
+}
+
+// Append a target to a list.
+static void graph_list_push(GraphList *list, uint32_t id) {
+    if (list->len == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 256;
+        uint32_t *grown = (uint32_t *)realloc(list->ids, cap * sizeof(uint32_t));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        list->ids = grown;
+        list->cap = cap;
+    }
+    list->ids[list->len++] = id;
+}
+
+// Function to compare two URL IDs.
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Create an empty graph over the IDs of a URL table.
+LinkGraph *graph_create(struct UrlTable *urls) {
+    LinkGraph *graph = (LinkGraph *)calloc(1, sizeof(LinkGraph));
+    if (!graph) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&graph->lock, NULL);
+    pthread_mutex_init(&graph->merge_lock, NULL);
+    graph->urls = urls;
+    return graph;
+}
+
+// Free the graph, its pending edges and its CSR.
+void graph_free(LinkGraph *graph) {
+    while (graph->pending) {
+        GraphBlock *next = graph->pending->next;
+        free(graph->pending);
+        graph->pending = next;
+    }
+    if (graph->csr) {
+        graph_csr_free(graph->csr);
+    }
+    pthread_mutex_destroy(&graph->lock);
+    pthread_mutex_destroy(&graph->merge_lock);
+    free(graph);
+}
+
+// Attach a worker's edge buffer to the graph.
+void graph_writer_init(GraphWriter *writer, LinkGraph *graph) {
+    writer->graph = graph;
+    writer->block = NULL;
+}
+
+// Hand a full block to the graph and start a new one.
+void graph_writer_spill(GraphWriter *writer) {
+    if (writer->block) {
+        pthread_mutex_lock(&writer->graph->lock);
+        writer->block->next = writer->graph->pending;
+        writer->graph->pending = writer->block;
+        pthread_mutex_unlock(&writer->graph->lock);
+    }
+    writer->block = (GraphBlock *)malloc(sizeof(GraphBlock));
+    if (!writer->block) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    writer->block->count = 0;
+}
+
+// Hand over a worker's partial block when it stops.
+void graph_writer_flush(GraphWriter *writer) {
+    if (writer->block && writer->block->count > 0) {
+        pthread_mutex_lock(&writer->graph->lock);
+        writer->block->next = writer->graph->pending;
+        writer->graph->pending = writer->block;
+        pthread_mutex_unlock(&writer->graph->lock);
+    } else {
+        free(writer->block);
+    }
+    writer->block = NULL;
+}
+
+// Fold the edges handed over since the last merge into the CSR. Edges are sorted and deduplicated
+// per source and self-links are dropped. The returned CSR stays valid until the next merge.
+GraphCsr *graph_merge(LinkGraph *graph) {
+    pthread_mutex_lock(&graph->merge_lock);
+    pthread_mutex_lock(&graph->lock);
+    GraphBlock *pending = graph->pending;
+    graph->pending = NULL;
+    pthread_mutex_unlock(&graph->lock);
+
+    GraphCsr *old = graph->csr;
+    uint32_t nodes = atomic_load(&graph->urls->next_id);
+    if (old && old->nodes > nodes) {
+        nodes = old->nodes;
+    }
+
+    // Bucket the new edges by source: count, prefix sum, scatter.
+    uint64_t *ends = (uint64_t *)calloc((size_t)nodes + 1, sizeof(uint64_t));
+    if (!ends) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t total = 0;
+    for (GraphBlock *block = pending; block; block = block->next) {
+        for (size_t i = 0; i < block->count; i++) {
+            ends[block->edges[i].src + 1]++;
+        }
+        total += block->count;
+    }
+    for (uint32_t i = 0; i < nodes; i++) {
+        ends[i + 1] += ends[i];
+    }
+    uint32_t *targets = (uint32_t *)malloc((total ? total : 1) * sizeof(uint32_t));
+    if (!targets) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    while (pending) {
+        GraphBlock *block = pending;
+        pending = block->next;
+        for (size_t i = 0; i < block->count; i++) {
+            targets[ends[block->edges[i].src]++] = block->edges[i].dst;
+        }
+        free(block);
+    }
+    // After the scatter ends[u] is where u's bucket stops; it starts where u - 1's stopped.
+
+    GraphCsr *csr = (GraphCsr *)calloc(1, sizeof(GraphCsr));
+    uint64_t *offsets = (uint64_t *)malloc(((size_t)nodes + 1) * sizeof(uint64_t));
+    if (!csr || !offsets) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    GraphBuffer buf = {NULL, 0, 0};
+    GraphList merged = {NULL, 0, 0};
+    uint64_t edges = 0;
+    for (uint32_t u = 0; u < nodes; u++) {
+        offsets[u] = buf.len;
+        uint64_t begin = u ? ends[u - 1] : 0;
+        qsort(targets + begin, ends[u] - begin, sizeof(uint32_t), compare_ids);
+
+        // Merge the old sorted list with the new sorted bucket.
+        merged.len = 0;
+        GraphCursor cursor;
+        uint32_t next_old;
+        bool have_old = old && u < old->nodes && graph_cursor(old, u, &cursor) > 0 && graph_next(&cursor, &next_old);
+        uint64_t i = begin;
+        while (have_old || i < ends[u]) {
+            uint32_t id;
+            if (have_old && (i == ends[u] || next_old <= targets[i])) {
+                id = next_old;
+                have_old = graph_next(&cursor, &next_old);
+            } else {
+                id = targets[i++];
+            }
+            if (id != u && (merged.len == 0 || merged.ids[merged.len - 1] != id)) {
+                graph_list_push(&merged, id);
+            }
+        }
+
+        graph_put_varint(&buf, merged.len);
+        for (size_t k = 0; k < merged.len; k++) {
+            if (k == 0) {
+                int64_t delta = (int64_t)merged.ids[0] - (int64_t)u;
+                graph_put_varint(&buf, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            } else {
+                graph_put_varint(&buf, merged.ids[k] - merged.ids[k - 1] - 1);
+            }
+        }
+        edges += merged.len;
+    }
+    offsets[nodes] = buf.len;
+    free(merged.ids);
+    free(targets);
+    free(ends);
+
+    csr->nodes = nodes;
+    csr->edges = edges;
+    csr->offsets = offsets;
+    csr->data = buf.data;
+    csr->data_len = buf.len;
+    graph->csr = csr;
+    if (old) {
+        graph_csr_free(old);
+    }
+    pthread_mutex_unlock(&graph->merge_lock);
+    return csr;
+}
+
+// Position a cursor on a node's targets. Returns the node's out-degree.
+uint32_t graph_cursor(const GraphCsr *csr, uint32_t node, GraphCursor *cursor) {
+    cursor->p = csr->data + csr->offsets[node];
+    cursor->left = (uint32_t)graph_get_varint(&cursor->p);
+    cursor->src = node;
+    cursor->first = true;
+    return cursor->left;
+}
+
+// Step to the next target. Returns false at the end of the list.
+bool graph_next(GraphCursor *cursor, uint32_t *dst) {
+    if (cursor->left == 0) {
+        return false;
+    }
+    uint64_t value = graph_get_varint(&cursor->p);
+    if (cursor->first) {
+        int64_t delta = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        cursor->prev = (uint32_t)((int64_t)cursor->src + delta);
+        cursor->first = false;
+    } else {
+        cursor->prev += (uint32_t)value + 1;
+    }
+    cursor->left--;
+    *dst = cursor->prev;
+    return true;
+}
+
+// Release a CSR, whether merged in memory or mapped from a file.
+void graph_csr_free(GraphCsr *csr) {
+    if (csr->map) {
+        munmap(csr->map, csr->map_len);
+    } else {
+        free((void *)csr->offsets);
+        free((void *)csr->data);
+    }
+    free(csr);
+}
+
+// Write all bytes or fail.
+static bool graph_write_all(FILE *file, const void *data, size_t len) {
+    return len == 0 || fwrite(data, 1, len, file) == len;
+}
+
+// Merge and write the graph to `path`, with the URL of every ID, one per line, in `path`.urls.
+// Call once the workers have stopped, so every ID has its URL.
+bool graph_write(LinkGraph *graph, const char *path) {
+    GraphCsr *csr = graph_merge(graph);
+    char tmp[1024], urls_path[1024], urls_tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    snprintf(urls_path, sizeof(urls_path), "%s.urls", path);
+    snprintf(urls_tmp, sizeof(urls_tmp), "%s.urls.tmp", path);
+
+    FILE *file = fopen(tmp, "wb");
+    FILE *urls = fopen(urls_tmp, "w");
+    if (!file || !urls) {
+        fprintf(stderr, "Error: Unable to write link graph %s\n", path);
+        if (file) {
+            fclose(file);
+        }
+        if (urls) {
+            fclose(urls);
+        }
+        return false;
+    }
+    GraphHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_MAGIC, sizeof(header.magic));
+    header.nodes = csr->nodes;
+    header.edges = csr->edges;
+    header.data_len = csr->data_len;
+    bool ok = graph_write_all(file, &header, sizeof(header)) &&
+              graph_write_all(file, csr->offsets, ((size_t)csr->nodes + 1) * sizeof(uint64_t)) &&
+              graph_write_all(file, csr->data, csr->data_len);
+    char url[MAX_URL_LENGTH];
+    for (uint32_t id = 0; ok && id < csr->nodes; id++) {
+        url_table_get(graph->urls, id, url, sizeof(url));
+        ok = fprintf(urls, "%s\n", url) >= 0;
+    }
+    ok = fclose(file) == 0 && ok;
+    ok = fclose(urls) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0 || rename(urls_tmp, urls_path) != 0) {
+        fprintf(stderr, "Error: Unable to write link graph %s\n", path);
+        return false;
+    }
+    fprintf(stderr, "Link graph: %u nodes, %lu edges, %zu bytes of adjacency (%.2f bytes/edge)\n", csr->nodes,
+            (unsigned long)csr->edges, csr->data_len, csr->edges ? (double)csr->data_len / csr->edges : 0.0);
+    return true;
+}
+
+// Map a graph file written by graph_write().
+GraphCsr *graph_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(GraphHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const GraphHeader *header = (const GraphHeader *)map;
+    size_t offsets_len = ((size_t)header->nodes + 1) * sizeof(uint64_t);
+    if (memcmp(header->magic, GRAPH_MAGIC, sizeof(header->magic)) != 0 ||
+        sizeof(GraphHeader) + offsets_len + header->data_len != (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    GraphCsr *csr = (GraphCsr *)calloc(1, sizeof(GraphCsr));
+    if (!csr) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    csr->nodes = header->nodes;
+    csr->edges = header->edges;
+    csr->offsets = (const uint64_t *)((const char *)map + sizeof(GraphHeader));
+    csr->data = (const uint8_t *)map + sizeof(GraphHeader) + offsets_len;
+    csr->data_len = header->data_len;
+    csr->map = map;
+    csr->map_len = st.st_size;
+    return csr;
+}
+
+// Print the out-links of a URL from a graph file to stdout. Returns false if the URL isn't in it.
+bool graph_get(const char *path, const char *url) {
+    GraphCsr *csr = graph_load(path);
+    if (!csr) {
+        fprintf(stderr, "Error: Unable to read link graph %s\n", path);
+        return false;
+    }
+    char urls_path[1024];
+    snprintf(urls_path, sizeof(urls_path), "%s.urls", path);
+    FILE *urls = fopen(urls_path, "r");
+    char **names = (char **)calloc((size_t)csr->nodes + 1, sizeof(char *));
+    if (!urls || !names) {
+        fprintf(stderr, "Error: Unable to read %s\n", urls_path);
+        if (urls) {
+            fclose(urls);
+        }
+        free(names);
+        graph_csr_free(csr);
+        return false;
+    }
+    char line[MAX_URL_LENGTH + 2];
+    uint32_t count = 0;
+    while (count < csr->nodes && fgets(line, sizeof(line), urls)) {
+        line[strcspn(line, "\n")] = '\0';
+        names[count++] = strdup(line);
+    }
+    fclose(urls);
+
+    bool found = false;
+    for (uint32_t id = 0; id < count && !found; id++) {
+        if (names[id] && strcmp(names[id], url) == 0) {
+            GraphCursor cursor;
+            uint32_t dst;
+            printf("%s -> %u links\n", url, graph_cursor(csr, id, &cursor));
+            while (graph_next(&cursor, &dst)) {
+                printf("  %s\n", dst < count && names[dst] ? names[dst] : "?");
+            }
+            found = true;
+        }
+    }
+    for (uint32_t id = 0; id < count; id++) {
+        free(names[id]);
+    }
+    free(names);
+    graph_csr_free(csr);
+    return found;
+}
+
+// Edges are recorded by the extractor's emitter, not per page.
+static void graph_sink_page(Sink *sink, const FetchResult *result) {
+    (void)sink;
+    (void)result;
+}
+
+// Write the graph file once the crawl is over.
+static void graph_sink_close(Sink *sink) {
+    GraphSink *graph_sink = (GraphSink *)sink;
+    graph_write(graph_sink->graph, graph_sink->path);
+    free(graph_sink);
+}
+
+// Create the sink that writes the link graph to `path` when the crawl ends.
+Sink *graph_sink_create(LinkGraph *graph, const char *path) {
+    GraphSink *sink = (GraphSink *)calloc(1, sizeof(GraphSink));
+    if (!sink) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    sink->base.name = "graph";
+    sink->base.page = graph_sink_page;
+    sink->base.close = graph_sink_close;
+    sink->graph = graph;
+    sink->path = path;
+    return &sink->base;
+}
@@ -0,0 +1,81 @@
+// Link graph capture: per-worker edge buffers merged into a compressed CSR adjacency file.
+#ifndef LINK_GRAPH_H
+#define LINK_GRAPH_H
+
+#include "crawler_core.h"
+
+#define GRAPH_BLOCK_EDGES 65536     // Edges a worker buffers before handing the block over
+
+// One discovered link, by URL ID.
+typedef struct {
+    uint32_t src, dst;
+} GraphEdge;
+
+// A full or partial buffer of edges.
+typedef struct GraphBlock {
+    struct GraphBlock *next;
+    size_t count;
+    GraphEdge edges[GRAPH_BLOCK_EDGES];
+} GraphBlock;
+
+// Compressed sparse rows. Each node's list is a varint out-degree, the first target as a zigzag
+// delta from the node, then the gaps between sorted targets minus one.
+typedef struct {
+    uint32_t nodes;
+    uint64_t edges;
+    const uint64_t *offsets;        // nodes + 1 byte offsets into data
+    const uint8_t *data;
+    size_t data_len;
+    void *map;                      // Set when the CSR is an mmap'd file
+    size_t map_len;
+} GraphCsr;
+
+// Walks the targets of one node.
+typedef struct {
+    const uint8_t *p;
+    uint32_t left;
+    uint32_t prev;
+    uint32_t src;
+    bool first;
+} GraphCursor;
+
+// The graph of a crawl: edge blocks handed over by the workers and the CSR they were merged into.
+typedef struct LinkGraph {
+    pthread_mutex_t lock;           // Guards pending
+    GraphBlock *pending;
+    pthread_mutex_t merge_lock;     // One merge at a time; guards csr
+    GraphCsr *csr;
+    struct UrlTable *urls;
+} LinkGraph;
+
+// Per-worker edge buffer.
+typedef struct GraphWriter {
+    LinkGraph *graph;
+    GraphBlock *block;
+} GraphWriter;
+
+LinkGraph *graph_create(struct UrlTable *urls);
+void graph_free(LinkGraph *graph);
+void graph_writer_init(GraphWriter *writer, LinkGraph *graph);
+void graph_writer_spill(GraphWriter *writer);
+void graph_writer_flush(GraphWriter *writer);
+GraphCsr *graph_merge(LinkGraph *graph);
+bool graph_write(LinkGraph *graph, const char *path);
+GraphCsr *graph_load(const char *path);
+void graph_csr_free(GraphCsr *csr);
+uint32_t graph_cursor(const GraphCsr *csr, uint32_t node, GraphCursor *cursor);
+bool graph_next(GraphCursor *cursor, uint32_t *dst);
+bool graph_get(const char *path, const char *url);
+Sink *graph_sink_create(LinkGraph *graph, const char *path);
+
+// Record a link. Costs two stores unless the worker's block is full.
+static inline void graph_add_edge(GraphWriter *writer, uint32_t src, uint32_t dst) {
+    if (!writer->block || writer->block->count == GRAPH_BLOCK_EDGES) {
+        graph_writer_spill(writer);
+    }
+    GraphEdge *edge = &writer->block->edges[writer->block->count++];
+    edge->src = src;
+    edge->dst = dst;
+}
+
+#endif
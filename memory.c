@@ -0,0 +1,228 @@
+#include "crawler_core.h"
+#include <malloc.h>
+#include <unistd.h>
+#include "memory.h"
+
+static size_t mem_limit;                // 0 when no limit is set: nothing is counted
+static atomic_long mem_totals[MEM_KINDS];
+static atomic_long mem_peak;
+static atomic_int mem_level;
+static atomic_ulong mem_soft_events, mem_hard_events;
+static atomic_ullong mem_last_trim;
+
+// Changes not yet folded into mem_totals. Memory freed on another thread than it was allocated
+// on makes these go negative; both directions are folded once they pass MEM_FLUSH_BYTES.
+static _Thread_local long mem_local[MEM_KINDS];
+
+// Set the budget in bytes. Called before the workers start; 0 turns the governor off.
+void mem_init(size_t limit) {
+    mem_limit = limit;
+}
+
+// Recompute the pressure level from the totals.
+static void mem_update(void) {
+    long total = 0;
+    for (int kind = 0; kind < MEM_KINDS; kind++) {
+        total += atomic_load_explicit(&mem_totals[kind], memory_order_relaxed);
+    }
+    long peak = atomic_load_explicit(&mem_peak, memory_order_relaxed);
+    while (total > peak && !atomic_compare_exchange_weak(&mem_peak, &peak, total)) {
+    }
+
+    MemPressure level = MEM_OK;
+    if (total >= (long)mem_limit) {
+        level = MEM_HARD;
+    } else if ((size_t)total >= mem_limit / 100 * MEM_SOFT_PERCENT) {
+        level = MEM_SOFT;
+    }
+    int old = atomic_exchange(&mem_level, (int)level);
+    if ((int)level > old) {
+        atomic_fetch_add(level == MEM_HARD ? &mem_hard_events : &mem_soft_events, 1);
+    }
+}
+
+// Return freed heap to the system, at most once per MEM_TRIM_INTERVAL_MS across all threads.
+// Workers call this between pages while memory is short, never with a lock held.
+void mem_trim(void) {
+    uint64_t now = now_ms();
+    unsigned long long last = atomic_load(&mem_last_trim);
+    if (now - last >= MEM_TRIM_INTERVAL_MS && atomic_compare_exchange_strong(&mem_last_trim, &last, now)) {
+        malloc_trim(0);
+    }
+}
+
+// Count `delta` bytes allocated (or, if negative, freed) by a subsystem.
+void mem_account(MemKind kind, long delta) {
+    if (!mem_limit) {
+        return;
+    }
+    long local = mem_local[kind] += delta;
+    if (local < MEM_FLUSH_BYTES && local > -MEM_FLUSH_BYTES) {
+        return;
+    }
+    mem_local[kind] = 0;
+    atomic_fetch_add_explicit(&mem_totals[kind], local, memory_order_relaxed);
+    mem_update();
+}
+
+// The current pressure level; one atomic load.
+MemPressure mem_pressure(void) {
+    return (MemPressure)atomic_load_explicit(&mem_level, memory_order_relaxed);
+}
+
+// Copy out the counters.
+void mem_stats(MemStats *stats) {
+    stats->limit = mem_limit;
+    for (int kind = 0; kind < MEM_KINDS; kind++) {
+        stats->current[kind] = atomic_load(&mem_totals[kind]);
+    }
+    stats->peak = atomic_load(&mem_peak);
+    stats->soft = atomic_load(&mem_soft_events);
+    stats->hard = atomic_load(&mem_hard_events);
+}
+
+// Parse a size such as "512", "512M", "2G" or "65536K"; a bare number is in MiB. Returns 0 if
+// the text is not a size.
+size_t mem_parse_size(const char *text) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 20;
+    switch (*end) {
+    case 'k': case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm': case 'M':
+        end++;
+        break;
+    case 'g': case 'G':
+        shift = 30;
+        end++;
+        break;
+    }
+    if (end == text || *end != '\0' || value == 0 || value > (SIZE_MAX >> shift)) {
+        return 0;
+    }
+    return (size_t)value << shift;
+}
+
+// Create the frontier's spill file: unlinked at once, so it goes away with the process.
+FrontierSpill *spill_create(void) {
+    FrontierSpill *spill = (FrontierSpill *)calloc(1, sizeof(FrontierSpill));
+    if (!spill) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    const char *tmp = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/wc-frontier-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    spill->fd = mkstemp(path);
+    if (spill->fd < 0) {
+        fprintf(stderr, "Error: Unable to create the frontier spill file in %s\n", tmp && *tmp ? tmp : "/tmp");
+        free(spill);
+        return NULL;
+    }
+    unlink(path);
+    return spill;
+}
+
+// Close the spill file.
+void spill_free(FrontierSpill *spill) {
+    if (spill) {
+        close(spill->fd);
+        free(spill);
+    }
+}
+
+// Write out the staged records.
+static void spill_flush(FrontierSpill *spill) {
+    size_t len = spill->staged_count * sizeof(SpillRecord);
+    if (len && pwrite(spill->fd, spill->staged, len, (off_t)spill->write_offset) != (ssize_t)len) {
+        fprintf(stderr, "Error: Unable to write the frontier spill file\n");
+        exit(EXIT_FAILURE);
+    }
+    spill->write_offset += len;
+    spill->staged_count = 0;
+}
+
+// Move a node to the spill file and free it. Called with the queue lock held.
+void spill_push(FrontierSpill *spill, URLQueueNode *node) {
+    spill->staged[spill->staged_count++] = (SpillRecord){node->id, node->depth};
+    free(node);
+    spill->count++;
+    spill->total++;
+    if (spill->staged_count == SPILL_BUFFER) {
+        spill_flush(spill);
+    }
+}
+
+// Move up to SPILL_REFILL of the oldest spilled nodes back into the frontier. Returns how many
+// came back. Called with the queue lock held, when the in-memory frontier has run dry.
+size_t spill_refill(FrontierSpill *spill, URLQueue *queue) {
+    SpillRecord records[SPILL_REFILL];
+    size_t count = 0;
+    if (spill->read_offset < spill->write_offset) {
+        size_t want = spill->write_offset - spill->read_offset;
+        if (want > sizeof(records)) {
+            want = sizeof(records);
+        }
+        ssize_t got = pread(spill->fd, records, want, (off_t)spill->read_offset);
+        if (got != (ssize_t)want) {
+            fprintf(stderr, "Error: Unable to read the frontier spill file\n");
+            exit(EXIT_FAILURE);
+        }
+        spill->read_offset += want;
+        count = want / sizeof(SpillRecord);
+        if (spill->read_offset == spill->write_offset) {
+            // All read back: start the file over instead of letting it grow.
+            spill->read_offset = spill->write_offset = 0;
+            if (ftruncate(spill->fd, 0) != 0) {
+                fprintf(stderr, "Warning: Unable to truncate the frontier spill file\n");
+            }
+        }
+    } else {
+        // Nothing on disk yet; take the staged records directly.
+        count = spill->staged_count;
+        memcpy(records, spill->staged, count * sizeof(SpillRecord));
+        spill->staged_count = 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+        URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+        if (!node) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        node->id = records[i].id;
+        node->depth = records[i].depth;
+        node->next = NULL;
+        queue->ops->push(queue->state, node);
+    }
+    spill->count -= count;
+    mem_account(MEM_FRONTIER, (long)(count * sizeof(URLQueueNode)));
+    return count;
+}
+
+// Copy out up to `max` spilled IDs, oldest first, leaving the spill as it is. Called with the
+// queue lock held.
+size_t spill_list(FrontierSpill *spill, uint32_t *ids, size_t max) {
+    SpillRecord records[SPILL_REFILL];
+    size_t count = 0;
+    for (uint64_t offset = spill->read_offset; offset < spill->write_offset && count < max;) {
+        size_t want = spill->write_offset - offset;
+        if (want > sizeof(records)) {
+            want = sizeof(records);
+        }
+        if (pread(spill->fd, records, want, (off_t)offset) != (ssize_t)want) {
+            fprintf(stderr, "Error: Unable to read the frontier spill file\n");
+            exit(EXIT_FAILURE);
+        }
+        offset += want;
+        for (size_t i = 0; i < want / sizeof(SpillRecord) && count < max; i++) {
+            ids[count++] = records[i].id;
+        }
+    }
+    for (size_t i = 0; i < spill->staged_count && count < max; i++) {
+        ids[count++] = spill->staged[i].id;
+    }
+    return count;
+}
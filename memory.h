@@ -0,0 +1,67 @@
+// Process-wide memory budget: per-subsystem byte counters and the backpressure they drive.
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "crawler_core.h"
+
+#define MEM_FLUSH_BYTES (64L << 10)     // Per-thread drift before a counter is folded into the totals
+#define MEM_SOFT_PERCENT 80             // Share of the limit where the crawl starts shedding memory
+#define MEM_TRIM_INTERVAL_MS 1000       // Least time between returns of freed heap to the system
+#define SPILL_BUFFER 4096               // Frontier records staged before a write to the spill file
+#define SPILL_REFILL 4096               // Records read back per refill
+
+// Subsystems with their own counters.
+typedef enum {
+    MEM_FRONTIER,   // Queued nodes and the URL table behind them
+    MEM_BUFFERS,    // Response bodies and other per-fetch buffers
+    MEM_PARSER,     // libxml2's parse arenas, as far as the pages have touched them
+    MEM_CACHES,     // DNS, robots.txt and per-host state
+    MEM_OUTPUT,     // Records and index postings waiting to be written
+    MEM_KINDS
+} MemKind;
+
+// How close the process is to its limit.
+typedef enum {
+    MEM_OK,
+    MEM_SOFT,       // Spill new frontier nodes, trim buffers, flush output early
+    MEM_HARD        // Also let only one worker fetch until usage falls again
+} MemPressure;
+
+// A frontier node written to the spill file.
+typedef struct {
+    uint32_t id;
+    int32_t depth;
+} SpillRecord;
+
+// Frontier overflow on disk, used while memory is short. Accessed with the queue lock held.
+typedef struct FrontierSpill {
+    int fd;                             // An unlinked temporary file
+    uint64_t read_offset, write_offset;
+    SpillRecord staged[SPILL_BUFFER];
+    size_t staged_count;
+    size_t count;                       // Nodes on disk or staged
+    unsigned long total;                // Nodes ever spilled
+} FrontierSpill;
+
+// What the governor saw, for the end-of-crawl report.
+typedef struct {
+    size_t limit;
+    long current[MEM_KINDS];
+    long peak;                          // Highest total of all subsystems
+    unsigned long soft, hard;           // Times each level was entered
+} MemStats;
+
+void mem_init(size_t limit);
+void mem_account(MemKind kind, long delta);
+MemPressure mem_pressure(void);
+void mem_trim(void);
+void mem_stats(MemStats *stats);
+size_t mem_parse_size(const char *text);
+
+FrontierSpill *spill_create(void);
+void spill_free(FrontierSpill *spill);
+void spill_push(FrontierSpill *spill, URLQueueNode *node);
+size_t spill_refill(FrontierSpill *spill, URLQueue *queue);
+size_t spill_list(FrontierSpill *spill, uint32_t *ids, size_t max);
+
+#endif
@@ -0,0 +1,213 @@
+#include "crawler_core.h"
+#include "pagerank.h"
+
+// In-links of every node, sources ascending, built from the out-link CSR once per round.
+typedef struct {
+    uint32_t nodes;
+    uint64_t *offsets;
+    uint32_t *sources;
+} PageRankTranspose;
+
+// One power-iteration step shared by the ranker's helper threads.
+typedef struct {
+    const PageRankTranspose *in;
+    const double *contrib;
+    double *next;
+    double base;
+    atomic_uint cursor;
+} PageRankStep;
+
+// Build the transpose of a CSR. Sources are visited in order, so every in-list comes out sorted.
+static void pagerank_transpose(const GraphCsr *csr, PageRankTranspose *in, uint32_t *outdeg) {
+    in->nodes = csr->nodes;
+    in->offsets = (uint64_t *)calloc((size_t)csr->nodes + 1, sizeof(uint64_t));
+    in->sources = (uint32_t *)malloc((csr->edges ? csr->edges : 1) * sizeof(uint32_t));
+    if (!in->offsets || !in->sources) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    GraphCursor cursor;
+    uint32_t dst;
+    for (uint32_t u = 0; u < csr->nodes; u++) {
+        outdeg[u] = graph_cursor(csr, u, &cursor);
+        while (graph_next(&cursor, &dst)) {
+            in->offsets[dst + 1]++;
+        }
+    }
+    for (uint32_t v = 0; v < csr->nodes; v++) {
+        in->offsets[v + 1] += in->offsets[v];
+    }
+    uint64_t *fill = (uint64_t *)malloc(((size_t)csr->nodes + 1) * sizeof(uint64_t));
+    if (!fill) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(fill, in->offsets, ((size_t)csr->nodes + 1) * sizeof(uint64_t));
+    for (uint32_t u = 0; u < csr->nodes; u++) {
+        graph_cursor(csr, u, &cursor);
+        while (graph_next(&cursor, &dst)) {
+            in->sources[fill[dst]++] = u;
+        }
+    }
+    free(fill);
+}
+
+// Helper thread: pull rank into blocks of destinations until none are left.
+static void *pagerank_step_thread(void *arg) {
+    PageRankStep *step = (PageRankStep *)arg;
+    const PageRankTranspose *in = step->in;
+    uint32_t begin;
+    while ((begin = atomic_fetch_add(&step->cursor, PAGERANK_BLOCK)) < in->nodes) {
+        uint32_t end = in->nodes - begin < PAGERANK_BLOCK ? in->nodes : begin + PAGERANK_BLOCK;
+        for (uint32_t v = begin; v < end; v++) {
+            double sum = 0.0;
+            for (uint64_t e = in->offsets[v]; e < in->offsets[v + 1]; e++) {
+                sum += step->contrib[in->sources[e]];
+            }
+            step->next[v] = step->base + PAGERANK_DAMPING * sum;
+        }
+    }
+    return NULL;
+}
+
+// Run one round: merge new edges, continue the iteration from the last scores, publish the result.
+static void pagerank_round(PageRank *ranker) {
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    GraphCsr *csr = graph_merge(ranker->graph);
+    uint32_t nodes = csr->nodes;
+    if (nodes == 0) {
+        return;
+    }
+
+    // Warm start: known nodes keep their rank, new ones start at the average.
+    double *rank = (double *)realloc(ranker->rank, (size_t)nodes * sizeof(double));
+    double *next = (double *)malloc((size_t)nodes * sizeof(double));
+    double *contrib = (double *)malloc((size_t)nodes * sizeof(double));
+    uint32_t *outdeg = (uint32_t *)malloc((size_t)nodes * sizeof(uint32_t));
+    if (!rank || !next || !contrib || !outdeg) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    double known = 0.0;
+    for (uint32_t u = 0; u < ranker->nodes; u++) {
+        known += rank[u];
+    }
+    double fresh = ranker->nodes ? known / ranker->nodes : 1.0 / nodes;
+    for (uint32_t u = ranker->nodes; u < nodes; u++) {
+        rank[u] = fresh;
+    }
+
+    PageRankTranspose in;
+    pagerank_transpose(csr, &in, outdeg);
+
+    pthread_t helpers[PAGERANK_THREADS];
+    int threads = ranker->threads < PAGERANK_THREADS ? ranker->threads : PAGERANK_THREADS;
+    for (int iteration = 0; iteration < PAGERANK_ITERATIONS; iteration++) {
+        // Rank of pages without out-links is spread evenly, as is the teleport share.
+        double total = 0.0, dangling = 0.0;
+        for (uint32_t u = 0; u < nodes; u++) {
+            total += rank[u];
+            if (outdeg[u] == 0) {
+                dangling += rank[u];
+                contrib[u] = 0.0;
+            } else {
+                contrib[u] = rank[u] / outdeg[u];
+            }
+        }
+        double base = ((1.0 - PAGERANK_DAMPING) * total + PAGERANK_DAMPING * dangling) / nodes;
+        PageRankStep step = {&in, contrib, next, base, 0};
+        int started_threads = 0;
+        for (int t = 1; t < threads; t++) {
+            if (pthread_create(&helpers[started_threads], NULL, pagerank_step_thread, &step) == 0) {
+                started_threads++;
+            }
+        }
+        pagerank_step_thread(&step);
+        for (int t = 0; t < started_threads; t++) {
+            pthread_join(helpers[t], NULL);
+        }
+        double *swap = rank;
+        rank = next;
+        next = swap;
+    }
+    ranker->rank = rank;
+    ranker->nodes = nodes;
+    free(next);
+    free(contrib);
+    free(outdeg);
+    free(in.offsets);
+    free(in.sources);
+
+    // Hand float scores to the frontier; it drops the old array under the queue lock.
+    float *scores = (float *)malloc((size_t)nodes * sizeof(float));
+    if (!scores) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t u = 0; u < nodes; u++) {
+        scores[u] = (float)rank[u];
+    }
+    frontier_rescore(ranker->queue, scores, nodes);
+    free(ranker->published);
+    ranker->published = scores;
+
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    atomic_store(&ranker->round_ns, (unsigned long)((finished.tv_sec - started.tv_sec) * 1000000000L +
+                                                    (finished.tv_nsec - started.tv_nsec)));
+    atomic_fetch_add(&ranker->rounds, 1);
+}
+
+// Ranker thread: one round per interval until stopped.
+static void *pagerank_thread(void *arg) {
+    PageRank *ranker = (PageRank *)arg;
+    pthread_mutex_lock(&ranker->lock);
+    while (!ranker->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PAGERANK_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (PAGERANK_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&ranker->wake, &ranker->lock, &deadline);
+        if (ranker->stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&ranker->lock);
+        pagerank_round(ranker);
+        pthread_mutex_lock(&ranker->lock);
+    }
+    pthread_mutex_unlock(&ranker->lock);
+    return NULL;
+}
+
+// Start ranking the graph in the background and re-prioritizing the queue with the result.
+bool pagerank_start(PageRank *ranker, LinkGraph *graph, URLQueue *queue, int threads) {
+    memset(ranker, 0, sizeof(*ranker));
+    ranker->graph = graph;
+    ranker->queue = queue;
+    ranker->threads = threads > 0 ? threads : 1;
+    pthread_mutex_init(&ranker->lock, NULL);
+    pthread_cond_init(&ranker->wake, NULL);
+    if (pthread_create(&ranker->thread, NULL, pagerank_thread, ranker) != 0) {
+        fprintf(stderr, "Error: Failed to create PageRank thread\n");
+        return false;
+    }
+    return true;
+}
+
+// Stop the ranker and take its scores back from the frontier.
+void pagerank_stop(PageRank *ranker) {
+    pthread_mutex_lock(&ranker->lock);
+    ranker->stopping = true;
+    pthread_cond_signal(&ranker->wake);
+    pthread_mutex_unlock(&ranker->lock);
+    pthread_join(ranker->thread, NULL);
+    frontier_rescore(ranker->queue, NULL, 0);
+    free(ranker->published);
+    free(ranker->rank);
+    pthread_mutex_destroy(&ranker->lock);
+    pthread_cond_destroy(&ranker->wake);
+}
@@ -0,0 +1,33 @@
+// Background PageRank over the captured link graph, feeding the priority frontier.
+#ifndef PAGERANK_H
+#define PAGERANK_H
+
+#include "crawler_core.h"
+#include "link_graph.h"
+
+#define PAGERANK_INTERVAL_MS 1000   // Pause between rounds
+#define PAGERANK_ITERATIONS 3       // Power-iteration steps per round, warm-started from the last round
+#define PAGERANK_THREADS 2
+#define PAGERANK_DAMPING 0.85
+#define PAGERANK_BLOCK 4096         // Destinations a thread takes at a time
+
+// Ranker state. Only the ranker thread touches rank; the frontier gets float copies.
+typedef struct {
+    LinkGraph *graph;
+    URLQueue *queue;
+    int threads;
+    double *rank;
+    uint32_t nodes;
+    float *published;               // Scores the frontier currently holds
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool stopping;
+    atomic_ulong rounds;
+    atomic_ulong round_ns;          // Wall time of the last round
+} PageRank;
+
+bool pagerank_start(PageRank *ranker, LinkGraph *graph, URLQueue *queue, int threads);
+void pagerank_stop(PageRank *ranker);
+
+#endif
@@ -0,0 +1,225 @@
+#include "crawler_core.h"
+#include <math.h>
+#include "memory.h"
+#include "recrawl.h"
+
+// Statistics of a page, adding its chunk if this is the first page of it to be seen.
+static RecrawlPage *recrawl_page(Recrawl *recrawl, uint32_t id) {
+    _Atomic(RecrawlPage *) *slot = &recrawl->chunks[id >> RECRAWL_CHUNK_BITS];
+    RecrawlPage *chunk = atomic_load_explicit(slot, memory_order_acquire);
+    if (!chunk) {
+        RecrawlPage *fresh = (RecrawlPage *)calloc(1u << RECRAWL_CHUNK_BITS, sizeof(RecrawlPage));
+        if (!fresh) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (atomic_compare_exchange_strong_explicit(slot, &chunk, fresh, memory_order_acq_rel, memory_order_acquire)) {
+            chunk = fresh;
+            mem_account(MEM_FRONTIER, (long)((1u << RECRAWL_CHUNK_BITS) * sizeof(RecrawlPage)));
+        } else {
+            free(fresh);
+        }
+    }
+    return &chunk[id & ((1u << RECRAWL_CHUNK_BITS) - 1)];
+}
+
+// Fold decoded page bytes into a digest, byte by byte so it doesn't depend on how the body was
+// split into chunks. Start from RECRAWL_DIGEST_SEED.
+uint64_t recrawl_digest(uint64_t digest, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        digest ^= (unsigned char)data[i];
+        digest *= 1099511628211ULL;
+    }
+    return digest;
+}
+
+// Pick the next revisit interval from what the page has done so far. With X changes seen in n
+// intervals covering T ms, the change rate estimate of Cho and Garcia-Molina,
+// -ln((n - X + 0.5) / (n + 0.5)) / (T / n), stays finite when every visit saw a change. The page is
+// due when it has changed with RECRAWL_STALE_CHANCE. Pages never seen to change back off instead.
+static uint64_t recrawl_interval(const Recrawl *recrawl, const RecrawlPage *page) {
+    double interval;
+    if (page->intervals == 0) {
+        interval = (double)recrawl->min_ms;
+    } else if (page->changes == 0) {
+        interval = 2.0 * page->interval_ms;
+    } else {
+        double n = page->intervals, changes = page->changes;
+        double rate = -log((n - changes + 0.5) / (n + 0.5)) / ((double)page->observed_ms / n);
+        interval = -log(1.0 - RECRAWL_STALE_CHANCE) / rate;
+    }
+    if (interval < (double)recrawl->min_ms) {
+        interval = (double)recrawl->min_ms;
+    }
+    if (interval > (double)recrawl->max_ms) {
+        interval = (double)recrawl->max_ms;
+    }
+    return (uint64_t)interval;
+}
+
+// Put a page on the wheel to be released after `delay_ms`.
+static void recrawl_schedule(Recrawl *recrawl, uint32_t id, int depth, uint64_t delay_ms) {
+    RecrawlTimer *timer = (RecrawlTimer *)malloc(sizeof(RecrawlTimer));
+    if (!timer) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    timer->id = id;
+    timer->depth = depth;
+    uint64_t due_tick = (now_ms() + delay_ms - recrawl->started_ms) / RECRAWL_TICK_MS;
+
+    pthread_mutex_lock(&recrawl->lock);
+    if (due_tick < recrawl->tick) {
+        due_tick = recrawl->tick;
+    }
+    timer->due_tick = due_tick;
+    RecrawlTimer **slot = &recrawl->slots[due_tick & (RECRAWL_SLOTS - 1)];
+    timer->next = *slot;
+    *slot = timer;
+    atomic_fetch_add(&recrawl->pending, 1);
+    pthread_mutex_unlock(&recrawl->lock);
+    mem_account(MEM_FRONTIER, (long)sizeof(RecrawlTimer));
+}
+
+// Record a finished fetch of a page and schedule its next visit. `fetched` is false when the fetch
+// failed; nothing is learned then, and the page is tried again after twice its interval.
+void recrawl_visit(Recrawl *recrawl, uint32_t id, int depth, uint64_t digest, bool fetched) {
+    uint64_t now = now_ms();
+    if (now >= recrawl->deadline_ms) {
+        return;
+    }
+    RecrawlPage *page = recrawl_page(recrawl, id);
+    if (fetched) {
+        if (page->last_ms) {
+            page->observed_ms += now - page->last_ms;
+            page->intervals++;
+            atomic_fetch_add(&recrawl->revisits, 1);
+            if (digest != page->digest) {
+                page->changes++;
+                atomic_fetch_add(&recrawl->changed, 1);
+            }
+        }
+        page->digest = digest;
+        page->last_ms = now;
+        page->interval_ms = (uint32_t)recrawl_interval(recrawl, page);
+    } else {
+        uint64_t backoff = 2 * (uint64_t)page->interval_ms;
+        page->interval_ms = (uint32_t)(backoff < recrawl->min_ms   ? recrawl->min_ms
+                                       : backoff > recrawl->max_ms ? recrawl->max_ms
+                                                                   : backoff);
+    }
+    recrawl_schedule(recrawl, id, depth, page->interval_ms);
+}
+
+// Whether revisits are still to come, keeping the workers from treating an empty frontier as the end.
+bool recrawl_pending(Recrawl *recrawl) {
+    return atomic_load(&recrawl->pending) > 0 && now_ms() < recrawl->deadline_ms;
+}
+
+// Turn the wheel once per tick, handing due pages to the frontier outside the wheel's lock.
+static void *recrawl_thread(void *arg) {
+    Recrawl *recrawl = (Recrawl *)arg;
+    pthread_mutex_lock(&recrawl->lock);
+    while (!recrawl->stopping) {
+        uint64_t now = now_ms();
+        uint64_t now_tick = (now - recrawl->started_ms) / RECRAWL_TICK_MS;
+        RecrawlTimer *due = NULL;
+        // A timer in the slot for another turn of the wheel stays where it is.
+        for (; recrawl->tick <= now_tick && now < recrawl->deadline_ms; recrawl->tick++) {
+            RecrawlTimer **link = &recrawl->slots[recrawl->tick & (RECRAWL_SLOTS - 1)];
+            while (*link) {
+                RecrawlTimer *timer = *link;
+                if (timer->due_tick <= now_tick) {
+                    *link = timer->next;
+                    timer->next = due;
+                    due = timer;
+                } else {
+                    link = &timer->next;
+                }
+            }
+        }
+        pthread_mutex_unlock(&recrawl->lock);
+
+        // Into the frontier before the pending count drops, so the crawl never looks finished in between.
+        unsigned long released = 0;
+        while (due) {
+            RecrawlTimer *timer = due;
+            due = timer->next;
+            URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+            if (!node) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            node->id = timer->id;
+            node->depth = timer->depth;
+            node->next = NULL;
+            frontier_push(recrawl->queue, node);
+            free(timer);
+            released++;
+        }
+        if (released) {
+            atomic_fetch_sub(&recrawl->pending, released);
+            atomic_fetch_add(&recrawl->released, released);
+            mem_account(MEM_FRONTIER, -(long)(released * sizeof(RecrawlTimer)));
+        }
+
+        pthread_mutex_lock(&recrawl->lock);
+        uint64_t next_ms = recrawl->started_ms + (now_tick + 1) * RECRAWL_TICK_MS;
+        struct timespec until = {(time_t)(next_ms / 1000), (long)(next_ms % 1000) * 1000000L};
+        while (!recrawl->stopping && now_ms() < next_ms) {
+            pthread_cond_timedwait(&recrawl->wake, &recrawl->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&recrawl->lock);
+    return NULL;
+}
+
+// Start revisiting pages for `seconds`, each no sooner than `min_s` and no later than `max_s` after
+// its last visit.
+Recrawl *recrawl_start(URLQueue *queue, long seconds, long min_s, long max_s) {
+    Recrawl *recrawl = (Recrawl *)calloc(1, sizeof(Recrawl));
+    if (!recrawl) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    recrawl->queue = queue;
+    recrawl->min_ms = (uint64_t)min_s * 1000;
+    recrawl->max_ms = (uint64_t)max_s * 1000;
+    recrawl->started_ms = now_ms();
+    recrawl->deadline_ms = recrawl->started_ms + (uint64_t)seconds * 1000;
+    pthread_mutex_init(&recrawl->lock, NULL);
+    pthread_cond_init(&recrawl->wake, NULL);
+    if (pthread_create(&recrawl->thread, NULL, recrawl_thread, recrawl) != 0) {
+        fprintf(stderr, "Error: Failed to create the recrawl thread\n");
+        free(recrawl);
+        return NULL;
+    }
+    return recrawl;
+}
+
+// Stop the wheel and drop the revisits still waiting on it.
+void recrawl_stop(Recrawl *recrawl) {
+    pthread_mutex_lock(&recrawl->lock);
+    recrawl->stopping = true;
+    pthread_cond_signal(&recrawl->wake);
+    pthread_mutex_unlock(&recrawl->lock);
+    pthread_join(recrawl->thread, NULL);
+    for (int i = 0; i < RECRAWL_SLOTS; i++) {
+        while (recrawl->slots[i]) {
+            RecrawlTimer *timer = recrawl->slots[i];
+            recrawl->slots[i] = timer->next;
+            free(timer);
+            mem_account(MEM_FRONTIER, -(long)sizeof(RecrawlTimer));
+        }
+    }
+    for (uint32_t i = 0; i < RECRAWL_CHUNKS; i++) {
+        RecrawlPage *chunk = atomic_load(&recrawl->chunks[i]);
+        if (chunk) {
+            mem_account(MEM_FRONTIER, -(long)((1u << RECRAWL_CHUNK_BITS) * sizeof(RecrawlPage)));
+            free(chunk);
+        }
+    }
+    pthread_mutex_destroy(&recrawl->lock);
+    pthread_cond_destroy(&recrawl->wake);
+    free(recrawl);
+}
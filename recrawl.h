@@ -0,0 +1,58 @@
+// Continuous crawling: every fetched page is revisited, sooner the more often it has been seen to
+// change. Change rates are estimated from content digests under a Poisson model, and pages wait
+// for their revisit on a hashed timer wheel that feeds them back into the frontier when due.
+#ifndef RECRAWL_H
+#define RECRAWL_H
+
+#include "crawler_core.h"
+
+#define RECRAWL_TICK_MS 100             // Timer wheel resolution
+#define RECRAWL_SLOTS 4096              // One turn of the wheel is about 7 minutes; later timers go round again
+#define RECRAWL_CHUNK_BITS 16           // Pages per statistics chunk
+#define RECRAWL_CHUNKS (1u << (32 - RECRAWL_CHUNK_BITS))
+#define RECRAWL_STALE_CHANCE 0.5        // Chance a page has changed by the time it is revisited
+#define RECRAWL_MIN_S 60                // Default bounds of the revisit interval
+#define RECRAWL_MAX_S 86400
+#define RECRAWL_DIGEST_SEED 14695981039346656037ULL  // FNV-1a offset basis
+
+// What is known about one page. Only the worker fetching the page touches it, so it has no lock.
+typedef struct {
+    uint64_t digest;                    // Of the decoded body at the last successful visit
+    uint64_t last_ms;
+    uint64_t observed_ms;               // Time covered by the intervals below
+    uint32_t intervals;                 // Intervals between successful visits
+    uint32_t changes;                   // Intervals at whose end the digest differed
+    uint32_t interval_ms;               // Revisit interval in use
+} RecrawlPage;
+
+// A page waiting for its revisit.
+typedef struct RecrawlTimer {
+    uint32_t id;
+    int depth;
+    uint64_t due_tick;
+    struct RecrawlTimer *next;
+} RecrawlTimer;
+
+// The scheduler and the thread that turns its wheel.
+typedef struct Recrawl {
+    URLQueue *queue;
+    uint64_t min_ms, max_ms;
+    uint64_t started_ms, deadline_ms;   // Nothing is revisited after the deadline
+    _Atomic(RecrawlPage *) chunks[RECRAWL_CHUNKS]; // URL ID -> statistics, filled on demand
+    RecrawlTimer *slots[RECRAWL_SLOTS];
+    uint64_t tick;                      // Next tick the wheel will process
+    pthread_mutex_t lock;               // Guards the wheel
+    pthread_cond_t wake;
+    bool stopping;
+    pthread_t thread;
+    atomic_ulong pending;               // Timers on the wheel
+    atomic_ulong revisits, changed, released;
+} Recrawl;
+
+Recrawl *recrawl_start(URLQueue *queue, long seconds, long min_s, long max_s);
+uint64_t recrawl_digest(uint64_t digest, const char *data, size_t len);
+void recrawl_visit(Recrawl *recrawl, uint32_t id, int depth, uint64_t digest, bool fetched);
+bool recrawl_pending(Recrawl *recrawl);
+void recrawl_stop(Recrawl *recrawl);
+
+#endif
@@ -0,0 +1,213 @@
+#include "crawler_core.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "memory.h"
+#include "replay.h"
+
+// Bytes a record takes in the file, padding included.
+static uint64_t record_size(uint32_t url_len, uint32_t headers_len, uint64_t body_len) {
+    uint64_t len = sizeof(ReplayRecord) + url_len + headers_len + body_len;
+    return (len + REPLAY_ALIGN - 1) & ~(uint64_t)(REPLAY_ALIGN - 1);
+}
+
+// Create a store to record into, replacing any file at `path`.
+ReplayStore *replay_create(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Error: Unable to create the replay file");
+        return NULL;
+    }
+    ReplayStore *store = (ReplayStore *)calloc(1, sizeof(ReplayStore));
+    if (!store) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(store->path, sizeof(store->path), "%s", path);
+    store->fd = fd;
+    store->recording = true;
+    store->size = sizeof(ReplayFileHeader);
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+// Append one fetched response. Called concurrently by the workers; the response must have been
+// captured, so headers and body are there as received.
+void replay_record(ReplayStore *store, const char *url, const FetchResult *result, uint32_t latency_us) {
+    static const char padding[REPLAY_ALIGN];
+    const BodyChain *body = result->body;
+    ReplayRecord record;
+    memset(&record, 0, sizeof(record));
+    record.url_hash = url_hash(url);
+    record.url_len = (uint32_t)strlen(url);
+    record.headers_len = (uint32_t)result->headers_len;
+    record.body_len = body ? body->total : 0;
+    record.status = (int32_t)result->status;
+    record.error = (int32_t)result->error;
+    record.latency_us = latency_us;
+    record.encoding = (uint8_t)result->encoding;
+    record.truncated = body && body->truncated;
+    uint64_t len = record_size(record.url_len, record.headers_len, record.body_len);
+
+    struct iovec iov[BODY_MAX_BLOCKS + 4];
+    int iovcnt = 0;
+    iov[iovcnt++] = (struct iovec){&record, sizeof(record)};
+    iov[iovcnt++] = (struct iovec){(void *)url, record.url_len};
+    if (record.headers_len) {
+        iov[iovcnt++] = (struct iovec){(void *)result->headers, record.headers_len};
+    }
+    for (int i = 0; body && i < body->count; i++) {
+        iov[iovcnt++] = (struct iovec){body->blocks[i], body->used[i]};
+    }
+    iov[iovcnt++] = (struct iovec){(void *)padding, len - (sizeof(record) + record.url_len + record.headers_len +
+                                                         record.body_len)};
+
+    // Reserve the space and index it under the lock; the write needs no lock.
+    pthread_mutex_lock(&store->lock);
+    uint64_t offset = store->size;
+    store->size += len;
+    if (store->count == store->capacity) {
+        size_t capacity = store->capacity ? store->capacity * 2 : 4096;
+        ReplayIndexEntry *grown = (ReplayIndexEntry *)realloc(store->entries, capacity * sizeof(ReplayIndexEntry));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        mem_account(MEM_OUTPUT, (long)((capacity - store->capacity) * sizeof(ReplayIndexEntry)));
+        store->entries = grown;
+        store->capacity = capacity;
+    }
+    store->entries[store->count++] = (ReplayIndexEntry){record.url_hash, offset};
+    pthread_mutex_unlock(&store->lock);
+
+    if (pwritev(store->fd, iov, iovcnt, (off_t)offset) != (ssize_t)len) {
+        fprintf(stderr, "Error: Unable to write the replay file\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Order index entries by hash, then by position so the newest record for a URL comes last.
+static int compare_entries(const void *a, const void *b) {
+    const ReplayIndexEntry *x = (const ReplayIndexEntry *)a;
+    const ReplayIndexEntry *y = (const ReplayIndexEntry *)b;
+    if (x->url_hash != y->url_hash) {
+        return x->url_hash < y->url_hash ? -1 : 1;
+    }
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+// Map a recorded store for the replay fetcher. With `latency`, each response is served no sooner
+// than it arrived when it was recorded.
+ReplayStore *replay_open(const char *path, bool latency) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error: Unable to open the replay file");
+        return NULL;
+    }
+    struct stat st;
+    const char *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ReplayFileHeader)) {
+        map = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    const ReplayFileHeader *header = (const ReplayFileHeader *)map;
+    if (map == MAP_FAILED || memcmp(header->magic, REPLAY_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != REPLAY_VERSION || header->index_offset % REPLAY_ALIGN != 0 ||
+        header->index_offset > (uint64_t)st.st_size ||
+        header->count > ((uint64_t)st.st_size - header->index_offset) / sizeof(ReplayIndexEntry)) {
+        fprintf(stderr, "Error: %s is not a finished replay file\n", path);
+        if (map != MAP_FAILED) {
+            munmap((void *)map, st.st_size);
+        }
+        return NULL;
+    }
+    // Lookups land anywhere in the file; don't read ahead around them.
+    madvise((void *)map, st.st_size, MADV_RANDOM);
+
+    ReplayStore *store = (ReplayStore *)calloc(1, sizeof(ReplayStore));
+    if (!store) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(store->path, sizeof(store->path), "%s", path);
+    store->fd = -1;
+    store->latency = latency;
+    store->map = map;
+    store->map_len = st.st_size;
+    store->index = (const ReplayIndexEntry *)(map + header->index_offset);
+    store->count = header->count;
+    return store;
+}
+
+// Look up the newest recorded response for a URL. Counts the lookup as served or missing.
+bool replay_find(ReplayStore *store, const char *url, ReplayResponse *response) {
+    uint64_t hash = url_hash(url);
+    size_t lo = 0, hi = store->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (store->index[mid].url_hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t end = lo;
+    while (end < store->count && store->index[end].url_hash == hash) {
+        end++;
+    }
+
+    // Walk the equal-hash run backwards so the newest record wins; the stored URL guards against collisions.
+    size_t url_len = strlen(url);
+    for (size_t i = end; i > lo; i--) {
+        uint64_t offset = store->index[i - 1].offset;
+        const ReplayRecord *record = (const ReplayRecord *)(store->map + offset);
+        if (offset + sizeof(ReplayRecord) > store->map_len ||
+            offset + record_size(record->url_len, record->headers_len, record->body_len) > store->map_len) {
+            continue;
+        }
+        const char *data = (const char *)(record + 1);
+        if (record->url_len != url_len || memcmp(data, url, url_len) != 0) {
+            continue;
+        }
+        response->status = record->status;
+        response->error = (CURLcode)record->error;
+        response->encoding = (ContentEncoding)record->encoding;
+        response->headers = data + record->url_len;
+        response->headers_len = record->headers_len;
+        response->body = response->headers + record->headers_len;
+        response->body_len = record->body_len;
+        response->latency_us = record->latency_us;
+        atomic_fetch_add_explicit(&store->served, 1, memory_order_relaxed);
+        return true;
+    }
+    atomic_fetch_add_explicit(&store->missing, 1, memory_order_relaxed);
+    return false;
+}
+
+// Finish a recording by writing the sorted index and the file header, or unmap a replayed store.
+void replay_close(ReplayStore *store) {
+    if (!store->recording) {
+        munmap((void *)store->map, store->map_len);
+        free(store);
+        return;
+    }
+    qsort(store->entries, store->count, sizeof(ReplayIndexEntry), compare_entries);
+    ReplayFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.count = store->count;
+    header.index_offset = store->size;
+    size_t index_len = store->count * sizeof(ReplayIndexEntry);
+    if (pwrite(store->fd, store->entries, index_len, (off_t)store->size) != (ssize_t)index_len ||
+        pwrite(store->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        fprintf(stderr, "Error: Unable to finish the replay file %s\n", store->path);
+    }
+    close(store->fd);
+    mem_account(MEM_OUTPUT, -(long)(store->capacity * sizeof(ReplayIndexEntry)));
+    free(store->entries);
+    pthread_mutex_destroy(&store->lock);
+    free(store);
+}
@@ -0,0 +1,77 @@
+// Recorded fetches for offline runs: a crawl with --record stores every response it fetches in one
+// indexed file, and the replay fetcher serves them back from a read-only mapping of that file.
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "crawler_core.h"
+
+#define REPLAY_MAGIC "WCREPLAY"
+#define REPLAY_VERSION 1
+#define REPLAY_ALIGN 8                  // Records start on this boundary so their headers can be read in place
+
+// Start of the file; count and index_offset are filled in when recording ends.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t count;
+    uint64_t index_offset;              // Sorted ReplayIndexEntry array after the last record
+} ReplayFileHeader;
+
+// One response, followed by its URL, raw headers and body as received, then padding.
+typedef struct {
+    uint64_t url_hash;
+    uint32_t url_len;
+    uint32_t headers_len;
+    uint64_t body_len;
+    int32_t status;
+    int32_t error;                      // CURLcode of the transfer
+    uint32_t latency_us;                // Total transfer time when it was recorded
+    uint8_t encoding;                   // ContentEncoding of the body
+    uint8_t truncated;                  // The body was cut at the capture limit
+    uint16_t reserved;
+} ReplayRecord;
+
+// Index entry pointing from a URL hash to a record.
+typedef struct {
+    uint64_t url_hash;
+    uint64_t offset;
+} ReplayIndexEntry;
+
+// A store being recorded or being replayed.
+typedef struct ReplayStore {
+    char path[512];
+    int fd;
+    bool recording;
+    bool latency;                       // Replay waits out each response's recorded time
+    // Recording: space is reserved and indexed under the lock, records are written outside it.
+    pthread_mutex_t lock;
+    uint64_t size;
+    ReplayIndexEntry *entries;
+    size_t count, capacity;
+    // Replaying.
+    const char *map;
+    size_t map_len;
+    const ReplayIndexEntry *index;
+    atomic_ulong served, missing;
+} ReplayStore;
+
+// A recorded response, pointing into the mapping.
+typedef struct {
+    long status;
+    CURLcode error;
+    ContentEncoding encoding;
+    const char *headers;
+    size_t headers_len;
+    const char *body;
+    size_t body_len;
+    uint32_t latency_us;
+} ReplayResponse;
+
+ReplayStore *replay_create(const char *path);
+void replay_record(ReplayStore *store, const char *url, const FetchResult *result, uint32_t latency_us);
+ReplayStore *replay_open(const char *path, bool latency);
+bool replay_find(ReplayStore *store, const char *url, ReplayResponse *response);
+void replay_close(ReplayStore *store);
+
+#endif
@@ -0,0 +1,521 @@
+#include "crawler_core.h"
+#include "robots.h"
+#include "error_log.h"
+#include "url_table.h"
+#include "fiber.h"
+#include "memory.h"
+#include <ctype.h>
+
+#define ROBOTS_ORIGIN_LENGTH 256
+#define ROBOTS_MAX_BYTES (500 * 1024)   // RFC 9309 minimum parse limit
+#define ROBOTS_MAX_DELAY_MS 30000
+
+// Node of a robots.txt prefix trie. Children form a sibling list inside the node array.
+typedef struct {
+    int first_child;
+    int next_sibling;
+    unsigned char byte;
+    signed char verdict;  // 0 = no rule ends here, 1 = Allow, -1 = Disallow
+} RobotsTrieNode;
+
+// Rule with '*' or '$' that the trie can't hold.
+typedef struct {
+    char *pattern;
+    int length;
+    bool allow;
+} RobotsWildcard;
+
+// Compiled rules for one origin. Immutable once published.
+typedef struct {
+    RobotsTrieNode *nodes;  // nodes[0] is the root
+    int node_count, node_cap;
+    RobotsWildcard *wildcards;
+    int wildcard_count, wildcard_cap;
+    bool disallow_all;      // robots.txt was unreachable
+    int crawl_delay_ms;
+} RobotsRules;
+
+// Cache entry for one origin (scheme://host[:port]).
+typedef struct RobotsHost {
+    struct RobotsHost *next;        // Bucket chain
+    struct RobotsHost *next_fetch;  // Fetch work list
+    uint64_t hash;
+    _Atomic(RobotsRules *) rules;   // NULL until robots.txt has been fetched
+    pthread_mutex_t lock;           // Orders parking against publication
+    URLQueueNode *parked;           // URLs waiting for the rules
+    atomic_ullong next_fetch_ms;    // Next fetch slot under Crawl-delay
+    char origin[ROBOTS_ORIGIN_LENGTH];
+} RobotsHost;
+
+// Return the trie child of `node` for `byte`, adding it if `create` is set.
+static int robots_trie_child(RobotsRules *rules, int node, unsigned char byte, bool create) {
+    for (int child = rules->nodes[node].first_child; child; child = rules->nodes[child].next_sibling) {
+        if (rules->nodes[child].byte == byte) {
+            return child;
+        }
+    }
+    if (!create) {
+        return 0;
+    }
+    if (rules->node_count == rules->node_cap) {
+        rules->node_cap *= 2;
+        rules->nodes = (RobotsTrieNode *)realloc(rules->nodes, rules->node_cap * sizeof(RobotsTrieNode));
+        if (!rules->nodes) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int child = rules->node_count++;
+    rules->nodes[child] = (RobotsTrieNode){0, rules->nodes[node].first_child, byte, 0};
+    rules->nodes[node].first_child = child;
+    return child;
+}
+
+// Allocate an empty rule set, which allows everything.
+static RobotsRules *robots_rules_new(void) {
+    RobotsRules *rules = (RobotsRules *)calloc(1, sizeof(RobotsRules));
+    if (!rules) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    rules->node_cap = 16;
+    rules->nodes = (RobotsTrieNode *)calloc(rules->node_cap, sizeof(RobotsTrieNode));
+    if (!rules->nodes) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    rules->node_count = 1;
+    return rules;
+}
+
+// Free a rule set.
+static void robots_rules_free(RobotsRules *rules) {
+    for (int i = 0; i < rules->wildcard_count; i++) {
+        free(rules->wildcards[i].pattern);
+    }
+    free(rules->wildcards);
+    free(rules->nodes);
+    free(rules);
+}
+
+// Compile one Allow/Disallow rule into the trie, or into the wildcard list.
+static void robots_add_rule(RobotsRules *rules, const char *pattern, size_t len, bool allow) {
+    if (len == 0) {
+        return; // An empty Disallow allows everything
+    }
+    if (memchr(pattern, '*', len) || pattern[len - 1] == '$') {
+        if (rules->wildcard_count == rules->wildcard_cap) {
+            rules->wildcard_cap = rules->wildcard_cap ? rules->wildcard_cap * 2 : 8;
+            rules->wildcards = (RobotsWildcard *)realloc(rules->wildcards, rules->wildcard_cap * sizeof(RobotsWildcard));
+            if (!rules->wildcards) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        RobotsWildcard *wildcard = &rules->wildcards[rules->wildcard_count++];
+        wildcard->pattern = strndup(pattern, len);
+        wildcard->length = len;
+        wildcard->allow = allow;
+        return;
+    }
+    int node = 0;
+    for (size_t i = 0; i < len; i++) {
+        node = robots_trie_child(rules, node, (unsigned char)pattern[i], true);
+    }
+    // When the same path is both allowed and disallowed, Allow wins.
+    if (allow || rules->nodes[node].verdict == 0) {
+        rules->nodes[node].verdict = allow ? 1 : -1;
+    }
+}
+
+// Match a robots wildcard pattern against the start of a path.
+static bool robots_wildcard_match(const char *pattern, const char *path) {
+    const char *star = NULL, *star_path = NULL;
+    while (true) {
+        if (*pattern == '\0') {
+            return true;
+        }
+        if (*pattern == '$' && pattern[1] == '\0') {
+            if (*path == '\0') {
+                return true;
+            }
+        } else if (*pattern == '*') {
+            star = ++pattern;
+            star_path = path;
+            continue;
+        } else if (*path && *pattern == *path) {
+            pattern++;
+            path++;
+            continue;
+        }
+        if (!star || !*star_path) {
+            return false;
+        }
+        pattern = star;
+        path = ++star_path;
+    }
+}
+
+// The longest matching rule decides; Allow wins ties. No match means allowed.
+bool robots_allowed(const RobotsRules *rules, const char *path) {
+    if (rules->disallow_all) {
+        return false;
+    }
+    int best_length = -1;
+    bool best_allow = true;
+    int node = 0;
+    for (int depth = 1; path[depth - 1]; depth++) {
+        node = robots_trie_child((RobotsRules *)rules, node, (unsigned char)path[depth - 1], false);
+        if (!node) {
+            break;
+        }
+        if (rules->nodes[node].verdict) {
+            best_length = depth;
+            best_allow = rules->nodes[node].verdict > 0;
+        }
+    }
+    for (int i = 0; i < rules->wildcard_count; i++) {
+        const RobotsWildcard *wildcard = &rules->wildcards[i];
+        if ((wildcard->length > best_length || (wildcard->length == best_length && wildcard->allow)) &&
+            robots_wildcard_match(wildcard->pattern, path)) {
+            best_length = wildcard->length;
+            best_allow = wildcard->allow;
+        }
+    }
+    return best_allow;
+}
+
+// Parse robots.txt. Groups naming our agent take precedence over '*' groups.
+RobotsRules *robots_parse(const char *text, size_t len) {
+    RobotsRules *ours = robots_rules_new();
+    RobotsRules *star = robots_rules_new();
+    bool have_ours = false;
+    bool group_ours = false, group_star = false, in_agents = false;
+
+    const char *end = text + len;
+    while (text < end) {
+        const char *eol = memchr(text, '\n', end - text);
+        if (!eol) {
+            eol = end;
+        }
+        const char *line_end = memchr(text, '#', eol - text);
+        if (!line_end) {
+            line_end = eol;
+        }
+        const char *colon = memchr(text, ':', line_end - text);
+        if (colon) {
+            const char *key = text;
+            size_t key_len = colon - text;
+            while (key_len && (*key == ' ' || *key == '\t')) {
+                key++;
+                key_len--;
+            }
+            while (key_len && (key[key_len - 1] == ' ' || key[key_len - 1] == '\t')) {
+                key_len--;
+            }
+            const char *value = colon + 1;
+            while (value < line_end && (*value == ' ' || *value == '\t')) {
+                value++;
+            }
+            size_t value_len = line_end - value;
+            while (value_len && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t' ||
+                                 value[value_len - 1] == '\r')) {
+                value_len--;
+            }
+
+            if (key_len == 10 && strncasecmp(key, "user-agent", 10) == 0) {
+                if (!in_agents) {
+                    group_ours = group_star = false;
+                }
+                in_agents = true;
+                if (value_len == 1 && *value == '*') {
+                    group_star = true;
+                } else if (value_len >= strlen(ROBOTS_AGENT_TOKEN) &&
+                           strncasecmp(value, ROBOTS_AGENT_TOKEN, strlen(ROBOTS_AGENT_TOKEN)) == 0) {
+                    group_ours = have_ours = true;
+                }
+            } else {
+                in_agents = false;
+                bool allow = key_len == 5 && strncasecmp(key, "allow", 5) == 0;
+                bool disallow = key_len == 8 && strncasecmp(key, "disallow", 8) == 0;
+                if (allow || disallow) {
+                    if (group_ours) {
+                        robots_add_rule(ours, value, value_len, allow);
+                    }
+                    if (group_star) {
+                        robots_add_rule(star, value, value_len, allow);
+                    }
+                } else if (key_len == 11 && strncasecmp(key, "crawl-delay", 11) == 0) {
+                    double seconds = strtod(value, NULL);
+                    int delay = seconds > 0 ? (int)(seconds * 1000) : 0;
+                    if (delay > ROBOTS_MAX_DELAY_MS) {
+                        delay = ROBOTS_MAX_DELAY_MS;
+                    }
+                    if (group_ours) {
+                        ours->crawl_delay_ms = delay;
+                    }
+                    if (group_star) {
+                        star->crawl_delay_ms = delay;
+                    }
+                }
+            }
+        }
+        text = eol + 1;
+    }
+
+    if (have_ours) {
+        robots_rules_free(star);
+        return ours;
+    }
+    robots_rules_free(ours);
+    return star;
+}
+
+// Find the entry for an origin, adding it (and scheduling its robots.txt fetch) if `create` is set.
+static RobotsHost *robots_host(RobotsCache *cache, const char *origin, bool create) {
+    uint64_t hash = url_hash(origin);
+    _Atomic(RobotsHost *) *bucket = &cache->buckets[hash % ROBOTS_BUCKETS];
+    RobotsHost *fresh = NULL;
+    RobotsHost *head = atomic_load_explicit(bucket, memory_order_acquire);
+    while (true) {
+        for (RobotsHost *host = head; host; host = host->next) {
+            if (host->hash == hash && strcmp(host->origin, origin) == 0) {
+                if (fresh) {
+                    pthread_mutex_destroy(&fresh->lock);
+                    free(fresh);
+                }
+                return host;
+            }
+        }
+        if (!create) {
+            return NULL;
+        }
+        if (!fresh) {
+            fresh = (RobotsHost *)calloc(1, sizeof(RobotsHost));
+            if (!fresh) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            fresh->hash = hash;
+            snprintf(fresh->origin, sizeof(fresh->origin), "%s", origin);
+            pthread_mutex_init(&fresh->lock, NULL);
+        }
+        fresh->next = head;
+        if (atomic_compare_exchange_weak_explicit(bucket, &head, fresh, memory_order_release, memory_order_acquire)) {
+            break;
+        }
+    }
+    mem_account(MEM_CACHES, sizeof(RobotsHost));
+
+    pthread_mutex_lock(&cache->fetch_lock);
+    if (cache->fetch_tail) {
+        cache->fetch_tail->next_fetch = fresh;
+    } else {
+        cache->fetch_head = fresh;
+    }
+    cache->fetch_tail = fresh;
+    pthread_mutex_unlock(&cache->fetch_lock);
+    return fresh;
+}
+
+// Decide whether a new frontier node may be queued. Disallowed nodes are freed, and nodes
+// whose origin has no rules yet are parked until its robots.txt arrives.
+bool robots_admit(RobotsCache *cache, URLQueueNode *node, const char *url) {
+    char origin[ROBOTS_ORIGIN_LENGTH];
+    const char *path;
+    if (!url_origin(url, origin, sizeof(origin), &path)) {
+        return true;
+    }
+    RobotsHost *host = robots_host(cache, origin, true);
+    RobotsRules *rules = atomic_load_explicit(&host->rules, memory_order_acquire);
+    if (!rules) {
+        if (cache->dns) {
+            dns_prefetch(cache->dns, url); // The robots.txt fetch needs the name first
+        }
+        pthread_mutex_lock(&host->lock);
+        rules = atomic_load_explicit(&host->rules, memory_order_acquire);
+        if (!rules) {
+            node->next = host->parked;
+            host->parked = node;
+            pthread_mutex_unlock(&host->lock);
+            return false;
+        }
+        pthread_mutex_unlock(&host->lock);
+    }
+    if (!robots_allowed(rules, path)) {
+        atomic_fetch_add(&cache->denied, 1);
+        free(node);
+        return false;
+    }
+    return true;
+}
+
+// Install an origin's rules and release its parked URLs into the frontier.
+static void robots_publish(RobotsCache *cache, RobotsHost *host, RobotsRules *rules, URLQueue *queue) {
+    mem_account(MEM_CACHES, (long)(sizeof(RobotsRules) + rules->node_cap * sizeof(RobotsTrieNode) +
+                                   rules->wildcard_cap * sizeof(RobotsWildcard)));
+    pthread_mutex_lock(&host->lock);
+    atomic_store_explicit(&host->rules, rules, memory_order_release);
+    URLQueueNode *parked = host->parked;
+    host->parked = NULL;
+    pthread_mutex_unlock(&host->lock);
+
+    // Parking reversed the order; restore it.
+    URLQueueNode *ordered = NULL;
+    while (parked) {
+        URLQueueNode *next = parked->next;
+        parked->next = ordered;
+        ordered = parked;
+        parked = next;
+    }
+    while (ordered) {
+        URLQueueNode *node = ordered;
+        ordered = ordered->next;
+        char url[MAX_URL_LENGTH], origin[ROBOTS_ORIGIN_LENGTH];
+        const char *path = "/";
+        url_table_get(queue->urls, node->id, url, sizeof(url));
+        url_origin(url, origin, sizeof(origin), &path);
+        if (robots_allowed(rules, path)) {
+            frontier_push(queue, node);
+        } else {
+            atomic_fetch_add(&cache->denied, 1);
+            free(node);
+        }
+    }
+}
+
+// Collect a robots.txt body, up to ROBOTS_MAX_BYTES.
+static size_t robots_write(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    BodyChain *body = (BodyChain *)userdata;
+    size_t len = size * nmemb;
+    size_t room = body->total < ROBOTS_MAX_BYTES ? ROBOTS_MAX_BYTES - body->total : 0;
+    body_append(body, (const char *)ptr, len < room ? len : room);
+    return len;
+}
+
+// If an origin is waiting for its robots.txt, fetch and publish it. Returns false when there was none.
+bool robots_fetch_next(RobotsCache *cache, CURL *curl, URLQueue *queue) {
+    pthread_mutex_lock(&cache->fetch_lock);
+    RobotsHost *host = cache->fetch_head;
+    if (host) {
+        cache->fetch_head = host->next_fetch;
+        if (!cache->fetch_head) {
+            cache->fetch_tail = NULL;
+        }
+        // Count as in flight before the list looks empty, so idle workers don't exit meanwhile.
+        frontier_begin(queue);
+    }
+    pthread_mutex_unlock(&cache->fetch_lock);
+    if (!host) {
+        return false;
+    }
+
+    char url[ROBOTS_ORIGIN_LENGTH + 16];
+    snprintf(url, sizeof(url), "%s/robots.txt", host->origin);
+    BodyChain body;
+    memset(&body, 0, sizeof(body));
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, robots_write);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    bool unresolvable = false;
+    struct curl_slist *resolve = cache->dns ? dns_apply(cache->dns, curl, url, &unresolvable) : NULL;
+    CURLcode res = unresolvable ? CURLE_COULDNT_RESOLVE_HOST : fiber_perform(curl);
+    if (resolve) {
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, NULL);
+        curl_slist_free_all(resolve);
+    }
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    atomic_fetch_add(&cache->fetched, 1);
+
+    // RFC 9309: a missing robots.txt allows everything, an unreachable one disallows everything.
+    RobotsRules *rules;
+    if (res == CURLE_OK && status >= 200 && status < 300) {
+        char *text = (char *)malloc(body.total + 1);
+        if (!text) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        size_t len = 0;
+        for (int i = 0; i < body.count; i++) {
+            memcpy(text + len, body.blocks[i], body.used[i]);
+            len += body.used[i];
+        }
+        rules = robots_parse(text, len);
+        free(text);
+    } else {
+        rules = robots_rules_new();
+        if (res != CURLE_OK || status >= 500) {
+            rules->disallow_all = true;
+            char host_name[ERROR_HOST_LENGTH];
+            url_host(url, host_name, sizeof(host_name));
+            log_error(res != CURLE_OK ? ERROR_KIND_CURL : ERROR_KIND_HTTP, res != CURLE_OK ? (int)res : (int)status,
+                      host_name, "robots.txt unreachable, disallowing host");
+        }
+    }
+    body_free(&body);
+
+    robots_publish(cache, host, rules, queue);
+    frontier_done(queue);
+    return true;
+}
+
+// Whether any origin is still waiting for its robots.txt fetch.
+bool robots_pending(RobotsCache *cache) {
+    pthread_mutex_lock(&cache->fetch_lock);
+    bool pending = cache->fetch_head != NULL;
+    pthread_mutex_unlock(&cache->fetch_lock);
+    return pending;
+}
+
+// Apply the origin's Crawl-delay: returns 0 and claims the slot if the URL may be fetched now,
+// otherwise the number of milliseconds until the next slot.
+uint64_t robots_delay(RobotsCache *cache, const char *url) {
+    char origin[ROBOTS_ORIGIN_LENGTH];
+    const char *path;
+    if (!url_origin(url, origin, sizeof(origin), &path)) {
+        return 0;
+    }
+    RobotsHost *host = robots_host(cache, origin, false);
+    RobotsRules *rules = host ? atomic_load_explicit(&host->rules, memory_order_acquire) : NULL;
+    if (!rules || rules->crawl_delay_ms == 0) {
+        return 0;
+    }
+    uint64_t now = now_ms();
+    unsigned long long next = atomic_load(&host->next_fetch_ms);
+    while (next <= now) {
+        if (atomic_compare_exchange_weak(&host->next_fetch_ms, &next, now + rules->crawl_delay_ms)) {
+            return 0;
+        }
+    }
+    return next - now;
+}
+
+// Set up an empty robots cache.
+void robots_init(RobotsCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->fetch_lock, NULL);
+}
+
+// Free every cached entry and its rules.
+void robots_free(RobotsCache *cache) {
+    for (int i = 0; i < ROBOTS_BUCKETS; i++) {
+        RobotsHost *host = atomic_load(&cache->buckets[i]);
+        while (host) {
+            RobotsHost *next = host->next;
+            RobotsRules *rules = atomic_load(&host->rules);
+            if (rules) {
+                robots_rules_free(rules);
+            }
+            while (host->parked) {
+                URLQueueNode *node = host->parked;
+                host->parked = node->next;
+                free(node);
+            }
+            pthread_mutex_destroy(&host->lock);
+            free(host);
+            host = next;
+        }
+    }
+    pthread_mutex_destroy(&cache->fetch_lock);
+}
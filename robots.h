@@ -0,0 +1,30 @@
+// Per-origin robots.txt cache consulted by enqueue().
+#ifndef ROBOTS_H
+#define ROBOTS_H
+
+#include "crawler_core.h"
+#include "dns_cache.h"
+
+#define ROBOTS_BUCKETS 4096
+#define ROBOTS_AGENT_TOKEN "wc-crawler"
+
+struct RobotsHost;
+
+// Per-origin robots.txt cache. Lookups are lock-free; entries are never removed.
+typedef struct RobotsCache {
+    _Atomic(struct RobotsHost *) buckets[ROBOTS_BUCKETS];
+    pthread_mutex_t fetch_lock;
+    struct RobotsHost *fetch_head, *fetch_tail; // Origins whose robots.txt nobody has fetched yet
+    DnsCache *dns;                       // Shared with the queue, NULL if unused
+    atomic_ulong fetched;
+    atomic_ulong denied;
+} RobotsCache;
+
+void robots_init(RobotsCache *cache);
+void robots_free(RobotsCache *cache);
+bool robots_admit(RobotsCache *cache, URLQueueNode *node, const char *url);
+bool robots_fetch_next(RobotsCache *cache, CURL *curl, URLQueue *queue);
+bool robots_pending(RobotsCache *cache);
+uint64_t robots_delay(RobotsCache *cache, const char *url);
+
+#endif
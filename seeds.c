@@ -0,0 +1,255 @@
+#include "crawler_core.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "seeds.h"
+#include "shard.h"
+#include "url_filter.h"
+#include "url_table.h"
+
+#define SEED_INFLATE_START (64UL << 20) // First size of the buffer a gzip seed file inflates into
+#define SEED_MIN_SLICE (1UL << 20)      // Smaller files use fewer loader threads
+
+// One loader thread's share of the seed text: whole lines from start up to end.
+typedef struct {
+    Crawler *crawler;
+    const char *start, *end;
+    SeedStats stats;
+} SeedSlice;
+
+// Inflate a gzip (or zlib) seed file, concatenated members included, into an anonymous mapping
+// that doubles as needed. Returns the mapping and its length and size, or NULL on corrupt input.
+static char *seed_inflate(const char *data, size_t size, size_t *len_out, size_t *map_size) {
+    size_t cap = SEED_INFLATE_START;
+    char *buf = (char *)mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (buf == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map the seed buffer\n");
+        return NULL;
+    }
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 32 enables automatic gzip/zlib header detection.
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        munmap(buf, cap);
+        return NULL;
+    }
+
+    size_t consumed = 0, len = 0;
+    bool ok = false;
+    while (true) {
+        // zlib counts in 32 bits, so feed and drain at most UINT_MAX bytes per call.
+        if (zs.avail_in == 0) {
+            size_t chunk = size - consumed < UINT_MAX ? size - consumed : UINT_MAX;
+            zs.next_in = (Bytef *)data + consumed;
+            zs.avail_in = (uInt)chunk;
+            consumed += chunk;
+        }
+        if (len == cap) {
+            char *grown = (char *)mremap(buf, cap, cap * 2, MREMAP_MAYMOVE);
+            if (grown == MAP_FAILED) {
+                fprintf(stderr, "Error: Unable to grow the seed buffer past %zu MiB\n", cap >> 20);
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        size_t room = cap - len < UINT_MAX ? cap - len : UINT_MAX;
+        zs.next_out = (Bytef *)buf + len;
+        zs.avail_out = (uInt)room;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        len += room - zs.avail_out;
+        if (ret == Z_STREAM_END) {
+            if (zs.avail_in == 0 && consumed == size) {
+                ok = true;
+                break;
+            }
+            inflateReset(&zs); // Another gzip member follows
+        } else if (ret != Z_OK && !(ret == Z_BUF_ERROR && (zs.avail_out == 0 || consumed < size))) {
+            fprintf(stderr, "Error: Corrupt or truncated compressed seed file\n");
+            break;
+        }
+    }
+    inflateEnd(&zs);
+    if (!ok) {
+        munmap(buf, cap);
+        return NULL;
+    }
+    *len_out = len;
+    *map_size = cap;
+    return buf;
+}
+
+// Whether a byte is white space around a seed line.
+static bool seed_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Loader thread: normalize each line of the slice, keep the new URLs this shard owns, and push
+// them to the frontier SEED_BATCH at a time. The URL table dedupes across threads.
+static void *seed_worker(void *arg) {
+    SeedSlice *slice = (SeedSlice *)arg;
+    URLQueue *queue = &slice->crawler->queue;
+    ShardSet *shards = slice->crawler->shards;
+    FrontierBatch batch = {NULL, NULL, 0};
+    char url[MAX_URL_LENGTH];
+
+    const char *p = slice->start;
+    while (p < slice->end) {
+        const char *line_end = (const char *)memchr(p, '\n', slice->end - p);
+        if (!line_end) {
+            line_end = slice->end;
+        }
+        const char *line = p;
+        p = line_end + 1;
+        while (line < line_end && seed_space(*line)) {
+            line++;
+        }
+        while (line_end > line && seed_space(line_end[-1])) {
+            line_end--;
+        }
+        if (line == line_end || *line == '#') {
+            continue;
+        }
+        slice->stats.lines++;
+
+        size_t len = url_normalize(line, line_end - line, url, sizeof(url));
+        if (len == 0) {
+            slice->stats.invalid++;
+            continue;
+        }
+        if (shards && shard_of(shards, url, len) != shards->self) {
+            slice->stats.skipped++;
+            continue;
+        }
+        if (slice->crawler->filter && !url_filter_allows(slice->crawler->filter, url, len)) {
+            slice->stats.filtered++;
+            continue;
+        }
+        if (!frontier_batch_add(queue, &batch, url, len, 0, NULL)) {
+            slice->stats.duplicates++;
+            continue;
+        }
+        slice->stats.loaded++;
+        if (batch.count == SEED_BATCH) {
+            frontier_batch_push(queue, &batch);
+        }
+    }
+    frontier_batch_push(queue, &batch);
+    return NULL;
+}
+
+// Load every URL of a seed file into the crawl's frontier at depth 0, using up to `threads`
+// loader threads. The file is mapped, not read; gzip files are inflated into memory first.
+bool seeds_load(Crawler *crawler, const char *path, int threads, SeedStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    uint64_t started = now_ms();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Unable to open seed file %s\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: Unable to read seed file %s\n", path);
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map seed file %s\n", path);
+        return false;
+    }
+
+    char *text = map;
+    size_t len = size, text_map = size;
+    if (size >= 2 && (unsigned char)map[0] == 0x1f && (unsigned char)map[1] == 0x8b) {
+        madvise(map, size, MADV_SEQUENTIAL);
+        text = seed_inflate(map, size, &len, &text_map);
+        munmap(map, size);
+        if (!text) {
+            return false;
+        }
+        if (len == 0) {
+            munmap(text, text_map);
+            return true;
+        }
+    } else {
+        // The slices are read in parallel; start paging all of the file in now.
+        madvise(map, size, MADV_WILLNEED);
+    }
+
+    // Size the URL table from the line count of the first megabyte, so it isn't rehashed while
+    // millions of seeds go in.
+    size_t sample = len < SEED_MIN_SLICE ? len : SEED_MIN_SLICE;
+    size_t sample_lines = 1;
+    for (const char *q = text; (q = (const char *)memchr(q, '\n', text + sample - q)); q++) {
+        sample_lines++;
+    }
+    url_table_reserve(crawler->queue.urls, len / sample * sample_lines);
+
+    if (threads > SEED_MAX_THREADS) {
+        threads = SEED_MAX_THREADS;
+    }
+    if ((size_t)threads > len / SEED_MIN_SLICE + 1) {
+        threads = (int)(len / SEED_MIN_SLICE + 1);
+    }
+
+    // Cut the text into one slice per thread, each ending after a newline.
+    SeedSlice slices[SEED_MAX_THREADS];
+    pthread_t workers[SEED_MAX_THREADS];
+    const char *end = text + len;
+    const char *pos = text;
+    for (int i = 0; i < threads; i++) {
+        const char *cut = i == threads - 1 ? end : text + len / threads * (i + 1);
+        if (cut < pos) {
+            cut = pos;
+        }
+        const char *newline = (const char *)memchr(cut, '\n', end - cut);
+        slices[i].crawler = crawler;
+        slices[i].start = pos;
+        slices[i].end = newline ? newline + 1 : end;
+        memset(&slices[i].stats, 0, sizeof(SeedStats));
+        pos = slices[i].end;
+    }
+
+    // Slice 0 runs here; a thread that fails to start has its slice run here too.
+    bool *inline_run = (bool *)calloc(threads, sizeof(bool));
+    if (!inline_run) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 1; i < threads; i++) {
+        inline_run[i] = pthread_create(&workers[i], NULL, seed_worker, &slices[i]) != 0;
+    }
+    seed_worker(&slices[0]);
+    for (int i = 1; i < threads; i++) {
+        if (inline_run[i]) {
+            seed_worker(&slices[i]);
+        } else {
+            pthread_join(workers[i], NULL);
+        }
+    }
+    free(inline_run);
+
+    for (int i = 0; i < threads; i++) {
+        stats->lines += slices[i].stats.lines;
+        stats->loaded += slices[i].stats.loaded;
+        stats->duplicates += slices[i].stats.duplicates;
+        stats->invalid += slices[i].stats.invalid;
+        stats->skipped += slices[i].stats.skipped;
+        stats->filtered += slices[i].stats.filtered;
+    }
+    stats->bytes = len;
+    munmap(text, text_map);
+    stats->seconds = (now_ms() - started) / 1000.0;
+    return true;
+}
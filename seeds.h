@@ -0,0 +1,24 @@
+// Bulk seed loading: a newline-delimited URL file, plain or gzip, parsed in parallel into the frontier.
+#ifndef SEEDS_H
+#define SEEDS_H
+
+#include "crawler_core.h"
+
+#define SEED_BATCH 4096             // URLs a loader thread pushes per frontier lock
+#define SEED_MAX_THREADS 64
+
+// What a seed load did.
+typedef struct {
+    unsigned long lines;            // Non-empty, non-comment lines
+    unsigned long loaded;           // New URLs that went to the frontier or waited for robots.txt
+    unsigned long duplicates;
+    unsigned long invalid;          // Not http(s), or too long
+    unsigned long skipped;          // Owned by another shard
+    unsigned long filtered;         // Rejected by --filter rules
+    size_t bytes;                   // Seed text after decompression
+    double seconds;
+} SeedStats;
+
+bool seeds_load(Crawler *crawler, const char *path, int threads, SeedStats *stats);
+
+#endif
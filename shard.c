@@ -0,0 +1,247 @@
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "crawler_core.h"
+#include "robots.h"
+#include "shard.h"
+
+#define SHARD_RECORD_PAD UINT32_MAX // Marks the unused tail of the ring before a wrap
+
+// State every shard process sees. outstanding counts busy shards plus links in the rings;
+// the crawl is over once it reaches zero, because nothing is left that could add a URL.
+typedef struct ShardShared {
+    _Alignas(64) atomic_long outstanding;
+    _Alignas(64) atomic_ulong pages;    // Fetched by all shards, against --max-pages
+} ShardShared;
+
+// Single-producer, single-consumer byte ring. Positions only grow; the offset is pos % size.
+typedef struct ShardRing {
+    _Alignas(64) atomic_ulong head;  // Written by the producer
+    _Alignas(64) atomic_ulong tail;  // Written by the consumer
+    _Alignas(64) uint8_t data[SHARD_RING_BYTES];
+} ShardRing;
+
+// Header of one forwarded link; the URL follows, padded to 8 bytes.
+typedef struct {
+    uint32_t len;
+    int32_t depth;
+} ShardRecord;
+
+// Ring carrying links from one worker of shard `from` to shard `to`.
+static ShardRing *shard_ring(ShardSet *set, int from, int slot, int to) {
+    ShardRing *rings = (ShardRing *)((char *)set->shared + sizeof(ShardRing));
+    return &rings[((size_t)from * set->threads + slot) * set->shards + to];
+}
+
+// Map the shared counters and rings. Call before shard_fork().
+ShardSet *shard_set_create(int shards, int threads) {
+    ShardSet *set = (ShardSet *)calloc(1, sizeof(ShardSet));
+    if (!set) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    set->shards = shards;
+    set->threads = threads;
+    set->self = -1;
+    // The first ring-sized slot holds ShardShared, so every ring stays aligned.
+    set->map_len = (1 + (size_t)shards * threads * shards) * sizeof(ShardRing);
+    void *map = mmap(NULL, set->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error: Unable to map %zu bytes of shard rings\n", set->map_len);
+        free(set);
+        return NULL;
+    }
+    set->shared = (ShardShared *)map;
+    atomic_init(&set->shared->outstanding, shards);
+    atomic_init(&set->shared->pages, 0);
+    pthread_mutex_init(&set->drain_lock, NULL);
+    return set;
+}
+
+// Fork one process per shard. Returns the shard index in a child, -1 in the parent, or -2 if the
+// shards could not all be started.
+int shard_fork(ShardSet *set) {
+    fflush(NULL);
+    for (int i = 0; i < set->shards; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            set->self = i;
+            // Keep the shards' "Fetched URL" lines whole when they share stdout.
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            return i;
+        }
+        if (pid < 0) {
+            fprintf(stderr, "Error: Unable to start shard %d\n", i);
+            for (int j = 0; j < i; j++) {
+                kill(set->pids[j], SIGTERM);
+                waitpid(set->pids[j], NULL, 0);
+            }
+            return -2;
+        }
+        set->pids[i] = pid;
+    }
+    return -1;
+}
+
+// Wait for every shard and release the mapping. Fails if any shard did.
+int shard_wait(ShardSet *set) {
+    int result = EXIT_SUCCESS;
+    for (int i = 0; i < set->shards; i++) {
+        int status;
+        if (waitpid(set->pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "Error: Shard %d failed\n", i);
+            result = EXIT_FAILURE;
+        }
+    }
+    munmap(set->shared, set->map_len);
+    pthread_mutex_destroy(&set->drain_lock);
+    free(set);
+    return result;
+}
+
+// Shard that owns a URL: its origin's hash, so one origin is always crawled by one process.
+int shard_of(ShardSet *set, const char *url, size_t len) {
+    char buf[MAX_URL_LENGTH];
+    char origin[MAX_URL_LENGTH];
+    const char *path;
+    if (len >= sizeof(buf)) {
+        return set->self;
+    }
+    memcpy(buf, url, len);
+    buf[len] = '\0';
+    if (!url_origin(buf, origin, sizeof(origin), &path)) {
+        return set->self;
+    }
+    return (int)(url_hash(origin) % (uint64_t)set->shards);
+}
+
+// Append a record to a ring. Returns false if there is no room yet.
+static bool shard_ring_push(ShardRing *ring, const char *url, size_t len, int depth) {
+    size_t need = sizeof(ShardRecord) + ((len + 7) & ~(size_t)7);
+    unsigned long head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t offset = head % SHARD_RING_BYTES;
+    size_t pad = offset + need > SHARD_RING_BYTES ? SHARD_RING_BYTES - offset : 0;
+    if (SHARD_RING_BYTES - (head - tail) < pad + need) {
+        return false;
+    }
+    if (pad) {
+        ((ShardRecord *)&ring->data[offset])->len = SHARD_RECORD_PAD;
+        offset = 0;
+    }
+    ShardRecord *record = (ShardRecord *)&ring->data[offset];
+    record->len = (uint32_t)len;
+    record->depth = depth;
+    memcpy(record + 1, url, len);
+    atomic_store_explicit(&ring->head, head + pad + need, memory_order_release);
+    return true;
+}
+
+// Forward a link to the shard that owns it. While the ring is full, drain our own inbound rings
+// so two shards filling each other's rings can't both wait forever.
+void shard_send(ShardSet *set, int slot, int to, const char *url, size_t len, int depth, Crawler *crawler) {
+    if (len >= MAX_URL_LENGTH) {
+        return;
+    }
+    ShardRing *ring = shard_ring(set, set->self, slot, to);
+    atomic_fetch_add(&set->shared->outstanding, 1);
+    while (!shard_ring_push(ring, url, len, depth)) {
+        shard_drain(set, crawler);
+        struct timespec pause = {0, 100000L};
+        nanosleep(&pause, NULL);
+    }
+    atomic_fetch_add(&set->sent, 1);
+}
+
+// Move every link waiting in this shard's inbound rings into its frontier. Caller holds drain_lock.
+static size_t shard_drain_locked(ShardSet *set, Crawler *crawler) {
+    size_t drained = 0;
+    FrontierBatch batch = {NULL, NULL, 0};
+    for (int from = 0; from < set->shards; from++) {
+        if (from == set->self) {
+            continue;
+        }
+        for (int slot = 0; slot < set->threads; slot++) {
+            ShardRing *ring = shard_ring(set, from, slot, set->self);
+            unsigned long tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            unsigned long head = atomic_load_explicit(&ring->head, memory_order_acquire);
+            if (tail == head) {
+                continue;
+            }
+            // Links in the ring are counted in outstanding, so become busy before taking them.
+            if (set->idle) {
+                set->idle = false;
+                atomic_fetch_add(&set->shared->outstanding, 1);
+            }
+            long taken = 0;
+            while (tail != head) {
+                size_t offset = tail % SHARD_RING_BYTES;
+                ShardRecord *record = (ShardRecord *)&ring->data[offset];
+                if (record->len == SHARD_RECORD_PAD) {
+                    tail += SHARD_RING_BYTES - offset;
+                    continue;
+                }
+                if (frontier_batch_add(&crawler->queue, &batch, (const char *)(record + 1), record->len,
+                                       record->depth, NULL)) {
+                    atomic_fetch_add(&crawler->stats.links, 1);
+                }
+                tail += sizeof(ShardRecord) + ((record->len + 7) & ~(size_t)7);
+                taken++;
+            }
+            // The links must be in the frontier before they stop counting as outstanding.
+            frontier_batch_push(&crawler->queue, &batch);
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+            atomic_fetch_sub(&set->shared->outstanding, taken);
+            drained += taken;
+        }
+    }
+    atomic_fetch_add(&set->received, drained);
+    return drained;
+}
+
+// Drain the inbound rings unless another worker already is.
+size_t shard_drain(ShardSet *set, Crawler *crawler) {
+    if (pthread_mutex_trylock(&set->drain_lock) != 0) {
+        return 0;
+    }
+    size_t drained = shard_drain_locked(set, crawler);
+    pthread_mutex_unlock(&set->drain_lock);
+    return drained;
+}
+
+// Count a page fetched by this shard. Returns the pages all shards have fetched so far.
+unsigned long shard_count_page(ShardSet *set) {
+    return atomic_fetch_add(&set->shared->pages, 1) + 1;
+}
+
+// Pages all shards have fetched so far.
+unsigned long shard_pages(ShardSet *set) {
+    return atomic_load(&set->shared->pages);
+}
+
+// Called by a worker with nothing to fetch. Marks the shard idle once its own frontier is and
+// returns true when every shard is idle with no links in flight. A `stopped` shard (fetch
+// budget spent) counts as idle with URLs still queued; links sent to it are dropped there.
+bool shard_idle(ShardSet *set, Crawler *crawler, bool stopped) {
+    URLQueue *queue = &crawler->queue;
+    pthread_mutex_lock(&set->drain_lock);
+    bool local_idle = shard_drain_locked(set, crawler) == 0;
+    if (local_idle) {
+        // URLs held back or parked count as active but are as good as queued to a stopped shard.
+        pthread_mutex_lock(&queue->lock);
+        local_idle = stopped ? queue->active - (int)queue->held_count - queue->parked == 0
+                             : queue->active == 0 && queue->size == 0;
+        pthread_mutex_unlock(&queue->lock);
+    }
+    if (local_idle && !stopped && queue->robots) {
+        local_idle = !robots_pending(queue->robots);
+    }
+    if (local_idle && !set->idle) {
+        set->idle = true;
+        atomic_fetch_sub(&set->shared->outstanding, 1);
+    }
+    bool over = set->idle && atomic_load(&set->shared->outstanding) == 0;
+    pthread_mutex_unlock(&set->drain_lock);
+    return over;
+}
@@ -0,0 +1,39 @@
+// Multi-process crawling: shard processes own slices of the origin-hash space and forward
+// each other's links through shared-memory rings.
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <sys/types.h>
+#include "crawler_core.h"
+
+#define SHARD_MAX 64
+#define SHARD_RING_BYTES (256 * 1024)  // Per producer thread and destination shard
+
+struct ShardShared;
+struct ShardRing;
+
+// One process's view of the shard set. The struct is private to each process after the fork;
+// `shared` and the rings are mapped into all of them.
+typedef struct ShardSet {
+    int shards;
+    int threads;                     // Producer slots per shard, one per worker
+    int self;                        // This process's shard, -1 in the parent
+    struct ShardShared *shared;
+    size_t map_len;
+    pid_t pids[SHARD_MAX];
+    pthread_mutex_t drain_lock;      // Makes the draining worker the rings' single consumer
+    bool idle;                       // This shard has given up its share of `outstanding`
+    atomic_ulong sent, received;
+} ShardSet;
+
+ShardSet *shard_set_create(int shards, int threads);
+int shard_fork(ShardSet *set);
+int shard_wait(ShardSet *set);
+int shard_of(ShardSet *set, const char *url, size_t len);
+void shard_send(ShardSet *set, int slot, int to, const char *url, size_t len, int depth, Crawler *crawler);
+size_t shard_drain(ShardSet *set, Crawler *crawler);
+bool shard_idle(ShardSet *set, Crawler *crawler, bool stopped);
+unsigned long shard_count_page(ShardSet *set);
+unsigned long shard_pages(ShardSet *set);
+
+#endif
@@ -0,0 +1,21 @@
+// Minimal checks for the unit tests: a failed CHECK is reported and counted, and the test goes on.
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int check_failures;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                                        \
+        }                                                                            \
+    } while (0)
+
+// Exit status of a test program.
+#define CHECK_RESULT() (check_failures ? EXIT_FAILURE : EXIT_SUCCESS)
+
+#endif
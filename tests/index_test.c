@@ -0,0 +1,259 @@
+// Tests of the inverted index: tokenizing, the segment file layout, merges, and a revisited
+// page's newest version replacing the older ones when a buffer is written, at a merge and in a query.
+#include "../index.c"
+#include "check.h"
+
+// A fresh index directory under /tmp.
+static void make_dir(char *dir, size_t size) {
+    snprintf(dir, size, "/tmp/wc-index-test-XXXXXX");
+    if (!mkdtemp(dir)) {
+        perror("Error: Unable to create a test directory");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Remove an index directory and its segments.
+static void remove_dir(const char *dir) {
+    DIR *listing = opendir(dir);
+    struct dirent *entry;
+    while (listing && (entry = readdir(listing))) {
+        if (entry->d_name[0] != '.') {
+            char path[1100];
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    if (listing) {
+        closedir(listing);
+    }
+    rmdir(dir);
+}
+
+// Index `html` as URL `url_id` through the sink, as a worker does after a fetch.
+static void add_page(Sink *sink, IndexPage *page, uint32_t url_id, const char *html) {
+    char url[64];
+    snprintf(url, sizeof(url), "http://example.com/%u", url_id);
+    index_page_begin(page);
+    index_page_feed(page, html, strlen(html));
+    FetchResult result;
+    memset(&result, 0, sizeof(result));
+    result.url = url;
+    result.url_id = url_id;
+    result.status = 200;
+    result.index_page = page;
+    sink->page(sink, &result);
+}
+
+// Close an index, dropping this thread's buffer pointer with it.
+static void close_index(Index *index, Sink *sink) {
+    sink->close(sink);
+    index_close(index);
+    index_free(index);
+    index_local = NULL;
+}
+
+// Map the only segment left in a directory. Returns false if there isn't exactly one.
+static bool map_single(const char *dir, IndexMap *map) {
+    DIR *listing = opendir(dir);
+    struct dirent *entry;
+    int found = 0;
+    char path[1100];
+    while (listing && (entry = readdir(listing))) {
+        if (strstr(entry->d_name, ".idx")) {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            found++;
+        }
+    }
+    if (listing) {
+        closedir(listing);
+    }
+    return found == 1 && index_map(map, path);
+}
+
+// The documents and frequencies of a term's posting list, as "doc:tf doc:tf".
+static void postings_of(const IndexMap *map, const char *term, char *out, size_t size) {
+    out[0] = '\0';
+    const IndexTermEntry *entry = index_find_term(map, term, strlen(term));
+    if (!entry) {
+        return;
+    }
+    PostingCursor cursor;
+    posting_open(&cursor, map, entry);
+    size_t len = 0;
+    while (posting_next(&cursor) && len < size) {
+        len += (size_t)snprintf(out + len, size - len, "%s%lu:%u", len ? " " : "", (unsigned long)cursor.doc,
+                                cursor.tf);
+    }
+}
+
+// Lines index_query() prints for `words`.
+static int query_lines(const char *dir, const char *words) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    FILE *capture = tmpfile();
+    dup2(fileno(capture), STDOUT_FILENO);
+    bool ok = index_query(dir, words);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    CHECK(ok);
+    int lines = 0;
+    rewind(capture);
+    for (int c; (c = fgetc(capture)) != EOF;) {
+        lines += c == '\n';
+    }
+    fclose(capture);
+    return lines;
+}
+
+// Words are folded to lower case and counted per page; markup, scripts and styles are skipped.
+static void test_segment(void) {
+    char dir[64];
+    make_dir(dir, sizeof(dir));
+    Index *index = index_open(dir);
+    Sink *sink = index_sink_create(index);
+    IndexPage *page = index_page_create();
+    add_page(sink, page, 7, "<html><title>Hello</title><p class=\"x\">hello, WORLD &amp; hello</p>"
+                            "<script>var hidden = 1;</script><style>p { color: red }</style></html>");
+    add_page(sink, page, 3, "<p>world peace</p>");
+    close_index(index, sink);
+
+    IndexMap map;
+    CHECK(map_single(dir, &map));
+    if (map.map) {
+        const IndexSegmentHeader *header = map.header;
+        CHECK(memcmp(header->magic, INDEX_MAGIC, 8) == 0);
+        CHECK(header->level == 0);
+        CHECK(header->docs == 2);
+        CHECK(header->doc_limit == 8);
+        for (uint32_t i = 1; i < header->terms; i++) {
+            CHECK(term_compare(map.map + map.terms[i - 1].text, map.terms[i - 1].len, map.map + map.terms[i].text,
+                               map.terms[i].len) < 0);
+        }
+        char postings[256];
+        postings_of(&map, "hello", postings, sizeof(postings));
+        CHECK(strcmp(postings, "7:3") == 0);
+        postings_of(&map, "world", postings, sizeof(postings));
+        CHECK(strcmp(postings, "3:1 7:1") == 0);
+        CHECK(index_find_term(&map, "hidden", 6) == NULL);
+        CHECK(index_find_term(&map, "color", 5) == NULL);
+        CHECK(index_find_term(&map, "class", 5) == NULL);
+        const IndexDocEntry *doc = index_find_doc(&map, 7);
+        CHECK(doc && doc->len == strlen("http://example.com/7") &&
+              memcmp(map.map + doc->text, "http://example.com/7", doc->len) == 0);
+        CHECK(index_find_doc(&map, 5) == NULL);
+        index_unmap(&map);
+    }
+    CHECK(query_lines(dir, "World") == 2);
+    CHECK(query_lines(dir, "hello world") == 1);
+    CHECK(query_lines(dir, "peace hello") == 0);
+
+    // A later crawl in the same directory numbers its documents after the earlier ones.
+    index = index_open(dir);
+    CHECK(index->doc_base == 8);
+    index_close(index);
+    index_free(index);
+    index_page_free(page);
+    remove_dir(dir);
+}
+
+// A page indexed twice in one buffer keeps only its second visit.
+static void test_revisit_in_buffer(void) {
+    char dir[64];
+    make_dir(dir, sizeof(dir));
+    Index *index = index_open(dir);
+    Sink *sink = index_sink_create(index);
+    IndexPage *page = index_page_create();
+    add_page(sink, page, 1, "stale shared");
+    add_page(sink, page, 2, "shared");
+    add_page(sink, page, 1, "fresh shared shared");
+    close_index(index, sink);
+
+    IndexMap map;
+    CHECK(map_single(dir, &map));
+    if (map.map) {
+        char postings[256];
+        CHECK(index_find_term(&map, "stale", 5) == NULL);
+        postings_of(&map, "fresh", postings, sizeof(postings));
+        CHECK(strcmp(postings, "1:1") == 0);
+        postings_of(&map, "shared", postings, sizeof(postings));
+        CHECK(strcmp(postings, "1:2 2:1") == 0);
+        CHECK(map.header->docs == 2);
+        const IndexDocEntry *doc = index_find_doc(&map, 1);
+        CHECK(doc && doc->version == 3);
+        index_unmap(&map);
+    }
+    index_page_free(page);
+    remove_dir(dir);
+}
+
+// Segments holding two visits of a page: a query sees only the newest before the merge, and the
+// merge keeps only the newest.
+static void test_revisit_across_segments(void) {
+    char dir[64];
+    make_dir(dir, sizeof(dir));
+    Index *index = index_open(dir);
+    Sink *sink = index_sink_create(index);
+    IndexPage *page = index_page_create();
+    const char *pages[][2] = {{"1", "stale common"}, {"2", "common"}, {"1", "fresh common"}};
+    for (int i = 0; i < 3; i++) {
+        add_page(sink, page, (uint32_t)atoi(pages[i][0]), pages[i][1]);
+        index_hand_off(index);
+    }
+    close_index(index, sink);
+    CHECK(query_lines(dir, "stale") == 0);
+    CHECK(query_lines(dir, "fresh") == 1);
+    CHECK(query_lines(dir, "common") == 2);
+
+    // A fourth segment, from a later crawl numbering its documents from 3, sets off a merge.
+    index = index_open(dir);
+    sink = index_sink_create(index);
+    add_page(sink, page, 3, "common");
+    close_index(index, sink);
+    IndexMap map;
+    CHECK(map_single(dir, &map));
+    if (map.map) {
+        char postings[256];
+        CHECK(map.header->level == 1);
+        CHECK(index_find_term(&map, "stale", 5) == NULL);
+        postings_of(&map, "fresh", postings, sizeof(postings));
+        CHECK(strcmp(postings, "1:1") == 0);
+        postings_of(&map, "common", postings, sizeof(postings));
+        CHECK(strcmp(postings, "1:1 2:1 6:1") == 0);
+        CHECK(map.header->docs == 3);
+        const IndexDocEntry *doc = index_find_doc(&map, 1);
+        CHECK(doc && doc->version == 3);
+        index_unmap(&map);
+    }
+    CHECK(query_lines(dir, "common") == 3);
+    index_page_free(page);
+    remove_dir(dir);
+}
+
+// Truncated or foreign files are skipped, not read.
+static void test_damaged(void) {
+    char dir[64];
+    make_dir(dir, sizeof(dir));
+    char path[128];
+    snprintf(path, sizeof(path), "%s/seg-000001.idx", dir);
+    FILE *file = fopen(path, "wb");
+    IndexSegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.size = sizeof(header) + 100;
+    fwrite(&header, sizeof(header), 1, file);
+    fclose(file);
+    IndexMap map;
+    CHECK(!index_map(&map, path));
+    CHECK(query_lines(dir, "anything") == 0);
+    remove_dir(dir);
+}
+
+// Run every test; the exit status says whether all passed.
+int main(void) {
+    test_segment();
+    test_revisit_in_buffer();
+    test_revisit_across_segments();
+    test_damaged();
+    return CHECK_RESULT();
+}
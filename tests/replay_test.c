@@ -0,0 +1,270 @@
+// Tests of the replay store: responses come back byte for byte with the newest record of a URL
+// winning, records and the index are laid out as the header says, concurrent recording loses
+// nothing, and files that were never finished or were cut short are refused.
+#include "../replay.c"
+#include "check.h"
+
+#define WRITERS 4
+#define WRITER_RECORDS 500
+
+// A file name under the temp directory, unique to this run.
+static void temp_path(char *path, size_t len, const char *name) {
+    snprintf(path, len, "/tmp/wc-replay-%d-%s", (int)getpid(), name);
+}
+
+// Fill `chain` with `len` bytes of a pattern derived from `seed`.
+static void fill_body(BodyChain *chain, size_t len, unsigned seed) {
+    char chunk[1000];
+    body_reset(chain);
+    for (size_t done = 0; done < len;) {
+        size_t n = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = (char)((done + i) * 31 + seed);
+        }
+        body_append(chain, chunk, n);
+        done += n;
+    }
+}
+
+// Whether `body` holds the pattern fill_body() wrote for `len` and `seed`.
+static bool body_matches(const char *body, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        if (body[i] != (char)(i * 31 + seed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read `len` bytes at `offset` of a file into `buf`.
+static bool read_at(const char *path, void *buf, size_t len, off_t offset) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pread(fd, buf, len, offset) == (ssize_t)len;
+    close(fd);
+    return ok;
+}
+
+// Record three responses, one URL twice, into `path`.
+static void record_three(const char *path) {
+    static const char headers_a[] = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n\r\n";
+    static const char headers_c[] = "HTTP/1.1 304 Not Modified\r\n\r\n";
+    ReplayStore *store = replay_create(path);
+    CHECK(store != NULL);
+    if (!store) {
+        return;
+    }
+    BodyChain body;
+    memset(&body, 0, sizeof(body));
+    FetchResult result;
+
+    // Spans several body blocks, so the record is written from more than one buffer.
+    fill_body(&body, 2 * BODY_BLOCK_SIZE + 123, 1);
+    memset(&result, 0, sizeof(result));
+    result.status = 200;
+    result.encoding = ENCODING_ZLIB;
+    result.headers = headers_a;
+    result.headers_len = sizeof(headers_a) - 1;
+    result.body = &body;
+    replay_record(store, "http://a.test/page", &result, 1500);
+
+    memset(&result, 0, sizeof(result));
+    result.error = CURLE_COULDNT_CONNECT;
+    replay_record(store, "http://b.test/", &result, 42);
+
+    fill_body(&body, 5, 2);
+    memset(&result, 0, sizeof(result));
+    result.status = 304;
+    result.headers = headers_c;
+    result.headers_len = sizeof(headers_c) - 1;
+    result.body = &body;
+    replay_record(store, "http://a.test/page", &result, 7);
+
+    body_free(&body);
+    replay_close(store);
+}
+
+// The header counts every record and points at an index sorted by hash, whose entries point at
+// aligned records for the URLs they were hashed from.
+static void test_replay_layout(void) {
+    char path[256];
+    temp_path(path, sizeof(path), "layout");
+    record_three(path);
+
+    ReplayFileHeader header;
+    CHECK(read_at(path, &header, sizeof(header), 0));
+    CHECK(memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) == 0);
+    CHECK(header.version == REPLAY_VERSION);
+    CHECK(header.count == 3);
+    CHECK(header.index_offset % REPLAY_ALIGN == 0);
+
+    ReplayIndexEntry index[3];
+    CHECK(read_at(path, index, sizeof(index), (off_t)header.index_offset));
+    uint64_t hash_a = url_hash("http://a.test/page");
+    int for_a = 0;
+    for (int i = 0; i < 3; i++) {
+        CHECK(index[i].offset % REPLAY_ALIGN == 0);
+        CHECK(index[i].offset >= sizeof(ReplayFileHeader));
+        CHECK(index[i].offset < header.index_offset);
+        if (i > 0) {
+            CHECK(index[i - 1].url_hash < index[i].url_hash ||
+                  (index[i - 1].url_hash == index[i].url_hash && index[i - 1].offset < index[i].offset));
+        }
+        ReplayRecord record;
+        CHECK(read_at(path, &record, sizeof(record), (off_t)index[i].offset));
+        CHECK(record.url_hash == index[i].url_hash);
+        for_a += index[i].url_hash == hash_a;
+    }
+    CHECK(for_a == 2);
+    unlink(path);
+}
+
+// Lookups return the newest response of a URL as recorded, and count what they found and missed.
+static void test_replay_round_trip(void) {
+    char path[256];
+    temp_path(path, sizeof(path), "round-trip");
+    record_three(path);
+
+    ReplayStore *store = replay_open(path, false);
+    CHECK(store != NULL);
+    if (!store) {
+        unlink(path);
+        return;
+    }
+    ReplayResponse response;
+    CHECK(replay_find(store, "http://a.test/page", &response));
+    CHECK(response.status == 304);
+    CHECK(response.error == CURLE_OK);
+    CHECK(response.encoding == ENCODING_IDENTITY);
+    CHECK(response.headers_len == strlen("HTTP/1.1 304 Not Modified\r\n\r\n"));
+    CHECK(memcmp(response.headers, "HTTP/1.1 304", 12) == 0);
+    CHECK(response.body_len == 5);
+    CHECK(body_matches(response.body, response.body_len, 2));
+    CHECK(response.latency_us == 7);
+
+    CHECK(replay_find(store, "http://b.test/", &response));
+    CHECK(response.error == CURLE_COULDNT_CONNECT);
+    CHECK(response.status == 0);
+    CHECK(response.headers_len == 0);
+    CHECK(response.body_len == 0);
+    CHECK(response.latency_us == 42);
+
+    CHECK(!replay_find(store, "http://a.test/other", &response));
+    CHECK(!replay_find(store, "http://a.test/pag", &response));
+    CHECK(atomic_load(&store->served) == 2);
+    CHECK(atomic_load(&store->missing) == 2);
+    replay_close(store);
+    unlink(path);
+}
+
+// Arguments of one recording thread.
+typedef struct {
+    ReplayStore *store;
+    unsigned writer;
+} Writer;
+
+// Record WRITER_RECORDS responses of distinct URLs, each body sized and patterned after its URL.
+static void *record_many(void *arg) {
+    Writer *writer = (Writer *)arg;
+    BodyChain body;
+    memset(&body, 0, sizeof(body));
+    for (unsigned i = 0; i < WRITER_RECORDS; i++) {
+        char url[64];
+        snprintf(url, sizeof(url), "http://w%u.test/%u", writer->writer, i);
+        unsigned seed = writer->writer * WRITER_RECORDS + i;
+        fill_body(&body, seed % 300, seed);
+        FetchResult result;
+        memset(&result, 0, sizeof(result));
+        result.status = 200;
+        result.body = &body;
+        replay_record(writer->store, url, &result, seed);
+    }
+    body_free(&body);
+    return NULL;
+}
+
+// Records written from several threads at once all come back intact.
+static void test_replay_concurrent(void) {
+    char path[256];
+    temp_path(path, sizeof(path), "concurrent");
+    ReplayStore *store = replay_create(path);
+    CHECK(store != NULL);
+    if (!store) {
+        return;
+    }
+    pthread_t threads[WRITERS];
+    Writer writers[WRITERS];
+    for (unsigned w = 0; w < WRITERS; w++) {
+        writers[w] = (Writer){store, w};
+        pthread_create(&threads[w], NULL, record_many, &writers[w]);
+    }
+    for (unsigned w = 0; w < WRITERS; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    replay_close(store);
+
+    store = replay_open(path, false);
+    CHECK(store != NULL);
+    if (!store) {
+        unlink(path);
+        return;
+    }
+    CHECK(store->count == WRITERS * WRITER_RECORDS);
+    bool intact = true;
+    for (unsigned w = 0; w < WRITERS; w++) {
+        for (unsigned i = 0; i < WRITER_RECORDS; i++) {
+            char url[64];
+            snprintf(url, sizeof(url), "http://w%u.test/%u", w, i);
+            unsigned seed = w * WRITER_RECORDS + i;
+            ReplayResponse response;
+            intact &= replay_find(store, url, &response) && response.latency_us == seed &&
+                      response.body_len == seed % 300 && body_matches(response.body, response.body_len, seed);
+        }
+    }
+    CHECK(intact);
+    replay_close(store);
+    unlink(path);
+}
+
+// A file whose header was never written, one cut short inside its index, one from another version
+// and one too short for a header are all refused.
+static void test_replay_refused(void) {
+    char path[256];
+    temp_path(path, sizeof(path), "refused");
+    ReplayFileHeader header;
+
+    record_three(path);
+    memset(&header, 0, sizeof(header));
+    int fd = open(path, O_WRONLY);
+    CHECK(fd >= 0 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    close(fd);
+    CHECK(replay_open(path, false) == NULL);
+
+    record_three(path);
+    CHECK(read_at(path, &header, sizeof(header), 0));
+    CHECK(truncate(path, (off_t)(header.index_offset + sizeof(ReplayIndexEntry))) == 0);
+    CHECK(replay_open(path, false) == NULL);
+
+    record_three(path);
+    CHECK(read_at(path, &header, sizeof(header), 0));
+    header.version = REPLAY_VERSION + 1;
+    fd = open(path, O_WRONLY);
+    CHECK(fd >= 0 && pwrite(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header));
+    close(fd);
+    CHECK(replay_open(path, false) == NULL);
+
+    CHECK(truncate(path, sizeof(header) - 1) == 0);
+    CHECK(replay_open(path, false) == NULL);
+    unlink(path);
+}
+
+// Run every test; the exit status says whether all passed.
+int main(void) {
+    test_replay_layout();
+    test_replay_round_trip();
+    test_replay_concurrent();
+    test_replay_refused();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,123 @@
+// Tests of the robots.txt parser and matcher.
+#include "../robots.c"
+#include "check.h"
+
+// Parse a robots.txt given as a string.
+static RobotsRules *parse(const char *text) {
+    return robots_parse(text, strlen(text));
+}
+
+// Groups naming our agent replace the '*' groups; without one, '*' applies.
+static void test_groups(void) {
+    RobotsRules *rules = parse("User-agent: *\n"
+                               "Disallow: /private\n"
+                               "\n"
+                               "User-agent: wc-crawler\n"
+                               "Disallow: /ours\n");
+    CHECK(!robots_allowed(rules, "/ours/page"));
+    CHECK(robots_allowed(rules, "/private/page"));
+    robots_rules_free(rules);
+
+    rules = parse("User-agent: otherbot\nDisallow: /\n\nUser-agent: *\nDisallow: /private\n");
+    CHECK(robots_allowed(rules, "/"));
+    CHECK(!robots_allowed(rules, "/private"));
+    robots_rules_free(rules);
+
+    // Consecutive User-agent lines share one group; the token matches case-insensitively.
+    rules = parse("User-agent: otherbot\nUser-agent: WC-Crawler/2.0\nDisallow: /shared\n");
+    CHECK(!robots_allowed(rules, "/shared"));
+    robots_rules_free(rules);
+}
+
+// The longest match decides, Allow wins ties, and an empty Disallow allows everything.
+static void test_precedence(void) {
+    RobotsRules *rules = parse("User-agent: *\n"
+                               "Disallow: /a\n"
+                               "Allow: /a/b\n"
+                               "Disallow: /a/b/c\n"
+                               "Allow: /tie\n"
+                               "Disallow: /tie\n");
+    CHECK(robots_allowed(rules, "/"));
+    CHECK(!robots_allowed(rules, "/a"));
+    CHECK(robots_allowed(rules, "/a/b"));
+    CHECK(robots_allowed(rules, "/a/bx"));
+    CHECK(!robots_allowed(rules, "/a/b/c/d"));
+    CHECK(robots_allowed(rules, "/tie"));
+    robots_rules_free(rules);
+
+    rules = parse("User-agent: *\nDisallow:\n");
+    CHECK(robots_allowed(rules, "/anything"));
+    robots_rules_free(rules);
+}
+
+// '*' matches any run of bytes and a trailing '$' anchors the end.
+static void test_wildcards(void) {
+    RobotsRules *rules = parse("User-agent: *\n"
+                               "Disallow: /*.pdf$\n"
+                               "Disallow: /tmp*/cache\n"
+                               "Allow: /tmp1/cache/keep$\n");
+    CHECK(!robots_allowed(rules, "/docs/file.pdf"));
+    CHECK(robots_allowed(rules, "/docs/file.pdf?x=1"));
+    CHECK(!robots_allowed(rules, "/tmp/x/cache"));
+    CHECK(!robots_allowed(rules, "/tmp1/cache/other"));
+    CHECK(robots_allowed(rules, "/tmp1/cache/keep"));
+    CHECK(robots_allowed(rules, "/cache"));
+    robots_rules_free(rules);
+}
+
+// Comments, CR LF line ends, spacing and key case don't change the rules.
+static void test_syntax(void) {
+    RobotsRules *rules = parse("# site rules\r\n"
+                               "USER-AGENT : * # everyone\r\n"
+                               "  disallow:\t/x  # trailing comment\r\n"
+                               "Sitemap: http://example.com/sitemap.xml\r\n"
+                               "no colon here\r\n"
+                               "Allow: /x/y");
+    CHECK(!robots_allowed(rules, "/x"));
+    CHECK(robots_allowed(rules, "/x/y"));
+    CHECK(robots_allowed(rules, "/z"));
+    robots_rules_free(rules);
+
+    rules = parse("");
+    CHECK(robots_allowed(rules, "/"));
+    CHECK(rules->crawl_delay_ms == 0);
+    robots_rules_free(rules);
+}
+
+// Crawl-delay is read in seconds, kept per group, and capped.
+static void test_crawl_delay(void) {
+    RobotsRules *rules = parse("User-agent: *\nCrawl-delay: 1.5\n");
+    CHECK(rules->crawl_delay_ms == 1500);
+    robots_rules_free(rules);
+
+    rules = parse("User-agent: *\nCrawl-delay: 5\n\nUser-agent: wc-crawler\nCrawl-delay: 0.25\n");
+    CHECK(rules->crawl_delay_ms == 250);
+    robots_rules_free(rules);
+
+    rules = parse("User-agent: *\nCrawl-delay: 3600\n");
+    CHECK(rules->crawl_delay_ms == ROBOTS_MAX_DELAY_MS);
+    robots_rules_free(rules);
+
+    rules = parse("User-agent: *\nCrawl-delay: soon\n");
+    CHECK(rules->crawl_delay_ms == 0);
+    robots_rules_free(rules);
+}
+
+// An unreachable robots.txt disallows the whole origin.
+static void test_disallow_all(void) {
+    RobotsRules *rules = robots_rules_new();
+    rules->disallow_all = true;
+    CHECK(!robots_allowed(rules, "/"));
+    robots_rules_free(rules);
+}
+
+// Run every test; the exit status says whether all passed.
+int main(void) {
+    test_groups();
+    test_precedence();
+    test_wildcards();
+    test_syntax();
+    test_crawl_delay();
+    test_disallow_all();
+    return CHECK_RESULT();
+}
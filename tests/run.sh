@@ -0,0 +1,23 @@
+#!/bin/sh
+# Build and run every tests/*_test.c against the shared modules. A test named <module>_test.c may
+# include ../<module>.c to reach its static functions, so that module is left out of its build.
+cd "$(dirname "$0")/.." || exit 1
+out=${TEST_BIN:-/tmp/wc-tests}
+mkdir -p "$out"
+programs='^(WC|CrawlerA|CrawlerB|CurlCrawler|TestCrawler1|crawler|fetch_url)\.c$'
+status=0
+for test in tests/*_test.c; do
+    name=$(basename "$test" .c)
+    sources=$(ls *.c | grep -v -E "$programs" | grep -v -x "${name%_test}.c")
+    if ! gcc -Wall -Wextra -O1 -g -I/usr/include/libxml2 -o "$out/$name" "$test" $sources \
+            -lcurl -lxml2 -lz -lbrotlidec -lcares -lpthread -lm; then
+        echo "FAIL $name (build)"
+        status=1
+    elif "$out/$name"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,125 @@
+// Tests of the frontier spill file: records keep their order and depth across the staging
+// buffer, the file and refills, and the frontier spills and refills through it under pressure.
+#include "../crawler_core.h"
+#include "../memory.h"
+#include "../url_table.h"
+#include "check.h"
+
+// A node for URL ID `id`, its depth derived from the ID.
+static URLQueueNode *node_for(uint32_t id) {
+    URLQueueNode *node = (URLQueueNode *)malloc(sizeof(URLQueueNode));
+    if (!node) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    node->id = id;
+    node->depth = (int)(id % 7);
+    node->next = NULL;
+    return node;
+}
+
+// Pop everything the frontier holds, checking it is IDs first, first + 1, ... Returns the next ID.
+static uint32_t drain(URLQueue *queue, uint32_t first) {
+    URLQueueNode *node;
+    while ((node = queue->ops->pop(queue->state)) != NULL) {
+        CHECK(node->id == first);
+        CHECK(node->depth == (int)(first % 7));
+        first++;
+        free(node);
+    }
+    return first;
+}
+
+// Records are 8 bytes on disk; they are staged, written a buffer at a time, listed and read back
+// oldest first, and the file starts over once it has all been read.
+static void test_spill_order(void) {
+    URLQueue queue;
+    initQueue(&queue, frontier_find("fifo"));
+    FrontierSpill *spill = spill_create();
+    CHECK(spill != NULL);
+    if (!spill) {
+        return;
+    }
+    CHECK(sizeof(SpillRecord) == 8);
+
+    const uint32_t total = 2 * SPILL_BUFFER + 10;
+    for (uint32_t id = 0; id < total; id++) {
+        spill_push(spill, node_for(id));
+    }
+    CHECK(spill->count == total);
+    CHECK(spill->total == total);
+    CHECK(spill->staged_count == 10);
+    CHECK(spill->write_offset == 2 * SPILL_BUFFER * sizeof(SpillRecord));
+
+    uint32_t *ids = (uint32_t *)malloc(total * sizeof(uint32_t));
+    CHECK(spill_list(spill, ids, total) == total);
+    bool ordered = true;
+    for (uint32_t i = 0; i < total; i++) {
+        ordered &= ids[i] == i;
+    }
+    CHECK(ordered);
+    CHECK(spill_list(spill, ids, 5) == 5);
+    free(ids);
+
+    // Refill part of the file, spill more, then read the rest: the order holds.
+    CHECK(spill_refill(spill, &queue) == SPILL_REFILL);
+    uint32_t next = drain(&queue, 0);
+    for (uint32_t id = total; id < total + 3; id++) {
+        spill_push(spill, node_for(id));
+    }
+    size_t refilled;
+    while ((refilled = spill_refill(spill, &queue)) > 0) {
+        CHECK(refilled <= SPILL_REFILL);
+        next = drain(&queue, next);
+    }
+    CHECK(next == total + 3);
+    CHECK(spill->count == 0);
+    CHECK(spill->read_offset == 0 && spill->write_offset == 0);
+
+    spill_free(spill);
+    freeQueue(&queue);
+}
+
+// Under memory pressure frontier_push sends nodes to the spill file, and dequeue brings them
+// back once the in-memory frontier is empty.
+static void test_frontier_spill(void) {
+    URLQueue queue;
+    initQueue(&queue, frontier_find("fifo"));
+    queue.spill = spill_create();
+    CHECK(queue.spill != NULL);
+    if (!queue.spill) {
+        freeQueue(&queue);
+        return;
+    }
+    mem_init(1024);
+    mem_account(MEM_FRONTIER, 1 << 20);
+    CHECK(mem_pressure() != MEM_OK);
+
+    const uint32_t total = SPILL_BUFFER + SPILL_REFILL / 2;
+    for (uint32_t id = 0; id < total; id++) {
+        frontier_push(&queue, node_for(id));
+    }
+    CHECK(queue.spill->count == total);
+    CHECK(queue.size == total);
+
+    mem_account(MEM_FRONTIER, -(1 << 20));
+    uint32_t expected = 0;
+    int depth;
+    uint32_t id;
+    while ((id = dequeue(&queue, &depth)) != URL_ID_NONE) {
+        CHECK(id == expected);
+        CHECK(depth == (int)(expected % 7));
+        expected++;
+        frontier_done(&queue);
+    }
+    CHECK(expected == total);
+    CHECK(frontier_idle(&queue));
+    freeQueue(&queue);
+}
+
+// Run every test; the exit status says whether all passed.
+int main(void) {
+    test_spill_order();
+    test_frontier_spill();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,319 @@
+#include "crawler_core.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "topic.h"
+
+#define TOPIC_NONE UINT32_MAX
+
+// Byte -> folded word byte: ASCII letters lowercased, digits and UTF-8 bytes kept, 0 for the
+// separators between words. Filled in by topics_load(), before any worker runs.
+static uint8_t topic_fold[256];
+
+// Fill in the folding table.
+static void topic_fold_init(void) {
+    for (int c = 0; c < 256; c++) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            topic_fold[c] = (uint8_t)c;
+        } else if (c >= 'A' && c <= 'Z') {
+            topic_fold[c] = (uint8_t)(c - 'A' + 'a');
+        } else {
+            topic_fold[c] = 0;
+        }
+    }
+}
+
+// Reduce a keyword line to " word word ": folded words between single spaces. Returns its
+// length, or 0 if the line has no words.
+static size_t topic_normalize(const char *line, char *out, size_t size) {
+    size_t len = 0;
+    bool space = true;
+    out[len++] = ' ';
+    for (const unsigned char *p = (const unsigned char *)line; *p && len + 2 < size; p++) {
+        uint8_t c = topic_fold[*p];
+        if (c) {
+            out[len++] = (char)c;
+            space = false;
+        } else if (!space) {
+            out[len++] = ' ';
+            space = true;
+        }
+    }
+    if (len == 1) {
+        return 0;
+    }
+    if (!space) {
+        out[len++] = ' ';
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// Build the automaton over the normalized keywords: a trie, then failure links filled in
+// breadth-first so every state has a complete row and the scan never follows a failure link.
+static void topics_build(Topics *topics, char **keys) {
+    bool used[256] = {false};
+    size_t key_bytes = 0;
+    for (size_t k = 0; k < topics->count; k++) {
+        for (const unsigned char *p = (const unsigned char *)keys[k]; *p; p++) {
+            used[*p] = true;
+        }
+        key_bytes += strlen(keys[k]);
+    }
+    topics->class_count = 1;
+    for (int b = 0; b < 256; b++) {
+        topics->classes[b] = used[b] ? (uint8_t)topics->class_count++ : 0;
+    }
+
+    size_t cols = topics->class_count;
+    size_t max_states = key_bytes + 1;
+    topics->next = (uint32_t *)calloc(max_states * cols, sizeof(uint32_t));
+    topics->match = (uint32_t *)malloc(max_states * sizeof(uint32_t));
+    topics->dict = (uint32_t *)calloc(max_states, sizeof(uint32_t));
+    uint32_t *fail = (uint32_t *)calloc(max_states, sizeof(uint32_t));
+    uint32_t *queue = (uint32_t *)malloc(max_states * sizeof(uint32_t));
+    if (!topics->next || !topics->match || !topics->dict || !fail || !queue) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < max_states; i++) {
+        topics->match[i] = TOPIC_NONE;
+    }
+
+    // The trie; 0 marks a missing edge. A keyword listed twice keeps its first line.
+    uint32_t states = 1;
+    for (size_t k = 0; k < topics->count; k++) {
+        uint32_t s = 0;
+        for (const unsigned char *p = (const unsigned char *)keys[k]; *p; p++) {
+            uint32_t *edge = &topics->next[s * cols + topics->classes[*p]];
+            if (*edge == 0) {
+                *edge = states++;
+            }
+            s = *edge;
+        }
+        if (topics->match[s] == TOPIC_NONE) {
+            topics->match[s] = (uint32_t)k;
+        }
+    }
+    topics->states = states;
+
+    size_t head = 0, tail = 0;
+    for (size_t c = 0; c < cols; c++) {
+        if (topics->next[c]) {
+            queue[tail++] = topics->next[c];
+        }
+    }
+    while (head < tail) {
+        uint32_t u = queue[head++];
+        for (size_t c = 0; c < cols; c++) {
+            uint32_t v = topics->next[u * cols + c];
+            uint32_t via_fail = topics->next[fail[u] * cols + c];
+            if (v) {
+                fail[v] = via_fail;
+                topics->dict[v] = topics->match[via_fail] != TOPIC_NONE ? via_fail : topics->dict[via_fail];
+                queue[tail++] = v;
+            } else {
+                topics->next[u * cols + c] = via_fail;
+            }
+        }
+    }
+    topics->start = topics->next[topics->classes[' ']];
+    free(fail);
+    free(queue);
+}
+
+// Read a keyword file: one word or phrase per line, '#' starts a comment line.
+Topics *topics_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Unable to open keyword file %s\n", path);
+        return NULL;
+    }
+    topic_fold_init();
+    Topics *topics = (Topics *)calloc(1, sizeof(Topics));
+    if (!topics) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    char **keys = NULL;
+    size_t cap = 0;
+    char line[TOPIC_LINE_LENGTH];
+    char key[TOPIC_LINE_LENGTH + 2];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *text = line + strspn(line, " \t");
+        if (*text == '#' || topic_normalize(text, key, sizeof(key)) == 0) {
+            continue;
+        }
+        if (topics->count == cap) {
+            cap = cap ? cap * 2 : 64;
+            topics->keywords = (char **)realloc(topics->keywords, cap * sizeof(char *));
+            keys = (char **)realloc(keys, cap * sizeof(char *));
+            if (!topics->keywords || !keys) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        topics->keywords[topics->count] = strdup(text);
+        keys[topics->count] = strdup(key);
+        if (!topics->keywords[topics->count] || !keys[topics->count]) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        topics->count++;
+    }
+    fclose(file);
+    if (topics->count == 0) {
+        fprintf(stderr, "Error: No keywords in %s\n", path);
+        free(keys);
+        topics_free(topics);
+        return NULL;
+    }
+    topics_build(topics, keys);
+    for (size_t k = 0; k < topics->count; k++) {
+        free(keys[k]);
+    }
+    free(keys);
+    return topics;
+}
+
+// Free a keyword list.
+void topics_free(Topics *topics) {
+    for (size_t k = 0; k < topics->count; k++) {
+        free(topics->keywords[k]);
+    }
+    free(topics->keywords);
+    free(topics->next);
+    free(topics->match);
+    free(topics->dict);
+    free(topics);
+}
+
+// Set up a worker's scan state.
+TopicScan *topic_scan_create(Topics *topics) {
+    TopicScan *scan = (TopicScan *)calloc(1, sizeof(TopicScan));
+    if (scan) {
+        scan->seen = (uint32_t *)calloc(topics->count, sizeof(uint32_t));
+    }
+    if (!scan || !scan->seen) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    scan->topics = topics;
+    return scan;
+}
+
+// Release a worker's scan state.
+void topic_scan_free(TopicScan *scan) {
+    if (scan) {
+        free(scan->seen);
+        free(scan);
+    }
+}
+
+// Start a new page, as if a separator came before it.
+void topic_begin(TopicScan *scan) {
+    if (++scan->page == 0) {
+        memset(scan->seen, 0, scan->topics->count * sizeof(uint32_t));
+        scan->page = 1;
+    }
+    scan->state = scan->topics->start;
+    scan->in_tag = false;
+    scan->space = true;
+    scan->hits = 0;
+    scan->terms = 0;
+}
+
+// Advance the automaton by one folded byte and count the keywords that end there.
+static void topic_step(TopicScan *scan, uint8_t c) {
+    Topics *topics = scan->topics;
+    uint32_t s = topics->next[scan->state * topics->class_count + topics->classes[c]];
+    scan->state = s;
+    for (uint32_t t = topics->match[s] != TOPIC_NONE ? s : topics->dict[s]; t; t = topics->dict[t]) {
+        uint32_t k = topics->match[t];
+        scan->hits++;
+        if (scan->seen[k] != scan->page) {
+            scan->seen[k] = scan->page;
+            scan->terms++;
+        }
+    }
+}
+
+// Length of the run of word bytes at the start of `p`. Keywords only start after a separator,
+// so at the root state a whole word is skipped without a table lookup, 16 bytes at a time
+// where SSE2 is available.
+static size_t topic_word_run(const unsigned char *p, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i letter_bias = _mm_set1_epi8((char)(0x80 - 'a'));
+    const __m128i letter_limit = _mm_set1_epi8((char)(0x80 + 26));
+    const __m128i digit_bias = _mm_set1_epi8((char)(0x80 - '0'));
+    const __m128i digit_limit = _mm_set1_epi8((char)(0x80 + 10));
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // Shifting a range down to -128 turns the unsigned range test into one signed compare.
+        __m128i letter = _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(v, case_bit), letter_bias), letter_limit);
+        __m128i digit = _mm_cmplt_epi8(_mm_add_epi8(v, digit_bias), digit_limit);
+        __m128i high = _mm_cmplt_epi8(v, zero);
+        int word = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), high));
+        if (word != 0xFFFF) {
+            return i + __builtin_ctz(~word);
+        }
+    }
+#endif
+    while (i < len && topic_fold[p[i]]) {
+        i++;
+    }
+    return i;
+}
+
+// Scan a chunk of decoded HTML. Markup between '<' and '>' counts as a separator, so only the
+// text is matched; state carries over between chunks.
+void topic_feed(TopicScan *scan, const char *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    while (p < end) {
+        if (scan->in_tag) {
+            const unsigned char *close = (const unsigned char *)memchr(p, '>', end - p);
+            if (!close) {
+                return;
+            }
+            scan->in_tag = false;
+            p = close + 1;
+            continue;
+        }
+        uint8_t c = topic_fold[*p];
+        if (c == 0) {
+            scan->in_tag = *p == '<';
+            p++;
+            if (!scan->space) {
+                scan->space = true;
+                topic_step(scan, ' ');
+            }
+            continue;
+        }
+        scan->space = false;
+        if (scan->state == 0) {
+            p += topic_word_run(p, end - p);
+            continue;
+        }
+        topic_step(scan, c);
+        p++;
+    }
+}
+
+// Finish the page: close a keyword at the very end, then add the page to the totals.
+void topic_end(TopicScan *scan) {
+    if (!scan->space) {
+        scan->space = true;
+        topic_step(scan, ' ');
+    }
+    Topics *topics = scan->topics;
+    atomic_fetch_add(&topics->pages, 1);
+    if (scan->hits) {
+        atomic_fetch_add(&topics->matched, 1);
+        atomic_fetch_add(&topics->hits, scan->hits);
+    }
+}
@@ -0,0 +1,49 @@
+// Keyword matching over page text as it streams in, for topic-focused crawls.
+#ifndef TOPIC_H
+#define TOPIC_H
+
+#include "crawler_core.h"
+
+#define TOPIC_LINE_LENGTH 256
+
+// Compiled keyword list, shared by the workers. Text and keywords are both case-folded and
+// reduced to words separated by single spaces, and every keyword is stored as " word ... ",
+// so the automaton only reports whole words and phrases.
+typedef struct Topics {
+    char **keywords;               // As given, for the report
+    size_t count;
+    uint8_t classes[256];          // Folded byte -> column of the transition table
+    int class_count;
+    uint32_t *next;                // state * class_count + class -> state
+    uint32_t *match;               // Keyword ending at this state, UINT32_MAX if none
+    uint32_t *dict;                // Nearest state on the failure chain with a match, 0 if none
+    uint32_t states;
+    uint32_t start;                // State after the separator a page starts with
+    unsigned long min_hits;        // Links of pages with fewer hits are not followed; 0 follows all
+    atomic_ulong pages;
+    atomic_ulong matched;          // Pages with at least one hit
+    atomic_ulong hits;
+    atomic_ulong unexpanded;       // Pages whose links were dropped for missing min_hits
+} Topics;
+
+// One worker's scan of the page being fetched.
+typedef struct TopicScan {
+    Topics *topics;
+    uint32_t state;
+    bool in_tag;
+    bool space;                    // The last byte passed to the automaton was a separator
+    unsigned long hits;
+    unsigned int terms;            // Distinct keywords seen on the page
+    uint32_t page;                 // Page number, the mark in `seen`
+    uint32_t *seen;                // Page on which each keyword was last seen
+} TopicScan;
+
+Topics *topics_load(const char *path);
+void topics_free(Topics *topics);
+TopicScan *topic_scan_create(Topics *topics);
+void topic_scan_free(TopicScan *scan);
+void topic_begin(TopicScan *scan);
+void topic_feed(TopicScan *scan, const char *data, size_t len);
+void topic_end(TopicScan *scan);
+
+#endif
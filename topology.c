@@ -0,0 +1,304 @@
+#include "crawler_core.h"
+#include <dirent.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "topology.h"
+
+#define TOPOLOGY_MPOL_PREFERRED 1   // set_mempolicy() modes, as in <numaif.h>
+#define TOPOLOGY_MPOL_INTERLEAVE 3
+#define TOPOLOGY_NODE_BITS 1024     // Node numbers a memory policy mask can name
+#define BENCH_OUTPUT_SIZE 16384
+
+static const char *placement_names[] = {"none", "compact", "spread", "remote"};
+
+// Look up a placement policy by name.
+bool placement_parse(const char *name, PlacementPolicy *policy) {
+    for (size_t i = 0; i < sizeof(placement_names) / sizeof(placement_names[0]); i++) {
+        if (strcmp(name, placement_names[i]) == 0) {
+            *policy = (PlacementPolicy)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Name of a placement policy.
+const char *placement_name(PlacementPolicy policy) {
+    return placement_names[policy];
+}
+
+// Add the CPUs of a /sys cpulist ("0-3,8,10-11") that this process may run on.
+static void topology_add_cpus(Topology *topo, const char *list, const cpu_set_t *allowed) {
+    const char *p = list;
+    while (*p >= '0' && *p <= '9') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, allowed) && topo->cpus < TOPOLOGY_MAX_CPUS) {
+                topo->cpu_ids[topo->cpus++] = (int)cpu;
+            }
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+// Read a small /sys file into buf. Returns false if it can't be read.
+static bool topology_read(const char *path, char *buf, size_t size) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    size_t len = fread(buf, 1, size - 1, file);
+    buf[len] = '\0';
+    fclose(file);
+    return true;
+}
+
+// Order node numbers for qsort().
+static int topology_compare(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// Find the usable CPUs and the nodes they sit on. Without NUMA information in /sys, every
+// usable CPU is put on one node.
+bool topology_discover(Topology *topo, PlacementPolicy policy) {
+    memset(topo, 0, sizeof(*topo));
+    topo->policy = policy;
+    topo->home = -1;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return false;
+    }
+
+    int ids[TOPOLOGY_MAX_NODES];
+    int count = 0;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) && count < TOPOLOGY_MAX_NODES) {
+            int id;
+            char rest;
+            if (sscanf(entry->d_name, "node%d%c", &id, &rest) == 1) {
+                ids[count++] = id;
+            }
+        }
+        closedir(dir);
+    }
+    qsort(ids, count, sizeof(int), topology_compare);
+
+    char path[128], list[4096];
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", ids[i]);
+        int first = topo->cpus;
+        if (topology_read(path, list, sizeof(list))) {
+            topology_add_cpus(topo, list, &allowed);
+        }
+        // Memory-only nodes and nodes we may not run on get no workers.
+        if (topo->cpus > first) {
+            topo->node_ids[topo->nodes] = ids[i];
+            topo->node_first[topo->nodes] = first;
+            topo->node_cpus[topo->nodes] = topo->cpus - first;
+            topo->nodes++;
+        }
+    }
+    if (topo->nodes == 0) {
+        topo->cpus = 0;
+        if (!topology_read("/sys/devices/system/cpu/online", list, sizeof(list))) {
+            snprintf(list, sizeof(list), "0-%d", CPU_SETSIZE - 1);
+        }
+        topology_add_cpus(topo, list, &allowed);
+        topo->nodes = 1;
+        topo->node_cpus[0] = topo->cpus;
+    }
+    return topo->cpus > 0;
+}
+
+// Set the calling thread's memory policy: one preferred node, or interleaving over all if node < 0.
+static void topology_memory(Topology *topo, int node) {
+    unsigned long mask[TOPOLOGY_NODE_BITS / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    for (int i = 0; i < topo->nodes; i++) {
+        int id = topo->node_ids[i];
+        if ((node < 0 || i == node) && id < TOPOLOGY_NODE_BITS) {
+            mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+        }
+    }
+    // Best effort: without the syscall, pages still come from the node that first touches them.
+    syscall(SYS_set_mempolicy, node < 0 ? TOPOLOGY_MPOL_INTERLEAVE : TOPOLOGY_MPOL_PREFERRED, mask,
+            (unsigned long)TOPOLOGY_NODE_BITS);
+}
+
+// Node whose memory a worker on `node` uses.
+static int topology_memory_node(Topology *topo, int node) {
+    return topo->policy == PLACEMENT_REMOTE ? (node + 1) % topo->nodes : node;
+}
+
+// Pin the calling thread to the CPUs of one node, or to a single CPU if cpu >= 0.
+static void topology_pin(Topology *topo, int node, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu >= 0) {
+        CPU_SET(cpu, &set);
+    } else {
+        for (int i = 0; i < topo->node_cpus[node]; i++) {
+            CPU_SET(topo->cpu_ids[topo->node_first[node] + i], &set);
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Confine a shard process to one node: its queue, URL table and workers all live there.
+void topology_home(Topology *topo, int shard) {
+    if (topo->policy == PLACEMENT_NONE) {
+        return;
+    }
+    topo->home = shard % topo->nodes;
+    topology_pin(topo, topo->home, -1);
+    topology_memory(topo, topology_memory_node(topo, topo->home));
+}
+
+// Place the memory the main thread is about to allocate for the whole crawl: the queue, the
+// URL table and the caches every worker reads.
+void topology_place_shared(Topology *topo) {
+    if (topo->policy == PLACEMENT_NONE || topo->home >= 0) {
+        return;
+    }
+    topology_memory(topo, topo->policy == PLACEMENT_SPREAD ? -1 : topology_memory_node(topo, 0));
+}
+
+// Pin worker `index` to its CPU and make its allocations (fetch buffers, extractor state, malloc
+// arena) come from the chosen node. Call before the worker allocates anything.
+void topology_place_worker(Topology *topo, int index) {
+    int node, cpu;
+    switch (topo->policy) {
+    case PLACEMENT_NONE:
+        return;
+    case PLACEMENT_SPREAD:
+        node = topo->home >= 0 ? topo->home : index % topo->nodes;
+        cpu = topo->home >= 0 ? index : index / topo->nodes;
+        break;
+    default:
+        // Compact: the index-th usable CPU, filling nodes in order.
+        node = topo->home >= 0 ? topo->home : 0;
+        cpu = index;
+        if (topo->home < 0) {
+            cpu = index % topo->cpus;
+            while (cpu >= topo->node_first[node] + topo->node_cpus[node]) {
+                node++;
+            }
+            cpu -= topo->node_first[node];
+        }
+        break;
+    }
+    topology_pin(topo, node, topo->cpu_ids[topo->node_first[node] + cpu % topo->node_cpus[node]]);
+    topology_memory(topo, topology_memory_node(topo, node));
+}
+
+// Run one crawl with a placement policy in a child process; return its "Pages fetched" line.
+static bool topology_bench_run(char *argv[], const CrawlerDefaults *defaults, char *line, size_t size) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // No output file noise and no search prompt in the children.
+        int devnull = open("/dev/null", O_RDWR);
+        dup2(devnull, STDIN_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        int argc = 0;
+        while (argv[argc]) {
+            argc++;
+        }
+        exit(crawler_main(argc, argv, defaults));
+    }
+    close(fds[1]);
+    char output[BENCH_OUTPUT_SIZE];
+    size_t len = 0;
+    ssize_t got;
+    while ((got = read(fds[0], output + len, sizeof(output) - 1 - len)) > 0) {
+        len += got;
+        if (len == sizeof(output) - 1) {
+            len = 0; // The stats come last; drop anything earlier that doesn't fit
+        }
+    }
+    output[len] = '\0';
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+
+    const char *found = strstr(output, "Pages fetched:");
+    if (!found || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        return false;
+    }
+    snprintf(line, size, "%.*s", (int)strcspn(found, "\n"), found);
+    return true;
+}
+
+// Benchmark mode: repeat the crawl from the command line under every placement policy and report
+// pages/s for each. "remote" keeps every worker's memory one node away from its CPU, so its gap to
+// "compact" is the cost of cross-socket traffic.
+int topology_bench(int argc, char *argv[], const CrawlerDefaults *defaults) {
+    Topology topo;
+    if (!topology_discover(&topo, PLACEMENT_COMPACT)) {
+        fprintf(stderr, "Error: Unable to read the CPU topology\n");
+        return EXIT_FAILURE;
+    }
+    printf("Topology: %d usable CPUs on %d NUMA node%s\n", topo.cpus, topo.nodes, topo.nodes == 1 ? "" : "s");
+    for (int i = 0; i < topo.nodes; i++) {
+        printf("  node %d: %d CPUs\n", topo.node_ids[i], topo.node_cpus[i]);
+    }
+    if (topo.nodes == 1) {
+        printf("Single node: \"remote\" cannot leave the socket and matches \"compact\"\n");
+    }
+
+    // The same arguments minus the benchmark and placement options, then --pin <policy>.
+    char **args = (char **)calloc(argc + 3, sizeof(char *));
+    if (!args) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    int count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--numa-bench") == 0) {
+            continue;
+        }
+        if (strcmp(argv[i], "--pin") == 0 && i + 1 < argc) {
+            i++;
+            continue;
+        }
+        args[count++] = argv[i];
+    }
+    args[count] = "--pin";
+    args[count + 2] = NULL;
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(placement_names) / sizeof(placement_names[0]); i++) {
+        char line[256];
+        args[count + 1] = (char *)placement_names[i];
+        if (topology_bench_run(args, defaults, line, sizeof(line))) {
+            printf("%-8s %s\n", placement_names[i], line);
+        } else {
+            printf("%-8s crawl failed\n", placement_names[i]);
+            ok = false;
+        }
+        fflush(stdout);
+    }
+    free(args);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
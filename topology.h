@@ -0,0 +1,38 @@
+// CPU and NUMA topology from /sys, and placement of worker threads and their memory on it.
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "crawler_core.h"
+
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_MAX_NODES 64
+
+// Where worker threads run and where their memory comes from.
+typedef enum {
+    PLACEMENT_NONE,     // Threads float, memory is first-touch
+    PLACEMENT_COMPACT,  // Fill one node's CPUs before the next; memory on the worker's node
+    PLACEMENT_SPREAD,   // Round-robin workers over nodes; memory on the worker's node, shared data interleaved
+    PLACEMENT_REMOTE    // Like compact, but all memory on another node: the cross-socket worst case
+} PlacementPolicy;
+
+// Online CPUs this process may use, grouped by node.
+typedef struct Topology {
+    PlacementPolicy policy;
+    int cpus;
+    int cpu_ids[TOPOLOGY_MAX_CPUS];     // Ordered by node
+    int nodes;
+    int node_ids[TOPOLOGY_MAX_NODES];
+    int node_first[TOPOLOGY_MAX_NODES]; // Range of cpu_ids on each node
+    int node_cpus[TOPOLOGY_MAX_NODES];
+    int home;                           // Node index a shard process is confined to, -1 if none
+} Topology;
+
+bool placement_parse(const char *name, PlacementPolicy *policy);
+const char *placement_name(PlacementPolicy policy);
+bool topology_discover(Topology *topo, PlacementPolicy policy);
+void topology_home(Topology *topo, int shard);
+void topology_place_shared(Topology *topo);
+void topology_place_worker(Topology *topo, int index);
+int topology_bench(int argc, char *argv[], const CrawlerDefaults *defaults);
+
+#endif
@@ -0,0 +1,43 @@
+// URL scope rules compiled into one Aho-Corasick automaton, checked in a single pass per link.
+#ifndef URL_FILTER_H
+#define URL_FILTER_H
+
+#include "crawler_core.h"
+
+#define FILTER_LINE_LENGTH 1024
+
+// What a rule matches and what a match means.
+typedef enum {
+    FILTER_HOST,       // Allowlist: the host is this domain or a subdomain of it
+    FILTER_ALLOW,      // Allowlist: the URL contains this text
+    FILTER_DENY,       // The URL contains this text
+    FILTER_DENY_EXT,   // The URL's path ends with this text
+    FILTER_DENY_GLOB   // The whole URL matches this pattern; * is any run, ? any one byte
+} FilterKind;
+
+struct FilterRule;
+
+// Compiled rules. The automaton is a dense DFA over byte classes: one table lookup per URL byte.
+typedef struct UrlFilter {
+    struct FilterRule *rules;
+    size_t rule_count;
+    char *text;                    // Rule strings back to back
+    uint8_t classes[256];          // Byte -> column of the transition table
+    int class_count;
+    uint32_t *next;                // state * class_count + class -> state
+    uint32_t *match;               // First rule whose key ends at this state, UINT32_MAX if none
+    uint32_t *dict;                // Nearest state on the failure chain with a match, 0 if none
+    uint32_t states;
+    uint32_t *unkeyed;             // Glob rules without a literal to key on; checked on every URL
+    size_t unkeyed_count;
+    bool has_hosts, has_allows;
+    atomic_ulong rejected;
+} UrlFilter;
+
+UrlFilter *url_filter_load(const char *path);
+UrlFilter *url_filter_compile(char *const *lines, size_t count);
+bool url_filter_allows(UrlFilter *filter, const char *url, size_t len);
+void url_filter_free(UrlFilter *filter);
+int url_filter_bench(void);
+
+#endif
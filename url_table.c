@@ -0,0 +1,297 @@
+#include "crawler_core.h"
+#include "url_table.h"
+#include "memory.h"
+#include <ctype.h>
+
+#define URL_ARENA_FIRST (4 * 1024)  // A shard's first arena block; later ones double
+#define URL_ARENA_BLOCK (256 * 1024) // Largest arena block, unless one URL needs more
+#define URL_SHARD_SLOTS 1024        // Initial index size per shard (power of two)
+#define URL_ORIGIN_LENGTH 256
+#define URL_NO_ORIGIN UINT32_MAX
+
+// An interned string. URLs store only what follows their origin; the origin is an entry of its own.
+typedef struct UrlEntry {
+    uint64_t hash;
+    uint32_t origin;   // ID of the scheme://host[:port] prefix, URL_NO_ORIGIN for origins and relative URLs
+    uint32_t len;
+    char text[];       // NUL-terminated
+} UrlEntry;
+
+// Bump-allocated storage for the entries of one shard; freed only with the table.
+typedef struct UrlArenaBlock {
+    struct UrlArenaBlock *next;
+    size_t used, size;
+    char data[];
+} UrlArenaBlock;
+
+// FNV-1a over a byte range, continuing from `hash`.
+static uint64_t fnv1a(const char *data, size_t len, uint64_t hash) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Find the entry for an ID. Safe without locks: an ID is only handed out after its entry is written.
+static UrlEntry *url_entry(UrlTable *table, uint32_t id) {
+    UrlEntry **chunk = atomic_load_explicit(&table->chunks[id >> URL_CHUNK_BITS], memory_order_acquire);
+    return chunk[id & ((1u << URL_CHUNK_BITS) - 1)];
+}
+
+// Record the entry of a new ID in the directory, adding the chunk if this is its first ID.
+static void url_publish(UrlTable *table, uint32_t id, UrlEntry *entry) {
+    _Atomic(UrlEntry **) *slot = &table->chunks[id >> URL_CHUNK_BITS];
+    UrlEntry **chunk = atomic_load_explicit(slot, memory_order_acquire);
+    if (!chunk) {
+        UrlEntry **fresh = (UrlEntry **)calloc(1u << URL_CHUNK_BITS, sizeof(UrlEntry *));
+        if (!fresh) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (atomic_compare_exchange_strong_explicit(slot, &chunk, fresh, memory_order_acq_rel, memory_order_acquire)) {
+            chunk = fresh;
+            mem_account(MEM_FRONTIER, (long)((1u << URL_CHUNK_BITS) * sizeof(UrlEntry *)));
+        } else {
+            free(fresh);
+        }
+    }
+    chunk[id & ((1u << URL_CHUNK_BITS) - 1)] = entry;
+}
+
+// Carve an entry out of a shard's arena. Called with the shard lock held.
+static UrlEntry *url_arena_alloc(UrlTable *table, UrlShard *shard, size_t len) {
+    size_t size = (sizeof(UrlEntry) + len + 1 + 7) & ~(size_t)7;
+    UrlArenaBlock *block = shard->arena;
+    if (!block || block->used + size > block->size) {
+        // Small arenas for shards that hold little, so a tight --mem-limit isn't spent up front.
+        size_t capacity = block ? block->size * 2 : URL_ARENA_FIRST;
+        if (capacity > URL_ARENA_BLOCK) {
+            capacity = URL_ARENA_BLOCK;
+        }
+        if (capacity < size) {
+            capacity = size;
+        }
+        block = (UrlArenaBlock *)malloc(sizeof(UrlArenaBlock) + capacity);
+        if (!block) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        mem_account(MEM_FRONTIER, (long)(sizeof(UrlArenaBlock) + capacity));
+        block->next = shard->arena;
+        block->used = 0;
+        block->size = capacity;
+        shard->arena = block;
+    }
+    UrlEntry *entry = (UrlEntry *)(block->data + block->used);
+    block->used += size;
+    atomic_fetch_add(&table->bytes, size);
+    return entry;
+}
+
+// Double a shard's index. Called with the shard lock held.
+static void url_shard_grow(UrlTable *table, UrlShard *shard) {
+    size_t capacity = shard->capacity * 2;
+    uint64_t *slots = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (!slots) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < shard->capacity; i++) {
+        if (shard->slots[i] == 0) {
+            continue;
+        }
+        uint64_t hash = url_entry(table, (uint32_t)shard->slots[i] - 1)->hash;
+        size_t j = (hash >> 20) & (capacity - 1);
+        while (slots[j] != 0) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = shard->slots[i];
+    }
+    free(shard->slots);
+    mem_account(MEM_FRONTIER, (long)(shard->capacity * sizeof(uint64_t)));
+    shard->slots = slots;
+    shard->capacity = capacity;
+}
+
+// Return the ID of (origin, text), adding it if it is new.
+static uint32_t url_intern_entry(UrlTable *table, uint32_t origin, const char *text, size_t len, uint64_t hash,
+                                 bool *fresh) {
+    UrlShard *shard = &table->shards[hash >> 58];
+    uint32_t tag = (uint32_t)hash;
+    pthread_mutex_lock(&shard->lock);
+    if ((shard->used + 1) * 10 > shard->capacity * 7) {
+        url_shard_grow(table, shard);
+    }
+
+    size_t mask = shard->capacity - 1;
+    size_t i = (hash >> 20) & mask;
+    for (; shard->slots[i] != 0; i = (i + 1) & mask) {
+        if ((uint32_t)(shard->slots[i] >> 32) != tag) {
+            continue;
+        }
+        uint32_t id = (uint32_t)shard->slots[i] - 1;
+        UrlEntry *entry = url_entry(table, id);
+        if (entry->origin == origin && entry->len == len && memcmp(entry->text, text, len) == 0) {
+            pthread_mutex_unlock(&shard->lock);
+            if (fresh) {
+                *fresh = false;
+            }
+            return id;
+        }
+    }
+
+    uint32_t id = atomic_fetch_add(&table->next_id, 1);
+    if (id == URL_ID_NONE) {
+        fprintf(stderr, "Error: URL table is full\n");
+        exit(EXIT_FAILURE);
+    }
+    UrlEntry *entry = url_arena_alloc(table, shard, len);
+    entry->hash = hash;
+    entry->origin = origin;
+    entry->len = (uint32_t)len;
+    memcpy(entry->text, text, len);
+    entry->text[len] = '\0';
+    url_publish(table, id, entry);
+    shard->slots[i] = ((uint64_t)tag << 32) | ((uint64_t)id + 1);
+    shard->used++;
+    pthread_mutex_unlock(&shard->lock);
+    if (fresh) {
+        *fresh = true;
+    }
+    return id;
+}
+
+// Create an empty table.
+UrlTable *url_table_create(void) {
+    UrlTable *table = (UrlTable *)calloc(1, sizeof(UrlTable));
+    if (!table) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < URL_SHARDS; i++) {
+        pthread_mutex_init(&table->shards[i].lock, NULL);
+        table->shards[i].capacity = URL_SHARD_SLOTS;
+        table->shards[i].slots = (uint64_t *)calloc(URL_SHARD_SLOTS, sizeof(uint64_t));
+        if (!table->shards[i].slots) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return table;
+}
+
+// Size the index for `urls` more URLs, so a bulk load doesn't rehash each shard over and over.
+void url_table_reserve(UrlTable *table, size_t urls) {
+    for (int i = 0; i < URL_SHARDS; i++) {
+        UrlShard *shard = &table->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        size_t need = shard->used + urls / URL_SHARDS + 1;
+        while (need * 10 > shard->capacity * 7) {
+            url_shard_grow(table, shard);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+// Free the table and every string in it.
+void url_table_free(UrlTable *table) {
+    for (int i = 0; i < URL_SHARDS; i++) {
+        UrlArenaBlock *block = table->shards[i].arena;
+        while (block) {
+            UrlArenaBlock *next = block->next;
+            free(block);
+            block = next;
+        }
+        free(table->shards[i].slots);
+        pthread_mutex_destroy(&table->shards[i].lock);
+    }
+    for (uint32_t i = 0; i < URL_CHUNKS; i++) {
+        free(atomic_load(&table->chunks[i]));
+        free(atomic_load(&table->claimed[i]));
+    }
+    free(table);
+}
+
+// Intern `len` bytes of URL. The origin is lower-cased and shared by all URLs of the host.
+// Sets *fresh when the URL was not in the table yet. URLs are interned for graph edges too, so
+// whether one was queued is kept apart; see url_claim().
+uint32_t url_intern(UrlTable *table, const char *url, size_t len, bool *fresh) {
+    const char *scheme_end = len > 3 ? memmem(url, len, "://", 3) : NULL;
+    if (!scheme_end) {
+        bool added;
+        uint32_t id = url_intern_entry(table, URL_NO_ORIGIN, url, len, fnv1a(url, len, 1469598103934665603ULL), &added);
+        if (added) {
+            atomic_fetch_add(&table->urls, 1);
+        }
+        if (fresh) {
+            *fresh = added;
+        }
+        return id;
+    }
+
+    size_t origin_len = scheme_end + 3 - url;
+    while (origin_len < len && url[origin_len] != '/' && url[origin_len] != '?' && url[origin_len] != '#') {
+        origin_len++;
+    }
+    char origin[URL_ORIGIN_LENGTH] = "";
+    if (origin_len >= sizeof(origin)) {
+        origin_len = sizeof(origin) - 1;
+    }
+    for (size_t i = 0; i < origin_len; i++) {
+        origin[i] = (char)tolower((unsigned char)url[i]);
+    }
+
+    uint64_t origin_hash = fnv1a(origin, origin_len, 1469598103934665603ULL);
+    uint32_t origin_id = url_intern_entry(table, URL_NO_ORIGIN, origin, origin_len, origin_hash, NULL);
+    uint64_t hash = fnv1a(url + origin_len, len - origin_len, origin_hash ^ 0xff);
+    bool added;
+    uint32_t id = url_intern_entry(table, origin_id, url + origin_len, len - origin_len, hash, &added);
+    if (added) {
+        atomic_fetch_add(&table->urls, 1);
+    }
+    if (fresh) {
+        *fresh = added;
+    }
+    return id;
+}
+
+// Mark an interned URL as queued. Returns true only for the first caller, which makes the claimed
+// bits the crawl's visited set.
+bool url_claim(UrlTable *table, uint32_t id) {
+    _Atomic(atomic_ulong *) *slot = &table->claimed[id >> URL_CHUNK_BITS];
+    atomic_ulong *chunk = atomic_load_explicit(slot, memory_order_acquire);
+    if (!chunk) {
+        size_t size = (1u << URL_CHUNK_BITS) / 64 * sizeof(atomic_ulong);
+        atomic_ulong *fresh = (atomic_ulong *)calloc(1, size);
+        if (!fresh) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        if (atomic_compare_exchange_strong_explicit(slot, &chunk, fresh, memory_order_acq_rel, memory_order_acquire)) {
+            chunk = fresh;
+            mem_account(MEM_FRONTIER, (long)size);
+        } else {
+            free(fresh);
+        }
+    }
+    uint32_t bit = id & ((1u << URL_CHUNK_BITS) - 1);
+    unsigned long mask = 1UL << (bit % 64);
+    return !(atomic_fetch_or_explicit(&chunk[bit / 64], mask, memory_order_relaxed) & mask);
+}
+
+// Copy the URL of an ID into `buf`. Returns its length, truncated to fit.
+size_t url_table_get(UrlTable *table, uint32_t id, char *buf, size_t size) {
+    UrlEntry *entry = url_entry(table, id);
+    size_t len = 0;
+    if (entry->origin != URL_NO_ORIGIN) {
+        UrlEntry *origin = url_entry(table, entry->origin);
+        len = origin->len < size - 1 ? origin->len : size - 1;
+        memcpy(buf, origin->text, len);
+    }
+    size_t n = entry->len < size - 1 - len ? entry->len : size - 1 - len;
+    memcpy(buf + len, entry->text, n);
+    len += n;
+    buf[len] = '\0';
+    return len;
+}
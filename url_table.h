@@ -0,0 +1,41 @@
+// Concurrent URL intern table: every distinct URL is stored once and named by a 32-bit ID.
+#ifndef URL_TABLE_H
+#define URL_TABLE_H
+
+#include "crawler_core.h"
+
+#define URL_ID_NONE UINT32_MAX
+#define URL_SHARDS 64               // Independently locked slices of the hash index
+#define URL_CHUNK_BITS 16           // IDs per directory chunk: 65536
+#define URL_CHUNKS (1u << (32 - URL_CHUNK_BITS))
+
+struct UrlEntry;
+struct UrlArenaBlock;
+
+// One slice of the hash index with the arena its entries live in.
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t *slots;                // (hash tag << 32 | id), 0 when empty
+    size_t capacity;
+    size_t used;
+    struct UrlArenaBlock *arena;
+} UrlShard;
+
+// The table. ID lookups are lock-free; interning locks one shard.
+typedef struct UrlTable {
+    UrlShard shards[URL_SHARDS];
+    _Atomic(struct UrlEntry **) chunks[URL_CHUNKS]; // ID -> entry directory, filled on demand
+    _Atomic(atomic_ulong *) claimed[URL_CHUNKS]; // ID -> queued bit, filled on demand
+    atomic_uint next_id;
+    atomic_ulong urls;              // Interned URLs, origins not counted
+    atomic_ulong bytes;             // Arena bytes in use
+} UrlTable;
+
+UrlTable *url_table_create(void);
+void url_table_free(UrlTable *table);
+void url_table_reserve(UrlTable *table, size_t urls);
+uint32_t url_intern(UrlTable *table, const char *url, size_t len, bool *fresh);
+bool url_claim(UrlTable *table, uint32_t id);
+size_t url_table_get(UrlTable *table, uint32_t id, char *buf, size_t size);
+
+#endif